@@ -1,15 +1,17 @@
 #define _CRTDBG_MAP_ALLOC
-#define _WINSOCKAPI_
 #include <stdlib.h>
-#include <crtdbg.h>
+#include "Platform.h"
 #include <stdbool.h>
 #include <stdio.h>
 #include <string.h>
-#include <windows.h>
 
 #include "DCS_Driver.h"
 #include "COM_Task.h"
 
+#if !defined(_WIN32)
+#include <sys/resource.h>
+#endif
+
 #define DEFAULT_PORT "50000"
 #define HOST_NAME "localhost"
 
@@ -67,7 +69,7 @@ void Get_Simulated_Correlation_CB(Simulated_Correlation* Simulated_Corr) {
 	printf("]\n");
 }
 
-void Get_BFI_Data(BFI_Data* pBFI_Data, int Cha_Num) {
+void Get_BFI_Data(const BFI_Data* pBFI_Data, int Cha_Num) {
 	printf("BFI Data:\n");
 	for (int x = 0; x < Cha_Num; x++) {
 		printf("Settings %d\n", x);
@@ -96,7 +98,7 @@ void Get_BFI_Corr_Ready_CB(bool bReady) {
 	printf("%s\n", bReady ? "true" : "false");
 }
 
-void Get_Corr_Intensity_Data_CB(Corr_Intensity_Data* pCorr_Intensity_Data, int Cha_Num, float* pDelayBuf, int Delay_Num) {
+void Get_Corr_Intensity_Data_CB(const Corr_Intensity_Data* pCorr_Intensity_Data, int Cha_Num, const float* pDelayBuf, int Delay_Num) {
 	printf("Corr Intensity Data:\n");
 	for (int x = 0; x < Cha_Num; x++) {
 		printf("Data %d:\n", pCorr_Intensity_Data[x].Cha_ID);
@@ -114,7 +116,7 @@ void Get_Corr_Intensity_Data_CB(Corr_Intensity_Data* pCorr_Intensity_Data, int C
 	printf("\b\b]\n");
 }
 
-void Get_Intensity_Data_CB(Intensity_Data* pIntensity_Data, int Cha_Num) {
+void Get_Intensity_Data_CB(const Intensity_Data* pIntensity_Data, int Cha_Num) {
 	printf("Intensity Data:\n");
 	for (int x = 0; x < Cha_Num; x++) {
 		printf("Channel %d:\n", pIntensity_Data[x].Cha_ID);
@@ -126,6 +128,1059 @@ void Get_Error_Code_CB(unsigned __int32 code) {
 	printf("Error code: %u\n", code);
 }
 
+#if FUNC_TO_TEST == 10
+//Seconds of streaming measured for each transport.
+#define BENCHMARK_SECONDS 5
+
+//What the socket transport waits on.
+#if defined(_WIN32)
+#define SOCKET_TRANSPORT_NAME "socket (WSA events)"
+#else
+#define SOCKET_TRANSPORT_NAME "socket (epoll)"
+#endif
+
+//CPU time used by the process so far, in seconds.
+static double cpu_seconds(void) {
+#if defined(_WIN32)
+	FILETIME creation, exit, kernel, user;
+	GetProcessTimes(GetCurrentProcess(), &creation, &exit, &kernel, &user);
+	const unsigned __int64 kernel_time = ((unsigned __int64)kernel.dwHighDateTime << 32) | kernel.dwLowDateTime;
+	const unsigned __int64 user_time = ((unsigned __int64)user.dwHighDateTime << 32) | user.dwLowDateTime;
+	return (kernel_time + user_time) / 1e7;
+#else
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+#endif
+}
+
+//Streams measurements from the DCS over [transport] and prints its throughput, system calls per frame and CPU time per MB.
+static int benchmark_transport(DCS_Address address, DCS_Transport transport) {
+	address.transport = transport;
+	int result = Initialize_COM_Task(address, Null_Receive_Callbacks(), false);
+	if (result != NO_DCS_ERROR) {
+		return result;
+	}
+
+	Transport_Stats before, after;
+	Send_Stats sent_before, sent_after;
+	Get_Transport_Stats(&before);
+	Get_Send_Stats(&sent_before);
+	const double cpu_before = cpu_seconds();
+
+	result = Enable_DCS(true, true);
+	int ids[] = { 1, 2, };
+	result = Start_DCS_Measurement(1, ids, sizeof(ids) / sizeof(ids[0]));
+	Sleep(BENCHMARK_SECONDS * 1000);
+	result = Stop_DCS_Measurement();
+	Sleep(100);
+
+	Get_Transport_Stats(&after);
+	Get_Send_Stats(&sent_after);
+	const double cpu = cpu_seconds() - cpu_before;
+	Destroy_COM_Task();
+
+	const unsigned __int64 syscalls = after.syscalls - before.syscalls;
+	const unsigned __int64 frames = after.frames_received - before.frames_received + sent_after.frames_sent - sent_before.frames_sent;
+	const double megabytes = (after.bytes_received - before.bytes_received + after.bytes_sent - before.bytes_sent) / (1024.0 * 1024.0);
+
+	printf("%s%s: %llu frames, %.2f MB, %.0f frames/s, %.2f MB/s, %.3f syscalls/frame, %.3f CPU ms/MB\n",
+		transport == DCS_TRANSPORT_IO_URING ? "io_uring" : SOCKET_TRANSPORT_NAME,
+		after.transport == transport ? "" : " (not available, used socket)",
+		frames, megabytes, (double)frames / BENCHMARK_SECONDS, megabytes / BENCHMARK_SECONDS,
+		frames > 0 ? (double)syscalls / frames : 0.0, megabytes > 0 ? cpu * 1000 / megabytes : 0.0);
+
+	return result;
+}
+#endif // 10
+
+#if FUNC_TO_TEST == 11
+//Devices streamed from at once, each from its own server on DEFAULT_PORT + its index.
+#define BENCHMARK_DEVICES 4
+//Seconds of streaming measured.
+#define BENCHMARK_SECONDS 5
+
+//Frames received by each device, counted on its event loop.
+static volatile unsigned __int64 device_frames[BENCHMARK_DEVICES];
+
+static void count_Intensity_Data(void* pContext, const Intensity_Data* pIntensity_Data, int Cha_Num) {
+	device_frames[(size_t)pContext]++;
+}
+
+static void count_Corr_Intensity_View(void* pContext, const Corr_Intensity_View* pView) {
+	device_frames[(size_t)pContext]++;
+}
+
+static void count_BFI_Data(void* pContext, const BFI_Data* pBFI_Data, int Cha_Num) {
+	device_frames[(size_t)pContext]++;
+}
+
+//Streams measurements from BENCHMARK_DEVICES servers through [loops] event loops and prints each device's throughput.
+static int benchmark_devices(DCS_Address address, unsigned int loops) {
+	DCS_Handle handles[BENCHMARK_DEVICES] = { 0 };
+	char ports[BENCHMARK_DEVICES][8];
+	DCS_Callbacks callbacks = Null_DCS_Callbacks();
+	callbacks.Get_Intensity_Data_CB = count_Intensity_Data;
+	callbacks.Get_Corr_Intensity_View_CB = count_Corr_Intensity_View;
+	callbacks.Get_BFI_Data = count_BFI_Data;
+
+	int result = DCS_Set_Event_Loops(loops);
+	for (size_t x = 0; x < BENCHMARK_DEVICES && result == NO_DCS_ERROR; x++) {
+		snprintf(ports[x], sizeof(ports[x]), "%d", atoi(DEFAULT_PORT) + (int)x);
+		address.port = ports[x];
+		device_frames[x] = 0;
+		result = DCS_Open(address, callbacks, (void*)x, false, &handles[x]);
+	}
+
+	Transport_Stats before[BENCHMARK_DEVICES] = { 0 };
+	int ids[] = { 1, 2, };
+	for (size_t x = 0; x < BENCHMARK_DEVICES && result == NO_DCS_ERROR; x++) {
+		DCS_Get_Transport_Stats(handles[x], &before[x]);
+		DCS_Enable(handles[x], true, true);
+		result = DCS_Start_Measurement(handles[x], 1, ids, sizeof(ids) / sizeof(ids[0]));
+	}
+
+	if (result == NO_DCS_ERROR) {
+		Sleep(BENCHMARK_SECONDS * 1000);
+		for (size_t x = 0; x < BENCHMARK_DEVICES; x++) {
+			DCS_Stop_Measurement(handles[x]);
+		}
+		Sleep(100);
+
+		for (size_t x = 0; x < BENCHMARK_DEVICES; x++) {
+			Transport_Stats after;
+			DCS_Get_Transport_Stats(handles[x], &after);
+			const double megabytes = (after.bytes_received - before[x].bytes_received) / (1024.0 * 1024.0);
+			printf("%u loop(s), device %zu: %.0f frames/s, %.2f MB/s\n", loops, x,
+				(double)device_frames[x] / BENCHMARK_SECONDS, megabytes / BENCHMARK_SECONDS);
+		}
+	}
+
+	for (size_t x = 0; x < BENCHMARK_DEVICES; x++) {
+		if (handles[x] != NULL) {
+			DCS_Close(handles[x]);
+		}
+	}
+
+	return result;
+}
+#endif // 11
+
+#if FUNC_TO_TEST == 12
+//Commands sent at once before waiting for any of them.
+#define ASYNC_REQUESTS 8
+
+//Sends a batch of Get and Set commands without waiting in between, then waits for each one's answer.
+static int demo_async(DCS_Handle hDevice) {
+	DCS_Request_Handle requests[ASYNC_REQUESTS] = { 0 };
+	DCS_Request_Options options = { .timeout_ms = 2000 };
+	Correlator_Setting correlator_settings = {
+		.Corr_Time = 5.5,
+		.Data_N = 4,
+		.Scale = 10,
+	};
+
+	int result = NO_DCS_ERROR;
+	for (int x = 0; x < ASYNC_REQUESTS && result == NO_DCS_ERROR; x++) {
+		switch (x % 4) {
+		case 0:
+			result = DCS_Get_DCS_Status_Async(hDevice, options, &requests[x]);
+			break;
+		case 1:
+			result = DCS_Set_Correlator_Setting_Async(hDevice, &correlator_settings, options, &requests[x]);
+			break;
+		case 2:
+			result = DCS_Get_Correlator_Setting_Async(hDevice, options, &requests[x]);
+			break;
+		default:
+			result = DCS_Get_Analyzer_Setting_Async(hDevice, options, &requests[x]);
+			break;
+		}
+	}
+
+	for (int x = 0; x < ASYNC_REQUESTS; x++) {
+		if (requests[x] == NULL) {
+			continue;
+		}
+
+		DCS_Response response;
+		const int status = DCS_Request_Wait(requests[x], INFINITE, &response);
+		switch (x % 4) {
+		case 0:
+			printf("Request %d, status %d: %d channels\n", x, status, status == NO_DCS_ERROR ? response.data.dcs_status.DCS_Cha_Num : 0);
+			break;
+		case 2:
+			printf("Request %d, status %d: scale %d\n", x, status, status == NO_DCS_ERROR ? response.data.correlator_setting.Scale : 0);
+			break;
+		case 3:
+			printf("Request %d, status %d: %d analyzer settings\n", x, status, status == NO_DCS_ERROR ? response.data.analyzer_setting.Cha_Num : 0);
+			break;
+		default:
+			printf("Request %d, status %d\n", x, status);
+			break;
+		}
+		DCS_Request_Free(requests[x]);
+	}
+
+	return result;
+}
+#endif // 12
+
+#if FUNC_TO_TEST == 13
+//Items kept of each type while the backlog is built, so each drain has plenty to take.
+#define BENCHMARK_ITEMS 4096
+//Milliseconds of streaming that build the backlog.
+#define BENCHMARK_BACKLOG_MS 3000
+//Channels measured.
+#define BENCHMARK_CHANNELS 2
+
+//Ways of taking the stored items.
+typedef enum {
+	DRAIN_GET, //A getter call per item, freeing the copy it returns
+	DRAIN_ACQUIRE, //A borrowing getter call per item, handing it back straight away
+	DRAIN_BATCH, //Drain_BFI_Data calls taking as many items as fit in a buffer. Correlation intensity items aren't taken,
+	             //so this comes last.
+	Drain_Method_Count,
+} Drain_Method;
+
+static const char* drain_names[Drain_Method_Count] = { "Get/free", "Acquire/Release", "Drain" };
+
+//Buffers for the batches taken with DRAIN_BATCH.
+static BFI_Data drained_records[BENCHMARK_ITEMS * BENCHMARK_CHANNELS];
+static int drained_counts[BENCHMARK_ITEMS * BENCHMARK_CHANNELS];
+
+//Takes every stored BFI item with [method] and returns the number taken.
+static unsigned __int64 drain_BFI(DCS_Handle hDevice, Drain_Method method) {
+	unsigned __int64 items = 0;
+	int Cha_Num = 0;
+
+	if (method == DRAIN_BATCH) {
+		int frames = 0;
+		while (DCS_Drain_BFI_Data(hDevice, drained_records, sizeof(drained_records) / sizeof(drained_records[0]), &frames, drained_counts) == NO_DCS_ERROR) {
+			items += frames;
+		}
+	}
+	else if (method == DRAIN_ACQUIRE) {
+		const BFI_Data* pBFI_Data;
+		while (DCS_Acquire_BFI_Data(hDevice, &pBFI_Data, &Cha_Num) == NO_DCS_ERROR) {
+			DCS_Release_BFI_Data(hDevice, pBFI_Data);
+			items++;
+		}
+	}
+	else {
+		BFI_Data* pBFI_Data;
+		while (DCS_Get_BFI_Data_Data(hDevice, &pBFI_Data, &Cha_Num) == NO_DCS_ERROR) {
+			free(pBFI_Data);
+			items++;
+		}
+	}
+
+	return items;
+}
+
+//Takes every stored correlation intensity item with [method] and returns the number taken.
+static unsigned __int64 drain_Corr_Intensity(DCS_Handle hDevice, Drain_Method method) {
+	unsigned __int64 items = 0;
+	int Cha_Num = 0;
+	int Delay_Num = 0;
+
+	if (method == DRAIN_ACQUIRE) {
+		const Corr_Intensity_Data* pCorr_Intensity_Data;
+		const float* pDelayBuf;
+		while (DCS_Acquire_Corr_Intensity_Data(hDevice, &pCorr_Intensity_Data, &Cha_Num, &pDelayBuf, &Delay_Num) == NO_DCS_ERROR) {
+			DCS_Release_Corr_Intensity_Data(hDevice, pCorr_Intensity_Data);
+			items++;
+		}
+	}
+	else if (method == DRAIN_GET) {
+		Corr_Intensity_Data* pCorr_Intensity_Data;
+		float* pDelayBuf;
+		while (DCS_Get_Corr_Intensity_Data_Data(hDevice, &pCorr_Intensity_Data, &Cha_Num, &pDelayBuf, &Delay_Num) == NO_DCS_ERROR) {
+			for (int x = 0; x < Cha_Num; x++) {
+				free(pCorr_Intensity_Data[x].pCorrBuf);
+			}
+			free(pCorr_Intensity_Data);
+			free(pDelayBuf);
+			items++;
+		}
+	}
+
+	return items;
+}
+
+//Prints how fast [items] were taken since the DCS_Clock_Now_Ns time [start].
+static void print_drain(const char* type, Drain_Method method, unsigned __int64 items, unsigned __int64 start) {
+	const double seconds = (DCS_Clock_Now_Ns() - start) / 1e9;
+	printf("%s, %s: %llu items in %.3f ms, %.0f items/s\n", type, drain_names[method],
+		items, seconds * 1000, seconds > 0 ? items / seconds : 0.0);
+}
+
+//Builds a backlog of stored items and drains it with each method in turn, printing how fast each took the items.
+static int benchmark_drain(DCS_Address address) {
+	DCS_Handle hDevice;
+	int result = DCS_Open(address, Null_DCS_Callbacks(), NULL, true, &hDevice);
+	if (result != NO_DCS_ERROR) {
+		return result;
+	}
+
+	Store_Config config = { .max_items = BENCHMARK_ITEMS, .overflow = OVERFLOW_DROP_OLDEST, .streaming = true };
+	DCS_Set_Store_Config(hDevice, config);
+	DCS_Enable(hDevice, true, true);
+
+	int ids[BENCHMARK_CHANNELS] = { 1, 2, };
+	for (Drain_Method method = 0; method < Drain_Method_Count && result == NO_DCS_ERROR; method++) {
+		result = DCS_Start_Measurement(hDevice, 1, ids, BENCHMARK_CHANNELS);
+		if (result != NO_DCS_ERROR) {
+			break;
+		}
+		Sleep(BENCHMARK_BACKLOG_MS);
+		DCS_Stop_Measurement(hDevice);
+		Sleep(100);
+
+		unsigned __int64 start = DCS_Clock_Now_Ns();
+		print_drain("BFI", method, drain_BFI(hDevice, method), start);
+
+		if (method != DRAIN_BATCH) {
+			start = DCS_Clock_Now_Ns();
+			print_drain("Corr intensity", method, drain_Corr_Intensity(hDevice, method), start);
+		}
+	}
+
+	DCS_Close(hDevice);
+	return result;
+}
+#endif // 13
+
+#if FUNC_TO_TEST == 14
+//The driver only builds the array swaps when the host's byte order differs from the DCS's, so the client builds
+//every path it can for itself.
+#define SWAP_ALL_PATHS
+#include "Endianess.c"
+
+//Most 32 bit values checked, covering every tail each path can leave.
+#define SWAP_CHECK_VALUES 67
+//Values in each array timed, from a small BFI frame up to a large correlation one.
+static const size_t swap_sizes[] = { 16, 256, 4096, 65536, };
+//Bytes converted for each array size timed.
+#define SWAP_BENCHMARK_BYTES (256 * 1024 * 1024)
+
+//A way of swapping an array of 32 bit values.
+typedef struct {
+	const char* name;
+	void (*swap)(void* pDest, const void* pSrc, size_t count);
+} Swap_Path;
+
+static const Swap_Path swap_paths[] = {
+	{ "scalar", swap32_scalar },
+#if defined(SWAP_USE_SSE2)
+	{ "SSE2", swap32_sse2 },
+#endif
+#if defined(SWAP_USE_SSSE3)
+	{ "SSSE3", swap32_ssse3 },
+#endif
+#if defined(SWAP_USE_AVX2)
+	{ "AVX2", swap32_avx2 },
+#endif
+#if defined(SWAP_USE_NEON)
+	{ "NEON", swap32_neon },
+#endif
+};
+
+//Source and destination of the swaps, with room to start them off alignment.
+static unsigned char swap_src[65536 * 4 + 32];
+static unsigned char swap_dest[65536 * 4 + 32];
+
+//Checks [pPath] against Swap32 for every count up to SWAP_CHECK_VALUES, at every byte offset of the source and
+//destination and in place. Returns the number of arrays it got wrong.
+static int check_Swap_Path(const Swap_Path* pPath) {
+	int failures = 0;
+
+	for (size_t count = 0; count <= SWAP_CHECK_VALUES; count++) {
+		for (size_t src_offset = 0; src_offset < 4; src_offset++) {
+			for (size_t dest_offset = 0; dest_offset <= 4; dest_offset++) {
+				//The last destination offset stands for swapping in place.
+				unsigned char* pDest = dest_offset < 4 ? &swap_dest[dest_offset + 1] : &swap_src[src_offset];
+				for (size_t x = 0; x < count * 4; x++) {
+					swap_src[src_offset + x] = (unsigned char)(x * 7 + count);
+				}
+				//A byte past the end shows whether the path wrote further than it should.
+				pDest[count * 4] = 0xA5;
+
+				pPath->swap(pDest, &swap_src[src_offset], count);
+
+				bool correct = pDest[count * 4] == 0xA5;
+				for (size_t x = 0; x < count && correct; x++) {
+					unsigned __int32 value;
+					unsigned __int32 swapped;
+					for (size_t y = 0; y < 4; y++) {
+						((unsigned char*)&value)[y] = (unsigned char)(x * 4 * 7 + y * 7 + count);
+					}
+					memcpy(&swapped, &pDest[x * 4], sizeof(swapped));
+					correct = swapped == Swap32(value);
+				}
+
+				if (!correct) {
+					printf("%s: wrong for %zu values, source offset %zu, %s\n", pPath->name, count, src_offset,
+						dest_offset < 4 ? "destination offset" : "in place");
+					failures++;
+				}
+			}
+		}
+	}
+
+	return failures;
+}
+
+//Checks every swap path built against Swap32, then prints how fast each swaps arrays of typical frame sizes.
+static int benchmark_swap(void) {
+	int result = NO_DCS_ERROR;
+	for (size_t x = 0; x < sizeof(swap_paths) / sizeof(swap_paths[0]); x++) {
+		const int failures = check_Swap_Path(&swap_paths[x]);
+		printf("%s: %s\n", swap_paths[x].name, failures == 0 ? "matches Swap32" : "FAILED");
+		if (failures != 0) {
+			result = FRAME_INVALID_DATA;
+		}
+	}
+
+	for (size_t size = 0; size < sizeof(swap_sizes) / sizeof(swap_sizes[0]); size++) {
+		const size_t count = swap_sizes[size];
+		const size_t repeats = SWAP_BENCHMARK_BYTES / (count * 4);
+
+		for (size_t x = 0; x < sizeof(swap_paths) / sizeof(swap_paths[0]); x++) {
+			//Offset by a byte, since frames are decoded wherever they land in the receive buffer.
+			const unsigned __int64 start = DCS_Clock_Now_Ns();
+			for (size_t y = 0; y < repeats; y++) {
+				swap_paths[x].swap(&swap_dest[1], &swap_src[1], count);
+			}
+			const double seconds = (DCS_Clock_Now_Ns() - start) / 1e9;
+
+			printf("%6zu values, %-6s: %.2f GB/s\n", count, swap_paths[x].name,
+				seconds > 0 ? SWAP_BENCHMARK_BYTES / seconds / 1e9 : 0.0);
+		}
+	}
+
+	return result;
+}
+#endif // 14
+
+#if FUNC_TO_TEST == 15
+//The checksums aren't part of the driver's API, so the client builds them for itself.
+#include "Checksum.c"
+
+//Frame sizes timed: a BFI frame of a few channels, a correlation frame of a few channels, a correlation frame of 16
+//channels and the largest frames a long correlator setting gives.
+static const size_t checksum_sizes[] = { 64, 512, 8192, 65536, };
+//Bytes checked for each frame size timed.
+#define CHECKSUM_BENCHMARK_BYTES (256 * 1024 * 1024)
+
+//Frame checked, and where it's copied to when the check is made while copying.
+static unsigned char checksum_src[65536];
+static unsigned char checksum_dest[65536];
+//Where the results go, so the checks aren't optimized away.
+static volatile unsigned __int32 checksum_sink;
+
+//Ways a received frame can be checked.
+typedef enum {
+	CHECK_XOR, //The DCS's XOR checksum
+	CHECK_CRC32C_SW, //CRC32C with the slicing-by-8 table
+	CHECK_CRC32C_HW, //CRC32C with the CPU's CRC instructions
+	Check_Method_Count,
+} Check_Method;
+
+static const char* check_names[Check_Method_Count] = { "XOR", "CRC32C table", "CRC32C hardware" };
+
+//Checks [size] bytes with [method], copying them as well if [copy], and returns the result.
+static unsigned __int32 run_Check(Check_Method method, size_t size, bool copy) {
+	if (method == CHECK_XOR) {
+		return copy ? copy_checksum(checksum_dest, checksum_src, size, 0) : checksum_update(0, checksum_src, size);
+	}
+	return copy ? copy_crc32c(checksum_dest, checksum_src, size, 0) : crc32c_update(0, checksum_src, size);
+}
+
+//Prints how fast the XOR checksum and CRC32C check frames of typical sizes, on their own and while copying the frame
+//out as the decoder does.
+static int benchmark_checksum(void) {
+	crc32c_init();
+	const bool hardware = crc32c_hw;
+
+	for (size_t x = 0; x < sizeof(checksum_src); x++) {
+		checksum_src[x] = (unsigned char)(x * 31 + 7);
+	}
+
+	for (size_t size = 0; size < sizeof(checksum_sizes) / sizeof(checksum_sizes[0]); size++) {
+		const size_t frame_size = checksum_sizes[size];
+		const size_t repeats = CHECKSUM_BENCHMARK_BYTES / frame_size;
+
+		for (Check_Method method = 0; method < Check_Method_Count; method++) {
+			if (method == CHECK_CRC32C_HW && !hardware) {
+				printf("%5zu bytes, %-15s: not available on this CPU\n", frame_size, check_names[method]);
+				continue;
+			}
+			//The table is used whenever the instructions are turned off.
+			crc32c_hw = method == CHECK_CRC32C_HW;
+
+			for (int copy = 0; copy < 2; copy++) {
+				unsigned __int32 result = 0;
+				const unsigned __int64 start = DCS_Clock_Now_Ns();
+				for (size_t y = 0; y < repeats; y++) {
+					result += run_Check(method, frame_size, copy);
+				}
+				const double seconds = (DCS_Clock_Now_Ns() - start) / 1e9;
+				checksum_sink = result;
+
+				printf("%5zu bytes, %-15s, %-5s: %.2f GB/s, %.1f ns/frame\n", frame_size, check_names[method],
+					copy ? "copy" : "check", seconds > 0 ? CHECKSUM_BENCHMARK_BYTES / seconds / 1e9 : 0.0,
+					seconds * 1e9 / repeats);
+			}
+		}
+	}
+
+	crc32c_hw = hardware;
+	return NO_DCS_ERROR;
+}
+#endif // 15
+
+#if FUNC_TO_TEST == 16
+//The queue and the threads it's timed with aren't part of the driver's API, so the client builds them for itself.
+#include "Platform.c"
+#include "Queue.c"
+
+//Most threads queueing at once, doubling from 1.
+#define CONTENTION_MAX_PRODUCERS 16
+//Items queued in each run, split between the producers.
+#define CONTENTION_ITEMS 1048576
+//Cells in the queue, as many as the transmission queue has.
+#define CONTENTION_CAPACITY 256
+
+//Ways of handing items from the producers to the consumer.
+typedef enum {
+	CONTENTION_QUEUE, //The lock-free queue the transmission queue uses
+	CONTENTION_MUTEX, //A list guarded by a mutex, as the transmission FIFO was before it, held to the same capacity
+	Contention_Method_Count,
+} Contention_Method;
+
+static const char* contention_names[Contention_Method_Count] = { "lock-free queue", "mutex and list" };
+
+//Item handed over. Its index says which item arrived.
+typedef struct Contention_Item {
+	unsigned __int32 index;
+	struct Contention_Item* pNextItem;
+} Contention_Item;
+
+static Contention_Item contention_items[CONTENTION_ITEMS];
+//Times each item arrived, which should be once.
+static unsigned __int8 contention_seen[CONTENTION_ITEMS];
+
+static Queue contention_queue;
+static Queue_Cell contention_cells[CONTENTION_CAPACITY];
+static Mutex* pContention_Mutex;
+static Contention_Item* pContention_Head;
+static Contention_Item* pContention_Tail;
+static unsigned __int32 contention_listed; //Items in the list
+//Set once every producer has started, so they all begin queueing together.
+static volatile unsigned __int32 contention_go;
+
+//Items a producer queues.
+typedef struct {
+	Contention_Method method;
+	unsigned __int32 first; //Index of its first item
+	unsigned __int32 count; //Number of items
+} Contention_Producer;
+
+static void produce(void* arg) {
+	const Contention_Producer* pProducer = arg;
+	while (Atomic_Load_Acquire(&contention_go) == 0) {
+		Sleep(0);
+	}
+
+	for (unsigned __int32 x = pProducer->first; x < pProducer->first + pProducer->count; x++) {
+		Contention_Item* pItem = &contention_items[x];
+		if (pProducer->method == CONTENTION_QUEUE) {
+			//A full queue is reported rather than waited on, so the producer gives way to the consumer and tries again.
+			while (!Queue_Push(&contention_queue, pItem)) {
+				Sleep(0);
+			}
+			continue;
+		}
+
+		pItem->pNextItem = NULL;
+		Mutex_Lock(pContention_Mutex);
+		while (contention_listed == CONTENTION_CAPACITY) {
+			Mutex_Unlock(pContention_Mutex);
+			Sleep(0);
+			Mutex_Lock(pContention_Mutex);
+		}
+		if (pContention_Head == NULL) {
+			pContention_Head = pItem;
+		}
+		else {
+			pContention_Tail->pNextItem = pItem;
+		}
+		pContention_Tail = pItem;
+		contention_listed++;
+		Mutex_Unlock(pContention_Mutex);
+	}
+}
+
+//Takes the item at the front of the list guarded by the mutex, or NULL if it's empty.
+static Contention_Item* pop_Locked(void) {
+	Mutex_Lock(pContention_Mutex);
+	Contention_Item* pItem = pContention_Head;
+	if (pItem != NULL) {
+		pContention_Head = pItem->pNextItem;
+		if (pContention_Head == NULL) {
+			pContention_Tail = NULL;
+		}
+		contention_listed--;
+	}
+	Mutex_Unlock(pContention_Mutex);
+	return pItem;
+}
+
+//Has [producers] threads queue CONTENTION_ITEMS items with [method] while this thread takes them, as the COM task
+//does. Prints the items handed over per second and returns false unless every item arrived exactly once.
+static bool run_Contention(Contention_Method method, unsigned int producers) {
+	Contention_Producer producer_args[CONTENTION_MAX_PRODUCERS];
+	Thread* threads[CONTENTION_MAX_PRODUCERS] = { 0 };
+
+	Queue_Init(&contention_queue, contention_cells, CONTENTION_CAPACITY);
+	pContention_Head = NULL;
+	pContention_Tail = NULL;
+	contention_listed = 0;
+	memset(contention_seen, 0, sizeof(contention_seen));
+	Atomic_Store_Release(&contention_go, 0);
+
+	unsigned __int32 first = 0;
+	for (unsigned int x = 0; x < producers; x++) {
+		producer_args[x].method = method;
+		producer_args[x].first = first;
+		producer_args[x].count = CONTENTION_ITEMS / producers + (x < CONTENTION_ITEMS % producers ? 1 : 0);
+		first += producer_args[x].count;
+		threads[x] = Thread_Start(produce, &producer_args[x]);
+		if (threads[x] == NULL) {
+			producers = x;
+			break;
+		}
+	}
+
+	const unsigned __int64 start = Clock_Now_Ns();
+	Atomic_Store_Release(&contention_go, 1);
+
+	unsigned __int32 received = 0;
+	while (received < first && producers > 0) {
+		Contention_Item* pItem = method == CONTENTION_QUEUE ? Queue_Pop(&contention_queue) : pop_Locked();
+		if (pItem == NULL) {
+			Sleep(0);
+			continue;
+		}
+		contention_seen[pItem->index]++;
+		received++;
+	}
+	const double seconds = (Clock_Now_Ns() - start) / 1e9;
+
+	for (unsigned int x = 0; x < producers; x++) {
+		Thread_Join(threads[x]);
+	}
+
+	bool exactly_once = producers > 0 && first == CONTENTION_ITEMS;
+	for (unsigned __int32 x = 0; x < CONTENTION_ITEMS && exactly_once; x++) {
+		exactly_once = contention_seen[x] == 1;
+	}
+
+	printf("%2u producer(s), %-15s: %.0f items/s%s\n", producers, contention_names[method],
+		seconds > 0 ? received / seconds : 0.0, exactly_once ? "" : ", ITEMS LOST OR REPEATED");
+	return exactly_once;
+}
+
+//Times the lock-free queue against a mutex and list with 1 to CONTENTION_MAX_PRODUCERS threads queueing at once,
+//checking that every item is taken exactly once.
+static int benchmark_contention(void) {
+	pContention_Mutex = Mutex_Create();
+	if (pContention_Mutex == NULL) {
+		return THREAD_START_ERROR;
+	}
+	for (unsigned __int32 x = 0; x < CONTENTION_ITEMS; x++) {
+		contention_items[x].index = x;
+	}
+
+	int result = NO_DCS_ERROR;
+	for (unsigned int producers = 1; producers <= CONTENTION_MAX_PRODUCERS; producers *= 2) {
+		for (Contention_Method method = 0; method < Contention_Method_Count; method++) {
+			if (!run_Contention(method, producers)) {
+				result = FRAME_INVALID_DATA;
+			}
+		}
+	}
+
+	Mutex_Destroy(pContention_Mutex);
+	return result;
+}
+#endif // 16
+
+#if FUNC_TO_TEST == 17
+//Seconds of streaming before allocations are counted, while the decode buffers, dispatch jobs and store slots grow.
+#define WARM_UP_SECONDS 1
+//Seconds of streaming during which allocations are counted.
+#define COUNTED_SECONDS 3
+//Items kept of each type.
+#define COUNTED_ITEMS 64
+
+//Set while allocations are counted.
+static volatile unsigned __int32 counting_allocations;
+//Allocations made by any thread while they were counted.
+static volatile unsigned __int32 allocations;
+//Frames handed to the callbacks while allocations were counted.
+static volatile unsigned __int32 counted_frames;
+
+#if defined(_WIN32)
+//Called by the debug CRT for every allocation, reallocation and free made through it, by the client or the driver.
+static int count_Allocation(int type, void* pData, size_t size, int block_type, long request, const unsigned char* pFile, int line) {
+	if (type != _HOOK_FREE && Atomic_Load_Acquire(&counting_allocations) != 0) {
+		Atomic_Increment(&allocations);
+	}
+	return TRUE;
+}
+#else
+//glibc's own allocator, which the wrappers below pass every call on to. The driver's calls come here as well.
+extern void* __libc_malloc(size_t size);
+extern void* __libc_calloc(size_t count, size_t size);
+extern void* __libc_realloc(void* pData, size_t size);
+
+static void count_Allocation(void) {
+	if (Atomic_Load_Acquire(&counting_allocations) != 0) {
+		Atomic_Increment(&allocations);
+	}
+}
+
+void* malloc(size_t size) {
+	count_Allocation();
+	return __libc_malloc(size);
+}
+
+void* calloc(size_t count, size_t size) {
+	count_Allocation();
+	return __libc_calloc(count, size);
+}
+
+void* realloc(void* pData, size_t size) {
+	count_Allocation();
+	return __libc_realloc(pData, size);
+}
+#endif
+
+static void count_Frame(void) {
+	if (Atomic_Load_Acquire(&counting_allocations) != 0) {
+		Atomic_Increment(&counted_frames);
+	}
+}
+
+static void counted_BFI_Data(void* pContext, const BFI_Data* pBFI_Data, int Cha_Num) {
+	count_Frame();
+}
+
+static void counted_Corr_Intensity_Data(void* pContext, const Corr_Intensity_Data* pCorr_Intensity_Data, int Cha_Num, const float* pDelayBuf, int Delay_Num) {
+	count_Frame();
+}
+
+static void counted_Intensity_Data(void* pContext, const Intensity_Data* pIntensity_Data, int Cha_Num) {
+	count_Frame();
+}
+
+//Hands every stored item straight back, so the store reuses its slots rather than dropping the oldest.
+static void release_Stored(DCS_Handle hDevice) {
+	int Cha_Num = 0;
+	int Delay_Num = 0;
+	const BFI_Data* pBFI_Data;
+	const Intensity_Data* pIntensity_Data;
+	const Corr_Intensity_Data* pCorr_Intensity_Data;
+	const float* pDelayBuf;
+
+	while (DCS_Acquire_BFI_Data(hDevice, &pBFI_Data, &Cha_Num) == NO_DCS_ERROR) {
+		DCS_Release_BFI_Data(hDevice, pBFI_Data);
+	}
+	while (DCS_Acquire_Intensity_Data(hDevice, &pIntensity_Data, &Cha_Num) == NO_DCS_ERROR) {
+		DCS_Release_Intensity_Data(hDevice, pIntensity_Data);
+	}
+	while (DCS_Acquire_Corr_Intensity_Data(hDevice, &pCorr_Intensity_Data, &Cha_Num, &pDelayBuf, &Delay_Num) == NO_DCS_ERROR) {
+		DCS_Release_Corr_Intensity_Data(hDevice, pCorr_Intensity_Data);
+	}
+}
+
+//Streams measurements into a streaming store with the callbacks on [dispatch_threads] dispatch threads, and counts the
+//allocations made once the stream has warmed up. Prints them and returns false unless frames arrived and none were made.
+static bool run_Allocations(DCS_Address address, unsigned int dispatch_threads) {
+	DCS_Callbacks callbacks = Null_DCS_Callbacks();
+	callbacks.Get_BFI_Data = counted_BFI_Data;
+	callbacks.Get_Corr_Intensity_Data_CB = counted_Corr_Intensity_Data;
+	callbacks.Get_Intensity_Data_CB = counted_Intensity_Data;
+	address.dispatch_threads = dispatch_threads;
+
+	DCS_Handle hDevice;
+	if (DCS_Open(address, callbacks, NULL, true, &hDevice) != NO_DCS_ERROR) {
+		printf("%u dispatch thread(s): couldn't connect\n", dispatch_threads);
+		return false;
+	}
+
+	Store_Config config = { .max_items = COUNTED_ITEMS, .overflow = OVERFLOW_DROP_OLDEST, .streaming = true };
+	DCS_Set_Store_Config(hDevice, config);
+	DCS_Enable(hDevice, true, true);
+
+	int ids[] = { 1, 2, };
+	bool passed = DCS_Start_Measurement(hDevice, 1, ids, sizeof(ids) / sizeof(ids[0])) == NO_DCS_ERROR;
+	if (passed) {
+		for (int x = 0; x < WARM_UP_SECONDS * 100; x++) {
+			Sleep(10);
+			release_Stored(hDevice);
+		}
+
+		Atomic_Store_Release(&allocations, 0);
+		Atomic_Store_Release(&counted_frames, 0);
+		Atomic_Store_Release(&counting_allocations, 1);
+		for (int x = 0; x < COUNTED_SECONDS * 100; x++) {
+			Sleep(10);
+			release_Stored(hDevice);
+		}
+		Atomic_Store_Release(&counting_allocations, 0);
+
+		DCS_Stop_Measurement(hDevice);
+		Sleep(100);
+	}
+	DCS_Close(hDevice);
+
+	const unsigned __int32 frames = Atomic_Load_Acquire(&counted_frames);
+	const unsigned __int32 made = Atomic_Load_Acquire(&allocations);
+	passed = passed && frames > 0 && made == 0;
+	printf("%u dispatch thread(s): %u frames, %u allocations, %.3f per frame%s\n", dispatch_threads, frames, made,
+		frames > 0 ? (double)made / frames : 0.0, passed ? "" : ", FAILED");
+	return passed;
+}
+
+//Checks that a steady stream is received without allocating, with the callbacks on the event loop and on dispatch threads.
+static int test_allocations(DCS_Address address) {
+#if defined(_WIN32) && !defined(_DEBUG)
+	printf("Allocations are only counted with the debug CRT, so build the client in Debug.\n");
+	return MEMORY_ALLOCATION_ERROR;
+#else
+#if defined(_WIN32)
+	_CrtSetAllocHook(count_Allocation);
+#endif
+	int result = NO_DCS_ERROR;
+	if (!run_Allocations(address, 0) || !run_Allocations(address, 2)) {
+		result = MEMORY_ALLOCATION_ERROR;
+	}
+	return result;
+#endif
+}
+#endif // 17
+
+#if FUNC_TO_TEST == 18
+//Milliseconds to wait for the measurement to store a BFI item.
+#define BORROW_WAIT_MS 2000
+
+//Prints how a release went and returns whether it returned [expected].
+static bool check_Release(const char* pCase, int status, int expected) {
+	printf("%-34s: status %d%s\n", pCase, status, status == expected ? "" : ", FAILED");
+	return status == expected;
+}
+
+//Borrows the oldest stored BFI item, waiting up to BORROW_WAIT_MS for one to arrive.
+static int acquire_Waiting(DCS_Handle hDevice, const BFI_Data** ppBFI_Data, int* pCha_Num) {
+	int result = 1;
+	for (int x = 0; x < BORROW_WAIT_MS / 10 && result == 1; x++) {
+		result = DCS_Acquire_BFI_Data(hDevice, ppBFI_Data, pCha_Num);
+		if (result == 1) {
+			Sleep(10);
+		}
+	}
+	return result;
+}
+
+//Checks that the release functions reject items they didn't lend or already took back, and that an item still
+//borrowed when its device is closed can be read and handed back afterwards.
+static int test_borrowing(DCS_Address address) {
+	DCS_Handle hDevice;
+	int result = DCS_Open(address, Null_DCS_Callbacks(), NULL, true, &hDevice);
+	if (result != NO_DCS_ERROR) {
+		return result;
+	}
+
+	DCS_Enable(hDevice, false, true);
+	int ids[] = { 1, 2, };
+	result = DCS_Start_Measurement(hDevice, 1, ids, sizeof(ids) / sizeof(ids[0]));
+
+	const BFI_Data* pBFI_Data = NULL;
+	const BFI_Data* pKept = NULL;
+	int Cha_Num = 0;
+	if (result == NO_DCS_ERROR) {
+		result = acquire_Waiting(hDevice, &pBFI_Data, &Cha_Num);
+	}
+	if (result == NO_DCS_ERROR) {
+		result = acquire_Waiting(hDevice, &pKept, &Cha_Num);
+	}
+	DCS_Stop_Measurement(hDevice);
+	if (result != NO_DCS_ERROR) {
+		printf("No BFI data was stored, status %d\n", result);
+		DCS_Close(hDevice);
+		return result;
+	}
+
+	bool passed = true;
+	const BFI_Data foreign[2] = { 0 };
+	passed &= check_Release("Release of a foreign pointer", DCS_Release_BFI_Data(hDevice, foreign), FRAME_INVALID_DATA);
+	passed &= check_Release("Release past a borrowed item", DCS_Release_BFI_Data(hDevice, pBFI_Data + 1), FRAME_INVALID_DATA);
+	passed &= check_Release("Release as another type", DCS_Release_Intensity_Data(hDevice, (const Intensity_Data*)pBFI_Data), FRAME_INVALID_DATA);
+	passed &= check_Release("Release", DCS_Release_BFI_Data(hDevice, pBFI_Data), NO_DCS_ERROR);
+	passed &= check_Release("Double release", DCS_Release_BFI_Data(hDevice, pBFI_Data), FRAME_INVALID_DATA);
+
+	//The item still borrowed stays readable once the device is closed, and the closed handle hands it back.
+	const int Cha_ID = pKept[0].Cha_ID;
+	DCS_Close(hDevice);
+	const bool kept = pKept[0].Cha_ID == Cha_ID;
+	printf("%-34s: channel %d%s\n", "Read after closing", pKept[0].Cha_ID, kept ? "" : ", FAILED");
+	passed &= kept;
+	passed &= check_Release("Release after closing", DCS_Release_BFI_Data(hDevice, pKept), NO_DCS_ERROR);
+	passed &= check_Release("Double release after closing", DCS_Release_BFI_Data(hDevice, pKept), FRAME_INVALID_DATA);
+
+	return passed ? NO_DCS_ERROR : FRAME_INVALID_DATA;
+}
+#endif // 18
+
+#if FUNC_TO_TEST == 19
+//Seconds of streaming before the blocks in use are counted, while the decode buffers and dispatch jobs grow.
+#define SWAP_WARM_UP_SECONDS 1
+//Times the callbacks are replaced while streaming.
+#define SWAP_COUNT 20000
+//Replacements made between pauses that let frames through. Each run of them gives the same context, so the frames
+//handled during the pauses go to the two contexts in turn.
+#define SWAPS_PER_PAUSE 100
+//Replaced sets that may still be kept at the end, for the threads that were running a callback at the last replacement.
+#define SWAP_KEPT_MAX 4
+
+//Frames handed to the callbacks given one of the contexts.
+typedef struct {
+	volatile unsigned __int32 frames;
+} Swap_Context;
+
+#if !defined(_WIN32)
+//Blocks allocated and not yet freed by any thread, counted from the start of the process.
+static volatile unsigned __int32 live_blocks;
+
+//glibc's own allocator, which the wrappers below pass every call on to. The driver's calls come here as well.
+extern void* __libc_malloc(size_t size);
+extern void* __libc_calloc(size_t count, size_t size);
+extern void* __libc_realloc(void* pData, size_t size);
+extern void __libc_free(void* pData);
+
+void* malloc(size_t size) {
+	void* pData = __libc_malloc(size);
+	if (pData != NULL) {
+		Atomic_Increment(&live_blocks);
+	}
+	return pData;
+}
+
+void* calloc(size_t count, size_t size) {
+	void* pData = __libc_calloc(count, size);
+	if (pData != NULL) {
+		Atomic_Increment(&live_blocks);
+	}
+	return pData;
+}
+
+//Only a new block or a freed one changes the count, not a block that's moved.
+void* realloc(void* pData, size_t size) {
+	void* pNew = __libc_realloc(pData, size);
+	if (pData == NULL && pNew != NULL) {
+		Atomic_Increment(&live_blocks);
+	}
+	else if (pData != NULL && pNew == NULL && size == 0) {
+		Atomic_Decrement(&live_blocks);
+	}
+	return pNew;
+}
+
+void free(void* pData) {
+	if (pData != NULL) {
+		Atomic_Decrement(&live_blocks);
+	}
+	__libc_free(pData);
+}
+#endif
+
+//Blocks allocated by the client and the driver and not yet freed.
+static long count_Live_Blocks(void) {
+#if defined(_WIN32)
+	_CrtMemState state;
+	_CrtMemCheckpoint(&state);
+	return (long)state.lCounts[_NORMAL_BLOCK];
+#else
+	return (long)Atomic_Load_Acquire(&live_blocks);
+#endif
+}
+
+static void swap_BFI_Data(void* pContext, const BFI_Data* pBFI_Data, int Cha_Num) {
+	Atomic_Increment(&((Swap_Context*)pContext)->frames);
+}
+
+static void swap_Corr_Intensity_Data(void* pContext, const Corr_Intensity_Data* pCorr_Intensity_Data, int Cha_Num, const float* pDelayBuf, int Delay_Num) {
+	Atomic_Increment(&((Swap_Context*)pContext)->frames);
+}
+
+//Replaces the callbacks of a streaming device over and over, alternating between two contexts, and checks that both
+//were called and the sets replaced were freed rather than kept until the device is closed.
+static int test_callback_swaps(DCS_Address address) {
+#if defined(_WIN32) && !defined(_DEBUG)
+	printf("Blocks are only counted with the debug CRT, so build the client in Debug.\n");
+	return MEMORY_ALLOCATION_ERROR;
+#else
+	DCS_Callbacks callbacks = Null_DCS_Callbacks();
+	callbacks.Get_BFI_Data = swap_BFI_Data;
+	callbacks.Get_Corr_Intensity_Data_CB = swap_Corr_Intensity_Data;
+	address.dispatch_threads = 2;
+
+	Swap_Context contexts[2] = { 0 };
+	DCS_Handle hDevice;
+	int result = DCS_Open(address, callbacks, &contexts[0], false, &hDevice);
+	if (result != NO_DCS_ERROR) {
+		return result;
+	}
+
+	DCS_Enable(hDevice, true, true);
+	int ids[] = { 1, 2, };
+	result = DCS_Start_Measurement(hDevice, 1, ids, sizeof(ids) / sizeof(ids[0]));
+	if (result != NO_DCS_ERROR) {
+		DCS_Close(hDevice);
+		return result;
+	}
+	Sleep(SWAP_WARM_UP_SECONDS * 1000);
+
+	const long before = count_Live_Blocks();
+	for (int x = 1; x <= SWAP_COUNT && result == NO_DCS_ERROR; x++) {
+		result = DCS_Set_Callbacks(hDevice, callbacks, &contexts[(x / SWAPS_PER_PAUSE) % 2], false);
+		if (x % SWAPS_PER_PAUSE == 0) {
+			Sleep(1);
+		}
+	}
+
+	//The sets still in use by the last replacement are freed by the next one.
+	Sleep(100);
+	if (result == NO_DCS_ERROR) {
+		result = DCS_Set_Callbacks(hDevice, callbacks, &contexts[0], false);
+	}
+	const long kept = count_Live_Blocks() - before;
+
+	DCS_Stop_Measurement(hDevice);
+	DCS_Close(hDevice);
+
+	const unsigned __int32 first = Atomic_Load_Acquire(&contexts[0].frames);
+	const unsigned __int32 second = Atomic_Load_Acquire(&contexts[1].frames);
+	const bool passed = result == NO_DCS_ERROR && first > 0 && second > 0 && kept <= SWAP_KEPT_MAX;
+	printf("%d replacements: %u and %u frames, %ld blocks kept%s\n", SWAP_COUNT, first, second, kept, passed ? "" : ", FAILED");
+	return passed ? NO_DCS_ERROR : MEMORY_ALLOCATION_ERROR;
+#endif
+}
+#endif // 19
+
 int main(void) {
 	//Needed to detect and output memory leaks in debug mode.
 	_CrtSetDbgFlag(_CRTDBG_ALLOC_MEM_DF | _CRTDBG_LEAK_CHECK_DF);
@@ -236,6 +1291,76 @@ int main(void) {
 	result = Get_Analyzer_Prefit_Param();
 #endif // 11
 
+#if FUNC_TO_TEST == 10
+	//Compare the transports on the same stream. Each sets up its own connection.
+	Destroy_COM_Task();
+
+	result = benchmark_transport(address, DCS_TRANSPORT_SOCKET);
+	if (result == NO_DCS_ERROR) {
+		result = benchmark_transport(address, DCS_TRANSPORT_IO_URING);
+	}
+	return result;
+#endif // 10
+
+#if FUNC_TO_TEST == 11
+	//Compare one event loop serving every device with one loop per device. Start a server on each port first.
+	Destroy_COM_Task();
+
+	result = benchmark_devices(address, 1);
+	if (result == NO_DCS_ERROR) {
+		result = benchmark_devices(address, BENCHMARK_DEVICES);
+	}
+	return result;
+#endif // 11
+
+#if FUNC_TO_TEST == 12
+	result = demo_async(DCS_Default_Handle());
+	Destroy_COM_Task();
+	return result;
+#endif // 12
+
+#if FUNC_TO_TEST == 13
+	//Drain a device of its own, with nothing but its store taking the data.
+	Destroy_COM_Task();
+	return benchmark_drain(address);
+#endif // 13
+
+#if FUNC_TO_TEST == 14
+	//The swaps need no DCS, though the connection made above still needs the server running.
+	Destroy_COM_Task();
+	return benchmark_swap();
+#endif // 14
+
+#if FUNC_TO_TEST == 15
+	//The checksums need no DCS, though the connection made above still needs the server running.
+	Destroy_COM_Task();
+	return benchmark_checksum();
+#endif // 15
+
+#if FUNC_TO_TEST == 16
+	//The queue needs no DCS, though the connection made above still needs the server running.
+	Destroy_COM_Task();
+	return benchmark_contention();
+#endif // 16
+
+#if FUNC_TO_TEST == 17
+	//Each run opens a device of its own.
+	Destroy_COM_Task();
+	return test_allocations(address);
+#endif // 17
+
+#if FUNC_TO_TEST == 18
+	//Borrow from a device of its own, so closing it leaves the default connection alone.
+	Destroy_COM_Task();
+	return test_borrowing(address);
+#endif // 18
+
+#if FUNC_TO_TEST == 19
+	//Replace the callbacks of a device of its own, which has dispatch threads.
+	Destroy_COM_Task();
+	return test_callback_swaps(address);
+#endif // 19
+
 	//Sleep to give time for COM task to receive data and call callbacks.
 	Sleep(3000);
 
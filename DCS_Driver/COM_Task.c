@@ -1,124 +1,362 @@
 #define _CRTDBG_MAP_ALLOC
 #include <stdlib.h>
-#include <crtdbg.h>
+#include "Platform.h"
 #include <stdio.h>
 #include <time.h>
-#include <process.h>
-#include <ws2tcpip.h>
-
-#pragma comment (lib, "Ws2_32.lib")
+#include <errno.h>
 
 #include "DCS_Driver.h"
 #include "Internal.h"
+#include "Framer.h"
+#include "Uring.h"
+#include "Queue.h"
+#include "Dispatch.h"
 #include "COM_Task.h"
-
-// Pointer to the transmission FIFO head
-static Transmission_Data_Type* pTrans_FIFO_Head = NULL;
-// Pointer to the transmission FIFO tail
-static Transmission_Data_Type* pTrans_FIFO_Tail = NULL;
-
-static Received_Data_Item* pRecv_Data_FIFO_Head = NULL;
-static Received_Data_Item* pRecv_Data_FIFO_Tail = NULL;
-
-//Handle of the COM task thread.
-static HANDLE threadHandle;
-//Handle of the mutex for destroying the COM task.
-static HANDLE hRunMutex;
-//Handle of the mutex for adding to the FIFO queue.
-static HANDLE hFIFOMutex;
-
-static HANDLE hRecvDataMutex;
-static inline void set_Recv_mutex();
-static inline void release_Recv_mutex();
-
-//Removes the first item in the FIFO and returns its pointer.
-static Transmission_Data_Type* Dequeue_Trans_FIFO(void);
-
-int Enqueue_Recv_FIFO(Received_Data_Item* pTransmission);
-
-//Work done by the COM task thread.
-static void COM_Task(void* address);
+#include "Device.h"
+#include "Event_Loop.h"
+#include "Request.h"
+#include "Timer_Wheel.h"
+#include "User_Timer.h"
+
+//Device used by Initialize_COM_Task and the rest of the API that doesn't take a handle. It lives for as long as
+//the driver is loaded, so frames queued before it's opened are sent once it is and its counters are never reset.
+static DCS_Device default_device;
+
+//Connects [pDevice] to [address], starts its dispatch threads and attaches it to an event loop.
+//Its callbacks must already be set.
+static int open_Device(DCS_Device* pDevice, DCS_Address address);
+//Detaches [pDevice] from its event loop, closing the connection, and frees everything it holds but the struct itself.
+static void close_Device(DCS_Device* pDevice);
+
+static inline void set_Recv_mutex(DCS_Device* pDevice);
+static inline void release_Recv_mutex(DCS_Device* pDevice);
+
+//Removes the first item in the FIFO and returns its pointer, or NULL if it is empty.
+static Transmission_Data_Type* Dequeue_Trans_FIFO(DCS_Device* pDevice);
+
+//Adds a received item to the store, making room for it as store_config says. Called by the event loop or a dispatch thread.
+int Enqueue_Recv_FIFO(DCS_Device* pDevice, Received_Data_Item* pRecv);
+//Adds [pRecv] to its ring, dropping an item if the ring is full. Must be called with hRecvDataMutex held.
+static int store_Recv_Item(DCS_Device* pDevice, Received_Data_Item* pRecv);
+//Lets whatever waits for room in the store carry on once items were taken or the limits changed: a dispatch thread
+//waiting to store an item, or the event loop holding reads behind pHeldItem. Must be called with hRecvDataMutex held.
+static void made_Store_Room(DCS_Device* pDevice);
+//Removes the oldest stored item of [type]. Returns NULL if there isn't one or [pDevice] is NULL.
+static Received_Data_Item* take_Recv_Item(DCS_Device* pDevice, Data_Item_Type type);
+//Bytes of received data [pItem] holds.
+static size_t recv_item_size(const Received_Data_Item* pItem);
+//Frees a stored item and everything it points to.
+static void free_Recv_Item(Received_Data_Item* pItem);
+//Frees an item allocated on its own, or drops the store's reference to the slot holding it. Must be called with
+//hRecvDataMutex held.
+static void release_Recv_Item(DCS_Device* pDevice, Received_Data_Item* pItem);
+//Frees a slot whose last reference has been dropped, or returns it to its ring's free slots. Must be called with
+//hRecvDataMutex held.
+static void recycle_Recv_Slot(DCS_Device* pDevice, struct Recv_Slot* pSlot);
+//Stores a frame decoded into a buffer from Take_Frame_Buffer, giving the store a reference of its own to it.
+static void keep_Frame_Buffer(DCS_Device* pDevice, Received_Data_Item* pFrame);
+//Takes a free slot of [type]'s ring with room for [size] bytes of data, allocating one if none is free, and gives the caller
+//its only reference. Returns NULL if the slot can't be allocated.
+static Received_Data_Item* take_Recv_Slot(DCS_Device* pDevice, Data_Item_Type type, size_t size);
+//Allocates free slots of [size] bytes for the ring until it has one more than the store keeps items of its type, for the
+//item being stored while the ring is full. Must be called with hRecvDataMutex held.
+static void fill_Recv_Slots(DCS_Device* pDevice, Recv_Ring* pRing, size_t size);
+//Frees the ring's free slots. Must be called with hRecvDataMutex held.
+static void free_Recv_Slots(Recv_Ring* pRing);
+//Stores [length] records of [element_size] bytes from [pData] as an item of [type], keeping [pFrame] if they were decoded
+//into it and copying them into a slot otherwise.
+static void store_Array(DCS_Device* pDevice, Data_Item_Type type, const void* pData, int length, size_t element_size, Received_Data_Item* pFrame);
+//Bytes of a correlation intensity item with [Cha_Num] channels and [Delay_Num] delays.
+static size_t corr_intensity_size(const Corr_Intensity_Data* pCorr_Intensity_Data, int Cha_Num, int Delay_Num);
+//Copies the channels, their correlation buffers and the delays into separate allocations, which the application frees.
+//Fills [arr] with the channels then the delays. Returns false, having freed what it copied, if one can't be allocated.
+static bool copy_Corr_Intensity(const Corr_Intensity_Data* pCorr_Intensity_Data, int Cha_Num, const float* pDelayBuf, int Delay_Num, Array_Data arr[2]);
+//Gives the application the array of an item taken from the store, copying it if a slot holds it, and frees the item.
+//Returns MEMORY_ALLOCATION_ERROR, having dropped the item, if the copy can't be allocated.
+static int hand_out_Array(DCS_Device* pDevice, Received_Data_Item* pItem, Array_Data* pArr);
+//Copies the oldest stored items of [type] into [pOutput], which has room for [capacity] records of [element_size] bytes,
+//until the next one doesn't fit or [capacity] items have been taken. Sets [*pFrames] to the number of items taken and,
+//if [pCounts] isn't NULL, each one's number of records in [pCounts]. Returns 1 if no item is stored and FRAME_INVALID_DATA
+//if the oldest one doesn't fit.
+static int drain_Recv_Items(DCS_Device* pDevice, Data_Item_Type type, void* pOutput, size_t element_size, int capacity, int* pFrames, int* pCounts);
+//Removes the oldest stored item of [type] like take_Recv_Item and records its slot as lent by [pDevice].
+static Received_Data_Item* borrow_Recv_Item(DCS_Device* pDevice, Data_Item_Type type);
+//Drops the reference to the slot of an item [pDevice] lent from its store of [type], whose data starts at [pData], or
+//frees the slot if the device has been closed since. Returns FRAME_INVALID_DATA, without reading [pData], if it isn't
+//the start of such an item or was already handed back.
+static int release_Borrowed_Item(DCS_Device* pDevice, Data_Item_Type type, const void* pData);
+//Marks the slots [pDevice] still has lent as orphaned, so they stay valid until handed back and are then freed. Called
+//once nothing else uses the device's store.
+static void orphan_Borrowed_Slots(DCS_Device* pDevice);
+//Take and give back borrow_lock.
+static inline void lock_Borrowed(void);
+static inline void unlock_Borrowed(void);
+//Whether [pRing] has to make room before an item of [size] bytes can be added.
+static bool recv_ring_full(const DCS_Device* pDevice, const Recv_Ring* pRing, size_t size);
+//Removes the oldest item in [pRing]. Returns NULL if it's empty.
+static Received_Data_Item* recv_ring_pop(Recv_Ring* pRing);
+//Discards the oldest items of [pRing] until it's within the limits and resizes it to match them.
+static void trim_Recv_Ring(DCS_Device* pDevice, Recv_Ring* pRing);
 
 //Initializes the handle for hFIFOMutex.
-static int init_FIFO_mutex(void);
+static int init_FIFO_mutex(DCS_Device* pDevice);
 //Releases the handle for hFIFOMutex.
-static int close_FIFO_mutex(void);
+static int close_FIFO_mutex(DCS_Device* pDevice);
 //Takes control of the hFIFOMutex.
-static inline void set_FIFO_mutex(void);
+static inline void set_FIFO_mutex(DCS_Device* pDevice);
 //Releases control of the hFIFOMutex.
-static inline void release_FIFO_mutex(void);
-
-//Sends data passed to function and releases it when finished. Returns <0 on error.
-static int send_data(SOCKET ConnectSocket, Transmission_Data_Type* data_to_send);
+static inline void release_FIFO_mutex(DCS_Device* pDevice);
+
+//Most frames given to a single Socket_Send call.
+#define SEND_BATCH_MAX 64
+
+//Last sequence ID given out by Next_Sequence_ID. Shared by every device.
+static volatile unsigned __int32 last_sequence_id = 0;
+
+//Clears every command record and sets the number of commands that can be in flight at once.
+static void reset_Commands(DCS_Device* pDevice, unsigned int window);
+//Starts the completion record of a command that is about to be sent.
+static void start_Command(DCS_Device* pDevice, Transmission_Data_Type* pTransmission);
+//Called by the wheel when a command hasn't been acknowledged in time. The device's next pass drops the connection.
+static void command_deadline_passed(Timer* pTimer, void* pContext);
+
+//Takes every command from the transmission FIFO that can be sent now and adds it to [pCursor].
+static void take_commands(DCS_Device* pDevice, Output_Cursor* pCursor);
+//Adds a frame to the end of [pCursor].
+static void queue_output(Output_Cursor* pCursor, Transmission_Data_Type* pTransmission);
+//Releases every frame in [pCursor] without sending it.
+static void clear_output(Output_Cursor* pCursor);
+//Lets go of a frame held by the output writing it or by its command record. It's only released once neither holds it.
+static void drop_Frame(Transmission_Data_Type* pTransmission);
+
+//Writes as much of the frames in [pCursor] as the socket will take in one scatter-gather call and
+//releases the frames that were completely written. Returns <0 on error.
+static int send_data(DCS_Device* pDevice, Output_Cursor* pCursor);
 
 //Receives data from socket. Returns >0 on fatal error, <0 on non-fatal error.
-static int recv_data(SOCKET ConnectSocket);
-
-//Processes the raw data from the DCS. Takes a pointer to a DCS frame *excluding* the prepended frame size.
-static int process_recv(char* buff, unsigned __int32 buffLen);
-
-//Callbacks to call when the host receives data from the DCS.
-static Receive_Callbacks callbacks;
-//Whether the received data should be stored on the heap to be manually emptied.
-static bool should_store;
-//Handle of the mutex for controlling addition to the [callbacks] struct.
-static HANDLE hCallbacksMutex;
+static int recv_data(DCS_Device* pDevice);
+//Carries on with the frames left in the framer once the store and dispatch queues have room for them, and has the next
+//pass read from the DCS again. Does nothing while either is still full. Returns false if the frames can't be split any more.
+static bool resume_Reads(DCS_Device* pDevice);
+
+//Verifies and processes every complete frame buffered in [pFramer], recording the last frame error in [*pFrameResult].
+//Stops early if a frame has reads held, leaving the rest buffered.
+//The frames are stamped with [timestamp], the Clock_Now_Ns time the read that completed them was received.
+//Counts each frame handed out in [*pFrameCount].
+//Returns false if the stream can't be split into frames any more.
+static bool process_frames(DCS_Device* pDevice, Framer* pFramer, unsigned __int64 timestamp, int* pFrameResult, unsigned __int32* pFrameCount);
+
+//Cancels everything pUring has in flight and releases it. Must be called before the socket is closed.
+static void close_Uring_transport(DCS_Device* pDevice);
+//Has the device's poller watch its connected socket, or its io_uring ring when that was asked for and can be set up.
+//Returns false if neither can be watched.
+static bool watch_Connection(DCS_Device* pDevice);
+//Stops the device's poller watching it and closes its connection, or the attempt to make it again.
+static void close_Connection(DCS_Device* pDevice);
+
+//Called when the connection fails. A device that reconnects is kept to connect again, with the commands the DCS hadn't
+//answered set aside to be sent again. Returns false if the device should be dropped instead.
+static bool lose_Connection(DCS_Device* pDevice);
+//Takes the commands a lost connection left unanswered off their records: the Get commands whose replies hadn't arrived,
+//then the commands that weren't acknowledged, oldest first. Returns their frames linked in the order they're sent again.
+static Transmission_Data_Type* take_Unanswered(DCS_Device* pDevice);
+//Puts the frames linked from [pList] ahead of the ones waiting to be sent again.
+static void replay_First(DCS_Device* pDevice, Transmission_Data_Type* pList);
+//Starts an attempt to connect the device again, watched by its poller.
+static void connect_Again(DCS_Device* pDevice);
+//Waits before the next attempt once one has failed.
+static void retry_Connect(DCS_Device* pDevice);
+//Called by the wheel when the next attempt to connect is due, or when the one being made has taken too long.
+static void reconnect_due(Timer* pTimer, void* pContext);
+//Finishes the attempt being made once its socket has activity. Returns true once the connection has been made again
+//and the device can be served as before.
+static bool finish_Connect(DCS_Device* pDevice);
+//io_uring version of recv_data. Handles every completion waiting, including finished sends.
+//Returns >0 on fatal error, <0 on non-fatal error.
+static int uring_recv_data(DCS_Device* pDevice);
+//io_uring version of send_data. Queues the frames in [pCursor] as a chain of linked sends once the previous
+//chain has finished, and submits them along with anything else queued in one call. Returns <0 on error.
+static int uring_send_data(DCS_Device* pDevice, Output_Cursor* pCursor);
+//Adds to the counters for Get_Transport_Stats.
+static void add_Transport_Stats(DCS_Device* pDevice, unsigned __int32 syscalls, unsigned __int32 frames_received, unsigned __int64 bytes_received, unsigned __int64 bytes_sent);
+
+//Processes the raw data from the DCS. Takes a pointer to a DCS frame *excluding* the prepended frame size
+//whose checksum has already been verified. Acknowledgements are handled straight away, and the rest of the frames
+//are decoded and handed to their callbacks here or, when there are dispatch threads, by the thread for their data ID.
+static int process_recv(DCS_Device* pDevice, char* buff, unsigned __int32 buffLen, unsigned __int64 timestamp);
+//Decodes the data of a [data_id] frame received at [timestamp] and calls its callbacks.
+static int process_payload(DCS_Device* pDevice, Data_ID data_id, Sequence_ID sequence, char* pDataBuff, unsigned __int32 pDataBuffLen, unsigned __int64 timestamp);
+//Hands an error found by the event loop to the error message callback. When there are dispatch threads it goes through
+//the one for error messages, so it's reported after the messages received before it and not on the event loop.
+static void report_COM_error(DCS_Device* pDevice, const char* message);
 
 //Initializes the handle for hCallbacksMutex.
-static int init_Callback_mutex(void);
+static int init_Callback_mutex(DCS_Device* pDevice);
 //Releases the handle for hCallbacksMutex.
-static int close_Callback_mutex(void);
-//Thread-safe method of setting the callbacks variable.
-static void set_Callbacks(Receive_Callbacks local_callbacks, bool local_should_store);
-//Thread-safe method of retrieving the callbacks variable.
-static void get_Callbacks(Receive_Callbacks* local_callbacks, bool* local_should_store);
-
-//Initializes the handle for hRecvDataMutex.
-static int init_Recv_mutex(void);
-//Releases the handle for hRecvDataMutex.
-static int close_Recv_mutex(void);
-
-//Clears out data from the recv FIFO.
-static void clear_Recv_FIFO(void);
+static int close_Callback_mutex(DCS_Device* pDevice);
+//Publishes a new callback set. The one it replaces is retired if the device is open and freed otherwise.
+static int set_Callbacks(DCS_Device* pDevice, Receive_Callbacks local_callbacks, DCS_Callbacks handlers, void* pContext, bool local_should_store);
+//Frees the retired callback sets the event loop and dispatch threads have finished with. Must be called with hCallbacksMutex held.
+static void reclaim_Callbacks(DCS_Device* pDevice);
+//Returns the callback set in use. Never NULL. Only the event loop and dispatch threads may keep it past hCallbacksMutex.
+static inline const Callback_Set* get_Callbacks(DCS_Device* pDevice);
+//Whether the callback set in use stores the received data. Can be called from any thread.
+static bool get_Should_Store(DCS_Device* pDevice);
+//Frees the callback set in use and every retired one. Only called once no thread can be reading them.
+static void free_Callbacks(DCS_Device* pDevice);
+
+//Initializes the handles for hRecvDataMutex and pStoreCond.
+static int init_Recv_mutex(DCS_Device* pDevice);
+//Releases the handles for hRecvDataMutex and pStoreCond.
+static int close_Recv_mutex(DCS_Device* pDevice);
+
+//Clears out data from the store and frees its rings.
+static void clear_Recv_FIFO(DCS_Device* pDevice);
 //Clears out data from the trans FIFO.
-static void clear_Trans_FIFO(void);
-
-static double last_Response_Time = 0.0;
-//Checks if difference between the last response and the current time is greater than CHECK_CONNECTION_FREQ.
-//Sends keep-alive command to maintain connection.
-static void check_Timer(void);
+static void clear_Trans_FIFO(DCS_Device* pDevice);
+
+//Transmission buffers of TRANSMISSION_POOL_BLOCK_SIZE bytes (including the struct) that are
+//kept after being sent so most commands are built without touching the heap. Lock-free like the FIFO,
+//and shared by every device. TRANSMISSION_POOL_MAX_BLOCKS must be a power of 2.
+#define TRANSMISSION_POOL_BLOCK_SIZE 256
+#define TRANSMISSION_POOL_MAX_BLOCKS 16
+
+//Slot a BFI, intensity or correlation intensity item is kept in, with the item's data following it in the same allocation.
+//Frames the store keeps are decoded straight into a slot, which the decoder and the store then share.
+typedef struct Recv_Slot {
+	Received_Data_Item item; //Item the slot holds. Its data is [arrays].
+	Array_Data arrays[2]; //The item's array, or the channels and delays of a correlation intensity item, pointing after the slot
+	size_t capacity; //Bytes of data the slot has room for
+	volatile unsigned __int32 refs; //References held by the decoder and the store, the slot is freed or reused when the last is dropped
+	struct Recv_Slot* pNextItem; //Next free slot of the ring, or next lent slot while a borrowing getter has lent it
+	DCS_Device* pLender; //Device a borrowing getter lent the slot from, while it's lent
+	bool orphaned; //Set if the slot was still lent when its device was closed, so it's freed once handed back
+} Recv_Slot;
+
+//Slots lent by the borrowing getters of every device and not handed back yet, linked through pNextItem. A release is
+//checked against them, so a pointer that wasn't lent or was already handed back is never read, even once its device has
+//been closed. Guarded by borrow_lock.
+static Recv_Slot* pBorrowed_Slots = NULL;
+//Set while pBorrowed_Slots is searched or changed.
+static volatile unsigned __int32 borrow_lock = 0;
+
+//Bit of a Data_Item_Type in DCS_Device.stream_types.
+#define STREAM_TYPE_BIT(type) (1u << (type))
+//Data types a measurement sends.
+#define STREAM_TYPES (STREAM_TYPE_BIT(BFI_Data_Type) | STREAM_TYPE_BIT(Intensity_Data_Type) | STREAM_TYPE_BIT(Corr_Intensity_Data_Type))
+
+static Queue trans_pool;
+static Queue_Cell trans_pool_cells[TRANSMISSION_POOL_MAX_BLOCKS];
+//Set once the pool has been set up, which is kept until the driver is unloaded.
+static volatile unsigned __int32 trans_pool_state = 0;
+//Sets up the transmission pool the first time a device is opened. Must be called with network_lock held.
+static void init_Trans_Pool(void);
+//Whether the transmission pool has been set up.
+static inline bool trans_pool_ready(void);
+//Frees every buffer in the transmission pool.
+static void clear_Trans_Pool(void);
+
+//Devices open, which share Winsock and the transmission pool. Guarded by network_lock.
+static unsigned int network_users = 0;
+//Set while a device being opened or closed changes network_users, so Winsock is started and cleaned up once.
+static volatile unsigned __int32 network_lock = 0;
+//Starts Winsock and sets up the transmission pool for the first device opened. Returns NETWORK_INIT_ERROR if Winsock can't be started.
+static int join_Network(void);
+//Frees the transmission pool and cleans up Winsock once the last device opened is closed.
+static void leave_Network(void);
+
+//Called by the wheel once the last response may be CHECK_CONNECTION_FREQ seconds old. Sends keep-alive command to
+//maintain connection if it is and no command is waiting for a response, and moves the timer on to the next check.
+static void keep_alive_due(Timer* pTimer, void* pContext);
 //Resets last response time. Meant to be called when a response is receieved.
-static void reset_Timer(void);
+static void reset_Timer(DCS_Device* pDevice);
+//Called by the wheel at the earliest request deadline. Times out the requests that are due.
+static void request_deadline_due(Timer* pTimer, void* pContext);
+//Arms the request deadline timer for the earliest deadline of the device's unresolved requests, or disarms it if there are none.
+static void arm_Request_Deadline(DCS_Device* pDevice);
+//Has the event loop give the device a pass once the timers firing now are done. Called by the device's timers.
+static inline void pass_Due(DCS_Device* pDevice);
 
 int Initialize_COM_Task(DCS_Address address, Receive_Callbacks local_callbacks, bool local_should_store) {
-	//Set the callback functions for receiving data whether the COM task exists or not.
-	//If the callbacks mutex isn't NULL, the COM task is already running so use the thread-safe callback setter.
-	if (hCallbacksMutex != NULL) {
-		set_Callbacks(local_callbacks, local_should_store);
-	}
-	//Otherwise, the thread-safe callback setter cannot be used and it's safe to set it directly.
-	else {
-		callbacks = local_callbacks;
-		should_store = local_should_store;
+	DCS_Device* pDevice = &default_device;
+
+	//Set the callback functions for receiving data whether the device is open or not.
+	const DCS_Callbacks no_handlers = { 0 };
+	int iResult = set_Callbacks(pDevice, local_callbacks, no_handlers, NULL, local_should_store);
+	if (iResult != NO_DCS_ERROR) {
+		return iResult;
 	}
 
-	//Return if a COM task already exists.
-	if (threadHandle != NULL || hRunMutex != NULL) {
+	//Return if the device is already open.
+	if (pDevice->pLoop != NULL) {
 		return THREAD_ALREADY_EXISTS;
 	}
 
-	WSADATA wsaData;
+	return open_Device(pDevice, address);
+}
+
+int DCS_Open(DCS_Address address, DCS_Callbacks callbacks, void* pContext, bool should_store, DCS_Handle* pHandle) {
+	if (pHandle == NULL) {
+		return FRAME_INVALID_DATA;
+	}
+	*pHandle = NULL;
+
+	DCS_Device* pDevice = calloc(1, sizeof(*pDevice));
+	if (pDevice == NULL) {
+		return MEMORY_ALLOCATION_ERROR;
+	}
+
+	int iResult = set_Callbacks(pDevice, Null_Receive_Callbacks(), callbacks, pContext, should_store);
+	if (iResult == NO_DCS_ERROR) {
+		iResult = open_Device(pDevice, address);
+	}
+	if (iResult != NO_DCS_ERROR) {
+		free_Callbacks(pDevice);
+		free(pDevice);
+		return iResult;
+	}
+
+	*pHandle = pDevice;
+	return NO_DCS_ERROR;
+}
+
+int DCS_Set_Callbacks(DCS_Handle hDevice, DCS_Callbacks callbacks, void* pContext, bool should_store) {
+	if (hDevice == NULL) {
+		return FRAME_INVALID_DATA;
+	}
+
+	return set_Callbacks(hDevice, Null_Receive_Callbacks(), callbacks, pContext, should_store);
+}
+
+int DCS_Close(DCS_Handle hDevice) {
+	//The default device is closed with Destroy_COM_Task and isn't allocated.
+	if (hDevice == NULL || hDevice == &default_device) {
+		return FRAME_INVALID_DATA;
+	}
+
+	close_Device(hDevice);
+	free(hDevice);
+
+	return NO_DCS_ERROR;
+}
+
+int DCS_Set_Event_Loops(unsigned int loops) {
+	return Event_Loop_Set_Count(loops);
+}
+
+static int open_Device(DCS_Device* pDevice, DCS_Address address) {
 	SOCKET ConnectSocket = INVALID_SOCKET;
 	struct addrinfo* result = NULL,
 		* ptr = NULL,
 		hints;
-	int iResult;
+	//Address connected to, kept so a lost connection can be made again without resolving it.
+	struct sockaddr_storage connected;
+	int connected_length = 0;
 
 	//Initialize Winsock
-	iResult = WSAStartup(MAKEWORD(2, 2), &wsaData);
-	if (iResult != 0) {
-		printf("WSAStartup failed with error: %d\n", iResult);
-		return NETWORK_INIT_ERROR;
+	int iResult = join_Network();
+	if (iResult != NO_DCS_ERROR) {
+		return iResult;
 	}
 
 	ZeroMemory(&hints, sizeof(hints));
@@ -130,7 +368,7 @@ int Initialize_COM_Task(DCS_Address address, Receive_Callbacks local_callbacks,
 	iResult = getaddrinfo(address.address, address.port, &hints, &result);
 	if (iResult != 0) {
 		printf("getaddrinfo failed with error: %d\n", iResult);
-		WSACleanup();
+		leave_Network();
 		return NETWORK_INIT_ERROR;
 	}
 
@@ -140,7 +378,8 @@ int Initialize_COM_Task(DCS_Address address, Receive_Callbacks local_callbacks,
 		ConnectSocket = socket(ptr->ai_family, ptr->ai_socktype, ptr->ai_protocol);
 		if (ConnectSocket == INVALID_SOCKET) {
 			printf("Socket failed with error: %d\n", WSAGetLastError());
-			WSACleanup();
+			freeaddrinfo(result);
+			leave_Network();
 			return NETWORK_INIT_ERROR;
 		}
 
@@ -153,6 +392,8 @@ int Initialize_COM_Task(DCS_Address address, Receive_Callbacks local_callbacks,
 			continue;
 		}
 		//printf("connected to server\n");
+		memcpy(&connected, ptr->ai_addr, ptr->ai_addrlen);
+		connected_length = (int)ptr->ai_addrlen;
 		break;
 	}
 
@@ -160,180 +401,424 @@ int Initialize_COM_Task(DCS_Address address, Receive_Callbacks local_callbacks,
 
 	if (ConnectSocket == INVALID_SOCKET) {
 		printf("Unable to connect to server!\n");
-		WSACleanup();
+		leave_Network();
 		return NETWORK_INIT_ERROR;
 	}
 
-	//Check_Command_Response(COMMAND_RSP_RESET, 0);
-
-	//Make the socket non-blocking for convenience when receiving data in the COM thread.
-	u_long iMode = 1;
-	iResult = ioctlsocket(ConnectSocket, FIONBIO, &iMode);
+	//Make the socket non-blocking for convenience when receiving data in the event loop.
+	iResult = Socket_Set_Nonblocking(ConnectSocket);
 	if (iResult != NO_ERROR) {
-		printf("ioctlsocket failed with error: %ld\n", iResult);
-		WSACleanup();
+		printf("Making the socket non-blocking failed with error: %d\n", WSAGetLastError());
+		closesocket(ConnectSocket);
+		leave_Network();
 		return NETWORK_INIT_ERROR;
 	}
 
-	reset_Timer();
-	Check_Command_Response(reset, 0);
+	reset_Timer(pDevice);
+	reset_Commands(pDevice, address.command_window);
+	Session_Open(pDevice, &address, (struct sockaddr*)&connected, connected_length);
 
-	//Initialize a set mutex for stopping the thread later.
-	hRunMutex = CreateMutexW(NULL, true, NULL);
-	if (hRunMutex == NULL) {
-		return THREAD_START_ERROR;
+	//The FIFO is emptied rather than torn down when the device is closed, so it's only set up once.
+	if (pDevice->trans_queue.pCells == NULL) {
+		Queue_Init(&pDevice->trans_queue, pDevice->trans_queue_cells, TRANSMIT_QUEUE_SIZE);
 	}
+	pDevice->requested_transport = address.transport;
+	pDevice->watched = INVALID_SOCKET;
+
+	//Choose the integrity check for this connection's frames before the event loop starts using it.
+	//Frames only carry sequence IDs when more than one command can be in flight.
+	crc32c_init();
+	Set_Frame_Format(pDevice, address.frame_check, pDevice->command_window > 1);
 
-	iResult = init_FIFO_mutex();
+	iResult = init_FIFO_mutex(pDevice);
 	if (iResult != NO_DCS_ERROR) {
-		CloseHandle(hRunMutex);
-		hRunMutex = NULL;
+		closesocket(ConnectSocket);
+		leave_Network();
 		return iResult;
 	}
 
-	iResult = init_Callback_mutex();
+	iResult = init_Callback_mutex(pDevice);
 	if (iResult != NO_DCS_ERROR) {
-		CloseHandle(hRunMutex);
-		hRunMutex = NULL;
-		close_FIFO_mutex();
+		close_FIFO_mutex(pDevice);
+		closesocket(ConnectSocket);
+		leave_Network();
 		return iResult;
 	}
 
-	iResult = init_Recv_mutex();
+	iResult = init_Recv_mutex(pDevice);
 	if (iResult != NO_DCS_ERROR) {
-		CloseHandle(hRunMutex);
-		hRunMutex = NULL;
-		close_FIFO_mutex();
-		close_Callback_mutex();
+		close_FIFO_mutex(pDevice);
+		close_Callback_mutex(pDevice);
+		closesocket(ConnectSocket);
+		leave_Network();
 		return iResult;
 	}
 
-	//Start the COM task thread, calling the COM_Task function.
-	SOCKET* heapSock = malloc(sizeof(ConnectSocket));
-	if (heapSock == NULL) {
-		CloseHandle(hRunMutex);
-		hRunMutex = NULL;
-		close_FIFO_mutex();
-		close_Callback_mutex();
-		close_Recv_mutex();
-		return MEMORY_ALLOCATION_ERROR;
+	iResult = Request_Open(pDevice);
+	if (iResult != NO_DCS_ERROR) {
+		close_FIFO_mutex(pDevice);
+		close_Callback_mutex(pDevice);
+		close_Recv_mutex(pDevice);
+		closesocket(ConnectSocket);
+		leave_Network();
+		return iResult;
 	}
-	*heapSock = ConnectSocket;
 
-	threadHandle = (HANDLE)_beginthread(COM_Task, 0, (void*)heapSock);
-	if (threadHandle == NULL || PtrToLong(threadHandle) == -1L) {
-		CloseHandle(hRunMutex);
-		hRunMutex = NULL;
-		close_FIFO_mutex();
-		close_Callback_mutex();
-		close_Recv_mutex();
-		threadHandle = NULL;
-		return THREAD_START_ERROR;
+	iResult = User_Timer_Open(pDevice);
+	if (iResult != NO_DCS_ERROR) {
+		close_FIFO_mutex(pDevice);
+		close_Callback_mutex(pDevice);
+		close_Recv_mutex(pDevice);
+		Request_Close(pDevice);
+		closesocket(ConnectSocket);
+		leave_Network();
+		return iResult;
+	}
+
+	pDevice->store_closing = false;
+	//Until the DCS says otherwise, a measurement could send any of the types.
+	pDevice->stream_types = STREAM_TYPES;
+	pDevice->correlation_length = 0;
+
+	//The dispatch threads are started first so the event loop can hand them frames straight away.
+	iResult = Dispatch_Start(&pDevice->dispatch, address.dispatch_threads, address.dispatch_queue_size, address.dispatch_overflow, process_payload, pDevice);
+	if (iResult != NO_DCS_ERROR) {
+		close_FIFO_mutex(pDevice);
+		close_Callback_mutex(pDevice);
+		close_Recv_mutex(pDevice);
+		Request_Close(pDevice);
+		User_Timer_Close(pDevice);
+		closesocket(ConnectSocket);
+		leave_Network();
+		return iResult;
+	}
+
+	//The event loop owns the socket from here on, and closes it when the device leaves the loop.
+	pDevice->socket = ConnectSocket;
+	iResult = Event_Loop_Attach(pDevice);
+	if (iResult != NO_DCS_ERROR) {
+		pDevice->socket = INVALID_SOCKET;
+		Dispatch_Stop(&pDevice->dispatch);
+		close_FIFO_mutex(pDevice);
+		close_Callback_mutex(pDevice);
+		close_Recv_mutex(pDevice);
+		Request_Close(pDevice);
+		User_Timer_Close(pDevice);
+		closesocket(ConnectSocket);
+		leave_Network();
+		return iResult;
 	}
 
 	return NO_DCS_ERROR;
 }
 
 int Destroy_COM_Task() {
-	clear_Recv_FIFO();
+	close_Device(&default_device);
 
-	clear_Trans_FIFO();
+	return NO_DCS_ERROR;
+}
+
+DCS_Device* Default_Device(void) {
+	return &default_device;
+}
+
+DCS_Handle DCS_Default_Handle(void) {
+	return &default_device;
+}
+
+static void close_Device(DCS_Device* pDevice) {
+	//Release a dispatch thread waiting for room in the store, and drop the item the event loop may be holding.
+	set_Recv_mutex(pDevice);
+	pDevice->store_closing = true;
+	made_Store_Room(pDevice);
+	release_Recv_mutex(pDevice);
+
+	clear_Recv_FIFO(pDevice);
 
-	//If the COM task isn't already stopped, free all the task's resources.
-	if (hRunMutex != NULL) {
-		//Release the run mutex to stop the thread.
-		ReleaseMutex(hRunMutex);
+	clear_Trans_FIFO(pDevice);
 
-		//Wait for thread to close.
-		WaitForSingleObject(threadHandle, INFINITE);
+	//If the device is open, free all its resources.
+	if (pDevice->pLoop != NULL) {
+		//Requests still waiting for the DCS won't be answered now.
+		Request_Fail_All(pDevice, NETWORK_NOT_READY);
 
-		//Take back control of the run mutex so it can be closed.
-		WaitForSingleObject(hRunMutex, INFINITE);
-		CloseHandle(hRunMutex);
+		//Stop queueing frames past the dispatch queues' limits, then have the event loop drop the device.
+		Dispatch_Close(&pDevice->dispatch);
+		Event_Loop_Detach(pDevice);
 
-		//Close other mutexes.
-		close_FIFO_mutex();
-		close_Callback_mutex();
-		close_Recv_mutex();
+		//The dispatch threads still use the callbacks, the store, the decode buffers and the requests, so they're stopped before those go.
+		Dispatch_Stop(&pDevice->dispatch);
+		Request_Close(pDevice);
+		User_Timer_Close(pDevice);
 
-		//Deference threads to indicate they don't exist.
-		threadHandle = NULL;
-		hRunMutex = NULL;
+		//Items stored since the store was first cleared.
+		clear_Recv_FIFO(pDevice);
+		//Items still borrowed outlive the device.
+		orphan_Borrowed_Slots(pDevice);
+
+		//Close mutexes.
+		close_FIFO_mutex(pDevice);
+		close_Callback_mutex(pDevice);
+		close_Recv_mutex(pDevice);
+
+		Release_Decode_Buffers(pDevice);
+		Framer_Free(&pDevice->recv_framer);
+		clear_output(&pDevice->output_cursor);
+		clear_output(&pDevice->uring_sending);
+
+		//The event loop has closed the device's socket, and its frames are back in the pool.
+		leave_Network();
 	}
 
-	return NO_DCS_ERROR;
+	//No thread is left calling through the callback sets.
+	free_Callbacks(pDevice);
 }
 
-static int send_data(SOCKET ConnectSocket, Transmission_Data_Type* data_to_send) {
-	//Allocate more memory in preparation for prepending frame size (excluding itself) to the frame.
-	char* tmp = realloc(data_to_send->pFrame, data_to_send->size + sizeof(data_to_send->size));
-	if (tmp == NULL) {
-		free(data_to_send->pFrame);
-		free(data_to_send);
-		return MEMORY_ALLOCATION_ERROR;
+static void take_commands(DCS_Device* pDevice, Output_Cursor* pCursor) {
+	//Frames queued from now on wake the event loop again, so none are left waiting for another reason to run a pass.
+	Atomic_Exchange(&pDevice->trans_wake_pending, 0);
+
+	//Commands are taken until the window of commands waiting for an acknowledgement is full. Commands being sent again
+	//after reconnecting go ahead of the ones queued.
+	while (pDevice->commands_pending < pDevice->command_window) {
+		Transmission_Data_Type* data_to_send = pDevice->replay.pHead;
+		if (data_to_send != NULL) {
+			pDevice->replay.pHead = data_to_send->pNextItem;
+			if (pDevice->replay.pHead == NULL) {
+				pDevice->replay.pTail = NULL;
+			}
+		}
+		else {
+			data_to_send = Dequeue_Trans_FIFO(pDevice);
+		}
+		if (data_to_send == NULL) {
+			break;
+		}
+
+		start_Command(pDevice, data_to_send);
+		queue_output(pCursor, data_to_send);
+	}
+}
+
+static void queue_output(Output_Cursor* pCursor, Transmission_Data_Type* pTransmission) {
+	pTransmission->pNextItem = NULL;
+	if (pCursor->pHead == NULL) {
+		pCursor->pHead = pTransmission;
+		pCursor->sent = 0;
+	}
+	else {
+		pCursor->pTail->pNextItem = pTransmission;
+	}
+	pCursor->pTail = pTransmission;
+}
+
+static void clear_output(Output_Cursor* pCursor) {
+	Transmission_Data_Type* item = pCursor->pHead;
+	while (item != NULL) {
+		Transmission_Data_Type* tmp_item = item;
+		item = item->pNextItem;
+
+		drop_Frame(tmp_item);
+	}
+	pCursor->pHead = NULL;
+	pCursor->pTail = NULL;
+	pCursor->sent = 0;
+}
+
+static void drop_Frame(Transmission_Data_Type* pTransmission) {
+	if (pTransmission->shared) {
+		pTransmission->shared = false;
+		return;
 	}
 
-	data_to_send->pFrame = tmp;
+	Free_Transmission(pTransmission);
+}
+
+static int send_data(DCS_Device* pDevice, Output_Cursor* pCursor) {
+	Send_Buffer buffers[SEND_BATCH_MAX];
+	unsigned __int32 buffer_count = 0;
+	unsigned __int32 offset = pCursor->sent;
+	unsigned __int32 total_size = 0;
 
-	//Shift pFrame sizeof(data_to_send->size) bytes to give space for the prepended frame size.
-	memmove(&data_to_send->pFrame[sizeof(data_to_send->size)], data_to_send->pFrame, data_to_send->size);
+	//Frames were built with their size already prepended, so each one is a single buffer.
+	//The first one starts wherever a previous call stopped writing it.
+	for (Transmission_Data_Type* item = pCursor->pHead; item != NULL && buffer_count < SEND_BATCH_MAX; item = item->pNextItem) {
+		const unsigned __int32 length = item->size + sizeof(item->size) - offset;
+		Send_Buffer_Set(&buffers[buffer_count], &item->pFrame[offset], length);
+		total_size += length;
 
-#pragma warning (disable: 6386)
-	//Write prepended data_to_send->size on the packet.
-	memcpy(data_to_send->pFrame, &data_to_send->size, sizeof(data_to_send->size));
-#pragma warning (default: 6386)
+		hexDump("Data packet", &item->pFrame[offset], length);
 
-	hexDump("Data packet", data_to_send->pFrame, data_to_send->size + sizeof(data_to_send->size));
+		buffer_count++;
+		offset = 0;
+	}
+	if (buffer_count == 0) {
+		return 0;
+	}
 
-	//Send the data over the socket. data_to_send->size was not modified when prepending the frame size so it is added here.
-	int iResult = send(ConnectSocket, data_to_send->pFrame, data_to_send->size + sizeof(data_to_send->size), 0);
+	int iResult = Socket_Send(pDevice->socket, buffers, buffer_count);
+	add_Transport_Stats(pDevice, 1, 0, 0, iResult == SOCKET_ERROR ? 0 : (unsigned __int32)iResult);
 	if (iResult == SOCKET_ERROR) {
+		//The socket buffer being full isn't an error. What's left is written on a later pass.
+		if (WSAGetLastError() == WSAEWOULDBLOCK) {
+			return 0;
+		}
+
 		//printf("send failed with error: %d\n", WSAGetLastError());
-		closesocket(ConnectSocket);
-		WSACleanup();
+		return iResult;
 	}
-	free(data_to_send->pFrame);
-	free(data_to_send);
 
-	//printf("Bytes Sent: %d\n", iResult);
+	//Release the frames that were completely written and keep the position in a partly written one.
+	const unsigned __int32 bytes_sent = (unsigned __int32)iResult;
+	unsigned __int32 frames_sent = 0;
+	unsigned __int32 remaining = bytes_sent;
+	while (pCursor->pHead != NULL) {
+		Transmission_Data_Type* item = pCursor->pHead;
+		const unsigned __int32 unsent = item->size + sizeof(item->size) - pCursor->sent;
+		if (remaining < unsent) {
+			pCursor->sent += remaining;
+			break;
+		}
 
-	return iResult;
+		remaining -= unsent;
+		pCursor->sent = 0;
+		pCursor->pHead = item->pNextItem;
+		drop_Frame(item);
+		frames_sent++;
+	}
+	if (pCursor->pHead == NULL) {
+		pCursor->pTail = NULL;
+	}
+
+	set_FIFO_mutex(pDevice);
+	pDevice->send_stats.send_calls++;
+	pDevice->send_stats.frames_sent += frames_sent;
+	if (buffer_count > 1) {
+		pDevice->send_stats.frames_coalesced += frames_sent;
+	}
+	if (bytes_sent < total_size) {
+		pDevice->send_stats.partial_writes++;
+	}
+	if (buffer_count > pDevice->send_stats.max_batch) {
+		pDevice->send_stats.max_batch = buffer_count;
+	}
+	release_FIFO_mutex(pDevice);
+
+	//printf("Bytes Sent: %d\n", bytes_sent);
+
+	return (int)bytes_sent;
+}
+
+int DCS_Get_Send_Stats(DCS_Handle hDevice, Send_Stats* pStats) {
+	if (hDevice == NULL || pStats == NULL) {
+		return FRAME_INVALID_DATA;
+	}
+	if (hDevice->hFIFOMutex == NULL) {
+		return NETWORK_NOT_READY;
+	}
+
+	set_FIFO_mutex(hDevice);
+	*pStats = hDevice->send_stats;
+	release_FIFO_mutex(hDevice);
+
+	return NO_DCS_ERROR;
+}
+
+int Get_Send_Stats(Send_Stats* pStats) {
+	return DCS_Get_Send_Stats(&default_device, pStats);
+}
+
+int DCS_Get_Transport_Stats(DCS_Handle hDevice, Transport_Stats* pStats) {
+	if (hDevice == NULL || pStats == NULL) {
+		return FRAME_INVALID_DATA;
+	}
+	if (hDevice->hFIFOMutex == NULL) {
+		return NETWORK_NOT_READY;
+	}
+
+	set_FIFO_mutex(hDevice);
+	*pStats = hDevice->transport_stats;
+	release_FIFO_mutex(hDevice);
+
+	return NO_DCS_ERROR;
+}
+
+int Get_Transport_Stats(Transport_Stats* pStats) {
+	return DCS_Get_Transport_Stats(&default_device, pStats);
+}
+
+int DCS_Get_Dispatch_Stats(DCS_Handle hDevice, Dispatch_Stats* pStats) {
+	if (hDevice == NULL || pStats == NULL) {
+		return FRAME_INVALID_DATA;
+	}
+	if (hDevice->hFIFOMutex == NULL) {
+		return NETWORK_NOT_READY;
+	}
+
+	Dispatch_Get_Stats(&hDevice->dispatch, pStats);
+
+	return NO_DCS_ERROR;
+}
+
+int Get_Dispatch_Stats(Dispatch_Stats* pStats) {
+	return DCS_Get_Dispatch_Stats(&default_device, pStats);
+}
+
+static void add_Transport_Stats(DCS_Device* pDevice, unsigned __int32 syscalls, unsigned __int32 frames_received, unsigned __int64 bytes_received, unsigned __int64 bytes_sent) {
+	set_FIFO_mutex(pDevice);
+	pDevice->transport_stats.syscalls += syscalls;
+	pDevice->transport_stats.frames_received += frames_received;
+	pDevice->transport_stats.bytes_received += bytes_received;
+	pDevice->transport_stats.bytes_sent += bytes_sent;
+	release_FIFO_mutex(pDevice);
 }
 
-static int recv_data(SOCKET ConnectSocket) {
+static int recv_data(DCS_Device* pDevice) {
 	int iResult = 0;
-	char socket_buffer[1024];
-	char* frame_data = NULL;
-	unsigned int frame_data_size = 0;
+	int frameResult = NO_DCS_ERROR;
+	unsigned __int32 recv_calls = 0;
+	unsigned __int32 frames_received = 0;
+	unsigned __int64 bytes_received = 0;
 
 	//Receives data waiting in buffer. Continues if no data available as socket is non-blocking.
 	do {
-		iResult = recv(ConnectSocket, socket_buffer, sizeof(socket_buffer), 0);
+		//Data is received straight into the framer after any partial frame left from the last read.
+		unsigned __int32 available;
+		char* pRecv = Framer_Reserve(&pDevice->recv_framer, &available);
+		if (pRecv == NULL) {
+			return 1;
+		}
+
+		unsigned __int64 timestamp;
+		iResult = Socket_Recv(pDevice->socket, pRecv, (int)available, &timestamp);
+		recv_calls++;
 		if (iResult > 0) {
-			//Data is available. Write it to the frame_data buffer.
-			frame_data_size += iResult;
+			//Reads that drain the same packet carry the same kernel timestamp, which moving onto Clock_Now_Ns can
+			//leave a few nanoseconds apart, so the timestamps are kept from going backwards.
+			if (timestamp < pDevice->recv_timestamp) {
+				timestamp = pDevice->recv_timestamp;
+			}
+			pDevice->recv_timestamp = timestamp;
 
-			char* tmp = realloc(frame_data, frame_data_size);
-			if (tmp == NULL) {
-				free(frame_data);
+			hexDump("recv", pRecv, iResult);
+			reset_Timer(pDevice);
+			Framer_Commit(&pDevice->recv_framer, iResult);
+			bytes_received += iResult;
 
-				closesocket(ConnectSocket);
-				WSACleanup();
+			//Data is available. Verify and process each frame that's now complete.
+			if (!process_frames(pDevice, &pDevice->recv_framer, timestamp, &frameResult, &frames_received)) {
 				return 1;
 			}
 
-			frame_data = tmp;
-
-			memcpy(&frame_data[frame_data_size - iResult], socket_buffer, iResult);
+			//The rest is left in the socket until there's room for it, so TCP flow control slows the DCS down.
+			if (pDevice->reads_held) {
+				iResult = 0;
+				break;
+			}
 		}
 		else if (iResult == 0) {
-			//Should never occur due to non-blocking socket.
-
-			//printf("Connection closed\n");
-			closesocket(ConnectSocket);
-			WSACleanup();
-
-			free(frame_data);
+			//The DCS closed the connection. No error is left set, so it's reported as closed rather than as a failed read.
+			WSASetLastError(0);
 			return 1;
 		}
 		else if (iResult < 0) {
@@ -345,239 +830,763 @@ static int recv_data(SOCKET ConnectSocket) {
 			}
 			else {
 				//printf("recv failed with error: %d\n", err);
-				closesocket(ConnectSocket);
-				WSACleanup();
-
-				free(frame_data);
 				return 1;
 			}
 		}
 	} while (iResult > 0);
 
-	if (frame_data_size > 0) {
-		hexDump("recv", frame_data, frame_data_size);
-		reset_Timer();
+	add_Transport_Stats(pDevice, recv_calls, frames_received, bytes_received, 0);
+
+	if (frameResult != NO_DCS_ERROR) {
+		return frameResult;
 	}
+	return iResult;
+}
 
-	//Loop over each frame that's available as multiple may have been received at once.
-	for (unsigned __int32 totLen = 0; totLen < frame_data_size;) {
-		//Strip off 32 bit integer size from beginning of frame to make well-defined DCS frame `buff`
-		unsigned __int32 frameLen;
-		memcpy(&frameLen, &frame_data[totLen], sizeof(frameLen));
+static bool process_frames(DCS_Device* pDevice, Framer* pFramer, unsigned __int64 timestamp, int* pFrameResult, unsigned __int32* pFrameCount) {
+	char* pFrame;
+	unsigned __int32 frame_size;
+	int status = FRAMER_NEED_MORE;
 
-		//Find pointer of received data and process it in process_recv.
-		char* buff = &frame_data[sizeof(frameLen) + totLen];
-		int tmpiResult = process_recv(buff, frameLen);
-		if (tmpiResult != NO_DCS_ERROR) {
-			iResult = tmpiResult;
-		}
+	//Frames are verified and processed where they were received.
+	while (!pDevice->reads_held && (status = Framer_Next(pFramer, &pFrame, &frame_size)) == FRAMER_FRAME) {
+		(*pFrameCount)++;
 
-		totLen += sizeof(frameLen) + frameLen;
-		//printf("%d", iResult);
+		int tmpResult = FRAME_CHECKSUM_ERROR;
+		if (check_frame(pFrame, frame_size)) {
+			tmpResult = process_recv(pDevice, pFrame, frame_size, timestamp);
+		}
+		if (tmpResult != NO_DCS_ERROR) {
+			*pFrameResult = tmpResult;
+		}
 	}
-	free(frame_data);
 
-	return iResult;
+	//A frame size that can't be valid means the frame boundaries are lost.
+	return status != FRAMER_BAD_SIZE;
 }
 
-//Function run by the COM task thread. Initiates connection to the DCS
-//and then continuously sends and receives data until Destroy_COM_Task is called.
-static void COM_Task(void* socket_ptr) {
-	SOCKET ConnectSocket = *(SOCKET*)socket_ptr;
-	free(socket_ptr);
-
-	int iResult = 0;
+static bool resume_Reads(DCS_Device* pDevice) {
+	set_Recv_mutex(pDevice);
+	const bool store_full = pDevice->pHeldItem != NULL;
+	release_Recv_mutex(pDevice);
+	if (store_full || Dispatch_Holding(&pDevice->dispatch)) {
+		return true;
+	}
 
-	//Repeat while RunMutex is still taken by the main thread. Clean up and exit when it's released.
-	while (WaitForSingleObject(hRunMutex, 50) == WAIT_TIMEOUT) {
-		int commandResp = Check_Command_Response(check, 0);
-		if (commandResp == 2) {
-			char message[] = "Error (0000): Command response timed out";
-			Get_Error_Message_CB(message, (unsigned int)strlen(message));
+	pDevice->reads_held = false;
+	int frameResult = NO_DCS_ERROR;
+	unsigned __int32 frames_received = 0;
+	const bool framed = process_frames(pDevice, &pDevice->recv_framer, pDevice->recv_timestamp, &frameResult, &frames_received);
+	add_Transport_Stats(pDevice, 0, frames_received, 0, 0);
 
-			_endthread();
-			return;
-		}
-		else if(commandResp == 0) {
-			check_Timer();
-
-			//If data is waiting in the queue, send it, one at a time.
-			Transmission_Data_Type* data_to_send = Dequeue_Trans_FIFO();
-			if (data_to_send != NULL) {
-				Check_Command_Response(set, data_to_send->command_code);
-
-				iResult = send_data(ConnectSocket, data_to_send);
-				if (iResult < 0) {
-					char message[50];
-					//printf(ANSI_COLOR_RED"Sending Error\n"ANSI_COLOR_RESET);
-
-					int errorCode = WSAGetLastError();
-					if (errorCode == 0) {
-						_snprintf_s(message, sizeof(message), _TRUNCATE, "Error (0000): Connection closed");
-					}
-					else {
-						_snprintf_s(message, sizeof(message), _TRUNCATE, "Error (0000): send failed with error %d", errorCode);
-					}
-					Get_Error_Message_CB(message, (unsigned int)strlen(message));
-
-					_endthread();
-					return;
-				}
-			}
-		}
+	//Edge-triggered polling only reports data that arrives from now on, so what arrived while reads were held is read straight away.
+	pDevice->ready = true;
+	return framed;
+}
 
-		//Received and process data from the DCS.
-		iResult = recv_data(ConnectSocket);
+bool Device_Loop_Start(DCS_Device* pDevice, Poller* pPoller, Timer_Wheel* pWheel) {
+	pDevice->pPoller = pPoller;
+	if (!watch_Connection(pDevice)) {
+		report_COM_error(pDevice, "Error (0000): Watching the socket failed");
+		return false;
+	}
 
-		if (iResult > 0) {
-			//printf(ANSI_COLOR_RED"Fatal Receive Error\n"ANSI_COLOR_RESET);
+	//Command deadlines were set up with the command records, and are armed as each command is sent.
+	pDevice->pWheel = pWheel;
+	pDevice->command_timed_out = false;
+	pDevice->reads_held = false;
+	Timer_Init(&pDevice->keep_alive, keep_alive_due, pDevice);
+	Timer_Schedule(pWheel, &pDevice->keep_alive, pDevice->last_response + CHECK_CONNECTION_FREQ * CLOCK_NS_PER_SEC);
+	Timer_Init(&pDevice->request_deadline, request_deadline_due, pDevice);
+	Timer_Init(&pDevice->session.retry, reconnect_due, pDevice);
 
-			char message[50];
+	return true;
+}
 
-			int errorCode = WSAGetLastError();
-			if (errorCode == 0) {
-				_snprintf_s(message, sizeof(message), _TRUNCATE, "Error (0000): Connection closed");
-			}
-			else {
-				_snprintf_s(message, sizeof(message), _TRUNCATE, "Error (0000): recv failed with error %d", WSAGetLastError());
-			}
-			Get_Error_Message_CB(message, (unsigned int) strlen(message));
+static bool watch_Connection(DCS_Device* pDevice) {
+	DCS_Transport transport = DCS_TRANSPORT_SOCKET;
 
-			_endthread();
-			return;
+	//Anything that stops io_uring being used leaves the socket to be watched as it would have been.
+	if (pDevice->requested_transport == DCS_TRANSPORT_IO_URING) {
+		pDevice->pUring = Uring_Create(pDevice->socket);
+		if (pDevice->pUring != NULL && Poller_Add(pDevice->pPoller, (SOCKET)Uring_Fd(pDevice->pUring), POLLER_READ_WRITE, pDevice) != NO_ERROR) {
+			close_Uring_transport(pDevice);
 		}
+		if (pDevice->pUring != NULL) {
+			pDevice->watched = (SOCKET)Uring_Fd(pDevice->pUring);
+			transport = DCS_TRANSPORT_IO_URING;
+		}
+	}
 
-		//Check_Command_Response(COMMAND_RSP_CHECK, 0);
+	//Data read straight from the socket is timestamped by the kernel where it can be, and otherwise as it's read.
+	bool kernel_timestamps = false;
+	if (pDevice->pUring == NULL) {
+		if (Poller_Add(pDevice->pPoller, pDevice->socket, POLLER_READ_WRITE, pDevice) != NO_ERROR) {
+			return false;
+		}
+		pDevice->watched = pDevice->socket;
+		kernel_timestamps = Socket_Enable_Timestamps(pDevice->socket) == NO_ERROR;
 	}
 
-	//Cleanup
-	closesocket(ConnectSocket);
-	WSACleanup();
+	set_FIFO_mutex(pDevice);
+	pDevice->transport_stats.transport = transport;
+	pDevice->transport_stats.kernel_timestamps = kernel_timestamps;
+	release_FIFO_mutex(pDevice);
 
-	ReleaseMutex(hRunMutex);
-	_endthread();
+	return true;
 }
 
-int Check_Command_Response(Command_Option Option, Data_ID Command_Code) {
-	static int Command_Rsp_Count = MAX_COMMAND_RESPONSE_TIME;
-	static Data_ID Command_Sent;
-	static bool Command_Ack = true;
+static void close_Connection(DCS_Device* pDevice) {
+	//The ring and socket have to be unwatched before they're closed, and the ring closed before the socket.
+	if (pDevice->watched != INVALID_SOCKET) {
+		Poller_Remove(pDevice->pPoller, pDevice->watched);
+		pDevice->watched = INVALID_SOCKET;
+	}
+	close_Uring_transport(pDevice);
 
-	switch (Option) {
-		case reset:
-			Command_Rsp_Count = MAX_COMMAND_RESPONSE_TIME;
-			Command_Ack = true;
-			return 0;
-		case set:
-			Command_Ack = false;
-			Command_Sent = Command_Code;
-			return 0;
-		case check:
-			if (Command_Ack) {
-				return 0;
-			}
-			if (Command_Rsp_Count > 0) {
-				Command_Rsp_Count--;
-				return 1;
-			}
-			return 2;
-		case validate:
-			if (Command_Code == Command_Sent) {
-				return Check_Command_Response(reset, Command_Code);
-			}
-			return 1;
+	if (pDevice->socket != INVALID_SOCKET) {
+		closesocket(pDevice->socket);
+		pDevice->socket = INVALID_SOCKET;
 	}
-	return 0;
 }
 
-int Enqueue_Trans_FIFO(Transmission_Data_Type* pTransmission) {
-	pTransmission->pNextItem = NULL;
+static void close_Uring_transport(DCS_Device* pDevice) {
+	if (pDevice->pUring != NULL) {
+		Uring_Destroy(pDevice->pUring);
+		pDevice->pUring = NULL;
+	}
+}
 
-	set_FIFO_mutex();
+static int uring_recv_data(DCS_Device* pDevice) {
+	int frameResult = NO_DCS_ERROR;
+	unsigned __int32 frames_received = 0;
+	unsigned __int64 bytes_received = 0;
+	unsigned __int64 bytes_sent = 0;
+	unsigned __int32 frames_sent = 0;
+	//errno value of the fatal error, 0 if the connection was closed and -1 if there isn't one.
+	int error = -1;
+
+	Uring_Completion completion;
+	//Completions are left in the ring while reads are held, and once its buffers run out the kernel stops receiving.
+	while (error < 0 && !pDevice->reads_held && Uring_Next(pDevice->pUring, &completion)) {
+		if (completion.type == URING_RECEIVED) {
+			//A multishot receive can't carry the kernel's timestamps, so the data is stamped as its completion is taken.
+			const unsigned __int64 timestamp = Clock_Now_Ns();
+			pDevice->recv_timestamp = timestamp;
+			hexDump("recv", completion.pData, completion.size);
+			reset_Timer(pDevice);
+			bytes_received += completion.size;
+
+			//The data is copied out so frames split across buffers are put back together and the buffer goes straight back to the kernel.
+			//If a frame holds reads, the rest of the buffer still goes into the framer to wait with the frames after it.
+			unsigned __int32 copied = 0;
+			while (copied < completion.size) {
+				unsigned __int32 available;
+				char* pRecv = Framer_Reserve(&pDevice->recv_framer, &available);
+				if (pRecv == NULL) {
+					error = ENOMEM;
+					break;
+				}
+
+				const unsigned __int32 length = completion.size - copied < available ? completion.size - copied : available;
+				memcpy(pRecv, &completion.pData[copied], length);
+				Framer_Commit(&pDevice->recv_framer, length);
+				copied += length;
+
+				if (!process_frames(pDevice, &pDevice->recv_framer, timestamp, &frameResult, &frames_received)) {
+					error = EPROTO;
+					break;
+				}
+			}
+		}
+		else if (completion.type == URING_SENT) {
+			//Sends are linked, so they finish in the order they were queued.
+			Transmission_Data_Type* item = pDevice->uring_sending.pHead;
+			pDevice->uring_sending.pHead = item->pNextItem;
+			if (pDevice->uring_sending.pHead == NULL) {
+				pDevice->uring_sending.pTail = NULL;
+			}
+			drop_Frame(item);
 
-	//If FIFO is empty, this element is both the head and tail.
-	if (pTrans_FIFO_Head == NULL) {
-		pTrans_FIFO_Head = pTransmission;
-		pTrans_FIFO_Tail = pTransmission;
+			bytes_sent += completion.size;
+			frames_sent++;
+		}
+		else if (completion.type == URING_CLOSED) {
+			error = 0;
+		}
+		else {
+			error = completion.error;
+		}
 	}
-	//Otherwise, add to the end of FIFO.
-	else {
-		pTrans_FIFO_Tail->pNextItem = pTransmission;
-		pTrans_FIFO_Tail = pTransmission;
+
+	add_Transport_Stats(pDevice, 0, frames_received, bytes_received, bytes_sent);
+	if (frames_sent > 0) {
+		set_FIFO_mutex(pDevice);
+		pDevice->send_stats.frames_sent += frames_sent;
+		release_FIFO_mutex(pDevice);
 	}
 
-	release_FIFO_mutex();
+	if (error >= 0) {
+		errno = error;
+		return 1;
+	}
 
-	return NO_DCS_ERROR;
+	return frameResult;
 }
 
-static Transmission_Data_Type* Dequeue_Trans_FIFO() {
-	set_FIFO_mutex();
+static int uring_send_data(DCS_Device* pDevice, Output_Cursor* pCursor) {
+	unsigned __int32 chain_length = 0;
+	unsigned __int32 chain_size = 0;
+
+	//Frames taken while a chain is still sending wait for it to finish, so one chain can't overtake another.
+	if (Uring_Can_Send(pDevice->pUring)) {
+		while (pCursor->pHead != NULL) {
+			Transmission_Data_Type* item = pCursor->pHead;
+			const unsigned __int32 length = item->size + sizeof(item->size);
+			if (!Uring_Queue_Send(pDevice->pUring, item->pFrame, length, item)) {
+				break;
+			}
 
-	Transmission_Data_Type* pTransmission = pTrans_FIFO_Head;
+			hexDump("Data packet", item->pFrame, length);
 
-	//If the original FIFO head isn't null, shift the queue.
-	if (pTransmission != NULL) {
-		pTrans_FIFO_Head = pTrans_FIFO_Head->pNextItem;
+			pCursor->pHead = item->pNextItem;
+			queue_output(&pDevice->uring_sending, item);
+			chain_length++;
+			chain_size += length;
+		}
+		if (pCursor->pHead == NULL) {
+			pCursor->pTail = NULL;
+		}
 	}
 
-	//If the new FIFO head is null, the queue is empty.
-	if (pTrans_FIFO_Head == NULL) {
-		pTrans_FIFO_Tail = NULL;
+	//Also restarts the receive if it stopped, so this runs every pass.
+	const int syscalls = Uring_Submit(pDevice->pUring);
+	if (syscalls == SOCKET_ERROR) {
+		return SOCKET_ERROR;
 	}
 
-	release_FIFO_mutex();
+	set_FIFO_mutex(pDevice);
+	pDevice->transport_stats.syscalls += syscalls;
+	if (chain_length > 0) {
+		pDevice->send_stats.send_calls++;
+		if (chain_length > 1) {
+			pDevice->send_stats.frames_coalesced += chain_length;
+		}
+		if (chain_length > pDevice->send_stats.max_batch) {
+			pDevice->send_stats.max_batch = chain_length;
+		}
+	}
+	release_FIFO_mutex(pDevice);
 
-	return pTransmission;
+	return (int)chain_size;
 }
 
-static int init_FIFO_mutex() {
-	if (hFIFOMutex != NULL) {
-		return THREAD_ALREADY_EXISTS;
+//Pass run for the device by its event loop whenever the loop wakes up, which it does as soon as there's
+//something to do rather than on a fixed period.
+bool Device_Loop_Pass(DCS_Device* pDevice) {
+	int iResult = 0;
+
+	//While the connection is being made again, passes wait for the attempt to finish and keep the timers and requests going.
+	if (pDevice->session.state != LINK_CONNECTED && !finish_Connect(pDevice)) {
+		User_Timer_Take(pDevice);
+		arm_Request_Deadline(pDevice);
+		return true;
 	}
 
-	hFIFOMutex = CreateMutexW(NULL, false, NULL);
-	if (hFIFOMutex == NULL) {
-		return THREAD_START_ERROR;
+	//Frames held back for lack of room go first once there is some.
+	if (pDevice->reads_held && !resume_Reads(pDevice)) {
+		iResult = 1;
 	}
-	return NO_DCS_ERROR;
-}
 
-static int close_FIFO_mutex() {
-	if (hFIFOMutex == NULL) {
-		return NO_DCS_ERROR;
+	//Received and process data from the DCS first, so commands its acknowledgements make room for go out in this pass.
+	//The socket is only read when the poller found activity on it. io_uring's completions are checked every pass.
+	//Neither is read while reads are held, and the activity found meanwhile is caught up on when they resume.
+	if (pDevice->reads_held) {
+		pDevice->ready = false;
+	}
+	else if (iResult == 0 && (pDevice->pUring != NULL || pDevice->ready)) {
+		pDevice->ready = false;
+		iResult = pDevice->pUring != NULL ? uring_recv_data(pDevice) : recv_data(pDevice);
 	}
 
-	int result = CloseHandle(hFIFOMutex);
+	if (iResult > 0) {
+		//printf(ANSI_COLOR_RED"Fatal Receive Error\n"ANSI_COLOR_RESET);
 
-	hFIFOMutex = NULL;
+		char message[50];
 
-	return result;
-}
+		int errorCode = WSAGetLastError();
+		if (errorCode == 0) {
+			_snprintf_s(message, sizeof(message), _TRUNCATE, "Error (0000): Connection closed");
+		}
+		else {
+			_snprintf_s(message, sizeof(message), _TRUNCATE, "Error (0000): recv failed with error %d", WSAGetLastError());
+		}
+		report_COM_error(pDevice, message);
+		return lose_Connection(pDevice);
+	}
 
-static inline void set_FIFO_mutex() {
-	if (hFIFOMutex == NULL) {
+	//Deadlines are kept by the event loop's timer wheel, which runs before the device's pass.
+	if (pDevice->command_timed_out) {
+		char message[] = "Error (0000): Command response timed out";
+		report_COM_error(pDevice, message);
+		return lose_Connection(pDevice);
+	}
+
+	//Timers scheduled by the application since the last pass.
+	User_Timer_Take(pDevice);
+
+	//Take everything that can be sent now from the queue.
+	take_commands(pDevice, &pDevice->output_cursor);
+
+	//Write all pending frames in one call, including the rest of any frame a previous pass only partly wrote.
+	//The io_uring transport submits every pass, since that's also what restarts its receive.
+	if (pDevice->pUring != NULL || pDevice->output_cursor.pHead != NULL) {
+		iResult = pDevice->pUring != NULL ? uring_send_data(pDevice, &pDevice->output_cursor) : send_data(pDevice, &pDevice->output_cursor);
+		if (iResult < 0) {
+			char message[50];
+			//printf(ANSI_COLOR_RED"Sending Error\n"ANSI_COLOR_RESET);
+
+			int errorCode = WSAGetLastError();
+			if (errorCode == 0) {
+				_snprintf_s(message, sizeof(message), _TRUNCATE, "Error (0000): Connection closed");
+			}
+			else {
+				_snprintf_s(message, sizeof(message), _TRUNCATE, "Error (0000): send failed with error %d", errorCode);
+			}
+			report_COM_error(pDevice, message);
+			return lose_Connection(pDevice);
+		}
+	}
+
+	//Requests made since the last pass can have deadlines earlier than the one the timer is armed for.
+	arm_Request_Deadline(pDevice);
+
+	return true;
+}
+
+void Device_Loop_Stop(DCS_Device* pDevice) {
+	//Nothing the device sent will be answered now. Requests fail unless close_Device already failed them.
+	Request_Fail_All(pDevice, NETWORK_ERROR);
+	for (unsigned int x = 0; x < DCS_MAX_COMMAND_WINDOW; x++) {
+		Request_Release(pDevice->command_records[x].pRequest);
+		pDevice->command_records[x].pRequest = NULL;
+		if (pDevice->command_records[x].pFrame != NULL) {
+			drop_Frame(pDevice->command_records[x].pFrame);
+			pDevice->command_records[x].pFrame = NULL;
+		}
+	}
+	clear_output(&pDevice->replay);
+	Session_Close(pDevice);
+
+	//The wheel belongs to the event loop, so nothing of the device's can be left in it.
+	for (unsigned int x = 0; x < DCS_MAX_COMMAND_WINDOW; x++) {
+		Timer_Cancel(pDevice->pWheel, &pDevice->command_records[x].deadline);
+	}
+	Timer_Cancel(pDevice->pWheel, &pDevice->keep_alive);
+	Timer_Cancel(pDevice->pWheel, &pDevice->request_deadline);
+	Timer_Cancel(pDevice->pWheel, &pDevice->session.retry);
+	User_Timer_Stop(pDevice);
+	pDevice->pWheel = NULL;
+
+	close_Connection(pDevice);
+	pDevice->pPoller = NULL;
+}
+
+static bool lose_Connection(DCS_Device* pDevice) {
+	Session* pSession = &pDevice->session;
+	if (!pSession->reconnect) {
+		return false;
+	}
+
+	close_Connection(pDevice);
+
+	//A frame partly received is lost with the connection.
+	Framer_Free(&pDevice->recv_framer);
+
+	//The frames being written are also held by their command records, so they're sent again from there.
+	clear_output(&pDevice->output_cursor);
+	clear_output(&pDevice->uring_sending);
+
+	//Commands the DCS hadn't answered were taken before any still waiting to be sent again, so they go first.
+	replay_First(pDevice, take_Unanswered(pDevice));
+
+	Timer_Cancel(pDevice->pWheel, &pDevice->keep_alive);
+	pDevice->command_timed_out = false;
+
+	pSession->attempts = 0;
+	pSession->delay = pSession->min_delay;
+	pSession->lost_time = Clock_Now_Ns();
+	pSession->last_data = pDevice->last_response;
+
+	//The first attempt is made straight away, since a connection that was reset can often be made again at once.
+	connect_Again(pDevice);
+	return true;
+}
+
+static Transmission_Data_Type* take_Unanswered(DCS_Device* pDevice) {
+	Transmission_Data_Type* pHead = NULL;
+	Transmission_Data_Type** ppTail = &pHead;
+
+	//The replies are lost with the connection, so their Get commands are built again.
+	Reply_Record lost[DCS_MAX_COMMAND_WINDOW];
+	const unsigned int lost_count = Request_Take_Replies(pDevice, lost);
+	for (unsigned int x = 0; x < lost_count; x++) {
+		Frame_Builder builder;
+		if (Frame_Begin(&builder, pDevice, lost[x].data_id, 0, lost[x].pRequest) == NO_DCS_ERROR) {
+			Transmission_Data_Type* pTransmission = Frame_Finish(&builder);
+			if (pTransmission != NULL) {
+				*ppTail = pTransmission;
+				ppTail = &pTransmission->pNextItem;
+			}
+		}
+		Request_Release(lost[x].pRequest);
+	}
+
+	//The commands that weren't acknowledged are sent again in the order they were sent, with their own frames.
+	for (;;) {
+		Command_Record* pOldest = NULL;
+		for (unsigned int x = 0; x < DCS_MAX_COMMAND_WINDOW; x++) {
+			Command_Record* pRecord = &pDevice->command_records[x];
+			if (pRecord->pending && (pOldest == NULL || pRecord->sent_time < pOldest->sent_time)) {
+				pOldest = pRecord;
+			}
+		}
+		if (pOldest == NULL) {
+			break;
+		}
+
+		pOldest->pending = false;
+		pDevice->commands_pending--;
+		Timer_Cancel(pDevice->pWheel, &pOldest->deadline);
+
+		//The frame takes the request back until it's sent again.
+		Transmission_Data_Type* pTransmission = pOldest->pFrame;
+		pOldest->pFrame = NULL;
+		if (pTransmission == NULL) {
+			Request_Release(pOldest->pRequest);
+			pOldest->pRequest = NULL;
+			continue;
+		}
+		pTransmission->pRequest = pOldest->pRequest;
+		pOldest->pRequest = NULL;
+
+		pTransmission->pNextItem = NULL;
+		*ppTail = pTransmission;
+		ppTail = &pTransmission->pNextItem;
+	}
+
+	return pHead;
+}
+
+static void replay_First(DCS_Device* pDevice, Transmission_Data_Type* pList) {
+	if (pList == NULL) {
+		return;
+	}
+
+	Transmission_Data_Type* pLast = pList;
+	while (pLast->pNextItem != NULL) {
+		pLast = pLast->pNextItem;
+	}
+	pLast->pNextItem = pDevice->replay.pHead;
+	if (pDevice->replay.pHead == NULL) {
+		pDevice->replay.pTail = pLast;
+	}
+	pDevice->replay.pHead = pList;
+}
+
+static void connect_Again(DCS_Device* pDevice) {
+	Session* pSession = &pDevice->session;
+	pSession->attempts++;
+
+	//The socket is watched before connecting so a failure can't be missed.
+	SOCKET ConnectSocket = socket(pSession->address.ss_family, SOCK_STREAM, IPPROTO_TCP);
+	if (ConnectSocket != INVALID_SOCKET && Socket_Set_Nonblocking(ConnectSocket) == NO_ERROR &&
+		Poller_Add(pDevice->pPoller, ConnectSocket, POLLER_READ_WRITE, pDevice) == NO_ERROR) {
+		pDevice->socket = ConnectSocket;
+		pDevice->watched = ConnectSocket;
+
+		if (Socket_Connect(ConnectSocket, (struct sockaddr*)&pSession->address, pSession->address_length) == NO_ERROR) {
+			//The next pass checks whether the attempt finished, in case it already has.
+			pSession->state = LINK_CONNECTING;
+			pDevice->ready = true;
+			Timer_Schedule(pDevice->pWheel, &pSession->retry, Clock_Now_Ns() + SESSION_CONNECT_TIMEOUT * CLOCK_NS_PER_SEC);
+			return;
+		}
+
+		close_Connection(pDevice);
+	}
+	else if (ConnectSocket != INVALID_SOCKET) {
+		closesocket(ConnectSocket);
+	}
+
+	retry_Connect(pDevice);
+}
+
+static void retry_Connect(DCS_Device* pDevice) {
+	pDevice->session.state = LINK_WAITING;
+	Timer_Schedule(pDevice->pWheel, &pDevice->session.retry, Clock_Now_Ns() + Session_Backoff(pDevice));
+}
+
+static void reconnect_due(Timer* pTimer, void* pContext) {
+	DCS_Device* pDevice = pContext;
+	pass_Due(pDevice);
+
+	//An attempt still being made when the timer fires has taken too long.
+	if (pDevice->session.state == LINK_CONNECTING) {
+		close_Connection(pDevice);
+		retry_Connect(pDevice);
+		return;
+	}
+
+	connect_Again(pDevice);
+}
+
+static bool finish_Connect(DCS_Device* pDevice) {
+	Session* pSession = &pDevice->session;
+	if (pSession->state != LINK_CONNECTING || !pDevice->ready) {
+		return false;
+	}
+	pDevice->ready = false;
+
+	const int result = Socket_Connect_Result(pDevice->socket);
+	if (result == WSAEWOULDBLOCK) {
+		return false;
+	}
+
+	//The connected socket is watched as it was when the device joined its event loop, which can mean moving it to io_uring.
+	if (result == NO_ERROR) {
+		Poller_Remove(pDevice->pPoller, pDevice->watched);
+		pDevice->watched = INVALID_SOCKET;
+	}
+	if (result != NO_ERROR || !watch_Connection(pDevice)) {
+		close_Connection(pDevice);
+		retry_Connect(pDevice);
+		return false;
+	}
+
+	Timer_Cancel(pDevice->pWheel, &pSession->retry);
+	pSession->state = LINK_CONNECTED;
+
+	const unsigned __int64 currTime = Clock_Now_Ns();
+	Reconnect_Info info = {
+		.attempts = pSession->attempts,
+		.latency_us = (currTime - pSession->lost_time) / 1000,
+		.gap_us = (currTime - pSession->last_data) / 1000,
+	};
+
+	reset_Timer(pDevice);
+	Timer_Schedule(pDevice->pWheel, &pDevice->keep_alive, pDevice->last_response + CHECK_CONNECTION_FREQ * CLOCK_NS_PER_SEC);
+
+	//The settings go ahead of the commands left unanswered, so those run on a DCS set up as it was.
+	replay_First(pDevice, Session_Replay(pDevice));
+
+	//The pass carries on as usual, reading whatever has already arrived.
+	pDevice->ready = true;
+	Get_Reconnect_CB(pDevice, &info);
+	return true;
+}
+
+static void report_COM_error(DCS_Device* pDevice, const char* message) {
+	unsigned __int32 size = (unsigned __int32)strlen(message);
+
+	if (Dispatch_Running(&pDevice->dispatch)) {
+		//Laid out like an error message from the DCS. itohl is its own inverse, so it also converts the size back.
+		char payload[sizeof(size) + 64];
+		if (size > sizeof(payload) - sizeof(size)) {
+			size = sizeof(payload) - sizeof(size);
+		}
+		const unsigned __int32 wire_size = itohl(size);
+		memcpy(payload, &wire_size, sizeof(wire_size));
+		memcpy(&payload[sizeof(wire_size)], message, size);
+
+		const int result = Dispatch_Frame(&pDevice->dispatch, GET_ERROR_MESSAGE, 0, payload, sizeof(size) + size, Clock_Now_Ns());
+		if (result == NO_DCS_ERROR || result == DISPATCH_FRAME_HELD) {
+			return;
+		}
+	}
+
+	Get_Error_Message_CB(pDevice, (char*)message, size);
+}
+
+static void reset_Commands(DCS_Device* pDevice, unsigned int window) {
+	memset(pDevice->command_records, 0, sizeof(pDevice->command_records));
+	for (unsigned int x = 0; x < DCS_MAX_COMMAND_WINDOW; x++) {
+		Timer_Init(&pDevice->command_records[x].deadline, command_deadline_passed, pDevice);
+	}
+	pDevice->commands_pending = 0;
+
+	if (window < 1) {
+		window = 1;
+	}
+	else if (window > DCS_MAX_COMMAND_WINDOW) {
+		window = DCS_MAX_COMMAND_WINDOW;
+	}
+	pDevice->command_window = window;
+}
+
+static void start_Command(DCS_Device* pDevice, Transmission_Data_Type* pTransmission) {
+	for (unsigned int x = 0; x < DCS_MAX_COMMAND_WINDOW; x++) {
+		Command_Record* pRecord = &pDevice->command_records[x];
+		if (!pRecord->pending) {
+			pRecord->pending = true;
+			pRecord->sequence = pTransmission->sequence;
+			pRecord->command_code = pTransmission->command_code;
+			pRecord->sent_time = Clock_Now_Ns();
+			Timer_Schedule(pDevice->pWheel, &pRecord->deadline, pRecord->sent_time + COMMAND_RESPONSE_TIMEOUT * CLOCK_NS_PER_SEC);
+			//The record resolves the request from here on, since the frame is freed once it's written.
+			pRecord->pRequest = pTransmission->pRequest;
+			pTransmission->pRequest = NULL;
+			//A device that reconnects keeps the frame until the command is acknowledged, to send it again if the connection is lost.
+			if (pDevice->session.reconnect) {
+				pRecord->pFrame = pTransmission;
+				pTransmission->shared = true;
+			}
+			pDevice->commands_pending++;
+			return;
+		}
+	}
+}
+
+static void command_deadline_passed(Timer* pTimer, void* pContext) {
+	DCS_Device* pDevice = pContext;
+
+	//While reads are held the acknowledgement may be waiting to be read, so the command is given longer.
+	if (pDevice->reads_held) {
+		Timer_Schedule(pDevice->pWheel, pTimer, Clock_Now_Ns() + COMMAND_RESPONSE_TIMEOUT * CLOCK_NS_PER_SEC);
+		return;
+	}
+
+	pDevice->command_timed_out = true;
+	pass_Due(pDevice);
+}
+
+Sequence_ID Next_Sequence_ID(void) {
+	Sequence_ID sequence;
+	do {
+		sequence = (Sequence_ID)Atomic_Increment(&last_sequence_id);
+	} while (sequence == 0);
+	return sequence;
+}
+
+int Complete_Command(DCS_Device* pDevice, Data_ID Command_Code, Sequence_ID sequence) {
+	Command_Record* pMatch = NULL;
+
+	for (unsigned int x = 0; x < DCS_MAX_COMMAND_WINDOW; x++) {
+		Command_Record* pRecord = &pDevice->command_records[x];
+		if (!pRecord->pending || pRecord->command_code != Command_Code) {
+			continue;
+		}
+
+		//A sequenced acknowledgement names its command. Otherwise the oldest command with the same code is the one acknowledged.
+		if (sequence != 0) {
+			if (pRecord->sequence == sequence) {
+				pMatch = pRecord;
+				break;
+			}
+		}
+		else if (pMatch == NULL || pRecord->sent_time < pMatch->sent_time) {
+			pMatch = pRecord;
+		}
+	}
+
+	//Acknowledgement for a command that isn't waiting for one.
+	if (pMatch == NULL) {
+		return NETWORK_ERROR;
+	}
+
+	pMatch->pending = false;
+	pDevice->commands_pending--;
+	Timer_Cancel(pDevice->pWheel, &pMatch->deadline);
+
+	//Settings the DCS acknowledged are what it's sent again after reconnecting.
+	if (pMatch->pFrame != NULL) {
+		Session_Acknowledged(pDevice, pMatch->pFrame);
+		drop_Frame(pMatch->pFrame);
+		pMatch->pFrame = NULL;
+	}
+
+	Request_Acknowledged(pDevice, pMatch->pRequest, pMatch->command_code, pMatch->sequence);
+	pMatch->pRequest = NULL;
+	return NO_DCS_ERROR;
+}
+
+int Enqueue_Trans_FIFO(DCS_Device* pDevice, Transmission_Data_Type* pTransmission) {
+	//Nothing takes frames off the FIFO before the device has first been opened.
+	if (pDevice == NULL || pDevice->trans_queue.pCells == NULL) {
+		Free_Transmission(pTransmission);
+		return NETWORK_NOT_READY;
+	}
+
+	if (!Queue_Push(&pDevice->trans_queue, pTransmission)) {
+		Free_Transmission(pTransmission);
+		return TRANSMIT_QUEUE_FULL;
+	}
+
+	//Wake the device's event loop so the frame is sent without waiting for other activity. If a wake-up is already
+	//pending, the event loop hasn't taken the device's frames since and will find this one too.
+	if (Atomic_Exchange(&pDevice->trans_wake_pending, 1) == 0) {
+		Event_Loop_Wake(pDevice);
+	}
+
+	return NO_DCS_ERROR;
+}
+
+static Transmission_Data_Type* Dequeue_Trans_FIFO(DCS_Device* pDevice) {
+	if (pDevice->trans_queue.pCells == NULL) {
+		return NULL;
+	}
+	return Queue_Pop(&pDevice->trans_queue);
+}
+
+static int init_FIFO_mutex(DCS_Device* pDevice) {
+	if (pDevice->hFIFOMutex != NULL) {
+		return THREAD_ALREADY_EXISTS;
+	}
+
+	pDevice->hFIFOMutex = Mutex_Create();
+	if (pDevice->hFIFOMutex == NULL) {
+		return THREAD_START_ERROR;
+	}
+	return NO_DCS_ERROR;
+}
+
+static int close_FIFO_mutex(DCS_Device* pDevice) {
+	if (pDevice->hFIFOMutex == NULL) {
+		return NO_DCS_ERROR;
+	}
+
+	Mutex_Destroy(pDevice->hFIFOMutex);
+
+	pDevice->hFIFOMutex = NULL;
+
+	return NO_DCS_ERROR;
+}
+
+static inline void set_FIFO_mutex(DCS_Device* pDevice) {
+	if (pDevice->hFIFOMutex == NULL) {
 		return;
 	}
 
-	WaitForSingleObject(hFIFOMutex, INFINITE);
+	Mutex_Lock(pDevice->hFIFOMutex);
 }
 
-static inline void release_FIFO_mutex() {
-	if (hFIFOMutex == NULL) {
+static inline void release_FIFO_mutex(DCS_Device* pDevice) {
+	if (pDevice->hFIFOMutex == NULL) {
 		return;
 	}
 
-	ReleaseMutex(hFIFOMutex);
+	Mutex_Unlock(pDevice->hFIFOMutex);
 }
 
-static int process_recv(char* buff, unsigned __int32 buffLen) {
+static int process_recv(DCS_Device* pDevice, char* buff, unsigned __int32 buffLen, unsigned __int64 timestamp) {
 	hexDump("process_recv", buff, buffLen);
 
-	//Verify checksum.
-	if (!check_checksum(buff, buffLen)) {
-		printf("Checksum error\n");
-		return FRAME_CHECKSUM_ERROR;
+	//The checksum was verified by recv_data as the frame was received.
+
+	//Frame must at least hold the header, type id, data id and checksum.
+	if (buffLen < sizeof(Frame_Version) + sizeof(Type_ID) + sizeof(Data_ID) + sizeof(Checksum)) {
+		printf("Frame too short\n");
+		return FRAME_INVALID_DATA;
 	}
 
 	unsigned __int32 index = 0; //Index to track position in buff.
@@ -588,11 +1597,19 @@ static int process_recv(char* buff, unsigned __int32 buffLen) {
 	index += sizeof(header);
 
 	header = itohs(header);
-	if (header != FRAME_VERSION) {
+	if (!Frame_Version_Valid(header)) {
 		printf("Invalid header\n");
 		return FRAME_VERSION_ERROR;
 	}
 
+	//Sequenced frames have a sequence ID after the data ID, and CRC32C frames end in a 4 byte trailer instead of the 1 byte checksum.
+	const unsigned __int32 headerSize = Frame_Header_Size(header);
+	const unsigned __int32 trailerSize = Frame_Trailer_Size(header);
+	if (buffLen < headerSize + trailerSize) {
+		printf("Frame too short\n");
+		return FRAME_INVALID_DATA;
+	}
+
 	//Ensure type id is correct.
 	Type_ID type_id;
 	memcpy(&type_id, &buff[index], sizeof(type_id));
@@ -611,65 +1628,82 @@ static int process_recv(char* buff, unsigned __int32 buffLen) {
 
 	data_id = itohl(data_id);
 
-	//Obtain just the data portion of the frame and place in pDataBuff.
-	unsigned int pDataBuffLen = buffLen - sizeof(data_id) - sizeof(type_id) - sizeof(header) - sizeof(Checksum);
-	char* pDataBuff = malloc(pDataBuffLen);
-	if (pDataBuff == NULL) {
-		return MEMORY_ALLOCATION_ERROR;
+	//Sequence ID of the command this frame responds to.
+	Sequence_ID sequence = 0;
+	if (index < headerSize) {
+		memcpy(&sequence, &buff[index], sizeof(sequence));
+		index += sizeof(sequence);
+
+		sequence = itohl(sequence);
 	}
 
-	memcpy(pDataBuff, &buff[index], pDataBuffLen);
-	index += pDataBuffLen;
+	//Data portion of the frame is decoded in place, straight out of the receive buffer.
+	const unsigned __int32 pDataBuffLen = buffLen - headerSize - trailerSize;
+	char* pDataBuff = &buff[index];
+
+	//Acknowledgements complete commands the event loop is tracking, so they're never handed to another thread.
+	if (data_id == COMMAND_ACK) {
+		return Receive_Command_ACK(pDevice, pDataBuff, pDataBuffLen, sequence);
+	}
+
+	//The frame only lives until the next read, so a dispatch thread is given a copy of its data.
+	if (Dispatch_Running(&pDevice->dispatch)) {
+		const int result = Dispatch_Frame(&pDevice->dispatch, data_id, sequence, pDataBuff, pDataBuffLen, timestamp);
+		if (result == DISPATCH_FRAME_HELD) {
+			pDevice->reads_held = true;
+			return NO_DCS_ERROR;
+		}
+		return result;
+	}
+	return process_payload(pDevice, data_id, sequence, pDataBuff, pDataBuffLen, timestamp);
+}
 
+static int process_payload(DCS_Device* pDevice, Data_ID data_id, Sequence_ID sequence, char* pDataBuff, unsigned __int32 pDataBuffLen, unsigned __int64 timestamp) {
 	//Call the correct callbacks based on data id with pDataBuff.
 	int err = NO_DCS_ERROR;
 	switch (data_id) {
 		case GET_DCS_STATUS:
-			err = Receive_DCS_Status(pDataBuff);
+			err = Receive_DCS_Status(pDevice, pDataBuff, pDataBuffLen, sequence);
 			break;
 
 		case GET_CORRELATOR_SETTING:
-			err = Receive_Correlator_Setting(pDataBuff);
+			err = Receive_Correlator_Setting(pDevice, pDataBuff, pDataBuffLen, sequence);
 			break;
 
 		case GET_ANALYZER_SETTING:
-			err = Receive_Analyzer_Setting(pDataBuff);
+			err = Receive_Analyzer_Setting(pDevice, pDataBuff, pDataBuffLen, sequence);
 			break;
 
 		case GET_SIMULATED_DATA:
-			err = Receive_Simulated_Correlation(pDataBuff);
+			err = Receive_Simulated_Correlation(pDevice, pDataBuff, pDataBuffLen, sequence);
 			break;
 
 		case GET_ANALYZER_PREFIT_PARAM:
-			err = Receive_Analyzer_Prefit_Param(pDataBuff);
-			break;
-
-		case COMMAND_ACK:
-			err = Receive_Command_ACK(pDataBuff);
+			err = Receive_Analyzer_Prefit_Param(pDevice, pDataBuff, pDataBuffLen, sequence);
 			break;
 
 		case GET_ERROR_MESSAGE:
-			err = Receive_Error_Message(pDataBuff);
+			err = Receive_Error_Message(pDevice, pDataBuff, pDataBuffLen);
 			break;
 
 		case GET_BFI_DATA:
-			err = Receive_BFI_Data(pDataBuff);
+			err = Receive_BFI_Data(pDevice, pDataBuff, pDataBuffLen, timestamp);
 			break;
 
 		case GET_BFI_CORR_READY:
-			err = Receive_BFI_Corr_Ready(pDataBuff);
+			err = Receive_BFI_Corr_Ready(pDevice, pDataBuff, pDataBuffLen);
 			break;
 
 		case GET_CORR_INTENSITY:
-			err = Receive_Corr_Intensity_Data(pDataBuff);
+			err = Receive_Corr_Intensity_Data(pDevice, pDataBuff, pDataBuffLen, timestamp);
 			break;
 
 		case GET_INTENSITY:
-			err = Receive_Intensity_Data(pDataBuff);
+			err = Receive_Intensity_Data(pDevice, pDataBuff, pDataBuffLen, timestamp);
 			break;
 
 		case GET_ERROR_ID:
-			err = Receive_Error_Code(pDataBuff);
+			err = Receive_Error_Code(pDevice, pDataBuff, pDataBuffLen);
 			break;
 
 		default:
@@ -677,265 +1711,937 @@ static int process_recv(char* buff, unsigned __int32 buffLen) {
 			err = FRAME_INVALID_DATA;
 	}
 
-	free(pDataBuff);
-
 	return err;
 }
 
-int Enqueue_Recv_FIFO(Received_Data_Item* pRecv) {
-	pRecv->pNextItem = NULL;
+int Enqueue_Recv_FIFO(DCS_Device* pDevice, Received_Data_Item* pRecv) {
+	pRecv->size = recv_item_size(pRecv);
+
+	set_Recv_mutex(pDevice);
+	Recv_Ring* pRing = &pDevice->recv_rings[pRecv->data_type];
+
+	if (pDevice->store_config.overflow == OVERFLOW_BLOCK && !pDevice->store_closing && recv_ring_full(pDevice, pRing, pRecv->size)) {
+		//The event loop is shared with other devices, so rather than wait it keeps the item and stops reading from this
+		//device's DCS, and TCP flow control slows the DCS down until the application catches up. Only one item is
+		//kept, so one the loop stores meanwhile, which can only be its own error report, is dropped.
+		if (Event_Loop_Is_Current(pDevice)) {
+			if (pDevice->pHeldItem == NULL) {
+				pDevice->pHeldItem = pRecv;
+				pDevice->reads_held = true;
+				release_Recv_mutex(pDevice);
+				return NO_DCS_ERROR;
+			}
+		}
+		//A dispatch thread waits, which in turn fills its queue and has the event loop hold reads.
+		else {
+			while (pDevice->store_config.overflow == OVERFLOW_BLOCK && !pDevice->store_closing && pDevice->pStoreCond != NULL && recv_ring_full(pDevice, pRing, pRecv->size)) {
+				Cond_Wait(pDevice->pStoreCond, pDevice->hRecvDataMutex);
+			}
+		}
+	}
+
+	const int result = store_Recv_Item(pDevice, pRecv);
+
+	release_Recv_mutex(pDevice);
+
+	return result;
+}
+
+static int store_Recv_Item(DCS_Device* pDevice, Received_Data_Item* pRecv) {
+	Recv_Ring* pRing = &pDevice->recv_rings[pRecv->data_type];
 
-	set_Recv_mutex();
+	if (recv_ring_full(pDevice, pRing, pRecv->size)) {
+		if (pDevice->store_config.overflow == OVERFLOW_DROP_OLDEST) {
+			while (recv_ring_full(pDevice, pRing, pRecv->size)) {
+				release_Recv_Item(pDevice, recv_ring_pop(pRing));
+				pRing->stats.dropped++;
+			}
+		}
+		//Dropping the newest item is also what happens to an item that can't wait for room.
+		else {
+			pRing->stats.dropped++;
+			release_Recv_Item(pDevice, pRecv);
+			return NO_DCS_ERROR;
+		}
+	}
 
-	//If FIFO is empty, this element is both the head and tail.
-	if (pRecv_Data_FIFO_Head == NULL) {
-		pRecv_Data_FIFO_Head = pRecv;
-		pRecv_Data_FIFO_Tail = pRecv;
+	//The ring gets its slots the first time an item of its type is stored.
+	if (pRing->ppItems == NULL) {
+		const unsigned __int32 capacity = pDevice->store_config.max_items != 0 ? pDevice->store_config.max_items : STORE_DEFAULT_MAX_ITEMS;
+		pRing->ppItems = malloc(sizeof(*pRing->ppItems) * capacity);
+		if (pRing->ppItems == NULL) {
+			pRing->stats.dropped++;
+			release_Recv_Item(pDevice, pRecv);
+			return MEMORY_ALLOCATION_ERROR;
+		}
+		pRing->capacity = capacity;
+		pRing->head = 0;
 	}
-	//Otherwise, add to the end of FIFO.
-	else {
-		pRecv_Data_FIFO_Tail->pNextItem = pRecv;
-		pRecv_Data_FIFO_Tail = pRecv;
+
+	pRing->ppItems[(pRing->head + pRing->stats.count) % pRing->capacity] = pRecv;
+	pRing->stats.count++;
+	pRing->stats.bytes += pRecv->size;
+	pRing->stats.stored++;
+	if (pRing->stats.count > pRing->stats.high_water_count) {
+		pRing->stats.high_water_count = pRing->stats.count;
+	}
+	if (pRing->stats.bytes > pRing->stats.high_water_bytes) {
+		pRing->stats.high_water_bytes = pRing->stats.bytes;
+	}
+
+	return NO_DCS_ERROR;
+}
+
+static void made_Store_Room(DCS_Device* pDevice) {
+	if (pDevice->pStoreCond != NULL) {
+		Cond_Wake_All(pDevice->pStoreCond);
+	}
+
+	Received_Data_Item* pItem = pDevice->pHeldItem;
+	if (pItem == NULL) {
+		return;
+	}
+	if (pDevice->store_config.overflow == OVERFLOW_BLOCK && !pDevice->store_closing && recv_ring_full(pDevice, &pDevice->recv_rings[pItem->data_type], pItem->size)) {
+		return;
+	}
+
+	pDevice->pHeldItem = NULL;
+	store_Recv_Item(pDevice, pItem);
+	Event_Loop_Wake(pDevice);
+}
+
+static Received_Data_Item* take_Recv_Item(DCS_Device* pDevice, Data_Item_Type type) {
+	if (pDevice == NULL) {
+		return NULL;
+	}
+
+	set_Recv_mutex(pDevice);
+
+	Received_Data_Item* pItem = recv_ring_pop(&pDevice->recv_rings[type]);
+
+	if (pItem != NULL) {
+		made_Store_Room(pDevice);
+	}
+
+	release_Recv_mutex(pDevice);
+
+	return pItem;
+}
+
+static bool recv_ring_full(const DCS_Device* pDevice, const Recv_Ring* pRing, size_t size) {
+	//An item bigger than the byte limit is still kept on its own.
+	if (pRing->stats.count == 0) {
+		return false;
+	}
+
+	const unsigned __int32 max_items = pDevice->store_config.max_items != 0 ? pDevice->store_config.max_items : STORE_DEFAULT_MAX_ITEMS;
+	if (pRing->stats.count >= max_items || pRing->stats.count >= pRing->capacity) {
+		return true;
+	}
+	return pDevice->store_config.max_bytes != 0 && pRing->stats.bytes + size > pDevice->store_config.max_bytes;
+}
+
+static Received_Data_Item* recv_ring_pop(Recv_Ring* pRing) {
+	if (pRing->stats.count == 0) {
+		return NULL;
+	}
+
+	Received_Data_Item* pItem = pRing->ppItems[pRing->head];
+	pRing->head = (pRing->head + 1) % pRing->capacity;
+	pRing->stats.count--;
+	pRing->stats.bytes -= pItem->size;
+
+	return pItem;
+}
+
+static void trim_Recv_Ring(DCS_Device* pDevice, Recv_Ring* pRing) {
+	const unsigned __int32 max_items = pDevice->store_config.max_items != 0 ? pDevice->store_config.max_items : STORE_DEFAULT_MAX_ITEMS;
+
+	while (pRing->stats.count > max_items ||
+		(pDevice->store_config.max_bytes != 0 && pRing->stats.bytes > pDevice->store_config.max_bytes && pRing->stats.count > 1)) {
+		release_Recv_Item(pDevice, recv_ring_pop(pRing));
+		pRing->stats.dropped++;
 	}
 
-	release_Recv_mutex();
+	if (pRing->ppItems == NULL || pRing->capacity == max_items) {
+		return;
+	}
+
+	//Move what's left to the front of a ring of the new size. If that can't be allocated, the old ring is kept
+	//and the item limit still applies.
+	Received_Data_Item** ppItems = malloc(sizeof(*ppItems) * max_items);
+	if (ppItems == NULL) {
+		return;
+	}
+	for (unsigned __int32 x = 0; x < pRing->stats.count; x++) {
+		ppItems[x] = pRing->ppItems[(pRing->head + x) % pRing->capacity];
+	}
+	free(pRing->ppItems);
+	pRing->ppItems = ppItems;
+	pRing->capacity = max_items;
+	pRing->head = 0;
+}
+
+int DCS_Set_Store_Config(DCS_Handle hDevice, Store_Config config) {
+	if (hDevice == NULL || (config.overflow != OVERFLOW_DROP_OLDEST && config.overflow != OVERFLOW_DROP_NEWEST && config.overflow != OVERFLOW_BLOCK)) {
+		return FRAME_INVALID_DATA;
+	}
+
+	set_Recv_mutex(hDevice);
+
+	hDevice->store_config = config;
+	for (int x = 0; x < Data_Item_Type_Count; x++) {
+		Recv_Ring* pRing = &hDevice->recv_rings[x];
+		trim_Recv_Ring(hDevice, pRing);
+
+		//The free slots were allocated for the old limits, and a streaming store gets them again for the new ones.
+		free_Recv_Slots(pRing);
+		if (config.streaming && pRing->slot_size != 0) {
+			fill_Recv_Slots(hDevice, pRing, pRing->slot_size);
+		}
+	}
+
+	//The new limits may give room to whatever is waiting for it, or let it stop waiting at all.
+	made_Store_Room(hDevice);
+
+	release_Recv_mutex(hDevice);
 
 	return NO_DCS_ERROR;
 }
 
-static int init_Recv_mutex() {
-	if (hRecvDataMutex != NULL) {
+int Set_Store_Config(Store_Config config) {
+	return DCS_Set_Store_Config(&default_device, config);
+}
+
+int DCS_Get_Store_Stats(DCS_Handle hDevice, Data_Item_Type type, Store_Stats* pStats) {
+	if (hDevice == NULL || pStats == NULL || type < 0 || type >= Data_Item_Type_Count || type == After_This_Are_Arrays) {
+		return FRAME_INVALID_DATA;
+	}
+
+	set_Recv_mutex(hDevice);
+	*pStats = hDevice->recv_rings[type].stats;
+	release_Recv_mutex(hDevice);
+
+	return NO_DCS_ERROR;
+}
+
+int Get_Store_Stats(Data_Item_Type type, Store_Stats* pStats) {
+	return DCS_Get_Store_Stats(&default_device, type, pStats);
+}
+
+static size_t recv_item_size(const Received_Data_Item* pItem) {
+	size_t element_size = 0;
+
+	switch (pItem->data_type) {
+		case DCS_Status_Type:
+			return sizeof(DCS_Status);
+
+		case Correlator_Setting_Type:
+			return sizeof(Correlator_Setting);
+
+		case Analyzer_Prefit_Param_Type:
+			return sizeof(Analyzer_Prefit_Param);
+
+		case Simulated_Correlation_Type:
+			return sizeof(Simulated_Correlation);
+
+		case Corr_Intensity_Data_Type: {
+			//Channels, each with its own correlation buffer, followed by the delays.
+			Array_Data array_data[2] = { 0 };
+			memcpy(array_data, pItem->data, sizeof(*array_data) * 2);
+
+			const Corr_Intensity_Data* data = array_data[0].ptr;
+			size_t size = sizeof(*data) * array_data[0].length + sizeof(float) * array_data[1].length;
+			for (int x = 0; x < array_data[0].length; x++) {
+				size += sizeof(*data[x].pCorrBuf) * data[x].Data_Num;
+			}
+			return size;
+		}
+
+		case Analyzer_Setting_Type:
+			element_size = sizeof(Analyzer_Setting);
+			break;
+
+		case BFI_Data_Type:
+			element_size = sizeof(BFI_Data);
+			break;
+
+		case Intensity_Data_Type:
+			element_size = sizeof(Intensity_Data);
+			break;
+
+		case Error_Message_Type:
+			element_size = sizeof(Error_Message);
+			break;
+
+		default:
+			return 0;
+	}
+
+	Array_Data array_data = { 0 };
+	memcpy(&array_data, pItem->data, sizeof(array_data));
+	return element_size * array_data.length;
+}
+
+static void free_Recv_Item(Received_Data_Item* pItem) {
+	if (pItem->data_type == Corr_Intensity_Data_Type) {
+#pragma warning (disable: 6001)
+		Array_Data array_data[2] = { 0 };
+		memcpy(array_data, pItem->data, sizeof(*array_data) * 2);
+
+		Corr_Intensity_Data* data = array_data[0].ptr;
+		for (int x = 0; x < array_data[0].length; x++) {
+			free(data[x].pCorrBuf);
+		}
+
+		free(array_data[0].ptr);
+		free(array_data[1].ptr);
+#pragma warning (default: 6001)
+	}
+	else if (pItem->data_type > After_This_Are_Arrays) {
+		Array_Data array_data = { 0 };
+		memcpy(&array_data, pItem->data, sizeof(array_data));
+
+		free(array_data.ptr);
+	}
+
+	free(pItem->data);
+	free(pItem);
+}
+
+static void release_Recv_Item(DCS_Device* pDevice, Received_Data_Item* pItem) {
+	if (!pItem->pooled) {
+		free_Recv_Item(pItem);
+		return;
+	}
+
+	//The decoder can still hold the slot while its callbacks run.
+	Recv_Slot* pSlot = (Recv_Slot*)pItem;
+	if (Atomic_Decrement(&pSlot->refs) == 0) {
+		recycle_Recv_Slot(pDevice, pSlot);
+	}
+}
+
+static void recycle_Recv_Slot(DCS_Device* pDevice, Recv_Slot* pSlot) {
+	Recv_Ring* pRing = &pDevice->recv_rings[pSlot->item.data_type];
+
+	//Slots left too small by a bigger item aren't reused.
+	if (pSlot->capacity < pRing->slot_size) {
+		free(pSlot);
+		pRing->slots--;
+		return;
+	}
+
+	pSlot->pNextItem = pRing->pFreeSlots;
+	pRing->pFreeSlots = pSlot;
+}
+
+static Received_Data_Item* take_Recv_Slot(DCS_Device* pDevice, Data_Item_Type type, size_t size) {
+	set_Recv_mutex(pDevice);
+	Recv_Ring* pRing = &pDevice->recv_rings[type];
+
+	//An item bigger than the slots were sized for makes the free ones too small.
+	if (size > pRing->slot_size) {
+		free_Recv_Slots(pRing);
+		pRing->slot_size = size;
+	}
+
+	Recv_Slot* pSlot = pRing->pFreeSlots;
+	if (pSlot != NULL) {
+		pRing->pFreeSlots = pSlot->pNextItem;
+	}
+	else {
+		pSlot = malloc(sizeof(*pSlot) + pRing->slot_size);
+		if (pSlot != NULL) {
+			pSlot->capacity = pRing->slot_size;
+			pRing->slots++;
+		}
+	}
+	release_Recv_mutex(pDevice);
+
+	if (pSlot == NULL) {
+		return NULL;
+	}
+
+	pSlot->item.data = pSlot->arrays;
+	pSlot->item.data_type = type;
+	pSlot->item.pooled = true;
+	pSlot->refs = 1;
+	return &pSlot->item;
+}
+
+Received_Data_Item* Take_Frame_Buffer(DCS_Device* pDevice, Data_Item_Type type, size_t size) {
+	if (!get_Callbacks(pDevice)->should_store) {
+		return NULL;
+	}
+	return take_Recv_Slot(pDevice, type, size);
+}
+
+void* Frame_Buffer_Data(Received_Data_Item* pFrame) {
+	return (Recv_Slot*)pFrame + 1;
+}
+
+void Release_Frame_Buffer(DCS_Device* pDevice, Received_Data_Item* pFrame) {
+	if (pFrame == NULL) {
+		return;
+	}
+
+	//The store usually still holds the slot, so the lock is only taken when it doesn't.
+	Recv_Slot* pSlot = (Recv_Slot*)pFrame;
+	if (Atomic_Decrement(&pSlot->refs) != 0) {
+		return;
+	}
+
+	set_Recv_mutex(pDevice);
+	recycle_Recv_Slot(pDevice, pSlot);
+	release_Recv_mutex(pDevice);
+}
+
+static void keep_Frame_Buffer(DCS_Device* pDevice, Received_Data_Item* pFrame) {
+	Atomic_Increment(&((Recv_Slot*)pFrame)->refs);
+	Enqueue_Recv_FIFO(pDevice, pFrame);
+}
+
+static void fill_Recv_Slots(DCS_Device* pDevice, Recv_Ring* pRing, size_t size) {
+	if (size > pRing->slot_size) {
+		free_Recv_Slots(pRing);
+		pRing->slot_size = size;
+	}
+
+	unsigned __int32 wanted = (pDevice->store_config.max_items != 0 ? pDevice->store_config.max_items : STORE_DEFAULT_MAX_ITEMS) + 1;
+	if (pDevice->store_config.max_bytes != 0 && pRing->slot_size != 0 && pDevice->store_config.max_bytes / pRing->slot_size + 1 < wanted) {
+		wanted = (unsigned __int32)(pDevice->store_config.max_bytes / pRing->slot_size) + 1;
+	}
+
+	while (pRing->slots < wanted) {
+		Recv_Slot* pSlot = malloc(sizeof(*pSlot) + pRing->slot_size);
+		if (pSlot == NULL) {
+			return;
+		}
+		pSlot->capacity = pRing->slot_size;
+		pSlot->pNextItem = pRing->pFreeSlots;
+		pRing->pFreeSlots = pSlot;
+		pRing->slots++;
+	}
+}
+
+static void free_Recv_Slots(Recv_Ring* pRing) {
+	while (pRing->pFreeSlots != NULL) {
+		Recv_Slot* pSlot = pRing->pFreeSlots;
+		pRing->pFreeSlots = pSlot->pNextItem;
+		free(pSlot);
+		pRing->slots--;
+	}
+}
+
+void Expect_Stream_Types(DCS_Device* pDevice, bool bCorr, bool bAnalyzer) {
+	set_Recv_mutex(pDevice);
+	pDevice->stream_types = STREAM_TYPE_BIT(bCorr ? Corr_Intensity_Data_Type : Intensity_Data_Type);
+	if (bAnalyzer) {
+		pDevice->stream_types |= STREAM_TYPE_BIT(BFI_Data_Type);
+	}
+	release_Recv_mutex(pDevice);
+}
+
+void Expect_Correlation_Length(DCS_Device* pDevice, unsigned __int32 length) {
+	set_Recv_mutex(pDevice);
+	pDevice->correlation_length = length;
+	release_Recv_mutex(pDevice);
+}
+
+void Reserve_Store_Slots(DCS_Device* pDevice, unsigned __int32 Cha_Num) {
+	if (!get_Should_Store(pDevice)) {
+		return;
+	}
+
+	set_Recv_mutex(pDevice);
+	if (pDevice->store_config.streaming) {
+		const unsigned __int32 types = pDevice->stream_types;
+		if (types & STREAM_TYPE_BIT(BFI_Data_Type)) {
+			fill_Recv_Slots(pDevice, &pDevice->recv_rings[BFI_Data_Type], sizeof(BFI_Data) * Cha_Num);
+		}
+		if (types & STREAM_TYPE_BIT(Intensity_Data_Type)) {
+			fill_Recv_Slots(pDevice, &pDevice->recv_rings[Intensity_Data_Type], sizeof(Intensity_Data) * Cha_Num);
+		}
+		//Each channel has a correlation buffer as long as the delays.
+		if ((types & STREAM_TYPE_BIT(Corr_Intensity_Data_Type)) && pDevice->correlation_length != 0) {
+			const size_t values = (size_t)pDevice->correlation_length * (Cha_Num + 1);
+			fill_Recv_Slots(pDevice, &pDevice->recv_rings[Corr_Intensity_Data_Type], sizeof(Corr_Intensity_Data) * Cha_Num + sizeof(float) * values);
+		}
+	}
+	release_Recv_mutex(pDevice);
+}
+
+void Reserve_Dispatch_Jobs(DCS_Device* pDevice, unsigned __int32 Cha_Num) {
+	if (!Dispatch_Running(&pDevice->dispatch)) {
+		return;
+	}
+
+	set_Recv_mutex(pDevice);
+	const unsigned __int32 types = pDevice->stream_types;
+	const unsigned __int32 correlation_length = pDevice->correlation_length;
+	release_Recv_mutex(pDevice);
+
+	//Types whose size isn't known yet get their jobs grown as their first frames arrive.
+	if (types & STREAM_TYPE_BIT(BFI_Data_Type)) {
+		Dispatch_Reserve(&pDevice->dispatch, GET_BFI_DATA, Stream_Frame_Size(GET_BFI_DATA, Cha_Num, correlation_length));
+	}
+	if (types & STREAM_TYPE_BIT(Intensity_Data_Type)) {
+		Dispatch_Reserve(&pDevice->dispatch, GET_INTENSITY, Stream_Frame_Size(GET_INTENSITY, Cha_Num, correlation_length));
+	}
+	if (types & STREAM_TYPE_BIT(Corr_Intensity_Data_Type)) {
+		Dispatch_Reserve(&pDevice->dispatch, GET_CORR_INTENSITY, Stream_Frame_Size(GET_CORR_INTENSITY, Cha_Num, correlation_length));
+	}
+}
+
+static int init_Recv_mutex(DCS_Device* pDevice) {
+	if (pDevice->hRecvDataMutex != NULL) {
 		return THREAD_ALREADY_EXISTS;
 	}
 
-	hRecvDataMutex = CreateMutexW(NULL, false, NULL);
-	if (hRecvDataMutex == NULL) {
+	pDevice->hRecvDataMutex = Mutex_Create();
+	if (pDevice->hRecvDataMutex == NULL) {
+		return THREAD_START_ERROR;
+	}
+
+	pDevice->pStoreCond = Cond_Create();
+	if (pDevice->pStoreCond == NULL) {
+		close_Recv_mutex(pDevice);
 		return THREAD_START_ERROR;
 	}
 	return NO_DCS_ERROR;
 }
 
-static int close_Recv_mutex() {
-	if (hRecvDataMutex == NULL) {
+static int close_Recv_mutex(DCS_Device* pDevice) {
+	if (pDevice->hRecvDataMutex == NULL) {
 		return NO_DCS_ERROR;
 	}
 
-	int result = CloseHandle(hRecvDataMutex);
+	if (pDevice->pStoreCond != NULL) {
+		Cond_Destroy(pDevice->pStoreCond);
+		pDevice->pStoreCond = NULL;
+	}
+	Mutex_Destroy(pDevice->hRecvDataMutex);
 
-	hRecvDataMutex = NULL;
+	pDevice->hRecvDataMutex = NULL;
 
-	return result;
+	return NO_DCS_ERROR;
 }
 
-static inline void set_Recv_mutex() {
-	if (hRecvDataMutex == NULL) {
+static inline void set_Recv_mutex(DCS_Device* pDevice) {
+	if (pDevice->hRecvDataMutex == NULL) {
 		return;
 	}
 
-	WaitForSingleObject(hRecvDataMutex, INFINITE);
+	Mutex_Lock(pDevice->hRecvDataMutex);
 }
 
-static inline void release_Recv_mutex() {
-	if (hRecvDataMutex == NULL) {
+static inline void release_Recv_mutex(DCS_Device* pDevice) {
+	if (pDevice->hRecvDataMutex == NULL) {
 		return;
 	}
 
-	ReleaseMutex(hRecvDataMutex);
+	Mutex_Unlock(pDevice->hRecvDataMutex);
 }
 
-static int init_Callback_mutex() {
-	if (hCallbacksMutex != NULL) {
+static int init_Callback_mutex(DCS_Device* pDevice) {
+	if (pDevice->hCallbacksMutex != NULL) {
 		return THREAD_ALREADY_EXISTS;
 	}
 
-	hCallbacksMutex = CreateMutexW(NULL, false, NULL);
-	if (hCallbacksMutex == NULL) {
+	pDevice->hCallbacksMutex = Mutex_Create();
+	if (pDevice->hCallbacksMutex == NULL) {
 		return THREAD_START_ERROR;
 	}
 	return NO_DCS_ERROR;
 }
 
-static int close_Callback_mutex() {
-	if (hCallbacksMutex == NULL) {
+static int close_Callback_mutex(DCS_Device* pDevice) {
+	if (pDevice->hCallbacksMutex == NULL) {
 		return NO_DCS_ERROR;
 	}
 
-	int result = CloseHandle(hCallbacksMutex);
+	Mutex_Destroy(pDevice->hCallbacksMutex);
 
-	hCallbacksMutex = NULL;
+	pDevice->hCallbacksMutex = NULL;
 
-	return result;
+	return NO_DCS_ERROR;
 }
 
-static void set_Callbacks(Receive_Callbacks local_callbacks, bool local_should_store) {
-	WaitForSingleObject(hCallbacksMutex, INFINITE);
-	callbacks = local_callbacks;
-	should_store = local_should_store;
-	ReleaseMutex(hCallbacksMutex);
+static int set_Callbacks(DCS_Device* pDevice, Receive_Callbacks local_callbacks, DCS_Callbacks handlers, void* pContext, bool local_should_store) {
+	Callback_Set* pSet = malloc(sizeof(*pSet));
+	if (pSet == NULL) {
+		return MEMORY_ALLOCATION_ERROR;
+	}
+	pSet->callbacks = local_callbacks;
+	pSet->handlers = handlers;
+	pSet->pContext = pContext;
+	pSet->should_store = local_should_store;
+	pSet->pNextItem = NULL;
+
+	//If the callbacks mutex is NULL, the device isn't open, so nothing can be reading the old set.
+	if (pDevice->hCallbacksMutex == NULL) {
+		free(Atomic_Exchange_Pointer((void* volatile*)&pDevice->pCallbackSet, pSet));
+		return NO_DCS_ERROR;
+	}
+
+	//The exchange also publishes the set's contents to the threads that load it.
+	Mutex_Lock(pDevice->hCallbacksMutex);
+	Callback_Set* pOld = Atomic_Exchange_Pointer((void* volatile*)&pDevice->pCallbackSet, pSet);
+	if (pOld != NULL) {
+		//Counted after the exchange, so a thread that was waiting can only load the new set once it runs again.
+		pOld->loop_passes = Event_Loop_Passes(pDevice);
+		pOld->dispatch_threads = Dispatch_Passes(&pDevice->dispatch, pOld->dispatch_passes);
+		pOld->pNextItem = pDevice->pRetiredSets;
+		pDevice->pRetiredSets = pOld;
+	}
+	reclaim_Callbacks(pDevice);
+	Mutex_Unlock(pDevice->hCallbacksMutex);
+
+	return NO_DCS_ERROR;
 }
 
-static void get_Callbacks(Receive_Callbacks* local_callbacks, bool* local_should_store) {
-	WaitForSingleObject(hCallbacksMutex, INFINITE);
-	*local_callbacks = callbacks;
-	*local_should_store = should_store;
-	ReleaseMutex(hCallbacksMutex);
+static void reclaim_Callbacks(DCS_Device* pDevice) {
+	const unsigned __int32 loop_passes = Event_Loop_Passes(pDevice);
+	unsigned __int32 dispatch_passes[DCS_MAX_DISPATCH_THREADS];
+	const unsigned int dispatch_threads = Dispatch_Passes(&pDevice->dispatch, dispatch_passes);
+
+	//A set is still in use while a thread whose count was odd when it was retired has the same count.
+	Callback_Set** ppSet = &pDevice->pRetiredSets;
+	while (*ppSet != NULL) {
+		Callback_Set* pSet = *ppSet;
+		bool in_use = (pSet->loop_passes & 1) != 0 && pSet->loop_passes == loop_passes;
+		for (unsigned int x = 0; x < pSet->dispatch_threads && x < dispatch_threads && !in_use; x++) {
+			in_use = (pSet->dispatch_passes[x] & 1) != 0 && pSet->dispatch_passes[x] == dispatch_passes[x];
+		}
+
+		if (in_use) {
+			ppSet = &pSet->pNextItem;
+			continue;
+		}
+		*ppSet = pSet->pNextItem;
+		free(pSet);
+	}
 }
 
-static void clear_Recv_FIFO(void) {
-	set_Recv_mutex();
-	Received_Data_Item* item = pRecv_Data_FIFO_Head;
-	while (item != NULL) {
-		if (item->data_type == Corr_Intensity_Data_Type) {
-#pragma warning (disable: 6001)
-			Array_Data array_data[2] = { 0 };
-			memcpy(array_data, item->data, sizeof(*array_data) * 2);
+static inline const Callback_Set* get_Callbacks(DCS_Device* pDevice) {
+	static const Callback_Set no_callbacks = { 0 };
 
-			Corr_Intensity_Data* data = array_data[0].ptr;
-			for (int x = 0; x < array_data[0].length; x++) {
-				free(data[x].pCorrBuf);
-			}
+	const Callback_Set* pSet = Atomic_Load_Pointer_Acquire((void* const volatile*)&pDevice->pCallbackSet);
+	return pSet != NULL ? pSet : &no_callbacks;
+}
 
-			free(array_data[0].ptr);
-			free(array_data[1].ptr);
-#pragma warning (default: 6001)
+static bool get_Should_Store(DCS_Device* pDevice) {
+	//Other threads don't hold back the freeing of retired sets, so they only read one under the mutex.
+	if (pDevice->hCallbacksMutex == NULL) {
+		return get_Callbacks(pDevice)->should_store;
+	}
+
+	Mutex_Lock(pDevice->hCallbacksMutex);
+	const bool should_store = get_Callbacks(pDevice)->should_store;
+	Mutex_Unlock(pDevice->hCallbacksMutex);
+	return should_store;
+}
+
+static void free_Callbacks(DCS_Device* pDevice) {
+	free(Atomic_Exchange_Pointer((void* volatile*)&pDevice->pCallbackSet, NULL));
+
+	while (pDevice->pRetiredSets != NULL) {
+		Callback_Set* pSet = pDevice->pRetiredSets;
+		pDevice->pRetiredSets = pSet->pNextItem;
+		free(pSet);
+	}
+}
+
+static void clear_Recv_FIFO(DCS_Device* pDevice) {
+	set_Recv_mutex(pDevice);
+	for (int x = 0; x < Data_Item_Type_Count; x++) {
+		Recv_Ring* pRing = &pDevice->recv_rings[x];
+
+		Received_Data_Item* item;
+		while ((item = recv_ring_pop(pRing)) != NULL) {
+			release_Recv_Item(pDevice, item);
+		}
+		free_Recv_Slots(pRing);
+
+		free(pRing->ppItems);
+		pRing->ppItems = NULL;
+		pRing->capacity = 0;
+		pRing->head = 0;
+	}
+	release_Recv_mutex(pDevice);
+}
+
+static void clear_Trans_FIFO(DCS_Device* pDevice) {
+	Transmission_Data_Type* trans_data;
+	while ((trans_data = Dequeue_Trans_FIFO(pDevice)) != NULL) {
+		Request_Release(trans_data->pRequest);
+		free(trans_data);
+	}
+}
+
+Transmission_Data_Type* Alloc_Transmission(unsigned __int32 size) {
+	const size_t pool_capacity = TRANSMISSION_POOL_BLOCK_SIZE - sizeof(Transmission_Data_Type);
+	Transmission_Data_Type* pTransmission = NULL;
+
+	if (size <= pool_capacity) {
+		//Reuse a pooled buffer if there's one available.
+		if (trans_pool_ready()) {
+			pTransmission = Queue_Pop(&trans_pool);
 		}
-		else if (item->data_type > After_This_Are_Arrays) {
-			Array_Data array_data = { 0 };
-			memcpy(&array_data, item->data, sizeof(array_data));
 
-			free(array_data.ptr);
+		//Small frames get a full block so that they can be returned to the pool once sent.
+		if (pTransmission == NULL) {
+			pTransmission = malloc(TRANSMISSION_POOL_BLOCK_SIZE);
+			if (pTransmission == NULL) {
+				return NULL;
+			}
+		}
+		pTransmission->capacity = (unsigned __int32)pool_capacity;
+	}
+	else {
+		//The struct and frame share a single allocation. The DCS's framer would drop the connection over a bigger frame.
+		if (size > sizeof(unsigned __int32) + FRAMER_MAX_FRAME_SIZE) {
+			return NULL;
 		}
+		pTransmission = malloc(sizeof(*pTransmission) + size);
+		if (pTransmission == NULL) {
+			return NULL;
+		}
+		pTransmission->capacity = size;
+	}
+
+	pTransmission->pFrame = (char*)(pTransmission + 1);
+	pTransmission->pRequest = NULL;
+	pTransmission->shared = false;
+	pTransmission->pNextItem = NULL;
+
+	return pTransmission;
+}
+
+void Free_Transmission(Transmission_Data_Type* pTransmission) {
+	if (pTransmission == NULL) {
+		return;
+	}
+
+	//Only set if the frame was never taken to be sent.
+	Request_Release(pTransmission->pRequest);
+	pTransmission->pRequest = NULL;
+
+	//Only blocks that came from the pool are returned to it, and only while it has room.
+	if (pTransmission->capacity == TRANSMISSION_POOL_BLOCK_SIZE - sizeof(Transmission_Data_Type) &&
+		trans_pool_ready() && Queue_Push(&trans_pool, pTransmission)) {
+		return;
+	}
+
+	free(pTransmission);
+}
+
+static void init_Trans_Pool(void) {
+	if (!trans_pool_ready()) {
+		Queue_Init(&trans_pool, trans_pool_cells, TRANSMISSION_POOL_MAX_BLOCKS);
+		Atomic_Store_Release(&trans_pool_state, 1);
+	}
+}
+
+static inline bool trans_pool_ready(void) {
+	return Atomic_Load_Acquire(&trans_pool_state) != 0;
+}
+
+static void clear_Trans_Pool(void) {
+	if (!trans_pool_ready()) {
+		return;
+	}
+
+	Transmission_Data_Type* pool_item;
+	while ((pool_item = Queue_Pop(&trans_pool)) != NULL) {
+		free(pool_item);
+	}
+}
+
+static int join_Network(void) {
+	//Opening and closing are rare and quick, so devices opened or closed at once just take turns.
+	while (!Atomic_Compare_Exchange(&network_lock, 0, 1)) {
+		Sleep(0);
+	}
+
+	if (network_users == 0) {
+		WSADATA wsaData;
+		const int iResult = WSAStartup(MAKEWORD(2, 2), &wsaData);
+		if (iResult != 0) {
+			Atomic_Store_Release(&network_lock, 0);
+			printf("WSAStartup failed with error: %d\n", iResult);
+			return NETWORK_INIT_ERROR;
+		}
+		init_Trans_Pool();
+	}
+	network_users++;
+
+	Atomic_Store_Release(&network_lock, 0);
+	return NO_DCS_ERROR;
+}
+
+static void leave_Network(void) {
+	while (!Atomic_Compare_Exchange(&network_lock, 0, 1)) {
+		Sleep(0);
+	}
+
+	//Frames freed after this go back to the pool, which stays set up, and are freed once the devices opened next are closed.
+	network_users--;
+	if (network_users == 0) {
+		clear_Trans_Pool();
+		WSACleanup();
+	}
+
+	Atomic_Store_Release(&network_lock, 0);
+}
+
+static void keep_alive_due(Timer* pTimer, void* pContext) {
+	DCS_Device* pDevice = pContext;
+	const unsigned __int64 currTime = Clock_Now_Ns();
+	const unsigned __int64 due = pDevice->last_response + CHECK_CONNECTION_FREQ * CLOCK_NS_PER_SEC;
+
+	//Data arriving doesn't move the timer, so it may have fired before the check is due.
+	if (currTime < due) {
+		Timer_Schedule(pDevice->pWheel, pTimer, due);
+		return;
+	}
 
-		Received_Data_Item* tmp_item = item;
-		item = item->pNextItem;
+	//Data waiting while reads are held shows the connection is alive.
+	if (pDevice->reads_held) {
+		Timer_Schedule(pDevice->pWheel, pTimer, currTime + CHECK_CONNECTION_FREQ * CLOCK_NS_PER_SEC);
+		return;
+	}
 
-		free(tmp_item->data);
-		free(tmp_item);
+	//Only check the connection when nothing is already waiting for a response, since its deadline covers it.
+	if (pDevice->commands_pending == 0) {
+		Send_Check_Network(pDevice);
+		//printf("Checking Network\n");
 	}
-	pRecv_Data_FIFO_Head = NULL;
-	pRecv_Data_FIFO_Tail = NULL;
-	release_Recv_mutex();
+	Timer_Schedule(pDevice->pWheel, pTimer, currTime + CHECK_CONNECTION_FREQ * CLOCK_NS_PER_SEC);
 }
 
-static void clear_Trans_FIFO(void) {
-	set_FIFO_mutex();
-	Transmission_Data_Type* trans_data = pTrans_FIFO_Head;
-	while (trans_data != NULL) {
-		Transmission_Data_Type* tmp_item = trans_data;
-		trans_data = trans_data->pNextItem;
-
-		free(tmp_item->pFrame);
-		free(tmp_item);
-	}
-	pTrans_FIFO_Head = NULL;
-	pTrans_FIFO_Tail = NULL;
-	release_FIFO_mutex();
+static void reset_Timer(DCS_Device* pDevice) {
+	pDevice->last_response = Clock_Now_Ns();
 }
 
-static void check_Timer(void) {
-	const clock_t currTime = clock();
-	const double currTimeSec = currTime / CLOCKS_PER_SEC;
+static void request_deadline_due(Timer* pTimer, void* pContext) {
+	DCS_Device* pDevice = pContext;
+	Request_Expire(pDevice);
+	arm_Request_Deadline(pDevice);
+}
 
-	if ((currTimeSec - last_Response_Time) >= CHECK_CONNECTION_FREQ) {
-		Send_Check_Network();
-		//printf("Checking Network\n");
-	}
+static inline void pass_Due(DCS_Device* pDevice) {
+	//Timers fire before the loop picks the devices to pass, so the flag is seen straight away.
+	Atomic_Store_Release(&pDevice->pass_due, 1);
 }
 
-static void reset_Timer(void) {
-	const clock_t currTime = clock();
-	last_Response_Time = currTime / CLOCKS_PER_SEC;
+static void arm_Request_Deadline(DCS_Device* pDevice) {
+	unsigned __int64 next = ~(unsigned __int64)0;
+	Request_Next_Deadline(pDevice, &next);
+
+	if (next == ~(unsigned __int64)0) {
+		Timer_Cancel(pDevice->pWheel, &pDevice->request_deadline);
+	}
+	else if (!Timer_Armed(&pDevice->request_deadline) || pDevice->request_deadline.expires != next) {
+		Timer_Schedule(pDevice->pWheel, &pDevice->request_deadline, next);
+	}
 }
 
 //////////////////////////////////////////////////////////////////////////////////////
 //Each of the following functions are internallly called callbacks. They will call the
-//user-defined callback it was passed in Initialize_COM_Task.
+//user-defined callbacks the device was given in Initialize_COM_Task or DCS_Open.
 //////////////////////////////////////////////////////////////////////////////////////
 
-#define GETTER_FUNCTION(arg) int Get_##arg##_Data(arg ## * output) {\
-	set_Recv_mutex();\
-	Received_Data_Item* item = pRecv_Data_FIFO_Head;\
-	Received_Data_Item* prev_item = NULL;\
-	while (item != NULL) {\
-		if (item->data_type == arg ## _Type) {\
-			memcpy(output, item->data, sizeof(*output));\
+//Each getter takes from a device's store, and its legacy version from the default device's.
+#define GETTER_FUNCTION(arg) int DCS_Get_##arg##_Data(DCS_Handle hDevice, arg* output) {\
+	Received_Data_Item* item = take_Recv_Item(hDevice, arg ## _Type);\
+	if (item == NULL) {\
+		return 1;\
+	}\
+\
+	memcpy(output, item->data, sizeof(*output));\
 \
-			if (prev_item != NULL) {\
-				prev_item->pNextItem = item->pNextItem;\
-				if (prev_item->pNextItem == NULL) {\
-					pRecv_Data_FIFO_Tail = prev_item;\
-				}\
-			}\
-			else {\
-				pRecv_Data_FIFO_Head = item->pNextItem;\
-				if (pRecv_Data_FIFO_Head == NULL) {\
-					pRecv_Data_FIFO_Tail = NULL;\
-				}\
-			}\
+	free(item->data);\
+	free(item);\
+	return NO_DCS_ERROR;\
+}\
+\
+int Get_##arg##_Data(arg* output) {\
+	return DCS_Get_##arg##_Data(&default_device, output);\
+}
+
+#define ARRAY_GETTER_FUNCTION(arg) int DCS_Get_##arg##_Data(DCS_Handle hDevice, arg** output, int* number) {\
+	Received_Data_Item* item = take_Recv_Item(hDevice, arg ## _Type);\
+	if (item == NULL) {\
+		return 1;\
+	}\
 \
-			release_Recv_mutex();\
+	Array_Data arr = { 0 };\
+	const int result = hand_out_Array(hDevice, item, &arr);\
+	if (result != NO_DCS_ERROR) {\
+		return result;\
+	}\
 \
-			free(item->data);\
-			free(item);\
-			return NO_DCS_ERROR;\
-		}\
+	*number = arr.length;\
+	*output = arr.ptr;\
+	return NO_DCS_ERROR;\
+}\
 \
-		prev_item = item;\
-		item = item->pNextItem;\
+int Get_##arg##_Data(arg** output, int* number) {\
+	return DCS_Get_##arg##_Data(&default_device, output, number);\
+}
+
+//Each borrowing getter lends the application the slot an item is kept in, and its release drops the reference the
+//store held while it was stored.
+#define BORROWING_GETTER_FUNCTION(arg) int DCS_Acquire_##arg(DCS_Handle hDevice, const arg** output, int* number) {\
+	Received_Data_Item* item = borrow_Recv_Item(hDevice, arg ## _Type);\
+	if (item == NULL) {\
+		return 1;\
 	}\
-	release_Recv_mutex();\
-	return 1;\
-}
-
-#define ARRAY_GETTER_FUNCTION(arg) int Get_##arg##_Data(arg ## ** output, int* number) {\
-	set_Recv_mutex();\
-	Received_Data_Item* item = pRecv_Data_FIFO_Head;\
-	Received_Data_Item* prev_item = NULL;\
-	while (item != NULL) {\
-		if (item->data_type == arg ## _Type) {\
-			Array_Data arr = { 0 };\
-			memcpy(&arr, item->data, sizeof(arr));\
 \
-			*number = arr.length;\
-			*output = arr.ptr;\
+	const Array_Data* arr = item->data;\
+	*number = arr->length;\
+	*output = arr->ptr;\
+	return NO_DCS_ERROR;\
+}\
 \
-			if (prev_item != NULL) {\
-				prev_item->pNextItem = item->pNextItem;\
-				if (prev_item->pNextItem == NULL) {\
-					pRecv_Data_FIFO_Tail = prev_item;\
-				}\
-			}\
-			else {\
-				pRecv_Data_FIFO_Head = item->pNextItem;\
-				if (pRecv_Data_FIFO_Head == NULL) {\
-					pRecv_Data_FIFO_Tail = NULL;\
-				}\
-			}\
+int Acquire_##arg(const arg** output, int* number) {\
+	return DCS_Acquire_##arg(&default_device, output, number);\
+}\
 \
-			release_Recv_mutex();\
+int DCS_Release_##arg(DCS_Handle hDevice, const arg* pData) {\
+	return release_Borrowed_Item(hDevice, arg ## _Type, pData);\
+}\
 \
-			free(item->data);\
-			free(item);\
-			return NO_DCS_ERROR;\
-		}\
+int Release_##arg(const arg* pData) {\
+	return DCS_Release_##arg(&default_device, pData);\
+}
+
+//Each drain copies the oldest items that fit into the application's buffer while holding the store's lock once.
+#define DRAIN_FUNCTION(arg) int DCS_Drain_##arg(DCS_Handle hDevice, arg* output, int capacity, int* frames, int* per_frame_cha) {\
+	return drain_Recv_Items(hDevice, arg ## _Type, output, sizeof(*output), capacity, frames, per_frame_cha);\
+}\
 \
-		prev_item = item;\
-		item = item->pNextItem;\
-	}\
-	release_Recv_mutex();\
-	return 1;\
+int Drain_##arg(arg* output, int capacity, int* frames, int* per_frame_cha) {\
+	return DCS_Drain_##arg(&default_device, output, capacity, frames, per_frame_cha);\
 }
 
-void Get_DCS_Status_CB(bool bCorr, bool bAnalyzer, int DCS_Cha_Num) {
-	Receive_Callbacks local_callbacks = { 0 };
-	bool should_store = false;
-	get_Callbacks(&local_callbacks, &should_store);
+void Get_DCS_Status_CB(DCS_Device* pDevice, bool bCorr, bool bAnalyzer, int DCS_Cha_Num, Sequence_ID sequence) {
+	const Callback_Set* pCallbacks = get_Callbacks(pDevice);
 
-	if (local_callbacks.Get_DCS_Status_CB != NULL) {
-		local_callbacks.Get_DCS_Status_CB(bCorr, bAnalyzer, DCS_Cha_Num);
+	if (pCallbacks->callbacks.Get_DCS_Status_CB != NULL) {
+		pCallbacks->callbacks.Get_DCS_Status_CB(bCorr, bAnalyzer, DCS_Cha_Num);
 	}
+	if (pCallbacks->handlers.Get_DCS_Status_CB != NULL) {
+		pCallbacks->handlers.Get_DCS_Status_CB(pCallbacks->pContext, bCorr, bAnalyzer, DCS_Cha_Num);
+	}
+
+	//Resolves the request the reply answers, if it was sent with one.
+	DCS_Response reply = { .data.dcs_status = { .bCorr = bCorr, .bAnalyzer = bAnalyzer, .DCS_Cha_Num = DCS_Cha_Num } };
+	Request_Reply(pDevice, GET_DCS_STATUS, sequence, &reply);
 
-	if (should_store) {
+	if (pCallbacks->should_store) {
 		DCS_Status status = {
 			.bCorr = bCorr,
 			.bAnalyzer = bAnalyzer,
@@ -948,6 +2654,7 @@ void Get_DCS_Status_CB(bool bCorr, bool bAnalyzer, int DCS_Cha_Num) {
 		}
 
 		data->data_type = DCS_Status_Type;
+		data->pooled = false;
 		data->data = malloc(sizeof(status));
 		if (data->data == NULL) {
 			free(data);
@@ -956,28 +2663,33 @@ void Get_DCS_Status_CB(bool bCorr, bool bAnalyzer, int DCS_Cha_Num) {
 
 		memcpy(data->data, &status, sizeof(status));
 
-		Enqueue_Recv_FIFO(data);
+		Enqueue_Recv_FIFO(pDevice, data);
 	}
 }
 
 GETTER_FUNCTION(DCS_Status)
 
-void Get_Correlator_Setting_CB(Correlator_Setting* pCorrelator_Setting) {
-	Receive_Callbacks local_callbacks = { 0 };
-	bool should_store = false;
-	get_Callbacks(&local_callbacks, &should_store);
+void Get_Correlator_Setting_CB(DCS_Device* pDevice, Correlator_Setting* pCorrelator_Setting, Sequence_ID sequence) {
+	const Callback_Set* pCallbacks = get_Callbacks(pDevice);
 
-	if (local_callbacks.Get_Correlator_Setting_CB != NULL) {
-		local_callbacks.Get_Correlator_Setting_CB(pCorrelator_Setting);
+	if (pCallbacks->callbacks.Get_Correlator_Setting_CB != NULL) {
+		pCallbacks->callbacks.Get_Correlator_Setting_CB(pCorrelator_Setting);
 	}
+	if (pCallbacks->handlers.Get_Correlator_Setting_CB != NULL) {
+		pCallbacks->handlers.Get_Correlator_Setting_CB(pCallbacks->pContext, pCorrelator_Setting);
+	}
+
+	DCS_Response reply = { .data.correlator_setting = *pCorrelator_Setting };
+	Request_Reply(pDevice, GET_CORRELATOR_SETTING, sequence, &reply);
 
-	if (should_store) {
+	if (pCallbacks->should_store) {
 		Received_Data_Item* data = malloc(sizeof(*data));
 		if (data == NULL) {
 			return;
 		}
 
 		data->data_type = Correlator_Setting_Type;
+		data->pooled = false;
 		data->data = malloc(sizeof(*pCorrelator_Setting));
 		if (data->data == NULL) {
 			free(data);
@@ -986,28 +2698,33 @@ void Get_Correlator_Setting_CB(Correlator_Setting* pCorrelator_Setting) {
 
 		memcpy(data->data, pCorrelator_Setting, sizeof(*pCorrelator_Setting));
 
-		Enqueue_Recv_FIFO(data);
+		Enqueue_Recv_FIFO(pDevice, data);
 	}
 }
 
 GETTER_FUNCTION(Correlator_Setting)
 
-void Get_Analyzer_Setting_CB(Analyzer_Setting* pAnalyzer_Setting, int Cha_Num) {
-	Receive_Callbacks local_callbacks = { 0 };
-	bool should_store = false;
-	get_Callbacks(&local_callbacks, &should_store);
+void Get_Analyzer_Setting_CB(DCS_Device* pDevice, Analyzer_Setting* pAnalyzer_Setting, int Cha_Num, Sequence_ID sequence) {
+	const Callback_Set* pCallbacks = get_Callbacks(pDevice);
 
-	if (local_callbacks.Get_Analyzer_Setting_CB != NULL) {
-		local_callbacks.Get_Analyzer_Setting_CB(pAnalyzer_Setting, Cha_Num);
+	if (pCallbacks->callbacks.Get_Analyzer_Setting_CB != NULL) {
+		pCallbacks->callbacks.Get_Analyzer_Setting_CB(pAnalyzer_Setting, Cha_Num);
 	}
+	if (pCallbacks->handlers.Get_Analyzer_Setting_CB != NULL) {
+		pCallbacks->handlers.Get_Analyzer_Setting_CB(pCallbacks->pContext, pAnalyzer_Setting, Cha_Num);
+	}
+
+	DCS_Response reply = { .data.analyzer_setting = { .pAnalyzer_Setting = pAnalyzer_Setting, .Cha_Num = Cha_Num } };
+	Request_Reply(pDevice, GET_ANALYZER_SETTING, sequence, &reply);
 
-	if (should_store) {
+	if (pCallbacks->should_store) {
 		Received_Data_Item* data = malloc(sizeof(*data));
 		if (data == NULL) {
 			return;
 		}
 
 		data->data_type = Analyzer_Setting_Type;
+		data->pooled = false;
 		Array_Data* arr = malloc(sizeof(*arr));
 		if (arr == NULL) {
 			free(data);
@@ -1028,28 +2745,33 @@ void Get_Analyzer_Setting_CB(Analyzer_Setting* pAnalyzer_Setting, int Cha_Num) {
 
 		data->data = arr;
 
-		Enqueue_Recv_FIFO(data);
+		Enqueue_Recv_FIFO(pDevice, data);
 	}
 }
 
 ARRAY_GETTER_FUNCTION(Analyzer_Setting)
 
-void Get_Analyzer_Prefit_Param_CB(Analyzer_Prefit_Param* pAnalyzer_Prefit) {
-	Receive_Callbacks local_callbacks = { 0 };
-	bool should_store = false;
-	get_Callbacks(&local_callbacks, &should_store);
+void Get_Analyzer_Prefit_Param_CB(DCS_Device* pDevice, Analyzer_Prefit_Param* pAnalyzer_Prefit, Sequence_ID sequence) {
+	const Callback_Set* pCallbacks = get_Callbacks(pDevice);
 
-	if (local_callbacks.Get_Analyzer_Prefit_Param_CB != NULL) {
-		local_callbacks.Get_Analyzer_Prefit_Param_CB(pAnalyzer_Prefit);
+	if (pCallbacks->callbacks.Get_Analyzer_Prefit_Param_CB != NULL) {
+		pCallbacks->callbacks.Get_Analyzer_Prefit_Param_CB(pAnalyzer_Prefit);
 	}
+	if (pCallbacks->handlers.Get_Analyzer_Prefit_Param_CB != NULL) {
+		pCallbacks->handlers.Get_Analyzer_Prefit_Param_CB(pCallbacks->pContext, pAnalyzer_Prefit);
+	}
+
+	DCS_Response reply = { .data.analyzer_prefit_param = *pAnalyzer_Prefit };
+	Request_Reply(pDevice, GET_ANALYZER_PREFIT_PARAM, sequence, &reply);
 
-	if (should_store) {
+	if (pCallbacks->should_store) {
 		Received_Data_Item* data = malloc(sizeof(*data));
 		if (data == NULL) {
 			return;
 		}
 
 		data->data_type = Analyzer_Prefit_Param_Type;
+		data->pooled = false;
 		data->data = malloc(sizeof(*pAnalyzer_Prefit));
 		if (data->data == NULL) {
 			free(data);
@@ -1058,28 +2780,33 @@ void Get_Analyzer_Prefit_Param_CB(Analyzer_Prefit_Param* pAnalyzer_Prefit) {
 
 		memcpy(data->data, pAnalyzer_Prefit, sizeof(*pAnalyzer_Prefit));
 
-		Enqueue_Recv_FIFO(data);
+		Enqueue_Recv_FIFO(pDevice, data);
 	}
 }
 
 GETTER_FUNCTION(Analyzer_Prefit_Param)
 
-void Get_Simulated_Correlation_CB(Simulated_Correlation* Simulated_Corr) {
-	Receive_Callbacks local_callbacks = { 0 };
-	bool should_store = false;
-	get_Callbacks(&local_callbacks, &should_store);
+void Get_Simulated_Correlation_CB(DCS_Device* pDevice, Simulated_Correlation* Simulated_Corr, Sequence_ID sequence) {
+	const Callback_Set* pCallbacks = get_Callbacks(pDevice);
 
-	if (local_callbacks.Get_Simulated_Correlation_CB != NULL) {
-		local_callbacks.Get_Simulated_Correlation_CB(Simulated_Corr);
+	if (pCallbacks->callbacks.Get_Simulated_Correlation_CB != NULL) {
+		pCallbacks->callbacks.Get_Simulated_Correlation_CB(Simulated_Corr);
 	}
+	if (pCallbacks->handlers.Get_Simulated_Correlation_CB != NULL) {
+		pCallbacks->handlers.Get_Simulated_Correlation_CB(pCallbacks->pContext, Simulated_Corr);
+	}
+
+	DCS_Response reply = { .data.simulated_correlation = *Simulated_Corr };
+	Request_Reply(pDevice, GET_SIMULATED_DATA, sequence, &reply);
 
-	if (should_store) {
+	if (pCallbacks->should_store) {
 		Received_Data_Item* data = malloc(sizeof(*data));
 		if (data == NULL) {
 			return;
 		}
 
 		data->data_type = Simulated_Correlation_Type;
+		data->pooled = false;
 		data->data = malloc(sizeof(*Simulated_Corr));
 		if (data->data == NULL) {
 			free(data);
@@ -1088,70 +2815,49 @@ void Get_Simulated_Correlation_CB(Simulated_Correlation* Simulated_Corr) {
 
 		memcpy(data->data, Simulated_Corr, sizeof(*Simulated_Corr));
 
-		Enqueue_Recv_FIFO(data);
+		Enqueue_Recv_FIFO(pDevice, data);
 	}
 }
 
 GETTER_FUNCTION(Simulated_Correlation)
 
-void Get_BFI_Data(BFI_Data* pBFI_Data, int Cha_Num) {
-	Receive_Callbacks local_callbacks = { 0 };
-	bool should_store = false;
-	get_Callbacks(&local_callbacks, &should_store);
+void Get_BFI_Data(DCS_Device* pDevice, const BFI_Data* pBFI_Data, int Cha_Num, Received_Data_Item* pFrame) {
+	const Callback_Set* pCallbacks = get_Callbacks(pDevice);
 
-	if (local_callbacks.Get_BFI_Data != NULL) {
-		local_callbacks.Get_BFI_Data(pBFI_Data, Cha_Num);
+	if (pCallbacks->callbacks.Get_BFI_Data != NULL) {
+		pCallbacks->callbacks.Get_BFI_Data(pBFI_Data, Cha_Num);
+	}
+	if (pCallbacks->handlers.Get_BFI_Data != NULL) {
+		pCallbacks->handlers.Get_BFI_Data(pCallbacks->pContext, pBFI_Data, Cha_Num);
 	}
 
-	if (should_store) {
-		Received_Data_Item* data = malloc(sizeof(*data));
-		if (data == NULL) {
-			return;
-		}
-
-		data->data_type = BFI_Data_Type;
-		Array_Data* arr = malloc(sizeof(*arr));
-		if (arr == NULL) {
-			free(data);
-			return;
-		}
-
-		arr->length = Cha_Num;
-
-		const size_t dataSize = sizeof(*pBFI_Data) * Cha_Num;
-		arr->ptr = malloc(dataSize);
-		if (arr->ptr == NULL) {
-			free(data);
-			free(arr);
-			return;
-		}
-
-		memcpy(arr->ptr, pBFI_Data, dataSize);
-
-		data->data = arr;
-
-		Enqueue_Recv_FIFO(data);
+	if (pCallbacks->should_store) {
+		store_Array(pDevice, BFI_Data_Type, pBFI_Data, Cha_Num, sizeof(*pBFI_Data), pFrame);
 	}
 }
 
 ARRAY_GETTER_FUNCTION(BFI_Data)
+BORROWING_GETTER_FUNCTION(BFI_Data)
+DRAIN_FUNCTION(BFI_Data)
 
-void Get_Error_Message_CB(Error_Message* pMessage, unsigned __int32 Size) {
-	Receive_Callbacks local_callbacks = { 0 };
-	bool should_store = false;
-	get_Callbacks(&local_callbacks, &should_store);
+void Get_Error_Message_CB(DCS_Device* pDevice, Error_Message* pMessage, unsigned __int32 Size) {
+	const Callback_Set* pCallbacks = get_Callbacks(pDevice);
 
-	if (local_callbacks.Get_Error_Message_CB != NULL) {
-		local_callbacks.Get_Error_Message_CB(pMessage, Size);
+	if (pCallbacks->callbacks.Get_Error_Message_CB != NULL) {
+		pCallbacks->callbacks.Get_Error_Message_CB(pMessage, Size);
+	}
+	if (pCallbacks->handlers.Get_Error_Message_CB != NULL) {
+		pCallbacks->handlers.Get_Error_Message_CB(pCallbacks->pContext, pMessage, Size);
 	}
 
-	if (should_store) {
+	if (pCallbacks->should_store) {
 		Received_Data_Item* data = malloc(sizeof(*data));
 		if (data == NULL) {
 			return;
 		}
 
 		data->data_type = Error_Message_Type;
+		data->pooled = false;
 		Array_Data* arr = malloc(sizeof(*arr));
 		if (arr == NULL) {
 			free(data);
@@ -1172,203 +2878,485 @@ void Get_Error_Message_CB(Error_Message* pMessage, unsigned __int32 Size) {
 
 		data->data = arr;
 
-		Enqueue_Recv_FIFO(data);
+		Enqueue_Recv_FIFO(pDevice, data);
 	}
 }
 
 ARRAY_GETTER_FUNCTION(Error_Message)
 
-void Get_Error_Code_CB(unsigned __int32 code) {
-	Receive_Callbacks local_callbacks = { 0 };
-	bool should_store = false;
-	get_Callbacks(&local_callbacks, &should_store);
+void Get_Error_Code_CB(DCS_Device* pDevice, unsigned __int32 code) {
+	const Callback_Set* pCallbacks = get_Callbacks(pDevice);
 
-	if (local_callbacks.Get_Error_Code_CB != NULL) {
-		local_callbacks.Get_Error_Code_CB(code);
+	if (pCallbacks->callbacks.Get_Error_Code_CB != NULL) {
+		pCallbacks->callbacks.Get_Error_Code_CB(code);
+	}
+	if (pCallbacks->handlers.Get_Error_Code_CB != NULL) {
+		pCallbacks->handlers.Get_Error_Code_CB(pCallbacks->pContext, code);
 	}
 }
 
-void Get_BFI_Corr_Ready_CB(bool bReady) {
-	Receive_Callbacks local_callbacks = { 0 };
-	bool should_store = false;
-	get_Callbacks(&local_callbacks, &should_store);
+void Get_BFI_Corr_Ready_CB(DCS_Device* pDevice, bool bReady) {
+	const Callback_Set* pCallbacks = get_Callbacks(pDevice);
 
-	if (local_callbacks.Get_BFI_Corr_Ready_CB != NULL) {
-		local_callbacks.Get_BFI_Corr_Ready_CB(bReady);
+	if (pCallbacks->callbacks.Get_BFI_Corr_Ready_CB != NULL) {
+		pCallbacks->callbacks.Get_BFI_Corr_Ready_CB(bReady);
+	}
+	if (pCallbacks->handlers.Get_BFI_Corr_Ready_CB != NULL) {
+		pCallbacks->handlers.Get_BFI_Corr_Ready_CB(pCallbacks->pContext, bReady);
 	}
 }
 
-void Get_Corr_Intensity_Data_CB(Corr_Intensity_Data* pCorr_Intensity_Data, int Cha_Num, float* pDelayBuf, int Delay_Num) {
-	Receive_Callbacks local_callbacks = { 0 };
-	bool should_store = false;
-	get_Callbacks(&local_callbacks, &should_store);
+void Get_Corr_Intensity_Data_CB(DCS_Device* pDevice, const Corr_Intensity_Data* pCorr_Intensity_Data, int Cha_Num, const float* pDelayBuf, int Delay_Num, Received_Data_Item* pFrame) {
+	const Callback_Set* pCallbacks = get_Callbacks(pDevice);
 
-	if (local_callbacks.Get_Corr_Intensity_Data_CB != NULL) {
-		local_callbacks.Get_Corr_Intensity_Data_CB(pCorr_Intensity_Data, Cha_Num, pDelayBuf, Delay_Num);
+	if (pCallbacks->callbacks.Get_Corr_Intensity_Data_CB != NULL) {
+		pCallbacks->callbacks.Get_Corr_Intensity_Data_CB(pCorr_Intensity_Data, Cha_Num, pDelayBuf, Delay_Num);
+	}
+	if (pCallbacks->handlers.Get_Corr_Intensity_Data_CB != NULL) {
+		pCallbacks->handlers.Get_Corr_Intensity_Data_CB(pCallbacks->pContext, pCorr_Intensity_Data, Cha_Num, pDelayBuf, Delay_Num);
 	}
 
-	if (should_store) {
-		Received_Data_Item* data = malloc(sizeof(*data));
-		if (data == NULL) {
-			return;
-		}
-
-		data->data_type = Corr_Intensity_Data_Type;
-		Array_Data* arr = malloc(sizeof(*arr) * 2);
-		if (arr == NULL) {
-			free(data);
-			return;
-		}
+	if (!pCallbacks->should_store) {
+		return;
+	}
 
+	//The channels, their correlation buffers and the delays were decoded into the slot the store keeps them in, channels
+	//first. The callbacks only see them read-only, so the store takes its pointers from the slot itself.
+	if (pFrame != NULL) {
+		Array_Data* arr = pFrame->data;
+		char* pBlock = Frame_Buffer_Data(pFrame);
+		arr[0].ptr = pBlock;
 		arr[0].length = Cha_Num;
+		arr[1].ptr = pBlock + ((const char*)pDelayBuf - (const char*)pCorr_Intensity_Data);
 		arr[1].length = Delay_Num;
 
-		const size_t corrDataSize = sizeof(*pCorr_Intensity_Data) * Cha_Num;
-		arr[0].ptr = malloc(corrDataSize);
-		if (arr[0].ptr == NULL) {
-			free(data);
-			free(arr);
-			return;
-		}
+		keep_Frame_Buffer(pDevice, pFrame);
+		return;
+	}
 
-		//Make copy of pCorr_Intensity_Data
-		Corr_Intensity_Data* pCorr_Intensity_Data_Copy = malloc(corrDataSize);
-		if (pCorr_Intensity_Data_Copy == NULL) {
-			free(data);
-			free(arr[0].ptr);
-			free(arr);
-			return;
-		}
-		memcpy(pCorr_Intensity_Data_Copy, pCorr_Intensity_Data, corrDataSize);
+	//Otherwise a slot holds a copy of them, laid out the same way.
+	Received_Data_Item* data = take_Recv_Slot(pDevice, Corr_Intensity_Data_Type, corr_intensity_size(pCorr_Intensity_Data, Cha_Num, Delay_Num));
+	if (data == NULL) {
+		return;
+	}
 
-		for (__int32 x = 0; x < Cha_Num; x++) {
-#pragma warning (disable: 6385 6386)
-			const size_t listSize = sizeof(*(pCorr_Intensity_Data_Copy[x].pCorrBuf)) * pCorr_Intensity_Data_Copy[x].Data_Num;
-			pCorr_Intensity_Data_Copy[x].pCorrBuf = malloc(listSize);
-			if (pCorr_Intensity_Data_Copy[x].pCorrBuf == NULL) {
-				free(data);
-				free(arr[0].ptr);
-				free(arr);
-
-				for (__int32 y = 0; y < x; y++) {
-					free(pCorr_Intensity_Data_Copy[y].pCorrBuf);
-				}
-				free(pCorr_Intensity_Data_Copy);
-				return;
-			}
+	Array_Data* arr = data->data;
+	Corr_Intensity_Data* pChannels = Frame_Buffer_Data(data);
+	float* pValues = (float*)&pChannels[Cha_Num];
 
-			memcpy(pCorr_Intensity_Data_Copy[x].pCorrBuf, pCorr_Intensity_Data[x].pCorrBuf, listSize);
-#pragma warning (default: 6385 6386)
-		}
+	memcpy(pChannels, pCorr_Intensity_Data, sizeof(*pChannels) * Cha_Num);
+	for (__int32 x = 0; x < Cha_Num; x++) {
+		pChannels[x].pCorrBuf = pValues;
+		memcpy(pValues, pCorr_Intensity_Data[x].pCorrBuf, sizeof(*pValues) * pCorr_Intensity_Data[x].Data_Num);
+		pValues += pCorr_Intensity_Data[x].Data_Num;
+	}
+	memcpy(pValues, pDelayBuf, sizeof(*pValues) * Delay_Num);
 
-		memcpy(arr[0].ptr, pCorr_Intensity_Data_Copy, corrDataSize);
+	arr[0].ptr = pChannels;
+	arr[0].length = Cha_Num;
+	arr[1].ptr = pValues;
+	arr[1].length = Delay_Num;
 
-		const size_t delayDataSize = sizeof(*pDelayBuf) * Delay_Num;
-		arr[1].ptr = malloc(delayDataSize);
-		if (arr[1].ptr == NULL) {
-			free(data);
-			free(arr[0].ptr);
-			free(arr);
+	Enqueue_Recv_FIFO(pDevice, data);
+}
 
-			for (__int32 x = 0; x < Cha_Num; x++) {
-#pragma warning (disable: 6001)
-				free(pCorr_Intensity_Data_Copy[x].pCorrBuf);
-#pragma warning (default: 6001)
-			}
-			free(pCorr_Intensity_Data_Copy);
-			return;
-		}
+void Get_Corr_Intensity_View_CB(DCS_Device* pDevice, const Corr_Intensity_View* pView) {
+	const Callback_Set* pCallbacks = get_Callbacks(pDevice);
 
-		free(pCorr_Intensity_Data_Copy);
+	if (pCallbacks->callbacks.Get_Corr_Intensity_View_CB != NULL) {
+		pCallbacks->callbacks.Get_Corr_Intensity_View_CB(pView);
+	}
+	if (pCallbacks->handlers.Get_Corr_Intensity_View_CB != NULL) {
+		pCallbacks->handlers.Get_Corr_Intensity_View_CB(pCallbacks->pContext, pView);
+	}
+}
 
-		memcpy(arr[1].ptr, pDelayBuf, delayDataSize);
+void Get_Reconnect_CB(DCS_Device* pDevice, const Reconnect_Info* pInfo) {
+	const Callback_Set* pCallbacks = get_Callbacks(pDevice);
 
-		data->data = arr;
+	if (pCallbacks->callbacks.Get_Reconnect_CB != NULL) {
+		pCallbacks->callbacks.Get_Reconnect_CB(pInfo);
+	}
+	if (pCallbacks->handlers.Get_Reconnect_CB != NULL) {
+		pCallbacks->handlers.Get_Reconnect_CB(pCallbacks->pContext, pInfo);
+	}
+}
+
+void Get_Corr_Intensity_Matrix_CB(DCS_Device* pDevice, const Corr_Intensity_Matrix* pMatrix) {
+	const Callback_Set* pCallbacks = get_Callbacks(pDevice);
+
+	if (pCallbacks->callbacks.Get_Corr_Intensity_Matrix_CB != NULL) {
+		pCallbacks->callbacks.Get_Corr_Intensity_Matrix_CB(pMatrix);
+	}
+	if (pCallbacks->handlers.Get_Corr_Intensity_Matrix_CB != NULL) {
+		pCallbacks->handlers.Get_Corr_Intensity_Matrix_CB(pCallbacks->pContext, pMatrix);
+	}
+}
+
+bool Corr_Intensity_Data_Requested(DCS_Device* pDevice) {
+	const Callback_Set* pCallbacks = get_Callbacks(pDevice);
+
+	return pCallbacks->should_store || pCallbacks->callbacks.Get_Corr_Intensity_Data_CB != NULL || pCallbacks->handlers.Get_Corr_Intensity_Data_CB != NULL;
+}
+
+bool Corr_Intensity_Matrix_Requested(DCS_Device* pDevice) {
+	const Callback_Set* pCallbacks = get_Callbacks(pDevice);
+
+	return pCallbacks->callbacks.Get_Corr_Intensity_Matrix_CB != NULL || pCallbacks->handlers.Get_Corr_Intensity_Matrix_CB != NULL;
+}
 
-		Enqueue_Recv_FIFO(data);
+int DCS_Get_Corr_Intensity_Data_Data(DCS_Handle hDevice, Corr_Intensity_Data** output, int* number, float** pDelayBufOutput, int* Delay_Num_Output) {
+	Received_Data_Item* item = take_Recv_Item(hDevice, Corr_Intensity_Data_Type);
+	if (item == NULL) {
+		return 1;
 	}
+
+	Array_Data arr[2] = { 0 };
+	memcpy(arr, item->data, sizeof(*arr) * 2);
+
+	//Items are kept in slots that are reused, so the application gets copies in separate allocations.
+	const bool copied = copy_Corr_Intensity(arr[0].ptr, arr[0].length, arr[1].ptr, arr[1].length, arr);
+
+	set_Recv_mutex(hDevice);
+	release_Recv_Item(hDevice, item);
+	release_Recv_mutex(hDevice);
+
+	if (!copied) {
+		return MEMORY_ALLOCATION_ERROR;
+	}
+
+	*number = arr[0].length;
+	*output = arr[0].ptr;
+
+	*Delay_Num_Output = arr[1].length;
+	*pDelayBufOutput = arr[1].ptr;
+	return NO_DCS_ERROR;
 }
 
 int Get_Corr_Intensity_Data_Data(Corr_Intensity_Data** output, int* number, float** pDelayBufOutput, int* Delay_Num_Output) {
-	set_Recv_mutex();
-	Received_Data_Item* item = pRecv_Data_FIFO_Head;
-	Received_Data_Item* prev_item = NULL;
-	while (item != NULL) {
-		if (item->data_type == Corr_Intensity_Data_Type) {
-			Array_Data arr[2] = { 0 };
-			memcpy(arr, item->data, sizeof(*arr) * 2);
+	return DCS_Get_Corr_Intensity_Data_Data(&default_device, output, number, pDelayBufOutput, Delay_Num_Output);
+}
 
-			*number = arr[0].length;
-			*output = arr[0].ptr;
+int DCS_Get_Corr_Intensity_Matrix_Data(DCS_Handle hDevice, Corr_Intensity_Matrix** output) {
+	Received_Data_Item* item = take_Recv_Item(hDevice, Corr_Intensity_Data_Type);
+	if (item == NULL) {
+		return 1;
+	}
 
-			*Delay_Num_Output = arr[1].length;
-			*pDelayBufOutput = arr[1].ptr;
+	Array_Data arr[2] = { 0 };
+	memcpy(arr, item->data, sizeof(*arr) * 2);
+	const Corr_Intensity_Data* pChannels = arr[0].ptr;
+	const float* pDelayBuf = arr[1].ptr;
 
-			if (prev_item != NULL) {
-				prev_item->pNextItem = item->pNextItem;
-				if (prev_item->pNextItem == NULL) {
-					pRecv_Data_FIFO_Tail = prev_item;
-				}
-			}
-			else {
-				pRecv_Data_FIFO_Head = item->pNextItem;
-				if (pRecv_Data_FIFO_Head == NULL) {
-					pRecv_Data_FIFO_Tail = NULL;
-				}
-			}
+	//Rows are as long as the longest channel's correlation buffer.
+	int Data_Num = 0;
+	for (int x = 0; x < arr[0].length; x++) {
+		if (pChannels[x].Data_Num > Data_Num) {
+			Data_Num = pChannels[x].Data_Num;
+		}
+	}
 
-			release_Recv_mutex();
+	Corr_Intensity_Matrix* pMatrix = malloc(Corr_Intensity_Matrix_Size(arr[0].length, Data_Num, arr[1].length));
+	if (pMatrix != NULL) {
+		Layout_Corr_Intensity_Matrix(pMatrix, arr[0].length, Data_Num, arr[1].length);
+		int* pCha_IDs = (int*)pMatrix->pCha_IDs;
+		float* pIntensity = (float*)pMatrix->pIntensity;
+		float* pCorr = (float*)pMatrix->pCorr;
 
-			free(item->data);
-			free(item);
-			return NO_DCS_ERROR;
+		for (int x = 0; x < arr[0].length; x++) {
+			pCha_IDs[x] = pChannels[x].Cha_ID;
+			pIntensity[x] = pChannels[x].intensity;
+
+			float* pRow = &pCorr[(size_t)x * Data_Num];
+			memcpy(pRow, pChannels[x].pCorrBuf, sizeof(*pRow) * pChannels[x].Data_Num);
+			memset(&pRow[pChannels[x].Data_Num], 0, sizeof(*pRow) * (Data_Num - pChannels[x].Data_Num));
 		}
 
-		prev_item = item;
-		item = item->pNextItem;
+		memcpy((float*)pMatrix->pDelayBuf, pDelayBuf, sizeof(*pDelayBuf) * arr[1].length);
+		pMatrix->timestamp_ns = arr[0].length != 0 ? pChannels[0].timestamp_ns : 0;
+	}
+
+	set_Recv_mutex(hDevice);
+	release_Recv_Item(hDevice, item);
+	release_Recv_mutex(hDevice);
+
+	if (pMatrix == NULL) {
+		return MEMORY_ALLOCATION_ERROR;
 	}
-	release_Recv_mutex();
-	return 1;
+
+	*output = pMatrix;
+	return NO_DCS_ERROR;
 }
 
-void Get_Intensity_Data_CB(Intensity_Data* pIntensity_Data, int Cha_Num) {
-	Receive_Callbacks local_callbacks = { 0 };
-	bool should_store = false;
-	get_Callbacks(&local_callbacks, &should_store);
+int Get_Corr_Intensity_Matrix_Data(Corr_Intensity_Matrix** output) {
+	return DCS_Get_Corr_Intensity_Matrix_Data(&default_device, output);
+}
 
-	if (local_callbacks.Get_Intensity_Data_CB != NULL) {
-		local_callbacks.Get_Intensity_Data_CB(pIntensity_Data, Cha_Num);
+int DCS_Acquire_Corr_Intensity_Data(DCS_Handle hDevice, const Corr_Intensity_Data** output, int* number, const float** pDelayBufOutput, int* Delay_Num_Output) {
+	Received_Data_Item* item = borrow_Recv_Item(hDevice, Corr_Intensity_Data_Type);
+	if (item == NULL) {
+		return 1;
 	}
 
-	if (should_store) {
-		Received_Data_Item* data = malloc(sizeof(*data));
-		if (data == NULL) {
-			return;
+	const Array_Data* arr = item->data;
+	*number = arr[0].length;
+	*output = arr[0].ptr;
+
+	*Delay_Num_Output = arr[1].length;
+	*pDelayBufOutput = arr[1].ptr;
+	return NO_DCS_ERROR;
+}
+
+int Acquire_Corr_Intensity_Data(const Corr_Intensity_Data** output, int* number, const float** pDelayBufOutput, int* Delay_Num_Output) {
+	return DCS_Acquire_Corr_Intensity_Data(&default_device, output, number, pDelayBufOutput, Delay_Num_Output);
+}
+
+int DCS_Release_Corr_Intensity_Data(DCS_Handle hDevice, const Corr_Intensity_Data* pData) {
+	return release_Borrowed_Item(hDevice, Corr_Intensity_Data_Type, pData);
+}
+
+int Release_Corr_Intensity_Data(const Corr_Intensity_Data* pData) {
+	return DCS_Release_Corr_Intensity_Data(&default_device, pData);
+}
+
+static int drain_Recv_Items(DCS_Device* pDevice, Data_Item_Type type, void* pOutput, size_t element_size, int capacity, int* pFrames, int* pCounts) {
+	if (pDevice == NULL || pFrames == NULL || capacity < 0 || (pOutput == NULL && capacity != 0)) {
+		return FRAME_INVALID_DATA;
+	}
+	*pFrames = 0;
+
+	set_Recv_mutex(pDevice);
+	Recv_Ring* pRing = &pDevice->recv_rings[type];
+	if (pRing->stats.count == 0) {
+		release_Recv_mutex(pDevice);
+		return 1;
+	}
+
+	//Items are only taken whole, and each one takes an entry of [pCounts] even if it has no records.
+	char* pNext = pOutput;
+	int records = 0;
+	int frames = 0;
+	while (pRing->stats.count != 0 && frames < capacity) {
+		const Array_Data* arr = pRing->ppItems[pRing->head]->data;
+		if (arr->length > capacity - records) {
+			break;
 		}
 
-		data->data_type = Intensity_Data_Type;
-		Array_Data* arr = malloc(sizeof(*arr));
-		if (arr == NULL) {
-			free(data);
-			return;
+		memcpy(pNext, arr->ptr, element_size * arr->length);
+		pNext += element_size * arr->length;
+		records += arr->length;
+		if (pCounts != NULL) {
+			pCounts[frames] = arr->length;
 		}
+		frames++;
 
-		arr->length = Cha_Num;
+		release_Recv_Item(pDevice, recv_ring_pop(pRing));
+	}
 
-		const size_t dataSize = sizeof(*pIntensity_Data) * Cha_Num;
-		arr->ptr = malloc(dataSize);
-		if (arr->ptr == NULL) {
-			free(data);
-			free(arr);
-			return;
+	if (frames != 0) {
+		made_Store_Room(pDevice);
+	}
+
+	release_Recv_mutex(pDevice);
+
+	*pFrames = frames;
+	return frames != 0 ? NO_DCS_ERROR : FRAME_INVALID_DATA;
+}
+
+static Received_Data_Item* borrow_Recv_Item(DCS_Device* pDevice, Data_Item_Type type) {
+	Received_Data_Item* pItem = take_Recv_Item(pDevice, type);
+	if (pItem == NULL) {
+		return NULL;
+	}
+
+	//BFI, intensity and correlation intensity items are always kept in slots. The store's reference goes with the loan.
+	Recv_Slot* pSlot = (Recv_Slot*)pItem;
+	pSlot->pLender = pDevice;
+	pSlot->orphaned = false;
+
+	lock_Borrowed();
+	pSlot->pNextItem = pBorrowed_Slots;
+	pBorrowed_Slots = pSlot;
+	unlock_Borrowed();
+
+	return pItem;
+}
+
+static int release_Borrowed_Item(DCS_Device* pDevice, Data_Item_Type type, const void* pData) {
+	if (pDevice == NULL || pData == NULL) {
+		return FRAME_INVALID_DATA;
+	}
+
+	//The item's data, or its channels, start right after its slot. Only the slots lent are compared with [pData].
+	lock_Borrowed();
+	Recv_Slot** ppSlot = &pBorrowed_Slots;
+	while (*ppSlot != NULL && (const void*)(*ppSlot + 1) != pData) {
+		ppSlot = &(*ppSlot)->pNextItem;
+	}
+
+	Recv_Slot* pSlot = *ppSlot;
+	if (pSlot == NULL || pSlot->pLender != pDevice || pSlot->item.data_type != type) {
+		unlock_Borrowed();
+		return FRAME_INVALID_DATA;
+	}
+	*ppSlot = pSlot->pNextItem;
+	unlock_Borrowed();
+
+	//The device has been closed, so nothing else holds the slot and there's no ring to return it to.
+	if (pSlot->orphaned) {
+		free(pSlot);
+		return NO_DCS_ERROR;
+	}
+
+	set_Recv_mutex(pDevice);
+	release_Recv_Item(pDevice, &pSlot->item);
+	release_Recv_mutex(pDevice);
+
+	return NO_DCS_ERROR;
+}
+
+static void orphan_Borrowed_Slots(DCS_Device* pDevice) {
+	set_Recv_mutex(pDevice);
+	lock_Borrowed();
+	for (Recv_Slot* pSlot = pBorrowed_Slots; pSlot != NULL; pSlot = pSlot->pNextItem) {
+		//Slots orphaned by an earlier close of the same device were already taken off its rings.
+		if (pSlot->pLender == pDevice && !pSlot->orphaned) {
+			pSlot->orphaned = true;
+			//The ring no longer owns the slot, so a store streaming on the device once it's opened again fills its own.
+			pDevice->recv_rings[pSlot->item.data_type].slots--;
 		}
+	}
+	unlock_Borrowed();
+	release_Recv_mutex(pDevice);
+}
+
+static inline void lock_Borrowed(void) {
+	//Held for a list walk, so threads borrowing or handing back items at once just take turns.
+	while (!Atomic_Compare_Exchange(&borrow_lock, 0, 1)) {
+		Sleep(0);
+	}
+}
 
-		memcpy(arr->ptr, pIntensity_Data, dataSize);
+static inline void unlock_Borrowed(void) {
+	Atomic_Store_Release(&borrow_lock, 0);
+}
 
-		data->data = arr;
+void Get_Intensity_Data_CB(DCS_Device* pDevice, const Intensity_Data* pIntensity_Data, int Cha_Num, Received_Data_Item* pFrame) {
+	const Callback_Set* pCallbacks = get_Callbacks(pDevice);
+
+	if (pCallbacks->callbacks.Get_Intensity_Data_CB != NULL) {
+		pCallbacks->callbacks.Get_Intensity_Data_CB(pIntensity_Data, Cha_Num);
+	}
+	if (pCallbacks->handlers.Get_Intensity_Data_CB != NULL) {
+		pCallbacks->handlers.Get_Intensity_Data_CB(pCallbacks->pContext, pIntensity_Data, Cha_Num);
+	}
+
+	if (pCallbacks->should_store) {
+		store_Array(pDevice, Intensity_Data_Type, pIntensity_Data, Cha_Num, sizeof(*pIntensity_Data), pFrame);
+	}
+}
+
+ARRAY_GETTER_FUNCTION(Intensity_Data)
+BORROWING_GETTER_FUNCTION(Intensity_Data)
+DRAIN_FUNCTION(Intensity_Data)
+
+static void store_Array(DCS_Device* pDevice, Data_Item_Type type, const void* pData, int length, size_t element_size, Received_Data_Item* pFrame) {
+	//The records were decoded at the start of the slot the store keeps them in.
+	if (pFrame != NULL) {
+		Array_Data* arr = pFrame->data;
+		arr->ptr = Frame_Buffer_Data(pFrame);
+		arr->length = length;
+
+		keep_Frame_Buffer(pDevice, pFrame);
+		return;
+	}
+
+	//The records weren't decoded into a slot, so they're copied into one.
+	const size_t dataSize = element_size * length;
+	Received_Data_Item* data = take_Recv_Slot(pDevice, type, dataSize);
+	if (data == NULL) {
+		return;
+	}
+
+	Array_Data* arr = data->data;
+	arr->ptr = Frame_Buffer_Data(data);
+	arr->length = length;
+	memcpy(arr->ptr, pData, dataSize);
+
+	Enqueue_Recv_FIFO(pDevice, data);
+}
+
+static size_t corr_intensity_size(const Corr_Intensity_Data* pCorr_Intensity_Data, int Cha_Num, int Delay_Num) {
+	size_t size = sizeof(*pCorr_Intensity_Data) * Cha_Num + sizeof(float) * Delay_Num;
+	for (int x = 0; x < Cha_Num; x++) {
+		size += sizeof(*pCorr_Intensity_Data[x].pCorrBuf) * pCorr_Intensity_Data[x].Data_Num;
+	}
+	return size;
+}
+
+static bool copy_Corr_Intensity(const Corr_Intensity_Data* pCorr_Intensity_Data, int Cha_Num, const float* pDelayBuf, int Delay_Num, Array_Data arr[2]) {
+	const size_t corrDataSize = sizeof(*pCorr_Intensity_Data) * Cha_Num;
+	Corr_Intensity_Data* pCorr_Intensity_Data_Copy = malloc(corrDataSize);
+	if (pCorr_Intensity_Data_Copy == NULL) {
+		return false;
+	}
+	memcpy(pCorr_Intensity_Data_Copy, pCorr_Intensity_Data, corrDataSize);
+
+	for (__int32 x = 0; x < Cha_Num; x++) {
+#pragma warning (disable: 6385 6386)
+		const size_t listSize = sizeof(*(pCorr_Intensity_Data_Copy[x].pCorrBuf)) * pCorr_Intensity_Data_Copy[x].Data_Num;
+		pCorr_Intensity_Data_Copy[x].pCorrBuf = malloc(listSize);
+		if (pCorr_Intensity_Data_Copy[x].pCorrBuf == NULL) {
+			for (__int32 y = 0; y < x; y++) {
+				free(pCorr_Intensity_Data_Copy[y].pCorrBuf);
+			}
+			free(pCorr_Intensity_Data_Copy);
+			return false;
+		}
+
+		memcpy(pCorr_Intensity_Data_Copy[x].pCorrBuf, pCorr_Intensity_Data[x].pCorrBuf, listSize);
+#pragma warning (default: 6385 6386)
+	}
 
-		Enqueue_Recv_FIFO(data);
+	const size_t delayDataSize = sizeof(*pDelayBuf) * Delay_Num;
+	float* pDelayBuf_Copy = malloc(delayDataSize);
+	if (pDelayBuf_Copy == NULL) {
+		for (__int32 x = 0; x < Cha_Num; x++) {
+#pragma warning (disable: 6001)
+			free(pCorr_Intensity_Data_Copy[x].pCorrBuf);
+#pragma warning (default: 6001)
+		}
+		free(pCorr_Intensity_Data_Copy);
+		return false;
 	}
+	memcpy(pDelayBuf_Copy, pDelayBuf, delayDataSize);
+
+	arr[0].ptr = pCorr_Intensity_Data_Copy;
+	arr[0].length = Cha_Num;
+	arr[1].ptr = pDelayBuf_Copy;
+	arr[1].length = Delay_Num;
+	return true;
 }
 
-ARRAY_GETTER_FUNCTION(Intensity_Data)
\ No newline at end of file
+static int hand_out_Array(DCS_Device* pDevice, Received_Data_Item* pItem, Array_Data* pArr) {
+	memcpy(pArr, pItem->data, sizeof(*pArr));
+
+	if (!pItem->pooled) {
+		free(pItem->data);
+		free(pItem);
+		return NO_DCS_ERROR;
+	}
+
+	//The item's size is the bytes of its array.
+	void* pCopy = malloc(pItem->size);
+	if (pCopy != NULL) {
+		memcpy(pCopy, pArr->ptr, pItem->size);
+	}
+	pArr->ptr = pCopy;
+
+	set_Recv_mutex(pDevice);
+	release_Recv_Item(pDevice, pItem);
+	release_Recv_mutex(pDevice);
+
+	return pCopy != NULL || pArr->length == 0 ? NO_DCS_ERROR : MEMORY_ALLOCATION_ERROR;
+}
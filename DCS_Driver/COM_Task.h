@@ -3,47 +3,53 @@
 #include "Internal.h"
 #include "DCS_Driver.h"
 
-#define MAX_COMMAND_RESPONSE_TIME 1000
-typedef enum {
-	reset,
-	set,
-	check,
-	validate,
-} Command_Option;
+//Seconds a command can wait for its acknowledgement before the connection is considered lost.
+#define COMMAND_RESPONSE_TIMEOUT 50
+
+/// <summary>
+/// Returns the device used by Initialize_COM_Task and the rest of the API that doesn't take a handle.
+/// </summary>
+/// <returns>The default device. Never NULL.</returns>
+DCS_Device* Default_Device(void);
 
 /// <summary>
-/// Adds the data to be transmitted to the transmission FIFO.
+/// Adds the data to be transmitted to the device's transmission FIFO without taking a lock. Safe to call from any thread.
+/// The transmission is released if it can't be queued.
 /// </summary>
+/// <param name="pDevice">Device to send the data to.</param>
 /// <param name="pTransmission">Structure containing the data to send.</param>
-/// <returns>Standard DCS status code.</returns>
-int Enqueue_Trans_FIFO(Transmission_Data_Type* pTransmission);
+/// <returns>Standard DCS status code. TRANSMIT_QUEUE_FULL if the FIFO is full.</returns>
+int Enqueue_Trans_FIFO(DCS_Device* pDevice, Transmission_Data_Type* pTransmission);
 
 /// <summary>
-/// Checks, sets, and timesout waiting for an acknowledgement of receiving a DCS command.
+/// Gets a transmission with room for [size] bytes at pFrame, reusing a pooled buffer when the frame is small enough.
 /// </summary>
-/// <param name="Option">The actions being performed by this call to the function.
-/// E.g. set, check, reset, validate.
-/// </param>
-/// <param name="Command_Code">The command being set or checked.</param>
-/// <returns>Standard DCS status code.</returns>
-int Check_Command_Response(int Option, Data_ID Command_Code);
+/// <param name="size">Number of bytes needed for the frame, including the prepended frame size.</param>
+/// <returns>The transmission, or NULL if it couldn't be allocated.</returns>
+Transmission_Data_Type* Alloc_Transmission(unsigned __int32 size);
+
+/// <summary>
+/// Returns a transmission from Alloc_Transmission to the pool, or frees it if the pool is full.
+/// </summary>
+/// <param name="pTransmission">Transmission to release.</param>
+void Free_Transmission(Transmission_Data_Type* pTransmission);
 
+/// <summary>
+/// Gets the sequence ID for a new sequenced command frame. Never returns 0.
+/// </summary>
+/// <returns>The sequence ID.</returns>
+Sequence_ID Next_Sequence_ID(void);
 
-/////////////////////////////////////////////////////////////////
-//Internal callbacks for functions receiving data from the DCS.//
-/////////////////////////////////////////////////////////////////
+/// <summary>
+/// Completes the in-flight command an acknowledgement is for. Sequenced acknowledgements are matched
+/// on their sequence ID, others on the command code of the oldest command waiting for one.
+/// </summary>
+/// <param name="pDevice">Device the acknowledgement was received from.</param>
+/// <param name="Command_Code">The command code carried by the acknowledgement.</param>
+/// <param name="sequence">Sequence ID of the acknowledgement, or 0 if it isn't sequenced.</param>
+/// <returns>Standard DCS status code.</returns>
+int Complete_Command(DCS_Device* pDevice, Data_ID Command_Code, Sequence_ID sequence);
 
-void Get_DCS_Status_CB(bool bCorr, bool bAnalyzer, int DCS_Cha_Num);
-void Get_Correlator_Setting_CB(Correlator_Setting* pCorrelator_Setting);
-void Get_Analyzer_Setting_CB(Analyzer_Setting* pAnalyzer_Setting, int Cha_Num);
-void Get_Analyzer_Prefit_Param_CB(Analyzer_Prefit_Param* pAnalyzer_Prefit);
-void Get_Simulated_Correlation_CB(Simulated_Correlation* Simulated_Corr);
-void Get_BFI_Data(BFI_Data* pBFI_Data, int Cha_Num);
-void Get_Error_Message_CB(char* pMessage, unsigned __int32 Size);
-void Get_Error_Code_CB(unsigned __int32 code);
-void Get_BFI_Corr_Ready_CB(bool bReady);
-void Get_Corr_Intensity_Data_CB(Corr_Intensity_Data* pCorr_Intensity_Data, int Cha_Num, float* pDelayBuf, int Delay_Num);
-void Get_Intensity_Data_CB(Intensity_Data* pIntensity_Data, int Cha_Num);
 
 typedef enum {
 	DCS_Status_Type,
@@ -56,14 +62,90 @@ typedef enum {
 	Intensity_Data_Type,
 	Error_Message_Type,
 	Corr_Intensity_Data_Type,
+	Data_Item_Type_Count,//Number of data types, not a type itself.
 } Data_Item_Type;
 
 typedef struct Received_Data_Item {
 	void* data;
 	Data_Item_Type data_type;
-	struct Received_Data_Item* pNextItem;
+	size_t size; //Bytes of received data the item holds, set when it's stored
+	bool pooled; //Set if the item is held by one of its ring's slots, which can be shared with the decoder, rather than allocated on its own
 } Received_Data_Item;
 
+//Most items kept per data type when Store_Config.max_items is 0.
+#define STORE_DEFAULT_MAX_ITEMS 1024
+
+//Limits for the items kept when should_store is set. Each data type is limited separately.
+typedef struct {
+	unsigned __int32 max_items; //Most items kept per data type, 0 for STORE_DEFAULT_MAX_ITEMS
+	unsigned __int64 max_bytes; //Most bytes of data kept per data type, 0 for no limit
+	Overflow_Policy overflow; //What happens to an item that arrives when either limit has been reached. OVERFLOW_BLOCK stops reading
+	                          //from the DCS, or holds up the dispatch thread storing the item, until the application takes one
+	bool streaming; //Allocate the slots BFI, intensity and correlation intensity items are kept in when a measurement is started,
+	                //rather than as the first items arrive, so storing them doesn't allocate at all. Slots are always reused once
+	                //their items are taken, so the getters hand out copies of those items.
+} Store_Config;
+
+//Counters for the items kept of one data type, since the driver was loaded.
+typedef struct {
+	unsigned __int32 count; //Items stored now
+	unsigned __int64 bytes; //Bytes of data stored now
+	unsigned __int32 high_water_count; //Most items stored at once
+	unsigned __int64 high_water_bytes; //Most bytes of data stored at once
+	unsigned __int64 stored; //Items added to the store
+	unsigned __int64 dropped; //Items discarded because the store was full
+} Store_Stats;
+
+/// <summary>
+/// Sets the limits for the items kept when should_store is set. Items over the new limits are discarded, oldest first.
+/// </summary>
+/// <param name="config">Limits to apply to every data type.</param>
+/// <returns>Standard DCS status code.</returns>
+__declspec(dllexport) int Set_Store_Config(Store_Config config);
+
+/// <summary>
+/// Retrieves the counters for the items kept of one data type.
+/// </summary>
+/// <param name="type">Data type to report on.</param>
+/// <param name="pStats">Filled with the current counters.</param>
+/// <returns>Standard DCS status code.</returns>
+__declspec(dllexport) int Get_Store_Stats(Data_Item_Type type, Store_Stats* pStats);
+
+/// <summary>
+/// Notes which data a measurement started on the device will send, from the Enable_DCS command sent or the status received.
+/// </summary>
+/// <param name="pDevice">Device the data is for.</param>
+/// <param name="bCorr">Whether correlation intensity data is sent in place of intensity data.</param>
+/// <param name="bAnalyzer">Whether BFI data is sent.</param>
+void Expect_Stream_Types(DCS_Device* pDevice, bool bCorr, bool bAnalyzer);
+
+/// <summary>
+/// Notes the number of values in each channel's correlation buffer, from the correlator setting sent or received.
+/// </summary>
+/// <param name="pDevice">Device the data is for.</param>
+/// <param name="length">Correlation values per channel, which is also the number of delays.</param>
+void Expect_Correlation_Length(DCS_Device* pDevice, unsigned __int32 length);
+
+/// <summary>
+/// Allocates the store's slots for the data a measurement of [Cha_Num] channels sends, if the store is streaming, so
+/// storing its items doesn't allocate. Types whose size isn't known yet get their slots as their first items arrive.
+/// </summary>
+/// <param name="pDevice">Device the measurement was started on.</param>
+/// <param name="Cha_Num">Number of channels measured.</param>
+void Reserve_Store_Slots(DCS_Device* pDevice, unsigned __int32 Cha_Num);
+
+/// <summary>
+/// Allocates enough dispatch jobs for the data a measurement of [Cha_Num] channels sends to fill each dispatch queue, so
+/// queueing its frames doesn't allocate. Does nothing if the device has no dispatch threads.
+/// </summary>
+/// <param name="pDevice">Device the measurement was started on.</param>
+/// <param name="Cha_Num">Number of channels measured.</param>
+void Reserve_Dispatch_Jobs(DCS_Device* pDevice, unsigned __int32 Cha_Num);
+
+//Same as Set_Store_Config and Get_Store_Stats, for the device [hDevice].
+__declspec(dllexport) int DCS_Set_Store_Config(DCS_Handle hDevice, Store_Config config);
+__declspec(dllexport) int DCS_Get_Store_Stats(DCS_Handle hDevice, Data_Item_Type type, Store_Stats* pStats);
+
 typedef struct {
 	bool bCorr;
 	bool bAnalyzer;
@@ -85,4 +167,73 @@ __declspec(dllexport) int Get_Simulated_Correlation_Data(Simulated_Correlation*
 __declspec(dllexport) int Get_BFI_Data_Data(BFI_Data** pBFI_Data, int* Cha_Num);
 __declspec(dllexport) int Get_Intensity_Data_Data(Intensity_Data** pIntensity_Data, int* Cha_Num);
 __declspec(dllexport) int Get_Corr_Intensity_Data_Data(Corr_Intensity_Data** output, int* number, float** pDelayBufOutput, int* Delay_Num_Output);
-__declspec(dllexport) int Get_Error_Message_Data(Error_Message** pMessage, int* length);
\ No newline at end of file
+__declspec(dllexport) int Get_Error_Message_Data(Error_Message** pMessage, int* length);
+
+//Same as the getters above, taking from the store of the device [hDevice].
+__declspec(dllexport) int DCS_Get_DCS_Status_Data(DCS_Handle hDevice, DCS_Status* output);
+__declspec(dllexport) int DCS_Get_Correlator_Setting_Data(DCS_Handle hDevice, Correlator_Setting* output);
+__declspec(dllexport) int DCS_Get_Analyzer_Setting_Data(DCS_Handle hDevice, Analyzer_Setting** pAnalyzer_Setting, int* Cha_Num);
+__declspec(dllexport) int DCS_Get_Analyzer_Prefit_Param_Data(DCS_Handle hDevice, Analyzer_Prefit_Param* output);
+__declspec(dllexport) int DCS_Get_Simulated_Correlation_Data(DCS_Handle hDevice, Simulated_Correlation* output);
+__declspec(dllexport) int DCS_Get_BFI_Data_Data(DCS_Handle hDevice, BFI_Data** pBFI_Data, int* Cha_Num);
+__declspec(dllexport) int DCS_Get_Intensity_Data_Data(DCS_Handle hDevice, Intensity_Data** pIntensity_Data, int* Cha_Num);
+__declspec(dllexport) int DCS_Get_Corr_Intensity_Data_Data(DCS_Handle hDevice, Corr_Intensity_Data** output, int* number, float** pDelayBufOutput, int* Delay_Num_Output);
+__declspec(dllexport) int DCS_Get_Error_Message_Data(DCS_Handle hDevice, Error_Message** pMessage, int* length);
+
+/// <summary>
+/// Takes the oldest correlation intensity item from the store as a matrix, in place of Get_Corr_Intensity_Data_Data.
+/// The matrix and its arrays are one allocation.
+/// </summary>
+/// <param name="output">Set to the matrix, which the caller frees with free(*output).</param>
+/// <returns>Standard DCS status code, or 1 if no item is stored.</returns>
+__declspec(dllexport) int Get_Corr_Intensity_Matrix_Data(Corr_Intensity_Matrix** output);
+//Same as Get_Corr_Intensity_Matrix_Data, taking from the store of the device [hDevice].
+__declspec(dllexport) int DCS_Get_Corr_Intensity_Matrix_Data(DCS_Handle hDevice, Corr_Intensity_Matrix** output);
+
+/// <summary>
+/// Borrows the oldest item of its type from the store, in place of the matching Get_*_Data getter. The data is read where
+/// the store keeps it, so nothing is allocated or copied, and stays valid until it's handed back with the matching
+/// Release_* function. The store's slot for the item is then reused. Items held for long make the store allocate slots
+/// for the ones that arrive meanwhile. Items still borrowed when their device is closed stay valid and are freed once
+/// they're handed back, which is the only use the closed handle still has.
+/// </summary>
+/// <returns>Standard DCS status code, or 1 if no item is stored.</returns>
+__declspec(dllexport) int Acquire_BFI_Data(const BFI_Data** pBFI_Data, int* Cha_Num);
+__declspec(dllexport) int Acquire_Intensity_Data(const Intensity_Data** pIntensity_Data, int* Cha_Num);
+__declspec(dllexport) int Acquire_Corr_Intensity_Data(const Corr_Intensity_Data** output, int* number, const float** pDelayBufOutput, int* Delay_Num_Output);
+
+/// <summary>
+/// Hands back an item borrowed with the matching Acquire_* function.
+/// </summary>
+/// <param name="pData">The records, or channels, the Acquire_* function gave.</param>
+/// <returns>Standard DCS status code. FRAME_INVALID_DATA if [pData] isn't an item of the type the device lent, or was
+/// already handed back.</returns>
+__declspec(dllexport) int Release_BFI_Data(const BFI_Data* pData);
+__declspec(dllexport) int Release_Intensity_Data(const Intensity_Data* pData);
+__declspec(dllexport) int Release_Corr_Intensity_Data(const Corr_Intensity_Data* pData);
+
+//Same as the borrowing getters above, for the store of the device [hDevice]. Items are handed back to the device they
+//were borrowed from.
+__declspec(dllexport) int DCS_Acquire_BFI_Data(DCS_Handle hDevice, const BFI_Data** pBFI_Data, int* Cha_Num);
+__declspec(dllexport) int DCS_Acquire_Intensity_Data(DCS_Handle hDevice, const Intensity_Data** pIntensity_Data, int* Cha_Num);
+__declspec(dllexport) int DCS_Acquire_Corr_Intensity_Data(DCS_Handle hDevice, const Corr_Intensity_Data** output, int* number, const float** pDelayBufOutput, int* Delay_Num_Output);
+__declspec(dllexport) int DCS_Release_BFI_Data(DCS_Handle hDevice, const BFI_Data* pData);
+__declspec(dllexport) int DCS_Release_Intensity_Data(DCS_Handle hDevice, const Intensity_Data* pData);
+__declspec(dllexport) int DCS_Release_Corr_Intensity_Data(DCS_Handle hDevice, const Corr_Intensity_Data* pData);
+
+/// <summary>
+/// Takes every stored item of its type that fits into the caller's buffer in one call, in place of calling the matching
+/// Get_*_Data getter once per item. The store's lock is taken once for the whole batch. Items are taken oldest first
+/// and only whole, and those that don't fit stay stored for the next call.
+/// </summary>
+/// <param name="output">Filled with the records of each item taken, one item after another.</param>
+/// <param name="capacity">Records [output] has room for, which is also the most items taken.</param>
+/// <param name="frames">Set to the number of items taken.</param>
+/// <param name="per_frame_cha">Filled with each item's number of records, and needs room for [capacity] of them. Can be NULL.</param>
+/// <returns>Standard DCS status code, or 1 if no item is stored. FRAME_INVALID_DATA if the oldest item is bigger than [output].</returns>
+__declspec(dllexport) int Drain_BFI_Data(BFI_Data* output, int capacity, int* frames, int* per_frame_cha);
+__declspec(dllexport) int Drain_Intensity_Data(Intensity_Data* output, int capacity, int* frames, int* per_frame_cha);
+
+//Same as the drains above, for the store of the device [hDevice].
+__declspec(dllexport) int DCS_Drain_BFI_Data(DCS_Handle hDevice, BFI_Data* output, int capacity, int* frames, int* per_frame_cha);
+__declspec(dllexport) int DCS_Drain_Intensity_Data(DCS_Handle hDevice, Intensity_Data* output, int capacity, int* frames, int* per_frame_cha);
\ No newline at end of file
@@ -1,55 +1,226 @@
 #include "DCS_Driver.h"
 #include "Internal.h"
+#include "COM_Task.h"
+#include "Request.h"
 
 int Get_DCS_Status(void) {
-	return Send_Get_DCS_Status();
+	return Send_Get_DCS_Status(Default_Device(), NULL);
 }
 
 int Set_Correlator_Setting(Correlator_Setting* pCorr_Setting) {
-	return Send_Correlator_Setting(pCorr_Setting);
+	return Send_Correlator_Setting(Default_Device(), pCorr_Setting, NULL);
 }
 
 int Get_Correlator_Setting(void) {
-	return Send_Get_Correlator_Setting();
+	return Send_Get_Correlator_Setting(Default_Device(), NULL);
 }
 
  int Set_Analyzer_Setting(Analyzer_Setting* pAnalyzer_Setting, int Cha_Num) {
-	return Send_Analyzer_Setting(pAnalyzer_Setting, Cha_Num);
+	return Send_Analyzer_Setting(Default_Device(), pAnalyzer_Setting, Cha_Num, NULL);
 }
 
  int Get_Analyzer_Setting(void) {
-	return Send_Get_Analyzer_Setting();
+	return Send_Get_Analyzer_Setting(Default_Device(), NULL);
 }
 
  int Start_DCS_Measurement(int interval, int* pCha_IDs, int Cha_Num) {
-	return Send_Start_Measurement(interval, pCha_IDs, Cha_Num);
+	return Send_Start_Measurement(Default_Device(), interval, pCha_IDs, Cha_Num, NULL);
 }
 
  int Stop_DCS_Measurement(void) {
-	return Send_Stop_Measurement();
+	return Send_Stop_Measurement(Default_Device(), NULL);
 }
 
  int Enable_DCS(bool bCorr, bool bAnalyzer) {
-	return Send_Enable_DCS(bCorr, bAnalyzer);
+	return Send_Enable_DCS(Default_Device(), bCorr, bAnalyzer, NULL);
 }
 
  int Get_Simulated_Correlation(void) {
-	return Send_Get_Simulated_Correlation();
+	return Send_Get_Simulated_Correlation(Default_Device(), NULL);
 }
 
  int Set_Optical_Param(Optical_Param_Type* pOpt_Param, int Cha_Num) {
-	return Send_Optical_Param(pOpt_Param, Cha_Num);
+	return Send_Optical_Param(Default_Device(), pOpt_Param, Cha_Num, NULL);
 }
 
  int Set_Analyzer_Prefit_Param(Analyzer_Prefit_Param* pAnalyzer_Prefit_Param) {
-	return Send_Analyzer_Prefit_Param(pAnalyzer_Prefit_Param);
+	return Send_Analyzer_Prefit_Param(Default_Device(), pAnalyzer_Prefit_Param, NULL);
 }
 
  int Get_Analyzer_Prefit_Param(void) {
-	return Send_Get_Analyzer_Prefit_Param();
+	return Send_Get_Analyzer_Prefit_Param(Default_Device(), NULL);
 }
 
  Receive_Callbacks Null_Receive_Callbacks(void) {
 	Receive_Callbacks callbacks = { 0 };
 	return callbacks;
+}
+
+DCS_Callbacks Null_DCS_Callbacks(void) {
+	DCS_Callbacks callbacks = { 0 };
+	return callbacks;
+}
+
+unsigned __int64 DCS_Clock_Now_Ns(void) {
+	return Clock_Now_Ns();
+}
+
+//Commands for a device opened with DCS_Open. Frame_Begin rejects a NULL handle.
+
+int DCS_Get_DCS_Status(DCS_Handle hDevice) {
+	return Send_Get_DCS_Status(hDevice, NULL);
+}
+
+int DCS_Set_Correlator_Setting(DCS_Handle hDevice, Correlator_Setting* pCorr_Setting) {
+	return Send_Correlator_Setting(hDevice, pCorr_Setting, NULL);
+}
+
+int DCS_Get_Correlator_Setting(DCS_Handle hDevice) {
+	return Send_Get_Correlator_Setting(hDevice, NULL);
+}
+
+int DCS_Set_Analyzer_Setting(DCS_Handle hDevice, Analyzer_Setting* pAnalyzer_Setting, int Cha_Num) {
+	return Send_Analyzer_Setting(hDevice, pAnalyzer_Setting, Cha_Num, NULL);
+}
+
+int DCS_Get_Analyzer_Setting(DCS_Handle hDevice) {
+	return Send_Get_Analyzer_Setting(hDevice, NULL);
+}
+
+int DCS_Start_Measurement(DCS_Handle hDevice, int interval, int* pCha_IDs, int Cha_Num) {
+	return Send_Start_Measurement(hDevice, interval, (unsigned __int32*)pCha_IDs, Cha_Num, NULL);
+}
+
+int DCS_Stop_Measurement(DCS_Handle hDevice) {
+	return Send_Stop_Measurement(hDevice, NULL);
+}
+
+int DCS_Enable(DCS_Handle hDevice, bool bCorr, bool bAnalyzer) {
+	return Send_Enable_DCS(hDevice, bCorr, bAnalyzer, NULL);
+}
+
+int DCS_Get_Simulated_Correlation(DCS_Handle hDevice) {
+	return Send_Get_Simulated_Correlation(hDevice, NULL);
+}
+
+int DCS_Set_Optical_Param(DCS_Handle hDevice, Optical_Param_Type* pOpt_Param, int Cha_Num) {
+	return Send_Optical_Param(hDevice, pOpt_Param, Cha_Num, NULL);
+}
+
+int DCS_Set_Analyzer_Prefit_Param(DCS_Handle hDevice, Analyzer_Prefit_Param* pAnalyzer_Prefit_Param) {
+	return Send_Analyzer_Prefit_Param(hDevice, pAnalyzer_Prefit_Param, NULL);
+}
+
+int DCS_Get_Analyzer_Prefit_Param(DCS_Handle hDevice) {
+	return Send_Get_Analyzer_Prefit_Param(hDevice, NULL);
+}
+
+//Async commands. Request_Submit discards the request if the command couldn't be queued.
+
+int DCS_Get_DCS_Status_Async(DCS_Handle hDevice, DCS_Request_Options options, DCS_Request_Handle* pRequest) {
+	DCS_Request* pNew;
+	int result = Request_Create(hDevice, options, &pNew);
+	if (result != NO_DCS_ERROR) {
+		return result;
+	}
+	return Request_Submit(hDevice, pNew, Send_Get_DCS_Status(hDevice, pNew), pRequest);
+}
+
+int DCS_Set_Correlator_Setting_Async(DCS_Handle hDevice, Correlator_Setting* pCorr_Setting, DCS_Request_Options options, DCS_Request_Handle* pRequest) {
+	DCS_Request* pNew;
+	int result = Request_Create(hDevice, options, &pNew);
+	if (result != NO_DCS_ERROR) {
+		return result;
+	}
+	return Request_Submit(hDevice, pNew, Send_Correlator_Setting(hDevice, pCorr_Setting, pNew), pRequest);
+}
+
+int DCS_Get_Correlator_Setting_Async(DCS_Handle hDevice, DCS_Request_Options options, DCS_Request_Handle* pRequest) {
+	DCS_Request* pNew;
+	int result = Request_Create(hDevice, options, &pNew);
+	if (result != NO_DCS_ERROR) {
+		return result;
+	}
+	return Request_Submit(hDevice, pNew, Send_Get_Correlator_Setting(hDevice, pNew), pRequest);
+}
+
+int DCS_Set_Analyzer_Setting_Async(DCS_Handle hDevice, Analyzer_Setting* pAnalyzer_Setting, int Cha_Num, DCS_Request_Options options, DCS_Request_Handle* pRequest) {
+	DCS_Request* pNew;
+	int result = Request_Create(hDevice, options, &pNew);
+	if (result != NO_DCS_ERROR) {
+		return result;
+	}
+	return Request_Submit(hDevice, pNew, Send_Analyzer_Setting(hDevice, pAnalyzer_Setting, Cha_Num, pNew), pRequest);
+}
+
+int DCS_Get_Analyzer_Setting_Async(DCS_Handle hDevice, DCS_Request_Options options, DCS_Request_Handle* pRequest) {
+	DCS_Request* pNew;
+	int result = Request_Create(hDevice, options, &pNew);
+	if (result != NO_DCS_ERROR) {
+		return result;
+	}
+	return Request_Submit(hDevice, pNew, Send_Get_Analyzer_Setting(hDevice, pNew), pRequest);
+}
+
+int DCS_Start_Measurement_Async(DCS_Handle hDevice, int interval, int* pCha_IDs, int Cha_Num, DCS_Request_Options options, DCS_Request_Handle* pRequest) {
+	DCS_Request* pNew;
+	int result = Request_Create(hDevice, options, &pNew);
+	if (result != NO_DCS_ERROR) {
+		return result;
+	}
+	return Request_Submit(hDevice, pNew, Send_Start_Measurement(hDevice, interval, (unsigned __int32*)pCha_IDs, Cha_Num, pNew), pRequest);
+}
+
+int DCS_Stop_Measurement_Async(DCS_Handle hDevice, DCS_Request_Options options, DCS_Request_Handle* pRequest) {
+	DCS_Request* pNew;
+	int result = Request_Create(hDevice, options, &pNew);
+	if (result != NO_DCS_ERROR) {
+		return result;
+	}
+	return Request_Submit(hDevice, pNew, Send_Stop_Measurement(hDevice, pNew), pRequest);
+}
+
+int DCS_Enable_Async(DCS_Handle hDevice, bool bCorr, bool bAnalyzer, DCS_Request_Options options, DCS_Request_Handle* pRequest) {
+	DCS_Request* pNew;
+	int result = Request_Create(hDevice, options, &pNew);
+	if (result != NO_DCS_ERROR) {
+		return result;
+	}
+	return Request_Submit(hDevice, pNew, Send_Enable_DCS(hDevice, bCorr, bAnalyzer, pNew), pRequest);
+}
+
+int DCS_Get_Simulated_Correlation_Async(DCS_Handle hDevice, DCS_Request_Options options, DCS_Request_Handle* pRequest) {
+	DCS_Request* pNew;
+	int result = Request_Create(hDevice, options, &pNew);
+	if (result != NO_DCS_ERROR) {
+		return result;
+	}
+	return Request_Submit(hDevice, pNew, Send_Get_Simulated_Correlation(hDevice, pNew), pRequest);
+}
+
+int DCS_Set_Optical_Param_Async(DCS_Handle hDevice, Optical_Param_Type* pOpt_Param, int Cha_Num, DCS_Request_Options options, DCS_Request_Handle* pRequest) {
+	DCS_Request* pNew;
+	int result = Request_Create(hDevice, options, &pNew);
+	if (result != NO_DCS_ERROR) {
+		return result;
+	}
+	return Request_Submit(hDevice, pNew, Send_Optical_Param(hDevice, pOpt_Param, Cha_Num, pNew), pRequest);
+}
+
+int DCS_Set_Analyzer_Prefit_Param_Async(DCS_Handle hDevice, Analyzer_Prefit_Param* pAnalyzer_Prefit_Param, DCS_Request_Options options, DCS_Request_Handle* pRequest) {
+	DCS_Request* pNew;
+	int result = Request_Create(hDevice, options, &pNew);
+	if (result != NO_DCS_ERROR) {
+		return result;
+	}
+	return Request_Submit(hDevice, pNew, Send_Analyzer_Prefit_Param(hDevice, pAnalyzer_Prefit_Param, pNew), pRequest);
+}
+
+int DCS_Get_Analyzer_Prefit_Param_Async(DCS_Handle hDevice, DCS_Request_Options options, DCS_Request_Handle* pRequest) {
+	DCS_Request* pNew;
+	int result = Request_Create(hDevice, options, &pNew);
+	if (result != NO_DCS_ERROR) {
+		return result;
+	}
+	return Request_Submit(hDevice, pNew, Send_Get_Analyzer_Prefit_Param(hDevice, pNew), pRequest);
 }
\ No newline at end of file
@@ -1,6 +1,7 @@
 ﻿#pragma once
 
 #include <stdbool.h>
+#include "Platform.h"
 
 #ifdef DCS_DRIVER_EXPORTS
 #define DCS_DRIVER_API __declspec(dllexport)
@@ -22,6 +23,10 @@
 #define THREAD_ALREADY_EXISTS -8
 #define NETWORK_INIT_ERROR -9
 #define NETWORK_ERROR -10
+#define TRANSMIT_QUEUE_FULL -11 //The command wasn't sent because too many are already waiting to be sent
+#define DISPATCH_QUEUE_FULL -12 //A received frame was dropped because too many are already waiting for their callbacks
+#define REQUEST_PENDING -13 //The request hasn't resolved yet
+#define REQUEST_TIMED_OUT -14 //The request's deadline passed before the DCS answered it
 
 typedef struct {
 	int Data_N; //data number for correlation computation
@@ -75,6 +80,7 @@ typedef struct {
 	float BFI; // absolute blood flow index
 	float Beta; // β value in the fitting
 	float rMSE; // relative mean square error
+	unsigned __int64 timestamp_ns; //DCS_Clock_Now_Ns time the frame was received
 } BFI_Data;
 
 typedef struct {
@@ -82,19 +88,153 @@ typedef struct {
 	float intensity; //intensity of the optical channel
 	int Data_Num; //number of the correlation value
 	float* pCorrBuf; //pointer to the buffer of the correlation values
+	unsigned __int64 timestamp_ns; //DCS_Clock_Now_Ns time the frame was received
 } Corr_Intensity_Data;
 
 typedef struct {
 	int Cha_ID; //Channel ID
 	float intensity; //intensity of the optical channel
+	unsigned __int64 timestamp_ns; //DCS_Clock_Now_Ns time the frame was received
 } Intensity_Data;
 
+//Read-only view of one channel of a received correlation intensity frame.
+//Only valid for the duration of the callback it was obtained in.
+typedef struct {
+	int Cha_ID; //Channel ID
+	float intensity; //intensity of the optical channel
+	int Data_Num; //number of the correlation values
+	const void* pCorrRaw; //Data_Num correlation values as received. Unaligned and in the DCS byte order,
+						  //use Copy_Corr_Intensity_Channel to get them as floats.
+} Corr_Intensity_Channel_View;
+
+//Read-only view of a received correlation intensity frame that points into the driver's receive buffer.
+//Only valid for the duration of the callback it was passed to.
+typedef struct {
+	int Cha_Num; //number of channels in the frame
+	int Delay_Num; //number of delay values in the frame
+	const char* pData; //start of the frame's data in the receive buffer
+	const unsigned __int32* pChannelOffsets; //byte offset of each channel's record from pData
+	const void* pDelayRaw; //Delay_Num delay values as received, use Copy_Corr_Intensity_Delays to read them
+	unsigned __int64 timestamp_ns; //DCS_Clock_Now_Ns time the frame was received
+} Corr_Intensity_View;
+
+//Bytes every array of a Corr_Intensity_Matrix is aligned to.
+#define DCS_MATRIX_ALIGNMENT 64
+
+//Correlation intensity frame as a structure of arrays, with every channel's correlation values in one row-major matrix
+//that can be handed to vectorized fitting or wrapped as a 2D array without being copied. Each array starts on a
+//DCS_MATRIX_ALIGNMENT byte boundary.
+typedef struct {
+	int Cha_Num; //number of channels, the rows of pCorr
+	int Data_Num; //correlation values per channel, the columns of pCorr. Rows of channels with fewer values end in zeros.
+	int Delay_Num; //number of delay values
+	const int* pCha_IDs; //Cha_Num channel IDs
+	const float* pIntensity; //Cha_Num intensities
+	const float* pCorr; //Cha_Num rows of Data_Num correlation values, one after the other
+	const float* pDelayBuf; //Delay_Num delay values shared by every channel
+	unsigned __int64 timestamp_ns; //DCS_Clock_Now_Ns time the frame was received
+} Corr_Intensity_Matrix;
+
+//Integrity check carried by the frames sent to the DCS.
+typedef enum {
+	FRAME_CHECK_XOR, //1 byte XOR checksum
+	FRAME_CHECK_CRC32C, //4 byte CRC32C, detects the multi-byte corruptions the XOR checksum misses
+} Frame_Check_Type;
+
+//Socket I/O used by the event loops.
+typedef enum {
+	DCS_TRANSPORT_SOCKET, //non-blocking recv and send calls
+	DCS_TRANSPORT_IO_URING, //Linux io_uring: a multishot receive into registered buffers and linked sends
+} DCS_Transport;
+
+//What a bounded queue does with an item that arrives when it's full.
+typedef enum {
+	OVERFLOW_DROP_OLDEST, //Discard the oldest item waiting to make room
+	OVERFLOW_DROP_NEWEST, //Discard the item that arrived
+	OVERFLOW_BLOCK, //Stop reading from the DCS until there's room, so TCP flow control slows it down
+} Overflow_Policy;
+
+//Most threads Initialize_COM_Task can start to run the callbacks.
+#define DCS_MAX_DISPATCH_THREADS 8
+//Frames each dispatch thread can have waiting when DCS_Address.dispatch_queue_size is 0.
+#define DCS_DEFAULT_DISPATCH_QUEUE_SIZE 256
+
+//Most commands that can be sent to the DCS before their acknowledgements arrive.
+#define DCS_MAX_COMMAND_WINDOW 32
+
+//Most event loop threads DCS_Set_Event_Loops can spread the open devices over.
+#define DCS_MAX_EVENT_LOOPS 16
+
+//Waits between attempts to connect again when DCS_Address.reconnect_min_ms and reconnect_max_ms are 0.
+#define DCS_DEFAULT_RECONNECT_MIN_MS 100
+#define DCS_DEFAULT_RECONNECT_MAX_MS 5000
+
 //Structure for DCS address data.
 typedef struct {
 	const char* address; //IP Address of the DCS
 	const char* port; //Port of the DCS
+	Frame_Check_Type frame_check; //Integrity check used for this connection. Defaults to FRAME_CHECK_XOR.
+	//Number of commands that can be waiting for an acknowledgement at once, up to DCS_MAX_COMMAND_WINDOW.
+	//Above 1, frames carry sequence IDs, which the DCS must support. 0 or 1 waits for each acknowledgement in turn.
+	unsigned int command_window;
+	//Socket I/O used by the event loop. DCS_TRANSPORT_IO_URING falls back to DCS_TRANSPORT_SOCKET where it isn't available.
+	DCS_Transport transport;
+	//Threads that run the callbacks, up to DCS_MAX_DISPATCH_THREADS, so a slow callback doesn't hold up the connection.
+	//0 runs them on the event loop. Every frame of a data type goes to the same thread, so its callbacks run in order.
+	unsigned int dispatch_threads;
+	//Frames each dispatch thread can have waiting, 0 for DCS_DEFAULT_DISPATCH_QUEUE_SIZE.
+	unsigned int dispatch_queue_size;
+	//What happens to a frame that arrives when its dispatch thread's queue is full.
+	//OVERFLOW_BLOCK stops reading from this DCS until there's room. Other devices on the event loop carry on.
+	Overflow_Policy dispatch_overflow;
+	//Connect again by itself when the connection is lost rather than reporting it and leaving the device closed. Commands
+	//keep being queued meanwhile, and once it's back the DCS is sent its last acknowledged settings, a measurement that was
+	//running is started again and every command it hadn't answered is sent again before the ones queued.
+	bool reconnect;
+	//Wait before the second attempt to connect again, doubled after each failed one up to reconnect_max_ms. Each wait is
+	//cut by a random amount of up to half so devices that lost the same DCS don't all try at once. The first attempt is
+	//made straight away. 0 for DCS_DEFAULT_RECONNECT_MIN_MS and DCS_DEFAULT_RECONNECT_MAX_MS.
+	unsigned __int32 reconnect_min_ms;
+	unsigned __int32 reconnect_max_ms;
 } DCS_Address;
 
+//How long a connection that was lost took to be made again, passed to the reconnect callback.
+typedef struct {
+	unsigned __int32 attempts; //attempts to connect made, including the one that succeeded
+	unsigned __int64 latency_us; //time from the connection being found lost to it being made again, in microseconds
+	unsigned __int64 gap_us; //time from the last data received on the lost connection to it being made again, in microseconds
+} Reconnect_Info;
+
+//Counters for the frames the driver has written to the DCS, kept since the driver was loaded.
+typedef struct {
+	unsigned __int64 frames_sent; //frames completely written to the socket
+	unsigned __int64 send_calls; //scatter-gather writes made
+	unsigned __int64 frames_coalesced; //frames written in the same call as at least one other frame
+	unsigned __int64 partial_writes; //writes the socket only took part of
+	unsigned __int32 max_batch; //most frames given to a single write
+} Send_Stats;
+
+//Counters for the socket I/O of a connection, kept since the driver was loaded.
+typedef struct {
+	DCS_Transport transport; //transport used by the current or last connection
+	unsigned __int64 syscalls; //recv, send and io_uring_enter calls made
+	unsigned __int64 frames_received; //complete frames received
+	unsigned __int64 bytes_received; //bytes read from the socket
+	unsigned __int64 bytes_sent; //bytes written to the socket
+	bool kernel_timestamps; //whether the current or last connection's receive timestamps were taken by the kernel
+} Transport_Stats;
+
+//Counters for the dispatch threads, kept since the driver was loaded.
+typedef struct {
+	unsigned int threads; //dispatch threads running, 0 if the callbacks run on the event loop
+	unsigned __int32 queue_depth; //frames waiting now, across every dispatch thread
+	unsigned __int32 max_queue_depth; //most frames waiting for one dispatch thread at once
+	unsigned __int64 dispatched; //frames handed to their callbacks
+	unsigned __int64 dropped; //frames discarded because a queue was full
+	unsigned __int64 total_latency_us; //time frames spent waiting before their callbacks ran, in microseconds
+	unsigned __int64 max_latency_us; //longest any frame waited, in microseconds
+} Dispatch_Stats;
+
 
 /////////////////////////////////
 //User-defined Callbacks Typedefs
@@ -120,17 +260,28 @@ typedef void(*Get_Error_Message_CB_Def)(char* pMessage, unsigned __int32 Size);
 
 typedef void(*Get_Error_Code_CB_Def)(unsigned __int32 code);
 
-//Callback for getting BFI data.
-typedef void(*Get_BFI_Data_Def)(BFI_Data* pBFI_Data, int Cha_Num);
+//Callback for getting BFI data. The records may be where the store keeps them, so they're read-only and only valid
+//during the callback.
+typedef void(*Get_BFI_Data_Def)(const BFI_Data* pBFI_Data, int Cha_Num);
 
 //Callback for signaling that the BFI correlation data is ready.
 typedef void(*Get_BFI_Corr_Ready_CB_Def)(bool bReady);
 
-//Callback for getting the correlation intensity data.
-typedef void(*Get_Corr_Intensity_Data_CB_Def)(Corr_Intensity_Data* pCorr_Intensity_Data, int Cha_Num, float* pDelayBuf, int Delay_Num);
+//Callback for getting the correlation intensity data. Read-only and only valid during the callback like the BFI data,
+//which goes for the correlation values each channel's pCorrBuf points to as well.
+typedef void(*Get_Corr_Intensity_Data_CB_Def)(const Corr_Intensity_Data* pCorr_Intensity_Data, int Cha_Num, const float* pDelayBuf, int Delay_Num);
+
+//Callback for getting the correlation intensity data. Read-only and only valid during the callback like the BFI data.
+typedef void(*Get_Intensity_Data_CB_Def)(const Intensity_Data* pIntensity_Data, int Cha_Num);
+
+//Callback for viewing the correlation intensity data in place, without any copies being made.
+typedef void(*Get_Corr_Intensity_View_CB_Def)(const Corr_Intensity_View* pView);
 
-//Callback for getting the correlation intensity data.
-typedef void(*Get_Intensity_Data_CB_Def)(Intensity_Data* pIntensity_Data, int Cha_Num);
+//Callback for a lost connection having been made again, called by the event loop before anything is sent on it.
+typedef void(*Get_Reconnect_CB_Def)(const Reconnect_Info* pInfo);
+
+//Callback for getting the correlation intensity data as a matrix. The matrix is only valid for the duration of the callback.
+typedef void(*Get_Corr_Intensity_Matrix_CB_Def)(const Corr_Intensity_Matrix* pMatrix);
 
 //Structure to hold all of the callbacks for the COM task to call.
 typedef struct {
@@ -156,8 +307,105 @@ typedef struct {
 	Get_Intensity_Data_CB_Def Get_Intensity_Data_CB;
 	//Callback for getting an error code.
 	Get_Error_Code_CB_Def Get_Error_Code_CB;
+	//Callback for viewing the correlation intensity data without copies.
+	Get_Corr_Intensity_View_CB_Def Get_Corr_Intensity_View_CB;
+	//Callback for a lost connection having been made again.
+	Get_Reconnect_CB_Def Get_Reconnect_CB;
+	//Callback for getting the correlation intensity data as a matrix.
+	Get_Corr_Intensity_Matrix_CB_Def Get_Corr_Intensity_Matrix_CB;
 } Receive_Callbacks;
 
+//Handle of a connection to a DCS opened with DCS_Open.
+typedef struct DCS_Device* DCS_Handle;
+
+//Callbacks for connections opened with DCS_Open. Each is passed the pContext given with them,
+//so one set of functions can tell the devices apart.
+
+typedef void(*DCS_Get_DCS_Status_CB_Def)(void* pContext, bool bCorr, bool bAnalyzer, int DCS_Cha_Num);
+typedef void(*DCS_Get_Correlator_Setting_CB_Def)(void* pContext, Correlator_Setting* pCorrelator_Setting);
+typedef void(*DCS_Get_Analyzer_Setting_CB_Def)(void* pContext, Analyzer_Setting* pAnalyzer_Setting, int Cha_Num);
+typedef void(*DCS_Get_Simulated_Correlation_CB_Def)(void* pContext, Simulated_Correlation* Simulated_Corr);
+typedef void(*DCS_Get_Analyzer_Prefit_Param_CB_Def)(void* pContext, Analyzer_Prefit_Param* pAnalyzer_Setting);
+typedef void(*DCS_Get_Error_Message_CB_Def)(void* pContext, char* pMessage, unsigned __int32 Size);
+typedef void(*DCS_Get_Error_Code_CB_Def)(void* pContext, unsigned __int32 code);
+typedef void(*DCS_Get_BFI_Data_Def)(void* pContext, const BFI_Data* pBFI_Data, int Cha_Num);
+typedef void(*DCS_Get_BFI_Corr_Ready_CB_Def)(void* pContext, bool bReady);
+typedef void(*DCS_Get_Corr_Intensity_Data_CB_Def)(void* pContext, const Corr_Intensity_Data* pCorr_Intensity_Data, int Cha_Num, const float* pDelayBuf, int Delay_Num);
+typedef void(*DCS_Get_Intensity_Data_CB_Def)(void* pContext, const Intensity_Data* pIntensity_Data, int Cha_Num);
+typedef void(*DCS_Get_Corr_Intensity_View_CB_Def)(void* pContext, const Corr_Intensity_View* pView);
+typedef void(*DCS_Get_Reconnect_CB_Def)(void* pContext, const Reconnect_Info* pInfo);
+typedef void(*DCS_Get_Corr_Intensity_Matrix_CB_Def)(void* pContext, const Corr_Intensity_Matrix* pMatrix);
+
+//Structure to hold all of the callbacks for a device's event loop to call. Same as Receive_Callbacks, with each taking a context.
+typedef struct {
+	DCS_Get_DCS_Status_CB_Def Get_DCS_Status_CB;
+	DCS_Get_Correlator_Setting_CB_Def Get_Correlator_Setting_CB;
+	DCS_Get_Analyzer_Setting_CB_Def Get_Analyzer_Setting_CB;
+	DCS_Get_Simulated_Correlation_CB_Def Get_Simulated_Correlation_CB;
+	DCS_Get_Analyzer_Prefit_Param_CB_Def Get_Analyzer_Prefit_Param_CB;
+	DCS_Get_Error_Message_CB_Def Get_Error_Message_CB;
+	DCS_Get_BFI_Data_Def Get_BFI_Data;
+	DCS_Get_BFI_Corr_Ready_CB_Def Get_BFI_Corr_Ready_CB;
+	DCS_Get_Corr_Intensity_Data_CB_Def Get_Corr_Intensity_Data_CB;
+	DCS_Get_Intensity_Data_CB_Def Get_Intensity_Data_CB;
+	DCS_Get_Error_Code_CB_Def Get_Error_Code_CB;
+	DCS_Get_Corr_Intensity_View_CB_Def Get_Corr_Intensity_View_CB;
+	DCS_Get_Reconnect_CB_Def Get_Reconnect_CB;
+	DCS_Get_Corr_Intensity_Matrix_CB_Def Get_Corr_Intensity_Matrix_CB;
+} DCS_Callbacks;
+
+//Handle of a command sent with one of the DCS_*_Async functions, used to wait for the DCS to answer it.
+typedef struct DCS_Request* DCS_Request_Handle;
+
+//Time a request has to resolve in when DCS_Request_Options.timeout_ms is 0.
+#define DCS_DEFAULT_REQUEST_TIMEOUT_MS 10000
+
+//What a request resolved with. Only the member of [data] for the request's command is set, and only once
+//it has resolved with NO_DCS_ERROR. Its pointers belong to the request and are valid until DCS_Request_Free.
+typedef struct {
+	//REQUEST_PENDING until the request resolves. Then NO_DCS_ERROR if the DCS acknowledged the command and, for
+	//a Get command, replied to it. Otherwise REQUEST_TIMED_OUT, NETWORK_ERROR if the connection was lost or
+	//NETWORK_NOT_READY if the device was closed.
+	int status;
+	union {
+		//DCS_Get_DCS_Status_Async
+		struct {
+			bool bCorr;
+			bool bAnalyzer;
+			int DCS_Cha_Num;
+		} dcs_status;
+		//DCS_Get_Correlator_Setting_Async
+		Correlator_Setting correlator_setting;
+		//DCS_Get_Analyzer_Setting_Async
+		struct {
+			Analyzer_Setting* pAnalyzer_Setting;
+			int Cha_Num;
+		} analyzer_setting;
+		//DCS_Get_Simulated_Correlation_Async
+		Simulated_Correlation simulated_correlation;
+		//DCS_Get_Analyzer_Prefit_Param_Async
+		Analyzer_Prefit_Param analyzer_prefit_param;
+	} data;
+} DCS_Response;
+
+//Called once when a request resolves, by the device's event loop or, for a reply, the thread running its callbacks.
+//The request stays valid until the callback returns, even if it's freed in the callback.
+typedef void(*DCS_Request_CB_Def)(void* pContext, DCS_Request_Handle hRequest, const DCS_Response* pResponse);
+
+//How a request made with one of the DCS_*_Async functions resolves.
+typedef struct {
+	unsigned __int32 timeout_ms; //Time from the call the DCS has to answer in, 0 for DCS_DEFAULT_REQUEST_TIMEOUT_MS
+	DCS_Request_CB_Def callback; //Called when the request resolves. Can be NULL.
+	void* pContext; //Passed to [callback]
+} DCS_Request_Options;
+
+//Handle of a timer made with DCS_Schedule_Timer.
+typedef struct DCS_Timer* DCS_Timer_Handle;
+
+//Called by the device's event loop each time a timer made with DCS_Schedule_Timer fires. The device isn't served while
+//it runs, so it should return quickly. It can schedule and cancel timers, including its own.
+typedef void(*DCS_Timer_CB_Def)(void* pContext, DCS_Timer_Handle hTimer);
+
 ////////////
 //Public API
 ////////////
@@ -167,6 +415,7 @@ typedef struct {
 /// Other function calls will be queued up and sent once the COM task is initialized.
 /// Can be called multiple times without calling [Destroy_COM_Task] to change the callbacks
 /// being used, but not the address.</para>
+/// <para>The connection is served by the same event loops as the devices opened with DCS_Open.</para>
 /// </summary>
 /// <param name="address">Address structure containing the IP and port of the
 /// DCS device.
@@ -277,8 +526,222 @@ DCS_DRIVER_API int Set_Analyzer_Prefit_Param(Analyzer_Prefit_Param* pAnalyzer_Pr
 /// <returns>Standard DCS status code.</returns>
 DCS_DRIVER_API int Get_Analyzer_Prefit_Param(void);
 
+/// <summary>
+/// Reads the channel at <paramref name="index"/> out of a correlation intensity view.
+/// </summary>
+/// <param name="pView">View passed to [Get_Corr_Intensity_View_CB].</param>
+/// <param name="index">Index of the channel, from 0 to Cha_Num - 1.</param>
+/// <param name="pChannel">Filled with the channel's view.</param>
+/// <returns>Standard DCS status code.</returns>
+DCS_DRIVER_API int View_Corr_Intensity_Channel(const Corr_Intensity_View* pView, int index, Corr_Intensity_Channel_View* pChannel);
+
+/// <summary>
+/// Copies the correlation values of a channel view into a caller-provided buffer in host byte order.
+/// </summary>
+/// <param name="pChannel">Channel view from [View_Corr_Intensity_Channel].</param>
+/// <param name="pCorrBuf">Buffer with room for Data_Num floats.</param>
+/// <returns>Standard DCS status code.</returns>
+DCS_DRIVER_API int Copy_Corr_Intensity_Channel(const Corr_Intensity_Channel_View* pChannel, float* pCorrBuf);
+
+/// <summary>
+/// Copies the delay values of a correlation intensity view into a caller-provided buffer in host byte order.
+/// </summary>
+/// <param name="pView">View passed to [Get_Corr_Intensity_View_CB].</param>
+/// <param name="pDelayBuf">Buffer with room for Delay_Num floats.</param>
+/// <returns>Standard DCS status code.</returns>
+DCS_DRIVER_API int Copy_Corr_Intensity_Delays(const Corr_Intensity_View* pView, float* pDelayBuf);
+
+/// <summary>
+/// Retrieves counters for the frames sent to the DCS, including how many were coalesced
+/// into a single write.
+/// </summary>
+/// <param name="pStats">Filled with the current counters.</param>
+/// <returns>Standard DCS status code.</returns>
+DCS_DRIVER_API int Get_Send_Stats(Send_Stats* pStats);
+
+/// <summary>
+/// Retrieves counters for the connection's socket I/O, including the system calls it made,
+/// and which transport the connection is using.
+/// </summary>
+/// <param name="pStats">Filled with the current counters.</param>
+/// <returns>Standard DCS status code.</returns>
+DCS_DRIVER_API int Get_Transport_Stats(Transport_Stats* pStats);
+
+/// <summary>
+/// Retrieves counters for the threads that run the callbacks when DCS_Address.dispatch_threads is set,
+/// including how deep their queues get and how long frames wait in them.
+/// </summary>
+/// <param name="pStats">Filled with the current counters.</param>
+/// <returns>Standard DCS status code.</returns>
+DCS_DRIVER_API int Get_Dispatch_Stats(Dispatch_Stats* pStats);
+
+/// <summary>
+/// Reads the monotonic clock the timestamp_ns of received data is taken on, so data can be lined up with other
+/// events the application times. Counts nanoseconds from an arbitrary starting point and never goes backwards.
+/// </summary>
+/// <returns>The current time in nanoseconds.</returns>
+DCS_DRIVER_API unsigned __int64 DCS_Clock_Now_Ns(void);
+
 /// <summary>
 /// Returns a struct of NULL-initialized callbacks for when they're not used.
 /// </summary>
 /// <returns>NULL-initialized callbacks.</returns>
-DCS_DRIVER_API Receive_Callbacks Null_Receive_Callbacks(void);
\ No newline at end of file
+DCS_DRIVER_API Receive_Callbacks Null_Receive_Callbacks(void);
+
+/// <summary>
+/// Returns a struct of NULL-initialized callbacks for DCS_Open when they're not used.
+/// </summary>
+/// <returns>NULL-initialized callbacks.</returns>
+DCS_DRIVER_API DCS_Callbacks Null_DCS_Callbacks(void);
+
+///////////////////////////////////////////////////////////////
+//Handle API. Each handle is its own connection to a DCS, and
+//any number can be open alongside the one Initialize_COM_Task
+//makes. Open devices are served by shared event loop threads.
+///////////////////////////////////////////////////////////////
+
+/// <summary>
+/// Connects to a DCS and has an event loop start serving it. Unlike Initialize_COM_Task, commands can only
+/// be sent once the handle is open.
+/// </summary>
+/// <param name="address">Address structure containing the IP and port of the DCS device.</param>
+/// <param name="callbacks">Callbacks to call when data is received from this device.</param>
+/// <param name="pContext">Passed to every callback. Can be NULL.</param>
+/// <param name="should_store">If true, stores data on heap to be manually retrieved by the DCS_Get_*_Data functions.</param>
+/// <param name="pHandle">Set to the device's handle, or NULL on failure.</param>
+/// <returns>Standard DCS status code.</returns>
+DCS_DRIVER_API int DCS_Open(DCS_Address address, DCS_Callbacks callbacks, void* pContext, bool should_store, DCS_Handle* pHandle);
+
+/// <summary>
+/// Closes a device opened with DCS_Open, freeing everything it holds including data it stored. Waits for its
+/// event loop and dispatch threads to stop using it, so it must not be called from one of its callbacks.
+/// </summary>
+/// <param name="hDevice">Handle to close. Invalid once this returns.</param>
+/// <returns>Standard DCS status code.</returns>
+DCS_DRIVER_API int DCS_Close(DCS_Handle hDevice);
+
+/// <summary>
+/// Changes the callbacks of an open device. Callbacks already running finish with the old ones.
+/// </summary>
+/// <param name="hDevice">Handle of the device.</param>
+/// <param name="callbacks">Callbacks to call when data is received from this device.</param>
+/// <param name="pContext">Passed to every callback. Can be NULL.</param>
+/// <param name="should_store">If true, stores data on heap to be manually retrieved.</param>
+/// <returns>Standard DCS status code.</returns>
+DCS_DRIVER_API int DCS_Set_Callbacks(DCS_Handle hDevice, DCS_Callbacks callbacks, void* pContext, bool should_store);
+
+/// <summary>
+/// Sets how many event loop threads the open devices are spread over. Defaults to 1, and loops already
+/// running are kept.
+/// </summary>
+/// <param name="loops">Number of loops, from 1 to DCS_MAX_EVENT_LOOPS.</param>
+/// <returns>Standard DCS status code.</returns>
+DCS_DRIVER_API int DCS_Set_Event_Loops(unsigned int loops);
+
+//Same as the functions without the DCS_ prefix, for the device [hDevice].
+
+DCS_DRIVER_API int DCS_Get_DCS_Status(DCS_Handle hDevice);
+DCS_DRIVER_API int DCS_Set_Correlator_Setting(DCS_Handle hDevice, Correlator_Setting* pCorr_Setting);
+DCS_DRIVER_API int DCS_Get_Correlator_Setting(DCS_Handle hDevice);
+DCS_DRIVER_API int DCS_Set_Analyzer_Setting(DCS_Handle hDevice, Analyzer_Setting* pAnalyzer_Setting, int Cha_Num);
+DCS_DRIVER_API int DCS_Get_Analyzer_Setting(DCS_Handle hDevice);
+DCS_DRIVER_API int DCS_Start_Measurement(DCS_Handle hDevice, int interval, int* pCha_IDs, int Cha_Num);
+DCS_DRIVER_API int DCS_Stop_Measurement(DCS_Handle hDevice);
+DCS_DRIVER_API int DCS_Enable(DCS_Handle hDevice, bool bCorr, bool bAnalyzer);
+DCS_DRIVER_API int DCS_Get_Simulated_Correlation(DCS_Handle hDevice);
+DCS_DRIVER_API int DCS_Set_Optical_Param(DCS_Handle hDevice, Optical_Param_Type* pOpt_Param, int Cha_Num);
+DCS_DRIVER_API int DCS_Set_Analyzer_Prefit_Param(DCS_Handle hDevice, Analyzer_Prefit_Param* pAnalyzer_Prefit_Param);
+DCS_DRIVER_API int DCS_Get_Analyzer_Prefit_Param(DCS_Handle hDevice);
+DCS_DRIVER_API int DCS_Get_Send_Stats(DCS_Handle hDevice, Send_Stats* pStats);
+DCS_DRIVER_API int DCS_Get_Transport_Stats(DCS_Handle hDevice, Transport_Stats* pStats);
+
+/// <summary>
+/// Retrieves counters for the device's dispatch threads, including those of threads already stopped: frames handed to
+/// the callbacks or dropped from a full queue, how deep the queues are and have been, and how long frames waited in them.
+/// Every counter stays 0 if the device was opened without DCS_Address.dispatch_threads. Only valid while the device is open.
+/// </summary>
+/// <param name="hDevice">Handle of the device.</param>
+/// <param name="pStats">Filled with the current counters.</param>
+/// <returns>Standard DCS status code. NETWORK_NOT_READY if the device isn't open.</returns>
+DCS_DRIVER_API int DCS_Get_Dispatch_Stats(DCS_Handle hDevice, Dispatch_Stats* pStats);
+
+/// <summary>
+/// Returns the handle of the device Initialize_COM_Task connects, so the DCS_*_Async functions can be used with it.
+/// It's only valid while the COM task is running and can't be passed to DCS_Close.
+/// </summary>
+/// <returns>Handle of the default device.</returns>
+DCS_DRIVER_API DCS_Handle DCS_Default_Handle(void);
+
+///////////////////////////////////////////////////////////////
+//Async commands. Each sends the same command as the function
+//without _Async and returns a request that resolves once the
+//DCS answers it, so many can be in flight and each waited on
+//for only as long as it takes.
+///////////////////////////////////////////////////////////////
+
+/// <summary>
+/// Waits for a request to resolve.
+/// </summary>
+/// <param name="hRequest">Request from one of the DCS_*_Async functions.</param>
+/// <param name="timeout_ms">Most milliseconds to wait, or INFINITE to wait until the request's own deadline if need be.</param>
+/// <param name="pResponse">Filled with the request's response, or its status if it's still pending. Can be NULL.</param>
+/// <returns>The request's status: NO_DCS_ERROR if the DCS answered it, REQUEST_PENDING if it hasn't resolved yet,
+/// or why it failed.</returns>
+DCS_DRIVER_API int DCS_Request_Wait(DCS_Request_Handle hRequest, unsigned __int32 timeout_ms, DCS_Response* pResponse);
+
+/// <summary>
+/// Checks whether a request has resolved without waiting. Same as DCS_Request_Wait with a timeout of 0.
+/// </summary>
+/// <param name="hRequest">Request from one of the DCS_*_Async functions.</param>
+/// <param name="pResponse">Filled with the request's response. Can be NULL.</param>
+/// <returns>The request's status, REQUEST_PENDING if it hasn't resolved yet.</returns>
+DCS_DRIVER_API int DCS_Request_Poll(DCS_Request_Handle hRequest, DCS_Response* pResponse);
+
+/// <summary>
+/// Frees a request and the data of its response. A request that hasn't resolved still resolves and calls its callback.
+/// </summary>
+/// <param name="hRequest">Request to free. Invalid once this returns.</param>
+/// <returns>Standard DCS status code.</returns>
+DCS_DRIVER_API int DCS_Request_Free(DCS_Request_Handle hRequest);
+
+//Same as the DCS_ functions without _Async. Each also takes:
+//  options: The request's timeout and completion callback.
+//  pRequest: Set to the request, to be freed with DCS_Request_Free, or NULL on failure. Can itself be NULL
+//            if only the callback is wanted, in which case the request is freed once it has resolved.
+//Each returns a standard DCS status code for sending the command. Nothing is sent and no callback is called on failure.
+
+DCS_DRIVER_API int DCS_Get_DCS_Status_Async(DCS_Handle hDevice, DCS_Request_Options options, DCS_Request_Handle* pRequest);
+DCS_DRIVER_API int DCS_Set_Correlator_Setting_Async(DCS_Handle hDevice, Correlator_Setting* pCorr_Setting, DCS_Request_Options options, DCS_Request_Handle* pRequest);
+DCS_DRIVER_API int DCS_Get_Correlator_Setting_Async(DCS_Handle hDevice, DCS_Request_Options options, DCS_Request_Handle* pRequest);
+DCS_DRIVER_API int DCS_Set_Analyzer_Setting_Async(DCS_Handle hDevice, Analyzer_Setting* pAnalyzer_Setting, int Cha_Num, DCS_Request_Options options, DCS_Request_Handle* pRequest);
+DCS_DRIVER_API int DCS_Get_Analyzer_Setting_Async(DCS_Handle hDevice, DCS_Request_Options options, DCS_Request_Handle* pRequest);
+DCS_DRIVER_API int DCS_Start_Measurement_Async(DCS_Handle hDevice, int interval, int* pCha_IDs, int Cha_Num, DCS_Request_Options options, DCS_Request_Handle* pRequest);
+DCS_DRIVER_API int DCS_Stop_Measurement_Async(DCS_Handle hDevice, DCS_Request_Options options, DCS_Request_Handle* pRequest);
+DCS_DRIVER_API int DCS_Enable_Async(DCS_Handle hDevice, bool bCorr, bool bAnalyzer, DCS_Request_Options options, DCS_Request_Handle* pRequest);
+DCS_DRIVER_API int DCS_Get_Simulated_Correlation_Async(DCS_Handle hDevice, DCS_Request_Options options, DCS_Request_Handle* pRequest);
+DCS_DRIVER_API int DCS_Set_Optical_Param_Async(DCS_Handle hDevice, Optical_Param_Type* pOpt_Param, int Cha_Num, DCS_Request_Options options, DCS_Request_Handle* pRequest);
+DCS_DRIVER_API int DCS_Set_Analyzer_Prefit_Param_Async(DCS_Handle hDevice, Analyzer_Prefit_Param* pAnalyzer_Prefit_Param, DCS_Request_Options options, DCS_Request_Handle* pRequest);
+DCS_DRIVER_API int DCS_Get_Analyzer_Prefit_Param_Async(DCS_Handle hDevice, DCS_Request_Options options, DCS_Request_Handle* pRequest);
+
+/// <summary>
+/// Has the device's event loop call [callback] once [delay_ms] milliseconds have passed, and then every [period_ms]
+/// milliseconds if it isn't 0. Timers are kept on the same monotonic clock as command deadlines and fire within a
+/// millisecond of being due however busy the connection is. They stop if the connection is lost or the device is closed.
+/// </summary>
+/// <param name="hDevice">Device whose event loop calls the callback.</param>
+/// <param name="delay_ms">Milliseconds until the first call.</param>
+/// <param name="period_ms">Milliseconds between later calls, or 0 to only call it once.</param>
+/// <param name="callback">Function to call.</param>
+/// <param name="pContext">Passed to [callback].</param>
+/// <param name="pTimer">Set to the timer, to be cancelled with DCS_Cancel_Timer, or NULL on failure. Can itself be NULL if
+/// the timer is never cancelled, in which case a timer called once is freed after its call.</param>
+/// <returns>Standard DCS status code. NETWORK_NOT_READY if the device isn't connected.</returns>
+DCS_DRIVER_API int DCS_Schedule_Timer(DCS_Handle hDevice, unsigned __int32 delay_ms, unsigned __int32 period_ms, DCS_Timer_CB_Def callback, void* pContext, DCS_Timer_Handle* pTimer);
+
+/// <summary>
+/// Stops a timer and frees its handle. The callback isn't called again once this returns, unless it's already running.
+/// Must be called for every timer whose handle was taken, even once it has fired or its device has been closed.
+/// </summary>
+/// <param name="hTimer">Timer from DCS_Schedule_Timer. Invalid once this returns.</param>
+/// <returns>Standard DCS status code.</returns>
+DCS_DRIVER_API int DCS_Cancel_Timer(DCS_Timer_Handle hTimer);
\ No newline at end of file
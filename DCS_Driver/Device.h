@@ -0,0 +1,291 @@
+#pragma once
+#include <stdbool.h>
+#include "Platform.h"
+
+#include "DCS_Driver.h"
+#include "Internal.h"
+#include "Framer.h"
+#include "Uring.h"
+#include "Queue.h"
+#include "Dispatch.h"
+#include "COM_Task.h"
+#include "Request.h"
+#include "Timer_Wheel.h"
+#include "User_Timer.h"
+#include "Session.h"
+
+//Everything the driver keeps for one connection to a DCS. The legacy API uses a single device that lives for
+//as long as the driver is loaded, and DCS_Open allocates one per handle. Event loops serve devices in passes
+//driven by Device_Loop_Pass, so only the functions declared here are called by a loop thread.
+
+//Frames each device's transmission FIFO holds. Must be a power of 2.
+#define TRANSMIT_QUEUE_SIZE 256
+
+struct Recv_Slot;
+
+//Items of one data type kept for the application, oldest first, in a ring of [capacity] slots.
+typedef struct {
+	Received_Data_Item** ppItems; //Allocated when the first item of the type is stored
+	unsigned __int32 capacity; //Number of slots in ppItems
+	unsigned __int32 head; //Slot of the oldest item
+	Store_Stats stats; //Counters for Get_Store_Stats, including the number of items held
+	//Allocations BFI, intensity and correlation intensity items are kept in, reused rather than freed once the application
+	//has taken their items and the decoder is done with them.
+	struct Recv_Slot* pFreeSlots; //Slots not holding an item
+	unsigned __int32 slots; //Slots allocated, free or holding an item
+	size_t slot_size; //Bytes of data a slot has room for. Only grows, and smaller slots are freed as they come back.
+} Recv_Ring;
+
+//Frames taken off the transmission FIFO that haven't been completely written to the socket yet.
+typedef struct {
+	Transmission_Data_Type* pHead; //Oldest frame, partly written if [sent] isn't 0
+	Transmission_Data_Type* pTail; //Newest frame
+	unsigned __int32 sent; //Bytes of pHead, including its prepended size, already written
+} Output_Cursor;
+
+//Completion record of a command that was sent and is waiting for its acknowledgement.
+typedef struct {
+	bool pending; //Whether the record is in use
+	Sequence_ID sequence; //Sequence ID of the command, 0 if it wasn't sequenced
+	Data_ID command_code; //Data ID of the command
+	unsigned __int64 sent_time; //Clock_Now_Ns time the command was taken to be sent
+	Timer deadline; //Fires if the command hasn't been acknowledged in time. Armed while the record is pending.
+	DCS_Request* pRequest; //Request the command resolves, NULL if it was sent without one
+	Transmission_Data_Type* pFrame; //Frame of the command, kept to be sent again if the connection is lost. NULL unless the device reconnects.
+} Command_Record;
+
+//Callbacks and store setting of a device. A set is never changed once it's published, so the threads
+//calling the callbacks read the current one with a single atomic load rather than taking a lock for every frame.
+typedef struct Callback_Set {
+	//Callbacks passed to Initialize_COM_Task.
+	Receive_Callbacks callbacks;
+	//Callbacks passed to DCS_Open, each called with [pContext].
+	DCS_Callbacks handlers;
+	void* pContext;
+	//Whether the received data should be stored on the heap to be manually emptied.
+	bool should_store;
+	//Set retired before this one.
+	struct Callback_Set* pNextItem;
+	//Counts of the device's event loop and dispatch threads once the set was replaced. It's freed when every count that
+	//was odd has changed, as the thread that loaded it has finished with it by then.
+	unsigned __int32 loop_passes;
+	unsigned __int32 dispatch_passes[DCS_MAX_DISPATCH_THREADS];
+	unsigned int dispatch_threads;
+} Callback_Set;
+
+struct Event_Loop;
+
+//Where a device is in being served by an event loop. Guarded by the loop's mutex.
+typedef enum {
+	LOOP_DETACHED, //Not served, either not attached yet or dropped by the loop
+	LOOP_JOINING, //Waiting for the loop thread to take it
+	LOOP_ACTIVE, //Served on every pass
+} Loop_State;
+
+struct DCS_Device {
+	//Socket connected to the DCS. Only valid while the device is attached to an event loop.
+	SOCKET socket;
+	//Socket or io_uring ring the event loop's poller watches for the device, INVALID_SOCKET if none.
+	SOCKET watched;
+
+	//Transmission FIFO. Any thread can add frames without a lock, and only the event loop takes them.
+	//Set up the first time the device is opened.
+	Queue trans_queue;
+	Queue_Cell trans_queue_cells[TRANSMIT_QUEUE_SIZE];
+	//Set by the first frame queued since the event loop last took frames, so only that frame wakes it.
+	volatile unsigned __int32 trans_wake_pending;
+
+	//Integrity check used by outgoing frames. Set before the device is attached to an event loop.
+	Frame_Check_Type frame_check;
+	//Whether outgoing frames carry a sequence ID.
+	bool frame_sequenced;
+	//Byte offset of each channel record in the correlation intensity frame being decoded. Kept between frames
+	//so steady-state decoding doesn't allocate. Only used by the thread decoding correlation intensity frames.
+	unsigned __int32* pChannel_Offsets;
+	//Number of entries pChannel_Offsets can hold.
+	unsigned __int32 Channel_Offsets_Capacity;
+	//Records decoded from the BFI and intensity frames, and the channels, correlation values and delays decoded from the
+	//correlation intensity frames, handed to the callbacks. Kept between frames like pChannel_Offsets, each only used
+	//by the thread decoding frames of its type.
+	void* pBFI_Records;
+	size_t BFI_Records_Size; //Bytes pBFI_Records can hold
+	void* pIntensity_Records;
+	size_t Intensity_Records_Size; //Bytes pIntensity_Records can hold
+	void* pCorr_Block;
+	size_t Corr_Block_Size; //Bytes pCorr_Block can hold
+	//Correlation intensity matrix handed to the matrix callbacks, laid out by Layout_Corr_Intensity_Matrix.
+	void* pCorr_Matrix;
+	size_t Corr_Matrix_Size; //Bytes pCorr_Matrix can hold
+
+	//Handle of the mutex guarding the send and transport counters.
+	Mutex* hFIFOMutex;
+	//Frames being written by the event loop. Only used by the loop thread.
+	Output_Cursor output_cursor;
+	//Counters for Get_Send_Stats. Guarded by hFIFOMutex.
+	Send_Stats send_stats;
+	//Counters for Get_Transport_Stats. Guarded by hFIFOMutex.
+	Transport_Stats transport_stats;
+
+	//Commands waiting for an acknowledgement. Only used by the loop thread once the device is attached.
+	Command_Record command_records[DCS_MAX_COMMAND_WINDOW];
+	//Number of commands that can be waiting for an acknowledgement at once.
+	unsigned int command_window;
+	//Number of records in [command_records] that are pending.
+	unsigned int commands_pending;
+	//Set when a command's deadline fires, so the next pass drops the connection.
+	bool command_timed_out;
+	//Clock_Now_Ns time of the last data received from the DCS.
+	unsigned __int64 last_response;
+	//Fires once the connection has been quiet for CHECK_CONNECTION_FREQ seconds. It's moved on when it fires
+	//rather than every time data arrives.
+	Timer keep_alive;
+	//Fires at the earliest deadline of the device's unresolved requests.
+	Timer request_deadline;
+	//Timer wheel of the event loop serving the device, NULL while it isn't being served. Only used by the loop thread.
+	Timer_Wheel* pWheel;
+	//Poller of the event loop serving the device, NULL while it isn't being served. Only used by the loop thread.
+	Poller* pPoller;
+
+	//Commands to send before any more are taken from the FIFO: the settings sent again after reconnecting and the
+	//commands a lost connection left unanswered. Only used by the loop thread.
+	Output_Cursor replay;
+	//What the device keeps to connect again once its connection is lost. Only used by the loop thread once the device is attached.
+	Session session;
+
+	//Received data that hasn't been handed out as frames yet. Kept between reads so frames can be split across them.
+	//Only used by the loop thread.
+	Framer recv_framer;
+	//Clock_Now_Ns time the data last read from the socket was received. Only used by the loop thread.
+	unsigned __int64 recv_timestamp;
+	//Transport asked for when the device was opened.
+	DCS_Transport requested_transport;
+	//io_uring transport, or NULL if the socket is read and written directly. Only used by the loop thread.
+	Uring* pUring;
+	//Frames handed to pUring that haven't finished sending, oldest first. Only used by the loop thread.
+	Output_Cursor uring_sending;
+
+	//Store of the items received while should_store is set, one ring per data type so each is taken in O(1).
+	//Guarded by hRecvDataMutex.
+	Recv_Ring recv_rings[Data_Item_Type_Count];
+	//Limits applied to every ring. Guarded by hRecvDataMutex.
+	Store_Config store_config;
+	//Woken when an item is taken from the store or the limits change, for a dispatch thread waiting with OVERFLOW_BLOCK.
+	Cond* pStoreCond;
+	//Item the event loop couldn't store under OVERFLOW_BLOCK, kept instead of waiting for room while it stops reading
+	//from the DCS. Stored as soon as there's room, which wakes the event loop. Guarded by hRecvDataMutex.
+	Received_Data_Item* pHeldItem;
+	//Set while the device is being closed so nothing waits for room in the store. Guarded by hRecvDataMutex.
+	bool store_closing;
+	//Data types a measurement started now would send, as Data_Item_Type bits, and the values in each channel's correlation
+	//buffer, 0 until known. Taken from the commands last sent and the replies last received, and used to size the store's
+	//slots when a measurement is started. Guarded by hRecvDataMutex.
+	unsigned __int32 stream_types;
+	unsigned __int32 correlation_length;
+	Mutex* hRecvDataMutex;
+
+	//Set in use, or NULL before the device is first given callbacks. Replaced as a whole by set_Callbacks.
+	Callback_Set* volatile pCallbackSet;
+	//Sets replaced while the device was attached. Its event loop or a dispatch thread may still be calling through
+	//them, so each is kept until they've finished the run they were in. Guarded by hCallbacksMutex.
+	Callback_Set* pRetiredSets;
+	//Handle of the mutex serializing changes to pCallbackSet and pRetiredSets. Reading pCallbackSet doesn't need it.
+	Mutex* hCallbacksMutex;
+
+	//Threads running the callbacks in place of the event loop, if any were asked for.
+	Dispatch dispatch;
+
+	//Requests sent with the DCS_*_Async functions that haven't resolved yet, newest first. Guarded by hRequestMutex.
+	DCS_Request* pRequests;
+	//Number of requests in pRequests, so event loop passes can skip taking the lock when there are none.
+	volatile unsigned __int32 requests_listed;
+	//Get commands acknowledged by the DCS whose replies haven't been decoded yet. Guarded by hRequestMutex.
+	Reply_Record reply_records[DCS_MAX_COMMAND_WINDOW];
+	//Get commands acknowledged since the device was opened. Guarded by hRequestMutex.
+	unsigned __int64 replies_expected;
+	//Whether requests can be made. Cleared once the device is closed or its connection is lost. Guarded by hRequestMutex.
+	bool requests_open;
+	//Handle of the mutex guarding the device's requests, NULL while the device isn't open.
+	Mutex* hRequestMutex;
+
+	//Timers scheduled with DCS_Schedule_Timer that the event loop hasn't armed yet. Guarded by hTimerMutex.
+	DCS_Timer* pNewTimers;
+	//Set while pNewTimers isn't empty, so event loop passes can skip taking the lock when it is.
+	volatile unsigned __int32 new_timers;
+	//Timers armed in pWheel. Only used by the loop thread.
+	DCS_Timer* pTimers;
+	//Whether timers can be scheduled. Cleared once the device leaves its event loop. Guarded by hTimerMutex.
+	bool timers_open;
+	//Handle of the mutex guarding the device's new timers, NULL while the device isn't open.
+	Mutex* hTimerMutex;
+
+	//Event loop the device is assigned to, NULL if it isn't open.
+	struct Event_Loop* pLoop;
+	//Where the device is in being served by pLoop. Guarded by the loop's mutex.
+	Loop_State loop_state;
+	//Set when the device should be dropped by pLoop. Guarded by the loop's mutex.
+	bool detaching;
+	//Set when the poller found activity on the device's socket since its last pass. Only used by the loop thread.
+	bool ready;
+	//Set by Event_Loop_Wake and the device's timers, and cleared by pLoop as it runs the pass they asked for.
+	volatile unsigned __int32 pass_due;
+	//Set while the event loop has stopped reading from the DCS because the store or a dispatch queue is full under
+	//OVERFLOW_BLOCK. Frames already read stay in recv_framer until there's room. Only used by the loop thread.
+	bool reads_held;
+	//Next device waiting to join pLoop or served by it.
+	struct DCS_Device* pNextMember;
+};
+
+//Has [pPoller] watch the device's socket, or its io_uring ring when that was asked for and can be set up, and arms
+//the device's timers in [pWheel]. Called by the loop thread when the device joins it, since io_uring completes requests
+//on the thread that submitted them. Returns false, having reported why, if the device can't be served.
+bool Device_Loop_Start(DCS_Device* pDevice, Poller* pPoller, Timer_Wheel* pWheel);
+
+//Receives, times out commands, checks the connection and sends for the device. Only reads the socket if [ready]
+//is set and reads aren't held. Returns false, having reported why, if the connection failed and the device should be dropped. A device that
+//reconnects is kept instead, and its passes wait for the connection to be made again.
+bool Device_Loop_Pass(DCS_Device* pDevice);
+
+//Stops the loop's poller watching the device, disarms its timers and closes its connection or the attempt to make it
+//again. Called by the loop thread when the device leaves it.
+void Device_Loop_Stop(DCS_Device* pDevice);
+
+/////////////////////////////////////////////////////////////////
+//Internal callbacks for functions receiving data from the DCS.//
+/////////////////////////////////////////////////////////////////
+
+//Replies to Get commands are passed the sequence ID the DCS echoed in them, 0 if they have none, to resolve their requests.
+void Get_DCS_Status_CB(DCS_Device* pDevice, bool bCorr, bool bAnalyzer, int DCS_Cha_Num, Sequence_ID sequence);
+void Get_Correlator_Setting_CB(DCS_Device* pDevice, Correlator_Setting* pCorrelator_Setting, Sequence_ID sequence);
+void Get_Analyzer_Setting_CB(DCS_Device* pDevice, Analyzer_Setting* pAnalyzer_Setting, int Cha_Num, Sequence_ID sequence);
+void Get_Analyzer_Prefit_Param_CB(DCS_Device* pDevice, Analyzer_Prefit_Param* pAnalyzer_Prefit, Sequence_ID sequence);
+void Get_Simulated_Correlation_CB(DCS_Device* pDevice, Simulated_Correlation* Simulated_Corr, Sequence_ID sequence);
+void Get_BFI_Data(DCS_Device* pDevice, const BFI_Data* pBFI_Data, int Cha_Num, Received_Data_Item* pFrame);
+void Get_Error_Message_CB(DCS_Device* pDevice, char* pMessage, unsigned __int32 Size);
+void Get_Error_Code_CB(DCS_Device* pDevice, unsigned __int32 code);
+void Get_BFI_Corr_Ready_CB(DCS_Device* pDevice, bool bReady);
+void Get_Corr_Intensity_Data_CB(DCS_Device* pDevice, const Corr_Intensity_Data* pCorr_Intensity_Data, int Cha_Num, const float* pDelayBuf, int Delay_Num, Received_Data_Item* pFrame);
+void Get_Intensity_Data_CB(DCS_Device* pDevice, const Intensity_Data* pIntensity_Data, int Cha_Num, Received_Data_Item* pFrame);
+void Get_Corr_Intensity_View_CB(DCS_Device* pDevice, const Corr_Intensity_View* pView);
+void Get_Reconnect_CB(DCS_Device* pDevice, const Reconnect_Info* pInfo);
+void Get_Corr_Intensity_Matrix_CB(DCS_Device* pDevice, const Corr_Intensity_Matrix* pMatrix);
+
+//Returns true if a user-defined callback or the store needs copies of the correlation intensity data.
+bool Corr_Intensity_Data_Requested(DCS_Device* pDevice);
+
+//Returns true if a user-defined callback takes the correlation intensity data as a matrix.
+bool Corr_Intensity_Matrix_Requested(DCS_Device* pDevice);
+
+//Frames the store keeps are decoded straight into the slot it keeps them in, rather than copied there once the callbacks
+//have seen them. The decoder holds a reference to the slot while the callbacks borrow its data read-only, Get_BFI_Data,
+//Get_Intensity_Data_CB and Get_Corr_Intensity_Data_CB give the store a reference of its own as [pFrame], and the slot is
+//reused once both have been dropped.
+
+//Returns a slot with room for [size] bytes of decoded [type] data, holding the caller's reference to it, or NULL if the
+//store doesn't keep data or the slot can't be allocated.
+Received_Data_Item* Take_Frame_Buffer(DCS_Device* pDevice, Data_Item_Type type, size_t size);
+
+//Returns where the data of a slot from Take_Frame_Buffer starts.
+void* Frame_Buffer_Data(Received_Data_Item* pFrame);
+
+//Drops the reference Take_Frame_Buffer gave the caller. Does nothing if [pFrame] is NULL.
+void Release_Frame_Buffer(DCS_Device* pDevice, Received_Data_Item* pFrame);
@@ -0,0 +1,363 @@
+#define _CRTDBG_MAP_ALLOC
+#include <stdlib.h>
+#include "Platform.h"
+#include <string.h>
+
+#include "Dispatch.h"
+#include "Event_Loop.h"
+
+//Frame waiting for a dispatch thread. The frame's data follows the struct in the same allocation.
+typedef struct Dispatch_Job {
+	struct Dispatch_Job* pNextItem;
+	Data_ID data_id;
+	Sequence_ID sequence; //Sequence ID of the command the frame answers, 0 if the frame has none
+	unsigned __int32 size; //Bytes of data after the struct
+	unsigned __int32 capacity; //Bytes of data the job has room for
+	unsigned __int64 received; //Clock_Now_Ns time the frame was received
+	unsigned __int64 queued; //Clock_Now_Ns time the frame was added to the queue
+} Dispatch_Job;
+
+//Work done by each dispatch thread.
+static void dispatch_thread(void* arg);
+//Dispatch thread of [pDispatch] that handles frames of [data_id].
+static Dispatcher* dispatcher_for(Dispatch* pDispatch, Data_ID data_id);
+//Removes the oldest frame waiting for [pDispatcher]. Must be called with its mutex held and the queue not empty.
+static Dispatch_Job* pop_job(Dispatcher* pDispatcher);
+//Keeps a job whose frame was handled or dropped to carry another. Must be called with its dispatcher's mutex held.
+static void spare_job(Dispatcher* pDispatcher, Dispatch_Job* pJob);
+//Grows the jobs [pDispatcher] has spare to its job size. Must be called with its mutex held.
+static int grow_spare_jobs(Dispatcher* pDispatcher);
+//Frees the jobs [pDispatcher] has spare.
+static void free_spare_jobs(Dispatcher* pDispatcher);
+//Adds [pFrom]'s counters to [pTo].
+static void add_Dispatch_Stats(Dispatch_Stats* pTo, const Dispatch_Stats* pFrom);
+
+int Dispatch_Start(Dispatch* pDispatch, unsigned int threads, unsigned int queue_size, Overflow_Policy overflow, Dispatch_Handler handler, DCS_Device* pDevice) {
+	if (threads == 0) {
+		return NO_DCS_ERROR;
+	}
+	if (threads > DCS_MAX_DISPATCH_THREADS) {
+		threads = DCS_MAX_DISPATCH_THREADS;
+	}
+
+	pDispatch->queue_capacity = queue_size != 0 ? queue_size : DCS_DEFAULT_DISPATCH_QUEUE_SIZE;
+	pDispatch->overflow = overflow;
+	pDispatch->handler = handler;
+	pDispatch->pDevice = pDevice;
+
+	for (unsigned int x = 0; x < threads; x++) {
+		Dispatcher* pDispatcher = &pDispatch->dispatchers[x];
+		memset(pDispatcher, 0, sizeof(*pDispatcher));
+		pDispatcher->pDispatch = pDispatch;
+
+		pDispatcher->pMutex = Mutex_Create();
+		pDispatcher->pCond = Cond_Create();
+		if (pDispatcher->pMutex != NULL && pDispatcher->pCond != NULL) {
+			pDispatcher->pThread = Thread_Start(dispatch_thread, pDispatcher);
+		}
+
+		if (pDispatcher->pThread == NULL) {
+			if (pDispatcher->pMutex != NULL) {
+				Mutex_Destroy(pDispatcher->pMutex);
+			}
+			if (pDispatcher->pCond != NULL) {
+				Cond_Destroy(pDispatcher->pCond);
+			}
+			memset(pDispatcher, 0, sizeof(*pDispatcher));
+			//Stop the threads that did start.
+			Dispatch_Stop(pDispatch);
+			return THREAD_START_ERROR;
+		}
+		pDispatch->count = x + 1;
+	}
+
+	return NO_DCS_ERROR;
+}
+
+bool Dispatch_Running(const Dispatch* pDispatch) {
+	return pDispatch->count != 0;
+}
+
+int Dispatch_Frame(Dispatch* pDispatch, Data_ID data_id, Sequence_ID sequence, const char* pData, unsigned __int32 size, unsigned __int64 timestamp) {
+	Dispatcher* pDispatcher = dispatcher_for(pDispatch, data_id);
+
+	Mutex_Lock(pDispatcher->pMutex);
+	//The spares are grown along with the job size rather than as they're taken, since the last of them may only be
+	//taken long after, once the queue is deeper than it has been.
+	if (size > pDispatcher->job_size) {
+		pDispatcher->job_size = size;
+		grow_spare_jobs(pDispatcher);
+	}
+	const unsigned __int32 job_size = pDispatcher->job_size;
+	Dispatch_Job* pJob = pDispatcher->pSpareJobs;
+	if (pJob != NULL) {
+		pDispatcher->pSpareJobs = pJob->pNextItem;
+	}
+	Mutex_Unlock(pDispatcher->pMutex);
+
+	const bool new_job = pJob == NULL;
+	if (new_job || pJob->capacity < size) {
+		Dispatch_Job* tmp = realloc(pJob, sizeof(*pJob) + job_size);
+		if (tmp == NULL) {
+			if (!new_job) {
+				Mutex_Lock(pDispatcher->pMutex);
+				spare_job(pDispatcher, pJob);
+				Mutex_Unlock(pDispatcher->pMutex);
+			}
+			return MEMORY_ALLOCATION_ERROR;
+		}
+		pJob = tmp;
+		pJob->capacity = job_size;
+	}
+	pJob->pNextItem = NULL;
+	pJob->data_id = data_id;
+	pJob->sequence = sequence;
+	pJob->size = size;
+	pJob->received = timestamp;
+	memcpy(pJob + 1, pData, size);
+
+	Mutex_Lock(pDispatcher->pMutex);
+	if (new_job) {
+		pDispatcher->jobs++;
+	}
+
+	//Rather than wait on the event loop, which other devices share, the frame is queued past the limit and the event loop
+	//stops reading from this device's DCS, so TCP flow control slows it down until the callbacks catch up.
+	int result = NO_DCS_ERROR;
+	if (pDispatch->overflow == OVERFLOW_BLOCK && !pDispatcher->closing && pDispatcher->count >= pDispatch->queue_capacity) {
+		pDispatcher->holding = true;
+		result = DISPATCH_FRAME_HELD;
+	}
+	else if (pDispatcher->count >= pDispatch->queue_capacity) {
+		pDispatcher->stats.dropped++;
+		if (pDispatch->overflow == OVERFLOW_DROP_OLDEST) {
+			spare_job(pDispatcher, pop_job(pDispatcher));
+		}
+		//Dropping the newest frame is also what happens once the device is being detached.
+		else {
+			spare_job(pDispatcher, pJob);
+			Mutex_Unlock(pDispatcher->pMutex);
+			return DISPATCH_QUEUE_FULL;
+		}
+	}
+
+	pJob->queued = Clock_Now_Ns();
+	if (pDispatcher->pHead == NULL) {
+		pDispatcher->pHead = pJob;
+	}
+	else {
+		pDispatcher->pTail->pNextItem = pJob;
+	}
+	pDispatcher->pTail = pJob;
+	pDispatcher->count++;
+	if (pDispatcher->count > pDispatcher->stats.max_queue_depth) {
+		pDispatcher->stats.max_queue_depth = pDispatcher->count;
+	}
+
+	Cond_Wake_All(pDispatcher->pCond);
+	Mutex_Unlock(pDispatcher->pMutex);
+
+	return result;
+}
+
+int Dispatch_Reserve(Dispatch* pDispatch, Data_ID data_id, unsigned __int32 size) {
+	if (!Dispatch_Running(pDispatch)) {
+		return NO_DCS_ERROR;
+	}
+	Dispatcher* pDispatcher = dispatcher_for(pDispatch, data_id);
+
+	//The queue can hold one frame past its limit under OVERFLOW_BLOCK, or one about to replace the oldest under
+	//OVERFLOW_DROP_OLDEST, while the thread is handling another.
+	const unsigned __int32 needed = pDispatch->queue_capacity + 2;
+
+	Mutex_Lock(pDispatcher->pMutex);
+	if (size > pDispatcher->job_size) {
+		pDispatcher->job_size = size;
+	}
+	int result = grow_spare_jobs(pDispatcher);
+	while (result == NO_DCS_ERROR && pDispatcher->jobs < needed) {
+		Dispatch_Job* pJob = malloc(sizeof(*pJob) + pDispatcher->job_size);
+		if (pJob == NULL) {
+			result = MEMORY_ALLOCATION_ERROR;
+			break;
+		}
+		pJob->capacity = pDispatcher->job_size;
+		spare_job(pDispatcher, pJob);
+		pDispatcher->jobs++;
+	}
+	Mutex_Unlock(pDispatcher->pMutex);
+
+	return result;
+}
+
+bool Dispatch_Holding(Dispatch* pDispatch) {
+	bool holding = false;
+	for (unsigned int x = 0; x < pDispatch->count && !holding; x++) {
+		Dispatcher* pDispatcher = &pDispatch->dispatchers[x];
+		Mutex_Lock(pDispatcher->pMutex);
+		holding = pDispatcher->holding;
+		Mutex_Unlock(pDispatcher->pMutex);
+	}
+	return holding;
+}
+
+void Dispatch_Close(Dispatch* pDispatch) {
+	for (unsigned int x = 0; x < pDispatch->count; x++) {
+		Dispatcher* pDispatcher = &pDispatch->dispatchers[x];
+		Mutex_Lock(pDispatcher->pMutex);
+		pDispatcher->closing = true;
+		Cond_Wake_All(pDispatcher->pCond);
+		Mutex_Unlock(pDispatcher->pMutex);
+	}
+}
+
+void Dispatch_Stop(Dispatch* pDispatch) {
+	for (unsigned int x = 0; x < pDispatch->count; x++) {
+		Dispatcher* pDispatcher = &pDispatch->dispatchers[x];
+		Mutex_Lock(pDispatcher->pMutex);
+		pDispatcher->closing = true;
+		pDispatcher->stopping = true;
+		Cond_Wake_All(pDispatcher->pCond);
+		Mutex_Unlock(pDispatcher->pMutex);
+	}
+
+	for (unsigned int x = 0; x < pDispatch->count; x++) {
+		Dispatcher* pDispatcher = &pDispatch->dispatchers[x];
+		Thread_Join(pDispatcher->pThread);
+
+		while (pDispatcher->pHead != NULL) {
+			free(pop_job(pDispatcher));
+			pDispatcher->stats.dropped++;
+		}
+		free_spare_jobs(pDispatcher);
+
+		add_Dispatch_Stats(&pDispatch->retired_stats, &pDispatcher->stats);
+		Mutex_Destroy(pDispatcher->pMutex);
+		Cond_Destroy(pDispatcher->pCond);
+		memset(pDispatcher, 0, sizeof(*pDispatcher));
+	}
+
+	pDispatch->count = 0;
+}
+
+unsigned int Dispatch_Passes(Dispatch* pDispatch, unsigned __int32* pPasses) {
+	for (unsigned int x = 0; x < pDispatch->count; x++) {
+		pPasses[x] = Atomic_Load_Acquire(&pDispatch->dispatchers[x].passes);
+	}
+	return pDispatch->count;
+}
+
+void Dispatch_Get_Stats(Dispatch* pDispatch, Dispatch_Stats* pStats) {
+	*pStats = pDispatch->retired_stats;
+	pStats->threads = pDispatch->count;
+
+	for (unsigned int x = 0; x < pDispatch->count; x++) {
+		Dispatcher* pDispatcher = &pDispatch->dispatchers[x];
+		Mutex_Lock(pDispatcher->pMutex);
+		add_Dispatch_Stats(pStats, &pDispatcher->stats);
+		pStats->queue_depth += pDispatcher->count;
+		Mutex_Unlock(pDispatcher->pMutex);
+	}
+}
+
+static void dispatch_thread(void* arg) {
+	Dispatcher* pDispatcher = arg;
+	Dispatch* pDispatch = pDispatcher->pDispatch;
+
+	Mutex_Lock(pDispatcher->pMutex);
+	for (;;) {
+		while (pDispatcher->pHead == NULL && !pDispatcher->stopping) {
+			Cond_Wait(pDispatcher->pCond, pDispatcher->pMutex);
+		}
+		if (pDispatcher->stopping) {
+			break;
+		}
+
+		Dispatch_Job* pJob = pop_job(pDispatcher);
+
+		const unsigned __int64 latency_us = (Clock_Now_Ns() - pJob->queued) / 1000;
+		pDispatcher->stats.dispatched++;
+		pDispatcher->stats.total_latency_us += latency_us;
+		if (latency_us > pDispatcher->stats.max_latency_us) {
+			pDispatcher->stats.max_latency_us = latency_us;
+		}
+
+		//Have the event loop read from the DCS again once there's room.
+		if (pDispatcher->holding && pDispatcher->count < pDispatch->queue_capacity) {
+			pDispatcher->holding = false;
+			Event_Loop_Wake(pDispatch->pDevice);
+		}
+
+		//The callbacks run without the lock so the event loop can keep queueing frames meanwhile.
+		Mutex_Unlock(pDispatcher->pMutex);
+		Atomic_Increment(&pDispatcher->passes);
+		pDispatch->handler(pDispatch->pDevice, pJob->data_id, pJob->sequence, (char*)(pJob + 1), pJob->size, pJob->received);
+		Atomic_Increment(&pDispatcher->passes);
+		Mutex_Lock(pDispatcher->pMutex);
+		spare_job(pDispatcher, pJob);
+	}
+	Mutex_Unlock(pDispatcher->pMutex);
+}
+
+static Dispatcher* dispatcher_for(Dispatch* pDispatch, Data_ID data_id) {
+	//Data IDs are small consecutive numbers, so they're mixed before being spread over the threads.
+	const unsigned __int32 hash = (unsigned __int32)(data_id * 2654435761u);
+	return &pDispatch->dispatchers[(hash >> 16) % pDispatch->count];
+}
+
+static Dispatch_Job* pop_job(Dispatcher* pDispatcher) {
+	Dispatch_Job* pJob = pDispatcher->pHead;
+	pDispatcher->pHead = pJob->pNextItem;
+	if (pDispatcher->pHead == NULL) {
+		pDispatcher->pTail = NULL;
+	}
+	pDispatcher->count--;
+	return pJob;
+}
+
+static void spare_job(Dispatcher* pDispatcher, Dispatch_Job* pJob) {
+	//A job queued before the job size last grew is grown on its way back. If that fails it's grown once it's taken.
+	if (pJob->capacity < pDispatcher->job_size) {
+		Dispatch_Job* tmp = realloc(pJob, sizeof(*pJob) + pDispatcher->job_size);
+		if (tmp != NULL) {
+			pJob = tmp;
+			pJob->capacity = pDispatcher->job_size;
+		}
+	}
+	pJob->pNextItem = pDispatcher->pSpareJobs;
+	pDispatcher->pSpareJobs = pJob;
+}
+
+static int grow_spare_jobs(Dispatcher* pDispatcher) {
+	for (Dispatch_Job** ppJob = &pDispatcher->pSpareJobs; *ppJob != NULL; ppJob = &(*ppJob)->pNextItem) {
+		if ((*ppJob)->capacity < pDispatcher->job_size) {
+			Dispatch_Job* tmp = realloc(*ppJob, sizeof(**ppJob) + pDispatcher->job_size);
+			if (tmp == NULL) {
+				return MEMORY_ALLOCATION_ERROR;
+			}
+			*ppJob = tmp;
+			tmp->capacity = pDispatcher->job_size;
+		}
+	}
+	return NO_DCS_ERROR;
+}
+
+static void free_spare_jobs(Dispatcher* pDispatcher) {
+	while (pDispatcher->pSpareJobs != NULL) {
+		Dispatch_Job* pJob = pDispatcher->pSpareJobs;
+		pDispatcher->pSpareJobs = pJob->pNextItem;
+		free(pJob);
+	}
+}
+
+static void add_Dispatch_Stats(Dispatch_Stats* pTo, const Dispatch_Stats* pFrom) {
+	pTo->dispatched += pFrom->dispatched;
+	pTo->dropped += pFrom->dropped;
+	pTo->total_latency_us += pFrom->total_latency_us;
+	if (pFrom->max_queue_depth > pTo->max_queue_depth) {
+		pTo->max_queue_depth = pFrom->max_queue_depth;
+	}
+	if (pFrom->max_latency_us > pTo->max_latency_us) {
+		pTo->max_latency_us = pFrom->max_latency_us;
+	}
+}
@@ -0,0 +1,85 @@
+#pragma once
+#include <stdbool.h>
+#include "Platform.h"
+#include "Internal.h"
+
+//Threads that run a device's callbacks in place of its event loop, so a slow callback holds up its own thread
+//rather than reading from the DCS. The event loop copies each verified frame's data into the queue of the
+//thread chosen by its data ID, and that thread decodes it and calls the callbacks. Every frame of a data
+//type goes through the same thread, so its callbacks run in the order the frames arrived.
+
+//Decodes a frame's data for [pDevice], received at the Clock_Now_Ns time [timestamp] with the sequence ID [sequence], and calls its
+//callbacks. Run by a dispatch thread.
+typedef int (*Dispatch_Handler)(DCS_Device* pDevice, Data_ID data_id, Sequence_ID sequence, char* pData, unsigned __int32 size, unsigned __int64 timestamp);
+
+struct Dispatch_Job;
+struct Dispatch;
+
+//One dispatch thread and the frames waiting for it, oldest first.
+typedef struct {
+	struct Dispatch* pDispatch; //Set of threads this one belongs to
+	Thread* pThread;
+	Mutex* pMutex; //Guards everything below
+	Cond* pCond; //Woken when a frame is queued or taken, and when the thread should stop
+	struct Dispatch_Job* pHead;
+	struct Dispatch_Job* pTail;
+	unsigned __int32 count;
+	struct Dispatch_Job* pSpareJobs; //Jobs whose frames have been handled, kept to carry the next ones
+	unsigned __int32 jobs; //Jobs allocated, whether queued, spare or being handled
+	unsigned __int32 job_size; //Size every job is grown to: the biggest frame queued or reserved so far
+	bool holding; //Set when a frame was queued past the limit under OVERFLOW_BLOCK, until there's room again
+	bool closing; //Set when frames mustn't be queued past the limit any more
+	bool stopping; //Set when the thread should exit
+	volatile unsigned __int32 passes; //Odd while the thread is running the handler and even otherwise. Read without the lock.
+	Dispatch_Stats stats; //Counters since the thread started. [threads] isn't used.
+} Dispatcher;
+
+//Dispatch threads of one device. Zeroed, it has no threads running.
+typedef struct Dispatch {
+	Dispatcher dispatchers[DCS_MAX_DISPATCH_THREADS];
+	unsigned int count; //Number of dispatch threads running. Only changed by Dispatch_Start and Dispatch_Stop.
+	unsigned __int32 queue_capacity; //Frames each queue holds
+	Overflow_Policy overflow; //What happens to a frame when its queue is full
+	Dispatch_Handler handler; //Called by the dispatch threads for each frame
+	DCS_Device* pDevice; //Passed to [handler]
+	Dispatch_Stats retired_stats; //Counters of the dispatch threads that have been stopped
+} Dispatch;
+
+//Starts [threads] dispatch threads for [pDevice], each queueing up to [queue_size] frames and handling a full queue as
+//[overflow] says. Does nothing and returns NO_DCS_ERROR if [threads] is 0.
+int Dispatch_Start(Dispatch* pDispatch, unsigned int threads, unsigned int queue_size, Overflow_Policy overflow, Dispatch_Handler handler, DCS_Device* pDevice);
+
+//Whether frames are being handed to dispatch threads.
+bool Dispatch_Running(const Dispatch* pDispatch);
+
+//Returned by Dispatch_Frame when the frame was queued past the limit under OVERFLOW_BLOCK. The event loop then stops
+//reading from the DCS until Dispatch_Holding is false, and the dispatch thread wakes it when that happens.
+#define DISPATCH_FRAME_HELD 1
+
+//Copies [size] bytes of a frame's data from [pData] to the queue of the dispatch thread for [data_id], along with its
+//sequence ID and the Clock_Now_Ns time [timestamp] it was received. Returns DISPATCH_QUEUE_FULL if the frame was dropped because the queue was
+//full, and DISPATCH_FRAME_HELD if it was kept but the event loop should stop reading.
+//Jobs are reused once their frames are handled, so this only allocates while the queue is deeper or the frame bigger than before.
+//A frame bigger than any before grows every job of its thread, so frames of mixed sizes don't keep growing them.
+int Dispatch_Frame(Dispatch* pDispatch, Data_ID data_id, Sequence_ID sequence, const char* pData, unsigned __int32 size, unsigned __int64 timestamp);
+
+//Allocates jobs for frames of [size] bytes until the dispatch thread for [data_id] has enough to fill its queue, so
+//frames up to that size are queued without allocating. Does nothing if no dispatch threads are running.
+int Dispatch_Reserve(Dispatch* pDispatch, Data_ID data_id, unsigned __int32 size);
+
+//Whether a queue has a frame past its limit, so the event loop shouldn't read from the DCS.
+bool Dispatch_Holding(Dispatch* pDispatch);
+
+//Stops queueing frames past the limit, so the device can be detached. Frames that don't fit are dropped from now on.
+void Dispatch_Close(Dispatch* pDispatch);
+
+//Stops the dispatch threads once their current callbacks return, discarding the frames still queued.
+void Dispatch_Stop(Dispatch* pDispatch);
+
+//Fills [pPasses], which has room for DCS_MAX_DISPATCH_THREADS counts, with the count of each dispatch thread running.
+//A count is odd while its thread is handling a frame, so a frame seen with an odd count has been handled once it changes.
+//Returns the number of threads.
+unsigned int Dispatch_Passes(Dispatch* pDispatch, unsigned __int32* pPasses);
+
+//Fills [pStats] with the counters of every dispatch thread [pDispatch] has started.
+void Dispatch_Get_Stats(Dispatch* pDispatch, Dispatch_Stats* pStats);
@@ -0,0 +1,336 @@
+#define _CRTDBG_MAP_ALLOC
+#include <stdlib.h>
+#include "Platform.h"
+
+#include "Device.h"
+#include "Event_Loop.h"
+
+//One event loop thread and the devices it serves.
+typedef struct Event_Loop {
+	Thread* pThread;
+	//Woken when a device joins or should leave the loop, and when a frame is queued for one of its devices.
+	Poller* pPoller;
+	//Guards pJoining and the loop_state and detaching of every device assigned to the loop.
+	Mutex* pMutex;
+	//Woken when a device leaves the loop.
+	Cond* pCond;
+	//Devices waiting for the loop thread to take them, linked through pNextMember.
+	DCS_Device* pJoining;
+	//Devices the loop serves, linked through pNextMember. Only used by the loop thread.
+	DCS_Device* pMembers;
+	//Devices assigned to the loop, including ones it dropped that haven't been closed yet. Guarded by the loops mutex.
+	unsigned int devices;
+	//Deadlines of every device the loop serves. Only used by the loop thread.
+	Timer_Wheel wheel;
+	//Odd while the loop thread is running passes and even while it waits. Only changed by the loop thread.
+	volatile unsigned __int32 passes;
+} Event_Loop;
+
+//Loops running, in no particular order. Guarded by the loops mutex.
+static Event_Loop* loops[DCS_MAX_EVENT_LOOPS];
+//Number of loops devices are spread over. Guarded by the loops mutex.
+static unsigned int loop_target = 1;
+//Mutex guarding the loops. Created the first time it's needed and kept until the driver is unloaded.
+static Mutex* pLoopsMutex;
+//0 until pLoopsMutex is being created, 1 while it is and 2 once it can be used.
+static volatile unsigned __int32 loops_mutex_state = 0;
+
+//Returns the loops mutex, creating it if this is the first call. Returns NULL if it can't be created.
+static Mutex* get_Loops_mutex(void);
+//Starts a loop thread with no devices. Returns NULL on failure.
+static Event_Loop* start_Loop(void);
+//Stops a loop with no devices left and frees it.
+static void stop_Loop(Event_Loop* pLoop);
+//Work done by each loop thread.
+static void event_loop(void* arg);
+//Takes the devices waiting to join the loop and drops the ones that should leave it.
+static void update_Members(Event_Loop* pLoop);
+//Drops a device from the loop and lets a thread waiting to detach it carry on. Called by the loop thread.
+static void leave_Loop(Event_Loop* pLoop, DCS_Device* pDevice);
+
+int Event_Loop_Set_Count(unsigned int loops) {
+	if (loops < 1 || loops > DCS_MAX_EVENT_LOOPS) {
+		return FRAME_INVALID_DATA;
+	}
+
+	Mutex* pMutex = get_Loops_mutex();
+	if (pMutex == NULL) {
+		return THREAD_START_ERROR;
+	}
+
+	Mutex_Lock(pMutex);
+	loop_target = loops;
+	Mutex_Unlock(pMutex);
+
+	return NO_DCS_ERROR;
+}
+
+int Event_Loop_Attach(DCS_Device* pDevice) {
+	Mutex* pMutex = get_Loops_mutex();
+	if (pMutex == NULL) {
+		return THREAD_START_ERROR;
+	}
+
+	Mutex_Lock(pMutex);
+
+	//Find the loop with room serving the fewest devices, and a slot for a new loop.
+	Event_Loop* pLoop = NULL;
+	unsigned int running = 0;
+	int free_slot = -1;
+	for (int x = 0; x < DCS_MAX_EVENT_LOOPS; x++) {
+		if (loops[x] == NULL) {
+			if (free_slot < 0) {
+				free_slot = x;
+			}
+			continue;
+		}
+
+		running++;
+		if (loops[x]->devices < POLLER_MAX_SOCKETS && (pLoop == NULL || loops[x]->devices < pLoop->devices)) {
+			pLoop = loops[x];
+		}
+	}
+
+	//Devices get loops of their own until the set number are running. A loop is also started when every one is full.
+	if ((pLoop == NULL || running < loop_target) && free_slot >= 0) {
+		Event_Loop* pNewLoop = start_Loop();
+		if (pNewLoop != NULL) {
+			loops[free_slot] = pNewLoop;
+			pLoop = pNewLoop;
+		}
+	}
+
+	if (pLoop == NULL) {
+		Mutex_Unlock(pMutex);
+		return THREAD_START_ERROR;
+	}
+	pLoop->devices++;
+
+	Mutex_Unlock(pMutex);
+
+	pDevice->pLoop = pLoop;
+
+	Mutex_Lock(pLoop->pMutex);
+	pDevice->loop_state = LOOP_JOINING;
+	pDevice->detaching = false;
+	//The device's first pass reads whatever arrived before its socket was watched.
+	pDevice->ready = true;
+	pDevice->pNextMember = pLoop->pJoining;
+	pLoop->pJoining = pDevice;
+	Mutex_Unlock(pLoop->pMutex);
+
+	Poller_Wake(pLoop->pPoller);
+
+	return NO_DCS_ERROR;
+}
+
+void Event_Loop_Detach(DCS_Device* pDevice) {
+	Event_Loop* pLoop = pDevice->pLoop;
+	if (pLoop == NULL) {
+		return;
+	}
+
+	Mutex_Lock(pLoop->pMutex);
+	pDevice->detaching = true;
+	Poller_Wake(pLoop->pPoller);
+	while (pDevice->loop_state != LOOP_DETACHED) {
+		Cond_Wait(pLoop->pCond, pLoop->pMutex);
+	}
+	Mutex_Unlock(pLoop->pMutex);
+
+	pDevice->pLoop = NULL;
+
+	//The loop is stopped along with its last device. The loop thread never takes the loops mutex, so it can be joined here.
+	Mutex_Lock(pLoopsMutex);
+	pLoop->devices--;
+	if (pLoop->devices == 0) {
+		for (int x = 0; x < DCS_MAX_EVENT_LOOPS; x++) {
+			if (loops[x] == pLoop) {
+				loops[x] = NULL;
+			}
+		}
+		stop_Loop(pLoop);
+	}
+	Mutex_Unlock(pLoopsMutex);
+}
+
+void Event_Loop_Wake(DCS_Device* pDevice) {
+	Event_Loop* pLoop = pDevice->pLoop;
+	if (pLoop != NULL) {
+		Atomic_Store_Release(&pDevice->pass_due, 1);
+		Poller_Wake(pLoop->pPoller);
+	}
+}
+
+unsigned __int32 Event_Loop_Passes(DCS_Device* pDevice) {
+	Event_Loop* pLoop = pDevice->pLoop;
+	return pLoop != NULL ? Atomic_Load_Acquire(&pLoop->passes) : 0;
+}
+
+bool Event_Loop_Is_Current(DCS_Device* pDevice) {
+	Event_Loop* pLoop = pDevice->pLoop;
+	return pLoop != NULL && Thread_Is_Current(pLoop->pThread);
+}
+
+static Mutex* get_Loops_mutex(void) {
+	if (Atomic_Load_Acquire(&loops_mutex_state) == 2) {
+		return pLoopsMutex;
+	}
+
+	//Only one thread creates the mutex. Any other waits for it, which only happens if the first devices are opened at once.
+	if (Atomic_Compare_Exchange(&loops_mutex_state, 0, 1)) {
+		pLoopsMutex = Mutex_Create();
+		Atomic_Store_Release(&loops_mutex_state, pLoopsMutex != NULL ? 2 : 0);
+		return pLoopsMutex;
+	}
+
+	unsigned __int32 state;
+	while ((state = Atomic_Load_Acquire(&loops_mutex_state)) == 1) {
+		Sleep(0);
+	}
+	return state == 2 ? pLoopsMutex : NULL;
+}
+
+static Event_Loop* start_Loop(void) {
+	Event_Loop* pLoop = calloc(1, sizeof(*pLoop));
+	if (pLoop == NULL) {
+		return NULL;
+	}
+
+	pLoop->pPoller = Poller_Create();
+	pLoop->pMutex = Mutex_Create();
+	pLoop->pCond = Cond_Create();
+	Timer_Wheel_Init(&pLoop->wheel, Clock_Now_Ns());
+	if (pLoop->pPoller != NULL && pLoop->pMutex != NULL && pLoop->pCond != NULL) {
+		pLoop->pThread = Thread_Start(event_loop, pLoop);
+	}
+
+	if (pLoop->pThread == NULL) {
+		if (pLoop->pPoller != NULL) {
+			Poller_Destroy(pLoop->pPoller);
+		}
+		if (pLoop->pMutex != NULL) {
+			Mutex_Destroy(pLoop->pMutex);
+		}
+		if (pLoop->pCond != NULL) {
+			Cond_Destroy(pLoop->pCond);
+		}
+		free(pLoop);
+		return NULL;
+	}
+
+	return pLoop;
+}
+
+static void stop_Loop(Event_Loop* pLoop) {
+	Poller_Stop(pLoop->pPoller);
+	Thread_Join(pLoop->pThread);
+
+	Poller_Destroy(pLoop->pPoller);
+	Mutex_Destroy(pLoop->pMutex);
+	Cond_Destroy(pLoop->pCond);
+	free(pLoop);
+}
+
+//Function run by each loop thread. Serves its devices until the loop is stopped, which only happens once
+//every device assigned to it has been detached.
+static void event_loop(void* arg) {
+	Event_Loop* pLoop = arg;
+	unsigned __int32 timeout = INFINITE;
+
+	//Each pass runs as soon as there's something to do rather than on a fixed period.
+	while (Poller_Wait(pLoop->pPoller, timeout)) {
+		Atomic_Increment(&pLoop->passes);
+
+		//Only devices whose sockets had activity are read.
+		void* pUser;
+		while (Poller_Next(pLoop->pPoller, &pUser)) {
+			((DCS_Device*)pUser)->ready = true;
+		}
+
+		update_Members(pLoop);
+
+		//Timers fire before the passes, so a pass sees whatever they set and sends whatever they queued.
+		Timer_Wheel_Advance(&pLoop->wheel, Clock_Now_Ns());
+
+		//Only devices whose sockets had activity, whose timers fired or that were woken are given a pass, so a
+		//loop serving many devices doesn't run through all of them for each one that has something to do.
+		DCS_Device** ppDevice = &pLoop->pMembers;
+		while (*ppDevice != NULL) {
+			DCS_Device* pDevice = *ppDevice;
+
+			const bool due = Atomic_Exchange(&pDevice->pass_due, 0) != 0;
+			if (!due && !pDevice->ready) {
+				ppDevice = &pDevice->pNextMember;
+				continue;
+			}
+
+			if (!Device_Loop_Pass(pDevice)) {
+				*ppDevice = pDevice->pNextMember;
+				leave_Loop(pLoop, pDevice);
+				continue;
+			}
+			ppDevice = &pDevice->pNextMember;
+		}
+
+		//The loop only wakes by itself for the next deadline of any device.
+		timeout = Timer_Wheel_Timeout(&pLoop->wheel, Clock_Now_Ns());
+
+		//Nothing a pass loaded is used while waiting, which is what lets a replaced callback set be freed.
+		Atomic_Increment(&pLoop->passes);
+	}
+}
+
+static void update_Members(Event_Loop* pLoop) {
+	Mutex_Lock(pLoop->pMutex);
+	DCS_Device* pJoining = pLoop->pJoining;
+	pLoop->pJoining = NULL;
+	Mutex_Unlock(pLoop->pMutex);
+
+	//Devices are started without the lock, since a failure is reported through their callbacks.
+	while (pJoining != NULL) {
+		DCS_Device* pDevice = pJoining;
+		pJoining = pDevice->pNextMember;
+
+		if (!Device_Loop_Start(pDevice, pLoop->pPoller, &pLoop->wheel)) {
+			leave_Loop(pLoop, pDevice);
+			continue;
+		}
+
+		Mutex_Lock(pLoop->pMutex);
+		pDevice->loop_state = LOOP_ACTIVE;
+		Mutex_Unlock(pLoop->pMutex);
+
+		pDevice->pNextMember = pLoop->pMembers;
+		pLoop->pMembers = pDevice;
+	}
+
+	Mutex_Lock(pLoop->pMutex);
+	bool left = false;
+	DCS_Device** ppDevice = &pLoop->pMembers;
+	while (*ppDevice != NULL) {
+		DCS_Device* pDevice = *ppDevice;
+		if (!pDevice->detaching) {
+			ppDevice = &pDevice->pNextMember;
+			continue;
+		}
+
+		*ppDevice = pDevice->pNextMember;
+		Device_Loop_Stop(pDevice);
+		pDevice->loop_state = LOOP_DETACHED;
+		left = true;
+	}
+	if (left) {
+		Cond_Wake_All(pLoop->pCond);
+	}
+	Mutex_Unlock(pLoop->pMutex);
+}
+
+static void leave_Loop(Event_Loop* pLoop, DCS_Device* pDevice) {
+	Device_Loop_Stop(pDevice);
+
+	Mutex_Lock(pLoop->pMutex);
+	pDevice->loop_state = LOOP_DETACHED;
+	Cond_Wake_All(pLoop->pCond);
+	Mutex_Unlock(pLoop->pMutex);
+}
@@ -0,0 +1,52 @@
+#pragma once
+#include "Platform.h"
+#include "Internal.h"
+
+//Threads that serve the open devices. Each loop waits on the sockets of up to POLLER_MAX_SOCKETS devices
+//with one poller and, whenever one has activity, a frame is queued or a timer in the loop's wheel comes due,
+//runs a pass for each device concerned. Loops are started as devices are attached and stopped once none are left.
+
+/// <summary>
+/// Sets the number of event loops devices are spread over. Loops already running are kept, and more are
+/// started beyond this if every loop is serving POLLER_MAX_SOCKETS devices.
+/// </summary>
+/// <param name="loops">Number of loops, from 1 to DCS_MAX_EVENT_LOOPS.</param>
+/// <returns>Standard DCS status code.</returns>
+int Event_Loop_Set_Count(unsigned int loops);
+
+/// <summary>
+/// Assigns an opened device to the loop serving the fewest devices, starting a loop if fewer than
+/// the set number are running. The loop thread starts serving it on its next pass.
+/// </summary>
+/// <param name="pDevice">Device with a connected socket.</param>
+/// <returns>Standard DCS status code.</returns>
+int Event_Loop_Attach(DCS_Device* pDevice);
+
+/// <summary>
+/// Has the device's loop stop serving it and waits until the loop thread no longer uses it. The device's
+/// connection is closed. Must not be called by a loop thread.
+/// </summary>
+/// <param name="pDevice">Device to detach. Nothing happens if it isn't attached.</param>
+void Event_Loop_Detach(DCS_Device* pDevice);
+
+/// <summary>
+/// Makes the device's loop run a pass for it straight away. Safe to call from any thread.
+/// </summary>
+/// <param name="pDevice">Device with something to do.</param>
+void Event_Loop_Wake(DCS_Device* pDevice);
+
+/// <summary>
+/// Counts the runs of the device's loop. The count is odd while the loop thread is running passes and even while it
+/// waits, so a run seen with an odd count has finished once the count changes. Safe to call from any thread.
+/// </summary>
+/// <param name="pDevice">Device to check.</param>
+/// <returns>Count of the device's loop, or 0 if it isn't attached.</returns>
+unsigned __int32 Event_Loop_Passes(DCS_Device* pDevice);
+
+/// <summary>
+/// Whether the calling thread is the loop serving the device, which mustn't wait on other threads since
+/// every device on the loop would wait with it.
+/// </summary>
+/// <param name="pDevice">Device to check.</param>
+/// <returns>True if called by the device's loop thread.</returns>
+bool Event_Loop_Is_Current(DCS_Device* pDevice);
@@ -0,0 +1,89 @@
+#define _CRTDBG_MAP_ALLOC
+#include <stdlib.h>
+#include "Platform.h"
+#include <string.h>
+
+#include "Framer.h"
+
+void Framer_Init(Framer* pFramer) {
+	pFramer->pBuffer = NULL;
+	pFramer->capacity = 0;
+	pFramer->start = 0;
+	pFramer->end = 0;
+}
+
+void Framer_Free(Framer* pFramer) {
+	free(pFramer->pBuffer);
+	Framer_Init(pFramer);
+}
+
+char* Framer_Reserve(Framer* pFramer, unsigned __int32* pAvailable) {
+	unsigned __int32 pending = pFramer->end - pFramer->start;
+
+	//Everything received has been handed out, so start again at the front of the buffer.
+	if (pending == 0) {
+		pFramer->start = 0;
+		pFramer->end = 0;
+	}
+
+	//Once the size of the frame being received is known, make room for all of it in one go.
+	unsigned __int32 needed = FRAMER_MIN_READ;
+	if (pending >= sizeof(unsigned __int32)) {
+		unsigned __int32 frame_size;
+		memcpy(&frame_size, &pFramer->pBuffer[pFramer->start], sizeof(frame_size));
+
+		if (frame_size <= FRAMER_MAX_FRAME_SIZE && sizeof(frame_size) + frame_size > pending + needed) {
+			needed = sizeof(frame_size) + frame_size - pending;
+		}
+	}
+
+	if (pFramer->capacity - pFramer->end < needed) {
+		//Move the partial frame to the front of the buffer before growing it.
+		if (pFramer->start > 0) {
+			memmove(pFramer->pBuffer, &pFramer->pBuffer[pFramer->start], pending);
+			pFramer->start = 0;
+			pFramer->end = pending;
+		}
+
+		if (pFramer->capacity - pFramer->end < needed) {
+			const unsigned __int32 capacity = pending + needed;
+			char* tmp = realloc(pFramer->pBuffer, capacity);
+			if (tmp == NULL) {
+				return NULL;
+			}
+			pFramer->pBuffer = tmp;
+			pFramer->capacity = capacity;
+		}
+	}
+
+	*pAvailable = pFramer->capacity - pFramer->end;
+	return &pFramer->pBuffer[pFramer->end];
+}
+
+void Framer_Commit(Framer* pFramer, unsigned __int32 count) {
+	pFramer->end += count;
+}
+
+int Framer_Next(Framer* pFramer, char** ppFrame, unsigned __int32* pSize) {
+	const unsigned __int32 pending = pFramer->end - pFramer->start;
+
+	//The prepended frame size may itself still be incomplete.
+	unsigned __int32 frame_size;
+	if (pending < sizeof(frame_size)) {
+		return FRAMER_NEED_MORE;
+	}
+	memcpy(&frame_size, &pFramer->pBuffer[pFramer->start], sizeof(frame_size));
+
+	if (frame_size > FRAMER_MAX_FRAME_SIZE) {
+		return FRAMER_BAD_SIZE;
+	}
+	if (pending - sizeof(frame_size) < frame_size) {
+		return FRAMER_NEED_MORE;
+	}
+
+	*ppFrame = &pFramer->pBuffer[pFramer->start + sizeof(frame_size)];
+	*pSize = frame_size;
+	pFramer->start += sizeof(frame_size) + frame_size;
+
+	return FRAMER_FRAME;
+}
@@ -1,24 +1,33 @@
 #define _CRTDBG_MAP_ALLOC
 #include <stdlib.h>
-#include <crtdbg.h>
+#include "Platform.h"
 #include <stdio.h>
 #include <stdbool.h>
 #include <math.h>
+#include <limits.h>
+#include <stddef.h>
+#include <stdint.h>
 
 #include "Internal.h"
 #include "COM_Task.h"
+#include "Device.h"
+#include "Request.h"
 
-int Send_Get_DCS_Status(void) {
-	return Send_DCS_Command(GET_DCS_STATUS, NULL, 0);
+int Send_Get_DCS_Status(DCS_Device* pDevice, DCS_Request* pRequest) {
+	return Send_DCS_Command(pDevice, GET_DCS_STATUS, NULL, 0, pRequest);
 }
 
-int Receive_DCS_Status(char* pDataBuf) {
+int Receive_DCS_Status(DCS_Device* pDevice, char* pDataBuf, unsigned __int32 DataLen, Sequence_ID sequence) {
 	unsigned __int32 index = 0;
 
 	bool bCorr; // TRUE if correlator is started, FALSE if the correlator is not started.
 	bool bAnalyzer; // TRUE if analyzer is started, FALSE if the analyzer is not started.
 	unsigned __int32 DCS_Cha_Num; // number of total DCS channels on the remote DCS.
 
+	if (DataLen < sizeof(bCorr) + sizeof(bAnalyzer) + sizeof(DCS_Cha_Num)) {
+		return FRAME_INVALID_DATA;
+	}
+
 	memcpy(&bCorr, &pDataBuf[index], sizeof(bCorr));
 	index += sizeof(bCorr);
 
@@ -31,15 +40,19 @@ int Receive_DCS_Status(char* pDataBuf) {
 	//Change from network to host byte order
 	DCS_Cha_Num = itohl(DCS_Cha_Num);
 
+	Expect_Stream_Types(pDevice, bCorr, bAnalyzer);
+
 	//Call user-defined callback.
-	Get_DCS_Status_CB(bCorr, bAnalyzer, DCS_Cha_Num);
+	Get_DCS_Status_CB(pDevice, bCorr, bAnalyzer, DCS_Cha_Num, sequence);
 
 	return NO_DCS_ERROR;
 }
 
-int Send_Correlator_Setting(Correlator_Setting* pCorrelator_Setting) {
-	char* pDataBuf; //data buffer for the byte stream of the correlator setting data
-	const unsigned __int32 BufferSize = sizeof(*pCorrelator_Setting); //data size of the buffer pDataBuf
+//Correlation values in each channel's buffer for each step of Correlator_Setting.Scale.
+#define CORRELATION_VALUES_PER_SCALE 8
+
+int Send_Correlator_Setting(DCS_Device* pDevice, Correlator_Setting* pCorrelator_Setting, DCS_Request* pRequest) {
+	const unsigned __int32 BufferSize = sizeof(*pCorrelator_Setting); //data size of the frame's data
 
 	//Set the Data_N to either 16384 or 32768.
 	if (pCorrelator_Setting->Data_N > 16384) {
@@ -57,32 +70,33 @@ int Send_Correlator_Setting(Correlator_Setting* pCorrelator_Setting) {
 		pCorrelator_Setting->Scale = 1;
 	}
 
-	pDataBuf = malloc(BufferSize);
-	if (pDataBuf == NULL) {
-		return MEMORY_ALLOCATION_ALIGNMENT;
+	Frame_Builder builder;
+	int result = Frame_Begin(&builder, pDevice, SET_CORRELATOR_SETTING, BufferSize, pRequest);
+	if (result != NO_DCS_ERROR) {
+		return result;
 	}
 
-	//Copy each struct member into data buffer and change them to the output order
-	unsigned __int32 Data_N = htool(pCorrelator_Setting->Data_N);
-	memcpy(&pDataBuf[0], &Data_N, sizeof(Data_N));
-
-	unsigned __int32 Scale = htool(pCorrelator_Setting->Scale);
-	memcpy(&pDataBuf[4], &Scale, sizeof(Scale));
-
-	unsigned __int32 SampleSize = htool((int)ceil(pCorrelator_Setting->Corr_Time / pCorrelator_Setting->Data_N / 200e-9));
-	memcpy(&pDataBuf[8], &SampleSize, sizeof(SampleSize));
-
-	int result = Send_DCS_Command(SET_CORRELATOR_SETTING, pDataBuf, BufferSize);
-	free(pDataBuf);
+	//Write each struct member into the frame in the output order
+	Frame_Put_Long(&builder, pCorrelator_Setting->Data_N);
+	Frame_Put_Long(&builder, pCorrelator_Setting->Scale);
+	Frame_Put_Long(&builder, (int)ceil(pCorrelator_Setting->Corr_Time / pCorrelator_Setting->Data_N / 200e-9));
 
+	result = Frame_End(&builder);
+	if (result == NO_DCS_ERROR) {
+		Expect_Correlation_Length(pDevice, CORRELATION_VALUES_PER_SCALE * pCorrelator_Setting->Scale);
+	}
 	return result;
 }
 
-int Send_Get_Correlator_Setting(void) {
-	return Send_DCS_Command(GET_CORRELATOR_SETTING, NULL, 0);
+int Send_Get_Correlator_Setting(DCS_Device* pDevice, DCS_Request* pRequest) {
+	return Send_DCS_Command(pDevice, GET_CORRELATOR_SETTING, NULL, 0, pRequest);
 }
 
-int Receive_Correlator_Setting(char* pDataBuf) {
+int Receive_Correlator_Setting(DCS_Device* pDevice, char* pDataBuf, unsigned __int32 DataLen, Sequence_ID sequence) {
+	if (DataLen < 3 * sizeof(unsigned __int32)) {
+		return FRAME_INVALID_DATA;
+	}
+
 	Correlator_Setting* pCorrelator_Setting = malloc(sizeof(Correlator_Setting));
 	if (pCorrelator_Setting == NULL) {
 		return MEMORY_ALLOCATION_ERROR;
@@ -111,12 +125,17 @@ int Receive_Correlator_Setting(char* pDataBuf) {
 	//Reverse Corr_Time calculation.
 	float Corr_Time = (float)2e-7 * Sample_Size * Data_N;
 
+	//A scale outside what Send_Correlator_Setting allows says nothing about the frames to come.
+	if (Scale >= 1 && Scale <= 10) {
+		Expect_Correlation_Length(pDevice, CORRELATION_VALUES_PER_SCALE * Scale);
+	}
+
 	//Copy data to the struct and call user-defined callback.
 	memcpy(&pCorrelator_Setting->Data_N, &Data_N, sizeof(Data_N));
 	memcpy(&pCorrelator_Setting->Scale, &Scale, sizeof(Scale));
 	memcpy(&pCorrelator_Setting->Corr_Time, &Corr_Time, sizeof(Corr_Time));
 
-	Get_Correlator_Setting_CB(pCorrelator_Setting);
+	Get_Correlator_Setting_CB(pDevice, pCorrelator_Setting, sequence);
 
 	//Cleanup dynamically allocated resources.
 	free(pCorrelator_Setting);
@@ -124,72 +143,58 @@ int Receive_Correlator_Setting(char* pDataBuf) {
 	return NO_DCS_ERROR;
 }
 
-int Send_Analyzer_Setting(Analyzer_Setting* pAnalyzer_Setting, unsigned __int32 Cha_Num) {
-	char* pDataBuf; //Data buffer for the byte stream of the analyzer setting data.
-	unsigned __int32 index = 0;//Keeps track of the current pDataBuf index
+int Send_Analyzer_Setting(DCS_Device* pDevice, Analyzer_Setting* pAnalyzer_Setting, unsigned __int32 Cha_Num, DCS_Request* pRequest) {
+	if (Cha_Num > (UINT_MAX - sizeof(Cha_Num)) / sizeof(*pAnalyzer_Setting)) {
+		return FRAME_INVALID_DATA;
+	}
 	const unsigned __int32 BufferSize = sizeof(Cha_Num) + Cha_Num * sizeof(*pAnalyzer_Setting);
 
-	pDataBuf = malloc(BufferSize);
-	if (pDataBuf == NULL) {
-		return MEMORY_ALLOCATION_ERROR;
+	Frame_Builder builder;
+	int result = Frame_Begin(&builder, pDevice, SET_ANALYZER_SETTING, BufferSize, pRequest);
+	if (result != NO_DCS_ERROR) {
+		return result;
 	}
 
-#pragma warning (disable: 6386 6385)
-	unsigned __int32 network_Cha_Num = htool(Cha_Num);//[Cha_Num] in the output byte order.
-
-	//Copy to the output buffer.
-	memcpy(&pDataBuf[index], &network_Cha_Num, sizeof(network_Cha_Num));
-	index += sizeof(network_Cha_Num);
-
-	//Change analyzer settings to network byte order
-
-	//Allocate memory for the output byte order struct.
-	Analyzer_Setting* network_Analyzer = malloc(Cha_Num * sizeof(Analyzer_Setting));
-	if (network_Analyzer == NULL) {
-		free(pDataBuf);
-		return MEMORY_ALLOCATION_ERROR;
-	}
+	Frame_Put_Long(&builder, Cha_Num);
 
-	//Loop over each channel and change each parameter to network byte order.
+	//Write each channel's settings in struct order and in the output byte order.
 	for (unsigned __int32 x = 0; x < Cha_Num; x++) {
-		network_Analyzer[x].Alpha = htoof(pAnalyzer_Setting[x].Alpha);
-		network_Analyzer[x].Beta = htoof(pAnalyzer_Setting[x].Beta);
-		network_Analyzer[x].Db = htoof(pAnalyzer_Setting[x].Db);
-		network_Analyzer[x].Distance = htoof(pAnalyzer_Setting[x].Distance);
-		network_Analyzer[x].mua0 = htoof(pAnalyzer_Setting[x].mua0);
-		network_Analyzer[x].musp = htoof(pAnalyzer_Setting[x].musp);
-		network_Analyzer[x].Wavelength = htoof(pAnalyzer_Setting[x].Wavelength);
+		Frame_Put_Float(&builder, pAnalyzer_Setting[x].Alpha);
+		Frame_Put_Float(&builder, pAnalyzer_Setting[x].Distance);
+		Frame_Put_Float(&builder, pAnalyzer_Setting[x].Wavelength);
+		Frame_Put_Float(&builder, pAnalyzer_Setting[x].mua0);
+		Frame_Put_Float(&builder, pAnalyzer_Setting[x].musp);
+		Frame_Put_Float(&builder, pAnalyzer_Setting[x].Db);
+		Frame_Put_Float(&builder, pAnalyzer_Setting[x].Beta);
 	}
 
-	//Copy array into the output buffer.
-	memcpy(&pDataBuf[index], network_Analyzer, Cha_Num * sizeof(*network_Analyzer));
-	index += Cha_Num * sizeof(*network_Analyzer);
-
-	free(network_Analyzer);
-#pragma warning (default: 6386 6385)
-
-	int result = Send_DCS_Command(SET_ANALYZER_SETTING, pDataBuf, BufferSize);
-	free(pDataBuf);
-
-	return result;
+	return Frame_End(&builder);
 }
 
-int Send_Get_Analyzer_Setting(void) {
-	return Send_DCS_Command(GET_ANALYZER_SETTING, NULL, 0);
+int Send_Get_Analyzer_Setting(DCS_Device* pDevice, DCS_Request* pRequest) {
+	return Send_DCS_Command(pDevice, GET_ANALYZER_SETTING, NULL, 0, pRequest);
 }
 
-int Receive_Analyzer_Setting(char* pDataBuf) {
+int Receive_Analyzer_Setting(DCS_Device* pDevice, char* pDataBuf, unsigned __int32 DataLen, Sequence_ID sequence) {
 	unsigned __int32 index = 0;//Keeps track of the current pDataBuf index.
 
 	Analyzer_Setting* pAnalyzer_Setting;
 	unsigned __int32 Cha_Num;
 
+	if (DataLen < sizeof(Cha_Num)) {
+		return FRAME_INVALID_DATA;
+	}
+
 	memcpy(&Cha_Num, &pDataBuf[index], sizeof(Cha_Num));
 	index += sizeof(Cha_Num);
 
 	//Change to host byte order.
 	Cha_Num = itohl(Cha_Num);
 
+	if (Cha_Num > (DataLen - index) / sizeof(*pAnalyzer_Setting)) {
+		return FRAME_INVALID_DATA;
+	}
+
 	//Allocate memory for the received analyzer settings.
 	pAnalyzer_Setting = malloc(Cha_Num * sizeof(*pAnalyzer_Setting));
 	if (pAnalyzer_Setting == NULL) {
@@ -212,95 +217,78 @@ int Receive_Analyzer_Setting(char* pDataBuf) {
 	}
 #pragma warning (default: 6386 6385)
 
-	Get_Analyzer_Setting_CB(pAnalyzer_Setting, Cha_Num);
+	Get_Analyzer_Setting_CB(pDevice, pAnalyzer_Setting, Cha_Num, sequence);
 	free(pAnalyzer_Setting);
 
 	return NO_DCS_ERROR;
 }
 
-int Send_Start_Measurement(__int32 Interval, unsigned __int32* pCha_IDs, unsigned __int32 Cha_Num) {
-	char* pDataBuf;//Output buffer.
-	unsigned __int32 index = 0;//Keeps track of the current pDataBuf index.
+int Send_Start_Measurement(DCS_Device* pDevice, __int32 Interval, unsigned __int32* pCha_IDs, unsigned __int32 Cha_Num, DCS_Request* pRequest) {
+	if (Cha_Num > (UINT_MAX - sizeof(Interval) - sizeof(Cha_Num)) / sizeof(*pCha_IDs)) {
+		return FRAME_INVALID_DATA;
+	}
 	const unsigned __int32 BufferSize = sizeof(Interval) + sizeof(Cha_Num) + Cha_Num * sizeof(*pCha_IDs);
 
-	//Allocate output buffer.
-	pDataBuf = malloc(BufferSize);
-	if (pDataBuf == NULL) {
-		return MEMORY_ALLOCATION_ERROR;
+	Frame_Builder builder;
+	int result = Frame_Begin(&builder, pDevice, START_MEASUREMENT, BufferSize, pRequest);
+	if (result != NO_DCS_ERROR) {
+		return result;
 	}
 
-#pragma warning (disable: 6386)
-	int network_Interval = htool(Interval);
-	memcpy(&pDataBuf[index], &network_Interval, sizeof(network_Interval));
-	index += sizeof(network_Interval);
-
-	int network_Cha_Num = htool(Cha_Num);
-	memcpy(&pDataBuf[index], &network_Cha_Num, sizeof(network_Cha_Num));
-	index += sizeof(network_Cha_Num);
-
-	//Allocate output byte order channel IDs array.
-	int* network_Cha_IDs = malloc(Cha_Num * sizeof(*network_Cha_IDs));
-	if (network_Cha_IDs == NULL) {
-		free(pDataBuf);
-		return MEMORY_ALLOCATION_ERROR;
-	}
+	Frame_Put_Long(&builder, Interval);
+	Frame_Put_Long(&builder, Cha_Num);
 
-	//Copy inputted array to [network_Cha_IDs] and change to output byte order in loop.
-	memcpy(network_Cha_IDs, pCha_IDs, Cha_Num * sizeof(*network_Cha_IDs));
+	//Write the channel IDs in the output byte order.
 	for (unsigned __int32 x = 0; x < Cha_Num; x++) {
-		network_Cha_IDs[x] = htool(network_Cha_IDs[x]);
+		Frame_Put_Long(&builder, pCha_IDs[x]);
 	}
 
-	//Copy output byte order array to final output buffer.
-	memcpy(&pDataBuf[index], network_Cha_IDs, Cha_Num * sizeof(*pCha_IDs));
-	index += Cha_Num * sizeof(*pCha_IDs);
-#pragma warning (default: 6386)
-	free(network_Cha_IDs);
-
-	int result = Send_DCS_Command(START_MEASUREMENT, pDataBuf, BufferSize);
-
-	free(pDataBuf);
-
+	//Every size the measurement's frames need is known now, so a streaming store and the dispatch threads get their
+	//memory before they arrive.
+	result = Frame_End(&builder);
+	if (result == NO_DCS_ERROR) {
+		Reserve_Store_Slots(pDevice, Cha_Num);
+		Reserve_Dispatch_Jobs(pDevice, Cha_Num);
+	}
 	return result;
 }
 
-int Send_Stop_Measurement(void) {
-	return Send_DCS_Command(STOP_MEASUREMENT, NULL, 0);
+int Send_Stop_Measurement(DCS_Device* pDevice, DCS_Request* pRequest) {
+	return Send_DCS_Command(pDevice, STOP_MEASUREMENT, NULL, 0, pRequest);
 }
 
-int Send_Enable_DCS(bool bCorr, bool bAnalyzer) {
+int Send_Enable_DCS(DCS_Device* pDevice, bool bCorr, bool bAnalyzer, DCS_Request* pRequest) {
 	const unsigned __int32 BufferSize = sizeof(bCorr) + sizeof(bAnalyzer);
 
-	unsigned __int32 index = 0;//Keeps track of the current pDataBuf index.
-
-	//Allocate final output buffer.
-	char* pDataBuf = malloc(BufferSize);
-	if (pDataBuf == NULL) {
-		return MEMORY_ALLOCATION_ERROR;
+	Frame_Builder builder;
+	int result = Frame_Begin(&builder, pDevice, ENABLE_CORR_ANALYZER, BufferSize, pRequest);
+	if (result != NO_DCS_ERROR) {
+		return result;
 	}
 
-	memcpy(&pDataBuf[index], &bAnalyzer, sizeof(bAnalyzer));
-	index += sizeof(bAnalyzer);
-
-	memcpy(&pDataBuf[index], &bCorr, sizeof(bCorr));
-	index += sizeof(bCorr);
-
-	int result = Send_DCS_Command(ENABLE_CORR_ANALYZER, pDataBuf, BufferSize);
-
-	free(pDataBuf);
+	Frame_Put_Bool(&builder, bAnalyzer);
+	Frame_Put_Bool(&builder, bCorr);
 
+	result = Frame_End(&builder);
+	if (result == NO_DCS_ERROR) {
+		Expect_Stream_Types(pDevice, bCorr, bAnalyzer);
+	}
 	return result;
 }
 
-int Send_Get_Simulated_Correlation(void) {
-	return Send_DCS_Command(GET_SIMULATED_DATA, NULL, 0);
+int Send_Get_Simulated_Correlation(DCS_Device* pDevice, DCS_Request* pRequest) {
+	return Send_DCS_Command(pDevice, GET_SIMULATED_DATA, NULL, 0, pRequest);
 }
 
-int Receive_Simulated_Correlation(char* pDataBuf) {
+int Receive_Simulated_Correlation(DCS_Device* pDevice, char* pDataBuf, unsigned __int32 DataLen, Sequence_ID sequence) {
 	unsigned __int32 index = 0;//Keeps track of the current pDataBuf index.
 
 	Simulated_Correlation Simulated_Corr = { 0 };
 
+	if (DataLen < sizeof(Simulated_Corr.Precut) + sizeof(Simulated_Corr.Cha_ID) + sizeof(Simulated_Corr.Data_Num)) {
+		return FRAME_INVALID_DATA;
+	}
+
 	memcpy(&Simulated_Corr.Precut, &pDataBuf[index], sizeof(Simulated_Corr.Precut));
 	index += sizeof(Simulated_Corr.Precut);
 
@@ -315,110 +303,88 @@ int Receive_Simulated_Correlation(char* pDataBuf) {
 	Simulated_Corr.Cha_ID = itohl(Simulated_Corr.Cha_ID);
 	Simulated_Corr.Data_Num = itohl(Simulated_Corr.Data_Num);
 
+	if (Simulated_Corr.Data_Num < 0 || (unsigned __int32)Simulated_Corr.Data_Num > (DataLen - index) / sizeof(*Simulated_Corr.pCorrBuf)) {
+		return FRAME_INVALID_DATA;
+	}
+
 	//Allocate array for correlation values.
 	Simulated_Corr.pCorrBuf = malloc(Simulated_Corr.Data_Num * sizeof(*Simulated_Corr.pCorrBuf));
 	if (Simulated_Corr.pCorrBuf == NULL) {
 		return MEMORY_ALLOCATION_ERROR;
 	}
 
-	memcpy(Simulated_Corr.pCorrBuf, &pDataBuf[index], Simulated_Corr.Data_Num * sizeof(*Simulated_Corr.pCorrBuf));
+	//Copy the correlation values and change them from network to host endianess
+	itohf_array(Simulated_Corr.pCorrBuf, &pDataBuf[index], Simulated_Corr.Data_Num);
 	index += Simulated_Corr.Data_Num * sizeof(*Simulated_Corr.pCorrBuf);
 
-	//Change each float from network to host endianess
-	for (int x = 0; x < Simulated_Corr.Data_Num; x++) {
-#pragma warning (disable: 6386)
-		Simulated_Corr.pCorrBuf[x] = itohf(Simulated_Corr.pCorrBuf[x]);
-#pragma warning (default: 6386)
-	}
-
-	Get_Simulated_Correlation_CB(&Simulated_Corr);
+	Get_Simulated_Correlation_CB(pDevice, &Simulated_Corr, sequence);
 
 	free(Simulated_Corr.pCorrBuf);
 
 	return NO_DCS_ERROR;
 }
 
-int Send_Optical_Param(Optical_Param_Type* pOpt_Param, int Cha_Num) {
-	char* pDataBuf;
-	unsigned __int32 index = 0;//Keeps track of the current pDataBuf index.
+int Send_Optical_Param(DCS_Device* pDevice, Optical_Param_Type* pOpt_Param, int Cha_Num, DCS_Request* pRequest) {
+	if (Cha_Num < 0 || (unsigned __int32)Cha_Num > (UINT_MAX - sizeof(Cha_Num)) / sizeof(*pOpt_Param)) {
+		return FRAME_INVALID_DATA;
+	}
 	const unsigned __int32 BufferSize = sizeof(Cha_Num) + Cha_Num * sizeof(*pOpt_Param);
 
-	pDataBuf = malloc(BufferSize);
-	if (pDataBuf == NULL) {
-		return MEMORY_ALLOCATION_ERROR;
+	Frame_Builder builder;
+	int result = Frame_Begin(&builder, pDevice, SET_OPTICAL_PARAM, BufferSize, pRequest);
+	if (result != NO_DCS_ERROR) {
+		return result;
 	}
 
-#pragma warning (disable: 6385 6386)
-	unsigned __int32 network_Cha_Num = htool(Cha_Num);
-	memcpy(&pDataBuf[index], &network_Cha_Num, sizeof(network_Cha_Num));
-	index += sizeof(network_Cha_Num);
+	Frame_Put_Long(&builder, Cha_Num);
 
-	//Allocate output array of optical parameters.
-	Optical_Param_Type* pOpt_Param_Out = malloc(Cha_Num * sizeof(*pOpt_Param_Out));
-	if (pOpt_Param_Out == NULL) {
-		return MEMORY_ALLOCATION_ERROR;
-	}
-
-	//Set array of params to output endianess.
+	//Write array of params in the output endianess.
 	for (int x = 0; x < Cha_Num; x++) {
-		pOpt_Param_Out[x].Cha_ID = htool(pOpt_Param[x].Cha_ID);
-
-		pOpt_Param_Out[x].mua0 = htoof(pOpt_Param[x].mua0);
-		pOpt_Param_Out[x].musp = htoof(pOpt_Param[x].musp);
+		Frame_Put_Long(&builder, pOpt_Param[x].Cha_ID);
+		Frame_Put_Float(&builder, pOpt_Param[x].mua0);
+		Frame_Put_Float(&builder, pOpt_Param[x].musp);
 	}
-	memcpy(&pDataBuf[index], pOpt_Param_Out, Cha_Num * sizeof(*pOpt_Param_Out));
-	index += Cha_Num * sizeof(*pOpt_Param_Out);
-	free(pOpt_Param_Out);
-#pragma warning (default: 6385 6386)
 
-	int result = Send_DCS_Command(SET_OPTICAL_PARAM, pDataBuf, BufferSize);
-
-	free(pDataBuf);
-
-	return result;
+	return Frame_End(&builder);
 }
 
-int Send_Analyzer_Prefit_Param(Analyzer_Prefit_Param* pAnalyzer_Prefit_Param) {
-	char* pDataBuf;
+int Send_Analyzer_Prefit_Param(DCS_Device* pDevice, Analyzer_Prefit_Param* pAnalyzer_Prefit_Param, DCS_Request* pRequest) {
+	//The DCS expects the struct as laid out in memory, including its trailing padding.
 	const unsigned __int32 BufferSize = sizeof(*pAnalyzer_Prefit_Param);
+	const unsigned __int32 PaddingSize = sizeof(*pAnalyzer_Prefit_Param) - offsetof(Analyzer_Prefit_Param, Model) - sizeof(pAnalyzer_Prefit_Param->Model);
+	static const char padding[sizeof(Analyzer_Prefit_Param)] = { 0 };
 
-	//Allocate memory for output buffer.
-	pDataBuf = malloc(BufferSize);
-	if (pDataBuf == NULL) {
-		return MEMORY_ALLOCATION_ERROR;
+	Frame_Builder builder;
+	int result = Frame_Begin(&builder, pDevice, SET_ANALYZER_PREFIT_PARAM, BufferSize, pRequest);
+	if (result != NO_DCS_ERROR) {
+		return result;
 	}
 
-#pragma warning (disable: 6386 6385)
-	//Change params to network byte order
-	Analyzer_Prefit_Param network_Analyzer = { 0 };
-
-	network_Analyzer.Precut = htool(pAnalyzer_Prefit_Param->Precut);
-	network_Analyzer.PostCut = htool(pAnalyzer_Prefit_Param->PostCut);
-
-	network_Analyzer.Min_Intensity = htoof(pAnalyzer_Prefit_Param->Min_Intensity);
-	network_Analyzer.Max_Intensity = htoof(pAnalyzer_Prefit_Param->Max_Intensity);
-	network_Analyzer.FitLimt = htoof(pAnalyzer_Prefit_Param->FitLimt);
-	network_Analyzer.earlyLeakage = htoof(pAnalyzer_Prefit_Param->earlyLeakage);
-	network_Analyzer.lightLeakage = htoof(pAnalyzer_Prefit_Param->lightLeakage);
-	network_Analyzer.Model = pAnalyzer_Prefit_Param->Model;
-
-	//Copy to final output buffer.
-	memcpy(pDataBuf, &network_Analyzer, sizeof(network_Analyzer));
-#pragma warning (default: 6386 6385)
-
-	int result = Send_DCS_Command(SET_ANALYZER_PREFIT_PARAM, pDataBuf, BufferSize);
-	free(pDataBuf);
-
-	return result;
+	//Write params in struct order and in the output byte order.
+	Frame_Put_Long(&builder, pAnalyzer_Prefit_Param->Precut);
+	Frame_Put_Long(&builder, pAnalyzer_Prefit_Param->PostCut);
+	Frame_Put_Float(&builder, pAnalyzer_Prefit_Param->Min_Intensity);
+	Frame_Put_Float(&builder, pAnalyzer_Prefit_Param->Max_Intensity);
+	Frame_Put_Float(&builder, pAnalyzer_Prefit_Param->FitLimt);
+	Frame_Put_Float(&builder, pAnalyzer_Prefit_Param->lightLeakage);
+	Frame_Put_Float(&builder, pAnalyzer_Prefit_Param->earlyLeakage);
+	Frame_Put_Bool(&builder, pAnalyzer_Prefit_Param->Model);
+	Frame_Put(&builder, padding, PaddingSize);
+
+	return Frame_End(&builder);
 }
 
-int Send_Get_Analyzer_Prefit_Param(void) {
-	return Send_DCS_Command(GET_ANALYZER_PREFIT_PARAM, NULL, 0);
+int Send_Get_Analyzer_Prefit_Param(DCS_Device* pDevice, DCS_Request* pRequest) {
+	return Send_DCS_Command(pDevice, GET_ANALYZER_PREFIT_PARAM, NULL, 0, pRequest);
 }
 
-int Receive_Analyzer_Prefit_Param(char* pDataBuf) {
+int Receive_Analyzer_Prefit_Param(DCS_Device* pDevice, char* pDataBuf, unsigned __int32 DataLen, Sequence_ID sequence) {
 	Analyzer_Prefit_Param pAnalyzer_Prefit_Param;
 
+	if (DataLen < sizeof(pAnalyzer_Prefit_Param)) {
+		return FRAME_INVALID_DATA;
+	}
+
 #pragma warning (disable: 6386 6385)
 	//Copy received data to struct.
 	memcpy(&pAnalyzer_Prefit_Param, pDataBuf, sizeof(pAnalyzer_Prefit_Param));
@@ -433,402 +399,631 @@ int Receive_Analyzer_Prefit_Param(char* pDataBuf) {
 	pAnalyzer_Prefit_Param.lightLeakage = itohf(pAnalyzer_Prefit_Param.lightLeakage);
 #pragma warning (default: 6386 6385)
 
-	Get_Analyzer_Prefit_Param_CB(&pAnalyzer_Prefit_Param);
+	Get_Analyzer_Prefit_Param_CB(pDevice, &pAnalyzer_Prefit_Param, sequence);
 
 	return NO_DCS_ERROR;
 }
 
-int Receive_Error_Message(char* pDataBuf) {
+int Receive_Error_Message(DCS_Device* pDevice, char* pDataBuf, unsigned __int32 DataLen) {
 	//Read 4 byte prepended string size.
 	unsigned __int32 strSize;
+	if (DataLen < sizeof(strSize)) {
+		return FRAME_INVALID_DATA;
+	}
 	memcpy(&strSize, pDataBuf, sizeof(strSize));
 	strSize = itohl(strSize);
 
-	//Allocate memory for string.
-	char* pMessage = malloc(strSize);
-	if (pMessage == NULL) {
-		return MEMORY_ALLOCATION_ERROR;
+	if (strSize > DataLen - sizeof(strSize)) {
+		return FRAME_INVALID_DATA;
 	}
 
-	memcpy(pMessage, &pDataBuf[sizeof(strSize)], strSize);
-
+	//The message is handed to the callback straight out of the receive buffer.
 	printf(ANSI_COLOR_BLUE);
-	Get_Error_Message_CB(pMessage, strSize);
+	Get_Error_Message_CB(pDevice, &pDataBuf[sizeof(strSize)], strSize);
 	printf(ANSI_COLOR_RESET);
 
-	free(pMessage);
 	return NO_DCS_ERROR;
 }
 
-int Receive_Error_Code(char* pDataBuf) {
+int Receive_Error_Code(DCS_Device* pDevice, char* pDataBuf, unsigned __int32 DataLen) {
 	unsigned __int32 errorType;
+	if (DataLen < sizeof(errorType)) {
+		return FRAME_INVALID_DATA;
+	}
 	memcpy(&errorType, pDataBuf, sizeof(errorType));
 	errorType = itohl(errorType);
 
 	printf(ANSI_COLOR_RED);
 	printf("Remote DCS Error!\n");
-	Get_Error_Code_CB(errorType);
+	Get_Error_Code_CB(pDevice, errorType);
 	printf(ANSI_COLOR_RESET);
 
 	return NO_DCS_ERROR;
 }
 
-int Receive_Command_ACK(char* pDataBuf) {
+int Receive_Command_ACK(DCS_Device* pDevice, char* pDataBuf, unsigned __int32 DataLen, Sequence_ID sequence) {
 	Data_ID commandId;
+	if (DataLen < sizeof(commandId)) {
+		return FRAME_INVALID_DATA;
+	}
 	memcpy(&commandId, pDataBuf, sizeof(commandId));
+	commandId = itohl(commandId);
 	//printf(ANSI_COLOR_GREEN"Command Ack: 0x%02x\n"ANSI_COLOR_RESET, commandId);
 
-	int ret = Check_Command_Response(validate, commandId);
-	if (ret != 0) {
-		//Return a standard error instead.
-		ret = NETWORK_ERROR;
-	}
+	return Complete_Command(pDevice, commandId, sequence);
+}
 
-	return ret;
+//Returns the device's decode buffer [*ppBuffer] with room for at least [size] bytes. It's only reallocated when a
+//frame needs more than any before it, so steady-state decoding doesn't allocate. Returns NULL if it can't grow.
+static void* reserve_Decode_Buffer(void** ppBuffer, size_t* pSize, size_t size) {
+	if (size > *pSize) {
+		void* tmp = realloc(*ppBuffer, size);
+		if (tmp == NULL) {
+			return NULL;
+		}
+		*ppBuffer = tmp;
+		*pSize = size;
+	}
+	return *ppBuffer;
 }
 
-int Receive_BFI_Data(char* pDataBuf) {
+//Size of a BFI record in the frame: Cha_ID, BFI, Beta and rMSE.
+#define BFI_RECORD_SIZE (4 * sizeof(__int32))
+
+int Receive_BFI_Data(DCS_Device* pDevice, char* pDataBuf, unsigned __int32 DataLen, unsigned __int64 timestamp) {
 	//Number of channels to expect in following data.
 	unsigned __int32 numChannels;
+	if (DataLen < sizeof(numChannels)) {
+		return FRAME_INVALID_DATA;
+	}
 	memcpy(&numChannels, &pDataBuf[0], sizeof(numChannels));
 	numChannels = itohl(numChannels);
 
-	//Pointer to the memory storing the BFI data structure array.
-	BFI_Data* pBFI_Data = malloc(numChannels * sizeof(*pBFI_Data));
-	if (pBFI_Data == NULL) {
+	if (numChannels > (DataLen - sizeof(numChannels)) / BFI_RECORD_SIZE) {
+		return FRAME_INVALID_DATA;
+	}
+
+	//Pointer to the memory storing the BFI data structure array. Frames the store keeps are decoded straight into its slot.
+	Received_Data_Item* pFrame = Take_Frame_Buffer(pDevice, BFI_Data_Type, numChannels * sizeof(BFI_Data));
+	BFI_Data* pBFI_Data = pFrame != NULL ? Frame_Buffer_Data(pFrame) : reserve_Decode_Buffer(&pDevice->pBFI_Records, &pDevice->BFI_Records_Size, numChannels * sizeof(*pBFI_Data));
+	if (pBFI_Data == NULL && numChannels != 0) {
 		return MEMORY_ALLOCATION_ERROR;
 	}
 
+	//BFI_Data starts with its four 32 bit fields laid out as they are in the frame, so each record's fields
+	//are copied and changed to host byte order in one call before the receive time is added.
 	for (unsigned __int32 x = 0; x < numChannels; x++) {
-		//Find index of BFI data in the raw buffer.
-		unsigned __int32 rawDataOffset = sizeof(numChannels) + x * sizeof(*pBFI_Data);
-
-		//For each struct member, copy from the input buffer and change to host byte order.
-		BFI_Data* currentBFI = &pBFI_Data[x];
-		memcpy(&currentBFI->Cha_ID, &pDataBuf[rawDataOffset], sizeof(currentBFI->Cha_ID));
-		currentBFI->Cha_ID = itohl(currentBFI->Cha_ID);
-		rawDataOffset += sizeof(currentBFI->Cha_ID);
-
-		memcpy(&currentBFI->BFI, &pDataBuf[rawDataOffset], sizeof(currentBFI->BFI));
-		currentBFI->BFI = itohf(currentBFI->BFI);
-		rawDataOffset += sizeof(currentBFI->BFI);
-
-		memcpy(&currentBFI->Beta, &pDataBuf[rawDataOffset], sizeof(currentBFI->Beta));
-		currentBFI->Beta = itohf(currentBFI->Beta);
-		rawDataOffset += sizeof(currentBFI->Beta);
-
-		memcpy(&currentBFI->rMSE, &pDataBuf[rawDataOffset], sizeof(currentBFI->rMSE));
-		currentBFI->rMSE = itohf(currentBFI->rMSE);
-		rawDataOffset += sizeof(currentBFI->rMSE);
+		itoh32_array(&pBFI_Data[x], &pDataBuf[sizeof(numChannels) + x * BFI_RECORD_SIZE], BFI_RECORD_SIZE / sizeof(__int32));
+		pBFI_Data[x].timestamp_ns = timestamp;
 	}
 
 	//Call user-defined callback
-	Get_BFI_Data(pBFI_Data, numChannels);
-	free(pBFI_Data);
+	Get_BFI_Data(pDevice, pBFI_Data, numChannels, pFrame);
+	Release_Frame_Buffer(pDevice, pFrame);
 
 	return NO_DCS_ERROR;
 }
 
-int Receive_BFI_Corr_Ready(char* pDataBuf) {
-	Get_BFI_Corr_Ready_CB(true);
+int Receive_BFI_Corr_Ready(DCS_Device* pDevice, char* pDataBuf, unsigned __int32 DataLen) {
+	Get_BFI_Corr_Ready_CB(pDevice, true);
 	return NO_DCS_ERROR;
 }
 
-int Receive_Corr_Intensity_Data(char* pDataBuf) {
+//Size of the fixed part of a channel record: Cha_ID, intensity and Data_Num.
+#define CORR_CHANNEL_HEADER_SIZE (sizeof(__int32) + sizeof(float) + sizeof(__int32))
+
+int Receive_Corr_Intensity_Data(DCS_Device* pDevice, char* pDataBuf, unsigned __int32 DataLen, unsigned __int64 timestamp) {
 	//Keeps track of current index while reading pDataBuf.
 	unsigned __int32 index = 0;
 
 	//Number of channels to expect in following data.
 	unsigned __int32 numChannels;
+	if (DataLen < sizeof(numChannels)) {
+		return FRAME_INVALID_DATA;
+	}
 	memcpy(&numChannels, &pDataBuf[index], sizeof(numChannels));
 	numChannels = itohl(numChannels);
 	index += sizeof(numChannels);
 
-	//Allocating memory for numChannels channels of data.
-	Corr_Intensity_Data* pCorr_Intensity_Data = malloc(sizeof(*pCorr_Intensity_Data) * numChannels);
-	if (pCorr_Intensity_Data == NULL) {
-		return MEMORY_ALLOCATION_ERROR;
+	if (numChannels > (DataLen - index) / CORR_CHANNEL_HEADER_SIZE) {
+		return FRAME_INVALID_DATA;
+	}
+
+	//Only grow the offset table when a frame has more channels than any frame before it.
+	if (numChannels > pDevice->Channel_Offsets_Capacity) {
+		unsigned __int32* tmp = realloc(pDevice->pChannel_Offsets, numChannels * sizeof(*pDevice->pChannel_Offsets));
+		if (tmp == NULL) {
+			return MEMORY_ALLOCATION_ERROR;
+		}
+		pDevice->pChannel_Offsets = tmp;
+		pDevice->Channel_Offsets_Capacity = numChannels;
 	}
 
 #pragma warning (disable: 6386 6385 6001)
-	//Read correlation data for each channel.
+	//Walk the channel records once to find where each of them starts. Nothing is copied here.
+	size_t totalCorrNum = 0;
+	unsigned __int32 maxCorrNum = 0;
 	for (unsigned __int32 x = 0; x < numChannels; x++) {
-		//Read the Cha_ID.
-		memcpy(&pCorr_Intensity_Data[x].Cha_ID, &pDataBuf[index], sizeof(pCorr_Intensity_Data[x].Cha_ID));
-		pCorr_Intensity_Data[x].Cha_ID = itohl(pCorr_Intensity_Data[x].Cha_ID);
-		index += sizeof(pCorr_Intensity_Data[x].Cha_ID);
-
-		//Read the intensity.
-		memcpy(&pCorr_Intensity_Data[x].intensity, &pDataBuf[index], sizeof(pCorr_Intensity_Data[x].intensity));
-		pCorr_Intensity_Data[x].intensity = itohf(pCorr_Intensity_Data[x].intensity);
-		index += sizeof(pCorr_Intensity_Data[x].intensity);
-
-		//Read data_num.
-		memcpy(&pCorr_Intensity_Data[x].Data_Num, &pDataBuf[index], sizeof(pCorr_Intensity_Data[x].Data_Num));
-		pCorr_Intensity_Data[x].Data_Num = itohl(pCorr_Intensity_Data[x].Data_Num);
-		index += sizeof(pCorr_Intensity_Data[x].Data_Num);
-
-		//Allocate memory for the correlation array based on data_num.
-		pCorr_Intensity_Data[x].pCorrBuf = malloc(pCorr_Intensity_Data[x].Data_Num * sizeof(*pCorr_Intensity_Data[x].pCorrBuf));
-		if (pCorr_Intensity_Data[x].pCorrBuf == NULL) {
-			//If allocation fails, loop backwards to free loop-allocated memory.
-			for (int y = x - 1; y >= 0; y--) {
-				free(pCorr_Intensity_Data[y].pCorrBuf);
-			}
-			free(pCorr_Intensity_Data);
-			return MEMORY_ALLOCATION_ERROR;
+		if (DataLen - index < CORR_CHANNEL_HEADER_SIZE) {
+			return FRAME_INVALID_DATA;
 		}
+		pDevice->pChannel_Offsets[x] = index;
+
+		unsigned __int32 Data_Num;
+		memcpy(&Data_Num, &pDataBuf[index + sizeof(__int32) + sizeof(float)], sizeof(Data_Num));
+		Data_Num = itohl(Data_Num);
+		index += CORR_CHANNEL_HEADER_SIZE;
 
-		//Read data into array.
-		for (int y = 0; y < pCorr_Intensity_Data[x].Data_Num; y++) {
-			memcpy(&pCorr_Intensity_Data[x].pCorrBuf[y], &pDataBuf[index], sizeof(*pCorr_Intensity_Data[x].pCorrBuf));
-			pCorr_Intensity_Data[x].pCorrBuf[y] = itohf(pCorr_Intensity_Data[x].pCorrBuf[y]);
-			index += sizeof(*pCorr_Intensity_Data[x].pCorrBuf);
+		if (Data_Num > (DataLen - index) / sizeof(float)) {
+			return FRAME_INVALID_DATA;
+		}
+		index += Data_Num * sizeof(float);
+		totalCorrNum += Data_Num;
+		if (Data_Num > maxCorrNum) {
+			maxCorrNum = Data_Num;
 		}
 	}
 
 	//Read in delay values.
 	//Get number of values.
 	unsigned __int32 Delay_Num;
+	if (DataLen - index < sizeof(Delay_Num)) {
+		return FRAME_INVALID_DATA;
+	}
 	memcpy(&Delay_Num, &pDataBuf[index], sizeof(Delay_Num));
 	Delay_Num = itohl(Delay_Num);
 	index += sizeof(Delay_Num);
 
-	//Allocate memory for actual values.
-	float* pDelayBuf = malloc(Delay_Num * sizeof(*pDelayBuf));
-	if (pDelayBuf == NULL) {
-		//Free dynamically allocated resources.
+	if (Delay_Num > (DataLen - index) / sizeof(float)) {
+		return FRAME_INVALID_DATA;
+	}
+
+	const Corr_Intensity_View view = {
+		.Cha_Num = numChannels,
+		.Delay_Num = Delay_Num,
+		.pData = pDataBuf,
+		.pChannelOffsets = pDevice->pChannel_Offsets,
+		.pDelayRaw = &pDataBuf[index],
+		.timestamp_ns = timestamp,
+	};
+
+	Get_Corr_Intensity_View_CB(pDevice, &view);
+
+	if (Corr_Intensity_Matrix_Requested(pDevice)) {
+		void* pMatrixBlock = reserve_Decode_Buffer(&pDevice->pCorr_Matrix, &pDevice->Corr_Matrix_Size, Corr_Intensity_Matrix_Size(numChannels, maxCorrNum, Delay_Num));
+		if (pMatrixBlock == NULL) {
+			return MEMORY_ALLOCATION_ERROR;
+		}
+
+		Corr_Intensity_Matrix* pMatrix = Layout_Corr_Intensity_Matrix(pMatrixBlock, numChannels, maxCorrNum, Delay_Num);
+		int* pCha_IDs = (int*)pMatrix->pCha_IDs;
+		float* pIntensity = (float*)pMatrix->pIntensity;
+		float* pCorr = (float*)pMatrix->pCorr;
+
 		for (unsigned __int32 x = 0; x < numChannels; x++) {
-			free(pCorr_Intensity_Data[x].pCorrBuf);
+			Corr_Intensity_Channel_View channel;
+			View_Corr_Intensity_Channel(&view, x, &channel);
+
+			pCha_IDs[x] = channel.Cha_ID;
+			pIntensity[x] = channel.intensity;
+
+			float* pRow = &pCorr[(size_t)x * maxCorrNum];
+			Copy_Corr_Intensity_Channel(&channel, pRow);
+			memset(&pRow[channel.Data_Num], 0, sizeof(*pRow) * (maxCorrNum - channel.Data_Num));
 		}
-		free(pCorr_Intensity_Data);
-		return MEMORY_ALLOCATION_ERROR;
+
+		Copy_Corr_Intensity_Delays(&view, (float*)pMatrix->pDelayBuf);
+		pMatrix->timestamp_ns = timestamp;
+
+		Get_Corr_Intensity_Matrix_CB(pDevice, pMatrix);
 	}
 
-	//Read in actual values.
-	for (unsigned __int32 x = 0; x < Delay_Num; x++) {
-		memcpy(&pDelayBuf[x], &pDataBuf[index], sizeof(*pDelayBuf));
-		pDelayBuf[x] = itohf(pDelayBuf[x]);
-		index += sizeof(*pDelayBuf);
+	//Copies are only made when the user-defined callback or the store asks for them.
+	if (!Corr_Intensity_Data_Requested(pDevice)) {
+		return NO_DCS_ERROR;
 	}
 
-	Get_Corr_Intensity_Data_CB(pCorr_Intensity_Data, numChannels, pDelayBuf, Delay_Num);
+	//The channel array, every channel's correlation values and the delays share one allocation, which is the store's
+	//slot for frames it keeps.
+	const size_t channelsSize = numChannels * sizeof(Corr_Intensity_Data);
+	const size_t blockSize = channelsSize + (totalCorrNum + Delay_Num) * sizeof(float);
+	Received_Data_Item* pFrame = Take_Frame_Buffer(pDevice, Corr_Intensity_Data_Type, blockSize);
+	char* pBlock = pFrame != NULL ? Frame_Buffer_Data(pFrame) : reserve_Decode_Buffer(&pDevice->pCorr_Block, &pDevice->Corr_Block_Size, blockSize);
+	if (pBlock == NULL && blockSize != 0) {
+		return MEMORY_ALLOCATION_ERROR;
+	}
+
+	Corr_Intensity_Data* pCorr_Intensity_Data = (Corr_Intensity_Data*)pBlock;
+	float* pValues = (float*)&pBlock[channelsSize];
 
-	//Free dynamically allocated resources.
 	for (unsigned __int32 x = 0; x < numChannels; x++) {
-		free(pCorr_Intensity_Data[x].pCorrBuf);
+		Corr_Intensity_Channel_View channel;
+		View_Corr_Intensity_Channel(&view, x, &channel);
+
+		pCorr_Intensity_Data[x].Cha_ID = channel.Cha_ID;
+		pCorr_Intensity_Data[x].intensity = channel.intensity;
+		pCorr_Intensity_Data[x].Data_Num = channel.Data_Num;
+		pCorr_Intensity_Data[x].pCorrBuf = pValues;
+		pCorr_Intensity_Data[x].timestamp_ns = timestamp;
+
+		Copy_Corr_Intensity_Channel(&channel, pValues);
+		pValues += channel.Data_Num;
 	}
-	free(pCorr_Intensity_Data);
-	free(pDelayBuf);
 
+	float* pDelayBuf = pValues;
+	Copy_Corr_Intensity_Delays(&view, pDelayBuf);
+
+	Get_Corr_Intensity_Data_CB(pDevice, pCorr_Intensity_Data, numChannels, pDelayBuf, Delay_Num, pFrame);
+	Release_Frame_Buffer(pDevice, pFrame);
 #pragma warning (default: 6386 6385 6001)
 
 	return NO_DCS_ERROR;
 }
 
-int Receive_Intensity_Data(char* pDataBuf) {
+int View_Corr_Intensity_Channel(const Corr_Intensity_View* pView, int index, Corr_Intensity_Channel_View* pChannel) {
+	if (pView == NULL || pChannel == NULL || index < 0 || index >= pView->Cha_Num) {
+		return FRAME_INVALID_DATA;
+	}
+
+	const char* pRecord = &pView->pData[pView->pChannelOffsets[index]];
+
+	unsigned __int32 Cha_ID;
+	memcpy(&Cha_ID, pRecord, sizeof(Cha_ID));
+	pRecord += sizeof(Cha_ID);
+
+	float intensity;
+	memcpy(&intensity, pRecord, sizeof(intensity));
+	pRecord += sizeof(intensity);
+
+	unsigned __int32 Data_Num;
+	memcpy(&Data_Num, pRecord, sizeof(Data_Num));
+	pRecord += sizeof(Data_Num);
+
+	pChannel->Cha_ID = itohl(Cha_ID);
+	pChannel->intensity = itohf(intensity);
+	pChannel->Data_Num = itohl(Data_Num);
+	pChannel->pCorrRaw = pRecord;
+
+	return NO_DCS_ERROR;
+}
+
+int Copy_Corr_Intensity_Channel(const Corr_Intensity_Channel_View* pChannel, float* pCorrBuf) {
+	if (pChannel == NULL || pCorrBuf == NULL) {
+		return FRAME_INVALID_DATA;
+	}
+
+	itohf_array(pCorrBuf, pChannel->pCorrRaw, pChannel->Data_Num);
+
+	return NO_DCS_ERROR;
+}
+
+int Copy_Corr_Intensity_Delays(const Corr_Intensity_View* pView, float* pDelayBuf) {
+	if (pView == NULL || pDelayBuf == NULL) {
+		return FRAME_INVALID_DATA;
+	}
+
+	itohf_array(pDelayBuf, pView->pDelayRaw, pView->Delay_Num);
+
+	return NO_DCS_ERROR;
+}
+
+void Release_Decode_Buffers(DCS_Device* pDevice) {
+	free(pDevice->pChannel_Offsets);
+	pDevice->pChannel_Offsets = NULL;
+	pDevice->Channel_Offsets_Capacity = 0;
+
+	free(pDevice->pBFI_Records);
+	pDevice->pBFI_Records = NULL;
+	pDevice->BFI_Records_Size = 0;
+
+	free(pDevice->pIntensity_Records);
+	pDevice->pIntensity_Records = NULL;
+	pDevice->Intensity_Records_Size = 0;
+
+	free(pDevice->pCorr_Block);
+	pDevice->pCorr_Block = NULL;
+	pDevice->Corr_Block_Size = 0;
+
+	free(pDevice->pCorr_Matrix);
+	pDevice->pCorr_Matrix = NULL;
+	pDevice->Corr_Matrix_Size = 0;
+}
+
+//Rounds [size] up to a whole number of DCS_MATRIX_ALIGNMENT blocks.
+#define MATRIX_ALIGN(size) (((size) + DCS_MATRIX_ALIGNMENT - 1) & ~(size_t)(DCS_MATRIX_ALIGNMENT - 1))
+
+size_t Corr_Intensity_Matrix_Size(int Cha_Num, int Data_Num, int Delay_Num) {
+	return sizeof(Corr_Intensity_Matrix) + DCS_MATRIX_ALIGNMENT - 1 +
+		MATRIX_ALIGN(sizeof(float) * Cha_Num * (size_t)Data_Num) +
+		MATRIX_ALIGN(sizeof(float) * Delay_Num) +
+		MATRIX_ALIGN(sizeof(int) * Cha_Num) +
+		MATRIX_ALIGN(sizeof(float) * Cha_Num);
+}
+
+Corr_Intensity_Matrix* Layout_Corr_Intensity_Matrix(void* pBlock, int Cha_Num, int Data_Num, int Delay_Num) {
+	Corr_Intensity_Matrix* pMatrix = pBlock;
+	pMatrix->Cha_Num = Cha_Num;
+	pMatrix->Data_Num = Data_Num;
+	pMatrix->Delay_Num = Delay_Num;
+	pMatrix->timestamp_ns = 0;
+
+	//The matrix comes first, since it's by far the biggest array, and every array starts on an aligned address.
+	char* pArrays = (char*)MATRIX_ALIGN((uintptr_t)(pMatrix + 1));
+	pMatrix->pCorr = (const float*)pArrays;
+	pArrays += MATRIX_ALIGN(sizeof(float) * Cha_Num * (size_t)Data_Num);
+	pMatrix->pDelayBuf = (const float*)pArrays;
+	pArrays += MATRIX_ALIGN(sizeof(float) * Delay_Num);
+	pMatrix->pCha_IDs = (const int*)pArrays;
+	pArrays += MATRIX_ALIGN(sizeof(int) * Cha_Num);
+	pMatrix->pIntensity = (const float*)pArrays;
+
+	return pMatrix;
+}
+
+//Size of an intensity record in the frame: Cha_ID and intensity.
+#define INTENSITY_RECORD_SIZE (2 * sizeof(__int32))
+
+int Receive_Intensity_Data(DCS_Device* pDevice, char* pDataBuf, unsigned __int32 DataLen, unsigned __int64 timestamp) {
 	unsigned __int32 index = 0;
 
 	//Number of channels to expect in following data.
 	unsigned __int32 numChannels;
+	if (DataLen < sizeof(numChannels)) {
+		return FRAME_INVALID_DATA;
+	}
 	memcpy(&numChannels, &pDataBuf[index], sizeof(numChannels));
 	numChannels = itohl(numChannels);
 	index += sizeof(numChannels);
 
-	//Allocating memory for numChannels channels of data.
-	Intensity_Data* pIntensity_Data = malloc(sizeof(*pIntensity_Data) * numChannels);
-	if (pIntensity_Data == NULL) {
+	if (numChannels > (DataLen - index) / INTENSITY_RECORD_SIZE) {
+		return FRAME_INVALID_DATA;
+	}
+
+	//Memory for numChannels channels of data, which is the store's slot for frames it keeps.
+	Received_Data_Item* pFrame = Take_Frame_Buffer(pDevice, Intensity_Data_Type, sizeof(Intensity_Data) * numChannels);
+	Intensity_Data* pIntensity_Data = pFrame != NULL ? Frame_Buffer_Data(pFrame) : reserve_Decode_Buffer(&pDevice->pIntensity_Records, &pDevice->Intensity_Records_Size, sizeof(*pIntensity_Data) * numChannels);
+	if (pIntensity_Data == NULL && numChannels != 0) {
 		return MEMORY_ALLOCATION_ERROR;
 	}
 
+	//Intensity_Data starts with a Cha_ID and an intensity, both 32 bits, laid out as they are in the frame.
 	for (unsigned __int32 x = 0; x < numChannels; x++) {
-#pragma warning (disable: 6386 6385)
-		//Read the Cha_ID.
-		memcpy(&pIntensity_Data[x].Cha_ID, &pDataBuf[index], sizeof(pIntensity_Data[x].Cha_ID));
-		pIntensity_Data[x].Cha_ID = itohl(pIntensity_Data[x].Cha_ID);
-		index += sizeof(pIntensity_Data[x].Cha_ID);
-
-		//Read the intensity.
-		memcpy(&pIntensity_Data[x].intensity, &pDataBuf[index], sizeof(pIntensity_Data[x].intensity));
-		pIntensity_Data[x].intensity = itohf(pIntensity_Data[x].intensity);
-		index += sizeof(pIntensity_Data[x].intensity);
-#pragma warning (default: 6386 6385)
+		itoh32_array(&pIntensity_Data[x], &pDataBuf[index + x * INTENSITY_RECORD_SIZE], INTENSITY_RECORD_SIZE / sizeof(__int32));
+		pIntensity_Data[x].timestamp_ns = timestamp;
 	}
 
-	Get_Intensity_Data_CB(pIntensity_Data, numChannels);
-
-	free(pIntensity_Data);
+	Get_Intensity_Data_CB(pDevice, pIntensity_Data, numChannels, pFrame);
+	Release_Frame_Buffer(pDevice, pFrame);
 
 	return NO_DCS_ERROR;
 }
 
-int Send_Check_Network(void) {
-	return Send_DCS_Command(CHECK_NET_CONNECTION, NULL, 0);
-}
+unsigned __int32 Stream_Frame_Size(Data_ID data_id, unsigned __int32 Cha_Num, unsigned __int32 Correlation_Length) {
+	//Each size starts with the channel count.
+	size_t size = sizeof(__int32);
+	switch (data_id) {
+		case GET_BFI_DATA:
+			size += (size_t)Cha_Num * BFI_RECORD_SIZE;
+			break;
+
+		case GET_INTENSITY:
+			size += (size_t)Cha_Num * INTENSITY_RECORD_SIZE;
+			break;
+
+		//Each channel's correlation buffer is followed by the delays, each as long as the correlation length.
+		case GET_CORR_INTENSITY:
+			if (Correlation_Length == 0) {
+				return 0;
+			}
+			size += (size_t)Cha_Num * (CORR_CHANNEL_HEADER_SIZE + (size_t)Correlation_Length * sizeof(float));
+			size += sizeof(__int32) + (size_t)Correlation_Length * sizeof(float);
+			break;
 
-int Send_DCS_Command(Data_ID data_ID, char* pDataBuf, const unsigned __int32 BufferSize) {
-	//Allocate memory for [pTransmission].
-	Transmission_Data_Type* pTransmission = malloc(sizeof(*pTransmission));
-	if (pTransmission == NULL) {
-		return MEMORY_ALLOCATION_ERROR;
+		default:
+			return 0;
 	}
+	return size <= UINT_MAX ? (unsigned __int32)size : 0;
+}
 
-	//Transmission size = 2(Header) + 4(Type ID) + 4(Data ID) + BufferSize + 1 (Checksum)
-	pTransmission->size = sizeof(Frame_Version) + sizeof(Type_ID) + sizeof(Data_ID) + BufferSize + 1;
+int Send_Check_Network(DCS_Device* pDevice) {
+	return Send_DCS_Command(pDevice, CHECK_NET_CONNECTION, NULL, 0, NULL);
+}
 
-	unsigned __int32 index = 0; //Index to track position in pFrame.
-	pTransmission->pFrame = malloc(pTransmission->size);
-	if (pTransmission->pFrame == NULL) {
-		free(pTransmission);
-		return MEMORY_ALLOCATION_ERROR;
+int Send_DCS_Command(DCS_Device* pDevice, Data_ID data_ID, const char* pDataBuf, const unsigned __int32 BufferSize, DCS_Request* pRequest) {
+	Frame_Builder builder;
+	int result = Frame_Begin(&builder, pDevice, data_ID, BufferSize, pRequest);
+	if (result != NO_DCS_ERROR) {
+		return result;
 	}
 
-	//Change frame version to output byte order and copy to output buffer.
-	const Frame_Version frame_version = htoos(FRAME_VERSION);
-#pragma warning (disable: 6386)
-	memcpy(&pTransmission->pFrame[index], &frame_version, sizeof(frame_version));
-	index += sizeof(frame_version);
-#pragma warning (default: 6386)
-
-	//Change command type to output byte order and copy to output buffer.
-	const Type_ID command = htool(COMMAND_ID);
-	memcpy(&pTransmission->pFrame[index], &command, sizeof(command));
-	index += sizeof(command);
-
-	//Change data ID to output byte order and copy to output buffer.
-	const Data_ID data_ID_out = htool(data_ID);
-	memcpy(&pTransmission->pFrame[index], &data_ID, sizeof(data_ID));
-	index += sizeof(data_ID);
-
 	//Copy main data to output buffer.
 	if (pDataBuf != NULL) {
-		memcpy(&pTransmission->pFrame[index], pDataBuf, BufferSize);
-		index += BufferSize;
+		Frame_Put(&builder, pDataBuf, BufferSize);
 	}
 
-	//Add checksum calculated from 2(Header) + 4(Type ID) + 4(Data ID) + BufferSize
-	pTransmission->pFrame[pTransmission->size - 1] = compute_checksum(pTransmission->pFrame, pTransmission->size - 1);
-
-	pTransmission->command_code = data_ID;
+	return Frame_End(&builder);
+}
 
-	int result = Enqueue_Trans_FIFO(pTransmission);
-	return result;
+void Set_Frame_Format(DCS_Device* pDevice, Frame_Check_Type check, bool sequenced) {
+	pDevice->frame_check = check;
+	pDevice->frame_sequenced = sequenced;
 }
 
-Checksum compute_checksum(char* pDataBuf, unsigned __int32 size) {
-	unsigned __int8 xor_sum = 0;
-	for (unsigned int index = 0; index < size; index++) {
-		xor_sum ^= pDataBuf[index];
+//Frame version of frames with the given integrity check and sequencing.
+static Frame_Version frame_version_for(Frame_Check_Type check, bool sequenced) {
+	if (sequenced) {
+		return check == FRAME_CHECK_CRC32C ? FRAME_VERSION_SEQUENCED_CRC32C : FRAME_VERSION_SEQUENCED;
 	}
-
-	return xor_sum;
+	return check == FRAME_CHECK_CRC32C ? FRAME_VERSION_CRC32C : FRAME_VERSION;
 }
 
-bool check_checksum(char* pDataBuf, unsigned __int32 size) {
-	unsigned __int8 xor_sum = 0;
-	for (unsigned __int32 index = 0; index < size; index++) {
-		xor_sum ^= pDataBuf[index];
-	}
+//Returns true if frames with the given version carry a sequence ID.
+static inline bool frame_version_sequenced(Frame_Version version) {
+	return version == FRAME_VERSION_SEQUENCED || version == FRAME_VERSION_SEQUENCED_CRC32C;
+}
 
-	return xor_sum == 0x00;
+bool Frame_Version_Valid(Frame_Version version) {
+	return version == FRAME_VERSION || version == FRAME_VERSION_CRC32C || frame_version_sequenced(version);
 }
 
+unsigned __int32 Frame_Header_Size(Frame_Version version) {
+	const unsigned __int32 size = sizeof(Frame_Version) + sizeof(Type_ID) + sizeof(Data_ID);
+	return frame_version_sequenced(version) ? size + sizeof(Sequence_ID) : size;
+}
 
-////////////////////////////////
-//Endianess management functions
-////////////////////////////////
+unsigned __int32 Frame_Trailer_Size(Frame_Version version) {
+	return version == FRAME_VERSION_CRC32C || version == FRAME_VERSION_SEQUENCED_CRC32C ? CRC32C_SIZE : sizeof(Checksum);
+}
 
-/*6 endianess management functions are defined with 5 character function names.
-The first 4 characters describe which direction the conversion is doing.
-"htoo" refers to "host to output" & "itoh" refers to "input to host".
-The last character refers to the data type. "l" is long, "s" is short,
-"f" is float.*/
+bool check_frame(const char* pFrame, unsigned __int32 size) {
+	Frame_Version version;
+	if (size < sizeof(version)) {
+		return false;
+	}
+	memcpy(&version, pFrame, sizeof(version));
+	version = itohs(version);
 
-//Determines if the host byte order is the same as the intended output byte order.
-static inline bool should_swap_htoo(void) {
-	if (!IS_BIG_ENDIAN && ENDIANESS_OUTPUT == BIG_ENDIAN) {
-		return true;
+	if (Frame_Trailer_Size(version) != CRC32C_SIZE) {
+		return check_checksum(pFrame, size);
 	}
-	if (IS_BIG_ENDIAN && ENDIANESS_OUTPUT == LITTLE_ENDIAN) {
-		return true;
+
+	//CRC32C covers everything before the trailer.
+	if (size < sizeof(version) + CRC32C_SIZE) {
+		return false;
 	}
-	return false;
+	unsigned __int32 crc;
+	memcpy(&crc, &pFrame[size - CRC32C_SIZE], sizeof(crc));
+	return crc32c_update(0, pFrame, size - CRC32C_SIZE) == itohl(crc);
 }
 
-//Determines if the input byte order is the same as the host byte order.
-static inline bool should_swap_itoh(void) {
-	if (!IS_BIG_ENDIAN && ENDIANESS_INPUT == BIG_ENDIAN) {
-		return true;
+//Index in pFrame where the frame's checksum or CRC32C starts.
+static inline unsigned __int32 frame_data_end(const Frame_Builder* pBuilder) {
+	return sizeof(pBuilder->pTransmission->size) + pBuilder->pTransmission->size - Frame_Trailer_Size(pBuilder->version);
+}
+
+int Frame_Begin(Frame_Builder* pBuilder, DCS_Device* pDevice, Data_ID data_ID, unsigned __int32 BufferSize, DCS_Request* pRequest) {
+	if (pDevice == NULL) {
+		return NETWORK_NOT_READY;
 	}
-	if (IS_BIG_ENDIAN && ENDIANESS_INPUT == LITTLE_ENDIAN) {
-		return true;
+
+	const Frame_Check_Type check = pDevice->frame_check;
+	const Frame_Version version = frame_version_for(check, pDevice->frame_sequenced);
+
+	//Frame size = 2(Header) + 4(Type ID) + 4(Data ID) + 4(Sequence ID, if sequenced) + BufferSize + 1 (Checksum) or 4 (CRC32C)
+	const unsigned __int32 overhead = Frame_Header_Size(version) + Frame_Trailer_Size(version);
+	if (BufferSize > UINT_MAX - overhead - sizeof(pBuilder->pTransmission->size)) {
+		return MEMORY_ALLOCATION_ERROR;
+	}
+	const unsigned __int32 size = overhead + BufferSize;
+
+	//The frame is sent with its size prepended to it so reserve room for it as well.
+	Transmission_Data_Type* pTransmission = Alloc_Transmission(sizeof(size) + size);
+	if (pTransmission == NULL) {
+		return MEMORY_ALLOCATION_ERROR;
 	}
-	return false;
-}
 
-//Swaps the byte order of a float.
-static inline float swap_float(const float inFloat) {
-	float retVal = 0.0f;
-	char* floatToConvert = (char*)&inFloat;
-	char* returnFloat = (char*)&retVal;
+	pTransmission->size = size;
+	pTransmission->command_code = data_ID;
+	pTransmission->sequence = frame_version_sequenced(version) ? Next_Sequence_ID() : 0;
+	pTransmission->pRequest = pRequest;
+	Request_Retain(pRequest);
+
+	pBuilder->pDevice = pDevice;
+	pBuilder->pTransmission = pTransmission;
+	pBuilder->index = 0;
+	pBuilder->version = version;
+	pBuilder->check = check;
+	pBuilder->checksum = 0;
+	pBuilder->crc = 0;
+	pBuilder->overflow = false;
+
+	//Write prepended frame size. It is sent in host order and isn't part of the checksum.
+	memcpy(pTransmission->pFrame, &size, sizeof(size));
+	pBuilder->index += sizeof(size);
 
-	//Swap the bytes into a temporary buffer
-	returnFloat[0] = floatToConvert[3];
-	returnFloat[1] = floatToConvert[2];
-	returnFloat[2] = floatToConvert[1];
-	returnFloat[3] = floatToConvert[0];
+	//Change frame version to output byte order and copy to output buffer.
+	const Frame_Version frame_version = htoos(version);
+	Frame_Put(pBuilder, &frame_version, sizeof(frame_version));
 
-	return retVal;
-}
+	//Command type and data ID.
+	Frame_Put_Long(pBuilder, COMMAND_ID);
+	Frame_Put_Long(pBuilder, data_ID);
 
-//Converts long from host to output byte order.
-u_long htool(u_long hostlong) {
-	if (should_swap_htoo()) {
-		return Swap32(hostlong);
+	//Sequenced frames identify the command so its acknowledgement can be matched to it.
+	if (pTransmission->sequence != 0) {
+		Frame_Put_Long(pBuilder, pTransmission->sequence);
 	}
-	return hostlong;
+
+	return NO_DCS_ERROR;
 }
 
-//Converts short from host to output byte order.
-u_short htoos(u_short hostshort) {
-	if (should_swap_htoo()) {
-		return Swap16(hostshort);
+void Frame_Put(Frame_Builder* pBuilder, const void* pData, unsigned __int32 size) {
+	Transmission_Data_Type* pTransmission = pBuilder->pTransmission;
+
+	//Leave room for the checksum or CRC32C at the end of the frame.
+	const unsigned __int32 end = frame_data_end(pBuilder);
+	if (pBuilder->overflow || size > end - pBuilder->index) {
+		pBuilder->overflow = true;
+		return;
 	}
-	return hostshort;
-}
 
-//Converts float from host to output byte order.
-float htoof(float value) {
-	if (should_swap_htoo()) {
-		return swap_float(value);
+	if (pBuilder->check == FRAME_CHECK_CRC32C) {
+		pBuilder->crc = copy_crc32c(&pTransmission->pFrame[pBuilder->index], pData, size, pBuilder->crc);
 	}
-	return value;
+	else {
+		pBuilder->checksum = copy_checksum(&pTransmission->pFrame[pBuilder->index], pData, size, pBuilder->checksum);
+	}
+	pBuilder->index += size;
 }
 
-//Converts long from input to host byte order.
-u_long itohl(u_long ilong) {
-	if (should_swap_itoh()) {
-		return Swap32(ilong);
-	}
-	return ilong;
+void Frame_Put_Long(Frame_Builder* pBuilder, u_long value) {
+	const unsigned __int32 out = htool(value);
+	Frame_Put(pBuilder, &out, sizeof(out));
 }
 
-//Converts short from input to host byte order.
-u_short itohs(u_short ishort) {
-	if (should_swap_itoh()) {
-		return Swap16(ishort);
+void Frame_Put_Float(Frame_Builder* pBuilder, float value) {
+	const float out = htoof(value);
+	Frame_Put(pBuilder, &out, sizeof(out));
+}
+
+void Frame_Put_Bool(Frame_Builder* pBuilder, bool value) {
+	Frame_Put(pBuilder, &value, sizeof(value));
+}
+
+int Frame_End(Frame_Builder* pBuilder) {
+	DCS_Device* pDevice = pBuilder->pDevice;
+	Transmission_Data_Type* pTransmission = Frame_Finish(pBuilder);
+	if (pTransmission == NULL) {
+		return FRAME_INVALID_DATA;
 	}
-	return ishort;
+
+	return Enqueue_Trans_FIFO(pDevice, pTransmission);
 }
 
-//Converts float from input to host byte order.
-float itohf(float value) {
-	if (should_swap_itoh()) {
-		return swap_float(value);
+Transmission_Data_Type* Frame_Finish(Frame_Builder* pBuilder) {
+	Transmission_Data_Type* pTransmission = pBuilder->pTransmission;
+
+	//The frame must have been filled exactly up to the checksum.
+	const unsigned __int32 end = frame_data_end(pBuilder);
+	pBuilder->pTransmission = NULL;
+	if (pBuilder->overflow || pBuilder->index != end) {
+		Free_Transmission(pTransmission);
+		return NULL;
 	}
-	return value;
+
+	//Add checksum or CRC32C calculated from 2(Header) + 4(Type ID) + 4(Data ID) + BufferSize
+	if (pBuilder->check == FRAME_CHECK_CRC32C) {
+		const unsigned __int32 crc = htool(pBuilder->crc);
+		memcpy(&pTransmission->pFrame[end], &crc, sizeof(crc));
+	}
+	else {
+		pTransmission->pFrame[end] = pBuilder->checksum;
+	}
+
+	return pTransmission;
 }
 
+
 //Convenience function for dumping data to stdout in debug builds, but nothing in release.
 void hexDump(const char* desc, const void* addr, const unsigned __int32 len) {
 #if defined(_DEBUG)
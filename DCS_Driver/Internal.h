@@ -1,54 +1,9 @@
 #pragma once
-#include <WinSock2.h>
+#include "Platform.h"
+#include "Endianess.h"
+#include "Checksum.h"
 #include "DCS_Driver.h"
 
-enum Endianess
-{
-	LITTLE_ENDIAN = 1,
-	BIG_ENDIAN = 0,
-};
-
-//Sets endianess of packaged/received data
-//0 is network byte order(big endian)
-//1 is little endian
-#define ENDIANESS_OUTPUT LITTLE_ENDIAN
-#define ENDIANESS_INPUT LITTLE_ENDIAN
-
-//True if the current system is big endian
-#define IS_BIG_ENDIAN (!*(unsigned char *)&(unsigned __int16){1})
-
-//Swaps endianess of 16 bit field
-#define Swap16(data) \
-( (((data) >> 8) & 0x00FF) | (((data) << 8) & 0xFF00) ) 
-
-//Swaps endianess of 32 bit field
-#define Swap32(data)   \
-( (((data) >> 24) & 0x000000FF) | (((data) >>  8) & 0x0000FF00) | \
-  (((data) <<  8) & 0x00FF0000) | (((data) << 24) & 0xFF000000) ) 
-
-//Host to output functions//
-
-//Converts host long to ENDIANESS_OUTPUT endianess.
-u_long htool(u_long hlong);
-
-//Converts host short to ENDIANESS_OUTPUT endianess.
-u_short htoos(u_short hshort);
-
-//Converts host float to ENDIANESS_OUTPUT endianess.
-float htoof(float value);
-
-//Input to host functions//
-
-//Converts ENDIANESS_INPUT endianess long to host endianess.
-u_long itohl(u_long ilong);
-
-//Converts ENDIANESS_INPUT endianess short to host endianess.
-u_short itohs(u_short ishort);
-
-//Converts ENDIANESS_INPUT endianess float to host endianess.
-float itohf(float value);
-
-
 //Data IDs
 //The following are data IDs used in the communication between the
 //host and the remote DCS. GET IDs are for asking for data from the DCS and receiving it.
@@ -80,6 +35,12 @@ float itohf(float value);
 #define DATA_ID 0x00000001
 
 #define FRAME_VERSION 0xFF01
+//Same frame as FRAME_VERSION but with a CRC32C trailer in place of the 1 byte checksum.
+#define FRAME_VERSION_CRC32C 0xFF02
+//Sequenced frames carry a Sequence_ID after the data ID so several commands can be in flight
+//and each response matched to its command. Otherwise the same as the two versions above.
+#define FRAME_VERSION_SEQUENCED 0xFF11
+#define FRAME_VERSION_SEQUENCED_CRC32C 0xFF12
 
 //Standard console output colors for creating colored stdout
 #define ANSI_COLOR_RED     "\x1b[31m"
@@ -101,101 +62,174 @@ typedef unsigned __int32 Type_ID;
 //Data id of DCS frame is a 32 bit integer.
 typedef unsigned __int32 Data_ID;
 
-//Checksum of DCS frame is an 8 bit integer.
-typedef unsigned __int8 Checksum;
+//Sequence id of a sequenced DCS frame is a 32 bit integer. 0 means the frame isn't tied to a command.
+typedef unsigned __int32 Sequence_ID;
+
+//Connection to one DCS and everything kept for it. Defined in Device.h.
+typedef struct DCS_Device DCS_Device;
+
+//Command sent with one of the DCS_*_Async functions, waiting for the DCS to answer it. Defined in Request.h.
+typedef struct DCS_Request DCS_Request;
 
 typedef struct Transmission_Data_Type {
-	unsigned __int32 size; //Size of the transmission buffer
-	char* pFrame; //Pointer to the transmission buffer
+	unsigned __int32 size; //Size of the DCS frame, excluding the 4 byte size prepended to it
+	char* pFrame; //Pointer to the transmission buffer, starting with the prepended frame size
+	unsigned __int32 capacity; //Number of bytes available at pFrame
 	Data_ID command_code;
+	Sequence_ID sequence; //Sequence ID written in the frame, 0 if the frame isn't sequenced
+	DCS_Request* pRequest; //Request the frame's command resolves, handed to its command record when it's sent. NULL if none.
+	bool shared; //Set while both the output writing the frame and its command record hold it. Whichever lets go first clears it.
 	struct Transmission_Data_Type* pNextItem; //Pointer to the next item in the queue.
 } Transmission_Data_Type;
 
+//Builds a DCS frame directly in its transmission buffer. The prepended frame size and the
+//header are written up front and the checksum is folded in as the data is appended.
+typedef struct {
+	DCS_Device* pDevice; //Device the frame is sent to
+	Transmission_Data_Type* pTransmission; //Transmission the frame is being built in
+	unsigned __int32 index; //Index in pFrame where the next byte is written
+	Frame_Version version; //Frame version the frame was started with
+	Frame_Check_Type check; //Integrity check the frame ends with
+	Checksum checksum; //Checksum of everything written after the prepended frame size so far
+	unsigned __int32 crc; //CRC32C of everything written after the prepended frame size so far
+	bool overflow; //Set if more data was appended than was reserved in Frame_Begin
+} Frame_Builder;
+
+//Sets the integrity check used by frames sent to [pDevice] from now on and whether they carry sequence IDs.
+void Set_Frame_Format(DCS_Device* pDevice, Frame_Check_Type check, bool sequenced);
+
+//Returns true if [version] (host order) is a known frame version.
+bool Frame_Version_Valid(Frame_Version version);
+
+//Size of the frame version, type id, data id and, for sequenced frames, sequence id that start a frame.
+unsigned __int32 Frame_Header_Size(Frame_Version version);
+
+//Size of the integrity check at the end of a frame with the given (host order) frame version.
+unsigned __int32 Frame_Trailer_Size(Frame_Version version);
+
+//Verifies the checksum or CRC32C of a full DCS frame based on its frame version.
+//Returns true if the frame is intact. False otherwise.
+bool check_frame(const char* pFrame, unsigned __int32 size);
+
+//Starts a frame to [pDevice] for [data_ID] with room for [BufferSize] bytes of data, resolving [pRequest] once the DCS answers it
+//if it isn't NULL. The frame is only allocated if no pooled transmission buffer is big enough. Returns NETWORK_NOT_READY if [pDevice] is NULL.
+int Frame_Begin(Frame_Builder* pBuilder, DCS_Device* pDevice, Data_ID data_ID, unsigned __int32 BufferSize, DCS_Request* pRequest);
+
+//Appends raw bytes to the frame.
+void Frame_Put(Frame_Builder* pBuilder, const void* pData, unsigned __int32 size);
+
+//Appends a 32 bit integer in the output byte order.
+void Frame_Put_Long(Frame_Builder* pBuilder, u_long value);
+
+//Appends a float in the output byte order.
+void Frame_Put_Float(Frame_Builder* pBuilder, float value);
+
+//Appends a bool as a single byte.
+void Frame_Put_Bool(Frame_Builder* pBuilder, bool value);
+
+//Writes the checksum or CRC32C and adds the frame to the device's transmission FIFO.
+//The frame is released if it wasn't filled with exactly the size passed to Frame_Begin.
+int Frame_End(Frame_Builder* pBuilder);
+
+//Same as Frame_End, but hands the frame back rather than queuing it. Returns NULL if the frame was released.
+Transmission_Data_Type* Frame_Finish(Frame_Builder* pBuilder);
+
 //This function is called by the function Get_DCS_Status. It calls the function
 //Send_DCS_Command to send the Get DCS Status command to the DCS. The Status data will
 //be received by the function Receive_DCS_Status.
-int Send_Get_DCS_Status(void);
-int Receive_DCS_Status(char* pDataBuf);
+int Send_Get_DCS_Status(DCS_Device* pDevice, DCS_Request* pRequest);
+int Receive_DCS_Status(DCS_Device* pDevice, char* pDataBuf, unsigned __int32 DataLen, Sequence_ID sequence);
 
 //Sends command to set the passed correlator settings.
-int Send_Correlator_Setting(Correlator_Setting* pCorrelator_Setting);
+int Send_Correlator_Setting(DCS_Device* pDevice, Correlator_Setting* pCorrelator_Setting, DCS_Request* pRequest);
 
 //This function is called by the function Get_Correlator_Setting. It calls the function
 //Send_DCS_Command to send the Get Correlator Settings command to the DCS. The data will
 //be received by the function Receive_Correlator_Setting.
-int Send_Get_Correlator_Setting(void);
-int Receive_Correlator_Setting(char* pDataBuf);
+int Send_Get_Correlator_Setting(DCS_Device* pDevice, DCS_Request* pRequest);
+int Receive_Correlator_Setting(DCS_Device* pDevice, char* pDataBuf, unsigned __int32 DataLen, Sequence_ID sequence);
 
 //Sends command to set the passed analyzer settings.
-int Send_Analyzer_Setting(Analyzer_Setting* pAnalyzer_Setting, unsigned __int32 Cha_Num);
+int Send_Analyzer_Setting(DCS_Device* pDevice, Analyzer_Setting* pAnalyzer_Setting, unsigned __int32 Cha_Num, DCS_Request* pRequest);
 
 //This function is called by the function Get_Analyzer_Setting. It calls the function
 //Send_DCS_Command to send the Get Analyzer Settings command to the DCS. The data will
 //be received by the function Receive_Analyzer_Setting.
-int Send_Get_Analyzer_Setting(void);
-int Receive_Analyzer_Setting(char* pDataBuf);
+int Send_Get_Analyzer_Setting(DCS_Device* pDevice, DCS_Request* pRequest);
+int Receive_Analyzer_Setting(DCS_Device* pDevice, char* pDataBuf, unsigned __int32 DataLen, Sequence_ID sequence);
 
 //Sends command to start a measurement with the passed parameters.
-int Send_Start_Measurement(__int32 Interval, unsigned __int32* pCha_IDs, unsigned __int32 Cha_Num);
+int Send_Start_Measurement(DCS_Device* pDevice, __int32 Interval, unsigned __int32* pCha_IDs, unsigned __int32 Cha_Num, DCS_Request* pRequest);
 
 //Sends command to start a measurement with the passed parameters.
-int Send_Stop_Measurement(void);
+int Send_Stop_Measurement(DCS_Device* pDevice, DCS_Request* pRequest);
 
 //Sends command to enable or disable different outputs of the DCS.
-int Send_Enable_DCS(bool bCorr, bool bAnalyzer);
+int Send_Enable_DCS(DCS_Device* pDevice, bool bCorr, bool bAnalyzer, DCS_Request* pRequest);
 
 
 //This function is called by the function Get_Simulated_Correlation. It calls the function
 //Send_DCS_Command to send the Get Simulated Correlation command to the DCS. The data will
 //be received by the function Receive_Simulated_Correlation.
-int Send_Get_Simulated_Correlation(void);
-int Receive_Simulated_Correlation(char* pDataBuf);
+int Send_Get_Simulated_Correlation(DCS_Device* pDevice, DCS_Request* pRequest);
+int Receive_Simulated_Correlation(DCS_Device* pDevice, char* pDataBuf, unsigned __int32 DataLen, Sequence_ID sequence);
 
 //Sends command to set the passed optical paramters with the given array of [Cha_Num] length.
-int Send_Optical_Param(Optical_Param_Type* pOpt_Param, int Cha_Num);
+int Send_Optical_Param(DCS_Device* pDevice, Optical_Param_Type* pOpt_Param, int Cha_Num, DCS_Request* pRequest);
 
 //Sends command to set the passed prefit paramters.
-int Send_Analyzer_Prefit_Param(Analyzer_Prefit_Param* pAnalyzer_Prefit_Param);
+int Send_Analyzer_Prefit_Param(DCS_Device* pDevice, Analyzer_Prefit_Param* pAnalyzer_Prefit_Param, DCS_Request* pRequest);
 
 //This function is called by the function Get_Analyzer_Prefit_Param. It calls the function
 //Send_DCS_Command to send the Get Analyzer Prefit Param command to the DCS. The data will
 //be received by the function Receive_Analyzer_Prefit_Param.
-int Send_Get_Analyzer_Prefit_Param(void);
-int Receive_Analyzer_Prefit_Param(char* pDataBuf);
+int Send_Get_Analyzer_Prefit_Param(DCS_Device* pDevice, DCS_Request* pRequest);
+int Receive_Analyzer_Prefit_Param(DCS_Device* pDevice, char* pDataBuf, unsigned __int32 DataLen, Sequence_ID sequence);
 
 //Receives logging messages from the DCS device and calls user-defined callback.
-int Receive_Error_Message(char* pDataBuf);
+int Receive_Error_Message(DCS_Device* pDevice, char* pDataBuf, unsigned __int32 DataLen);
 
 //Receives the error code of an upcoming error.
-int Receive_Error_Code(char* pDataBuf);
+int Receive_Error_Code(DCS_Device* pDevice, char* pDataBuf, unsigned __int32 DataLen);
 
-//Handles the acknowledgement frame from the DCS.
-int Receive_Command_ACK(char* pDataBuf);
+//Handles the acknowledgement frame from the DCS. [sequence] is the sequence ID of the
+//acknowledged command, or 0 if the acknowledgement wasn't sequenced.
+int Receive_Command_ACK(DCS_Device* pDevice, char* pDataBuf, unsigned __int32 DataLen, Sequence_ID sequence);
 
-//Processes BFI data and calls user-defined callback with the data.
-int Receive_BFI_Data(char* pDataBuf);
+//Processes BFI data and calls user-defined callback with the data, stamped with the Clock_Now_Ns time [timestamp] it was received.
+int Receive_BFI_Data(DCS_Device* pDevice, char* pDataBuf, unsigned __int32 DataLen, unsigned __int64 timestamp);
 
 //Processes command that alerts client program that the BFI data is ready.
-int Receive_BFI_Corr_Ready(char* pDataBuf);
+int Receive_BFI_Corr_Ready(DCS_Device* pDevice, char* pDataBuf, unsigned __int32 DataLen);
+
+//Processes correlation intensity data in place and calls user-defined callbacks with the data.
+//Copies of the data are only made if a callback or the store needs them. Stamped with the receive time as with Receive_BFI_Data.
+int Receive_Corr_Intensity_Data(DCS_Device* pDevice, char* pDataBuf, unsigned __int32 DataLen, unsigned __int64 timestamp);
 
-//Processes correlation intensity data and calls user-defined callback with the data.
-int Receive_Corr_Intensity_Data(char* pDataBuf);
+//Processes intensity data and calls user-defined callback with the data, stamped with the receive time as with Receive_BFI_Data.
+int Receive_Intensity_Data(DCS_Device* pDevice, char* pDataBuf, unsigned __int32 DataLen, unsigned __int64 timestamp);
 
-//Processes intensity data and calls user-defined callback with the data.
-int Receive_Intensity_Data(char* pDataBuf);
+//Size of the data of a [data_id] frame of a measurement of [Cha_Num] channels whose correlation buffers hold [Correlation_Length]
+//values. Returns 0 for data that isn't streamed or whose size isn't known.
+unsigned __int32 Stream_Frame_Size(Data_ID data_id, unsigned __int32 Cha_Num, unsigned __int32 Correlation_Length);
 
 //Sends command to check network connection.
-int Send_Check_Network(void);
+int Send_Check_Network(DCS_Device* pDevice);
 
 //This function generates the frame to be sent to the remote DCS. 
-int Send_DCS_Command(Data_ID data_ID, char* pDataBuf, const unsigned __int32 BufferSize);
+//[pRequest] is resolved once the DCS answers the command, as with every Send_ function, and can be NULL.
+int Send_DCS_Command(DCS_Device* pDevice, Data_ID data_ID, const char* pDataBuf, const unsigned __int32 BufferSize, DCS_Request* pRequest);
+
+//Frees the scratch buffers the receive functions keep for [pDevice] between frames.
+void Release_Decode_Buffers(DCS_Device* pDevice);
 
-//Computes a checksum from a given DCS frame.
-unsigned __int8 compute_checksum(char* pDataBuf, unsigned __int32 size);
+//Bytes needed to lay out a Corr_Intensity_Matrix of [Cha_Num] channels of [Data_Num] values and [Delay_Num] delays,
+//including the struct itself and room to align its arrays wherever the block starts.
+size_t Corr_Intensity_Matrix_Size(int Cha_Num, int Data_Num, int Delay_Num);
 
-//Checks given checksum from a full DCS frame.
-//Returns true if checksum is valid. False otherwise.
-bool check_checksum(char* pDataBuf, unsigned __int32 size);
+//Sets up a Corr_Intensity_Matrix at the start of [pBlock], of Corr_Intensity_Matrix_Size bytes, with its arrays aligned
+//after it in the block. Returns the matrix, whose arrays are left for the caller to fill.
+Corr_Intensity_Matrix* Layout_Corr_Intensity_Matrix(void* pBlock, int Cha_Num, int Data_Num, int Delay_Num);
 
 //Prints out data at addr in hex format only in debug build. NOP in release.
 void hexDump(const char* desc, const void* addr, const unsigned __int32 len);
\ No newline at end of file
@@ -0,0 +1,639 @@
+#define _CRTDBG_MAP_ALLOC
+#include <stdlib.h>
+#include <limits.h>
+
+#include "Platform.h"
+
+#if defined(_WIN32)
+#include <process.h>
+#include <timeapi.h>
+
+#pragma comment (lib, "Ws2_32.lib")
+#pragma comment (lib, "Winmm.lib")
+#else
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/random.h>
+#include <linux/errqueue.h>
+#include <linux/net_tstamp.h>
+#endif
+
+struct Thread {
+#if defined(_WIN32)
+	HANDLE handle;
+#else
+	pthread_t thread;
+#endif
+	void (*function)(void* arg); //Function run by the thread
+	void* arg; //Argument given to [function]
+};
+
+//Socket watched by a poller.
+typedef struct {
+	SOCKET socket;
+	void* pUser; //Handed back by Poller_Next
+#if defined(_WIN32)
+	WSAEVENT hEvent; //Event Winsock signals when the socket has activity
+#endif
+} Poller_Entry;
+
+struct Poller {
+#if defined(_WIN32)
+	HANDLE hStopEvent; //Manual-reset event set once the poller is stopped
+	HANDLE hWakeEvent; //Auto-reset event set by Poller_Wake
+#else
+	int epoll_fd; //Epoll instance watching the sockets and [wake_fd]
+	int wake_fd; //Eventfd written by Poller_Wake and Poller_Stop
+	volatile bool stopped; //Set once the poller is stopped
+#endif
+	Poller_Entry entries[POLLER_MAX_SOCKETS]; //Sockets being watched, in no particular order
+	unsigned int count; //Number of entries in use
+	void* ready[POLLER_MAX_SOCKETS]; //pUser of each socket the last wait found activity on
+	unsigned int ready_count; //Number of entries in [ready]
+	unsigned int ready_next; //Index in [ready] Poller_Next hands out next
+};
+
+#if !defined(_WIN32)
+int rand_s(unsigned int* pValue) {
+	if (getrandom(pValue, sizeof(*pValue), 0) != sizeof(*pValue)) {
+		return errno;
+	}
+	return 0;
+}
+#endif
+
+int Socket_Send(SOCKET socket, Send_Buffer* pBuffers, unsigned __int32 count) {
+#if defined(_WIN32)
+	DWORD bytes_sent = 0;
+	if (WSASend(socket, pBuffers, count, &bytes_sent, 0, NULL, NULL) == SOCKET_ERROR) {
+		return SOCKET_ERROR;
+	}
+	return (int)bytes_sent;
+#else
+	struct msghdr message = {
+		.msg_iov = pBuffers,
+		.msg_iovlen = count,
+	};
+	//Without MSG_NOSIGNAL, writing to a connection the peer closed would end the process with SIGPIPE.
+	return (int)sendmsg(socket, &message, MSG_NOSIGNAL);
+#endif
+}
+
+int Socket_Recv(SOCKET socket, char* pBuffer, int size, unsigned __int64* pTimestamp) {
+#if defined(_WIN32)
+	const int received = recv(socket, pBuffer, size, 0);
+	*pTimestamp = Clock_Now_Ns();
+	return received;
+#else
+	struct iovec vector = {
+		.iov_base = pBuffer,
+		.iov_len = (size_t)size,
+	};
+	union {
+		char buffer[CMSG_SPACE(sizeof(struct scm_timestamping))];
+		struct cmsghdr align;
+	} control;
+	struct msghdr message = {
+		.msg_iov = &vector,
+		.msg_iovlen = 1,
+		.msg_control = control.buffer,
+		.msg_controllen = sizeof(control.buffer),
+	};
+	const int received = (int)recvmsg(socket, &message, 0);
+	const unsigned __int64 now = Clock_Now_Ns();
+	*pTimestamp = now;
+	if (received <= 0) {
+		return received;
+	}
+
+	//The kernel's timestamp is on the realtime clock, so it's moved onto Clock_Now_Ns by how long ago it was taken.
+	for (struct cmsghdr* pHeader = CMSG_FIRSTHDR(&message); pHeader != NULL; pHeader = CMSG_NXTHDR(&message, pHeader)) {
+		if (pHeader->cmsg_level != SOL_SOCKET || pHeader->cmsg_type != SCM_TIMESTAMPING) {
+			continue;
+		}
+
+		struct scm_timestamping stamps;
+		memcpy(&stamps, CMSG_DATA(pHeader), sizeof(stamps));
+		const unsigned __int64 stamp = (unsigned __int64)stamps.ts[0].tv_sec * 1000000000 + (unsigned __int64)stamps.ts[0].tv_nsec;
+
+		struct timespec realtime;
+		clock_gettime(CLOCK_REALTIME, &realtime);
+		const unsigned __int64 realtime_now = (unsigned __int64)realtime.tv_sec * 1000000000 + (unsigned __int64)realtime.tv_nsec;
+		if (stamp != 0 && stamp <= realtime_now && realtime_now - stamp < now) {
+			*pTimestamp = now - (realtime_now - stamp);
+		}
+		break;
+	}
+	return received;
+#endif
+}
+
+int Socket_Enable_Timestamps(SOCKET socket) {
+#if defined(_WIN32)
+	//SIO_TIMESTAMPING only timestamps datagrams.
+	return SOCKET_ERROR;
+#else
+	const int flags = SOF_TIMESTAMPING_RX_SOFTWARE | SOF_TIMESTAMPING_SOFTWARE;
+	if (setsockopt(socket, SOL_SOCKET, SO_TIMESTAMPING, &flags, sizeof(flags)) == -1) {
+		return SOCKET_ERROR;
+	}
+	return NO_ERROR;
+#endif
+}
+
+int Socket_Set_Nonblocking(SOCKET socket) {
+#if defined(_WIN32)
+	u_long iMode = 1;
+	return ioctlsocket(socket, FIONBIO, &iMode);
+#else
+	const int flags = fcntl(socket, F_GETFL, 0);
+	if (flags == -1 || fcntl(socket, F_SETFL, flags | O_NONBLOCK) == -1) {
+		return SOCKET_ERROR;
+	}
+	return NO_ERROR;
+#endif
+}
+
+int Socket_Connect(SOCKET socket, const struct sockaddr* pAddress, int length) {
+#if defined(_WIN32)
+	if (connect(socket, pAddress, length) == 0 || WSAGetLastError() == WSAEWOULDBLOCK) {
+		return NO_ERROR;
+	}
+#else
+	if (connect(socket, pAddress, (socklen_t)length) == 0 || errno == EINPROGRESS) {
+		return NO_ERROR;
+	}
+#endif
+	return SOCKET_ERROR;
+}
+
+int Socket_Connect_Result(SOCKET socket) {
+#if defined(_WIN32)
+	//A failed connection shows up in the exception set rather than the write set.
+	fd_set writable;
+	fd_set failed;
+	FD_ZERO(&writable);
+	FD_ZERO(&failed);
+	FD_SET(socket, &writable);
+	FD_SET(socket, &failed);
+	const struct timeval no_wait = { 0, 0 };
+	if (select(0, NULL, &writable, &failed, &no_wait) == SOCKET_ERROR) {
+		return WSAGetLastError();
+	}
+	if (FD_ISSET(socket, &failed)) {
+		int error = 0;
+		int length = sizeof(error);
+		getsockopt(socket, SOL_SOCKET, SO_ERROR, (char*)&error, &length);
+		return error != 0 ? error : WSAECONNREFUSED;
+	}
+	return FD_ISSET(socket, &writable) ? NO_ERROR : WSAEWOULDBLOCK;
+#else
+	struct pollfd entry = {
+		.fd = socket,
+		.events = POLLOUT,
+	};
+	if (poll(&entry, 1, 0) == -1) {
+		return errno;
+	}
+	if (entry.revents == 0) {
+		return WSAEWOULDBLOCK;
+	}
+
+	int error = 0;
+	socklen_t length = sizeof(error);
+	if (getsockopt(socket, SOL_SOCKET, SO_ERROR, &error, &length) == -1) {
+		return errno;
+	}
+	if (error == 0 && (entry.revents & (POLLERR | POLLHUP)) != 0) {
+		return ECONNREFUSED;
+	}
+	return error;
+#endif
+}
+
+Mutex* Mutex_Create(void) {
+#if defined(_WIN32)
+	//A critical section only enters the kernel when another thread holds it, unlike a mutex object.
+	CRITICAL_SECTION* pSection = malloc(sizeof(*pSection));
+	if (pSection == NULL) {
+		return NULL;
+	}
+	InitializeCriticalSection(pSection);
+	return (Mutex*)pSection;
+#else
+	pthread_mutex_t* pMutex = malloc(sizeof(*pMutex));
+	if (pMutex == NULL) {
+		return NULL;
+	}
+	if (pthread_mutex_init(pMutex, NULL) != 0) {
+		free(pMutex);
+		return NULL;
+	}
+	return (Mutex*)pMutex;
+#endif
+}
+
+void Mutex_Destroy(Mutex* pMutex) {
+#if defined(_WIN32)
+	DeleteCriticalSection((CRITICAL_SECTION*)pMutex);
+#else
+	pthread_mutex_destroy((pthread_mutex_t*)pMutex);
+#endif
+	free(pMutex);
+}
+
+void Mutex_Lock(Mutex* pMutex) {
+#if defined(_WIN32)
+	EnterCriticalSection((CRITICAL_SECTION*)pMutex);
+#else
+	pthread_mutex_lock((pthread_mutex_t*)pMutex);
+#endif
+}
+
+void Mutex_Unlock(Mutex* pMutex) {
+#if defined(_WIN32)
+	LeaveCriticalSection((CRITICAL_SECTION*)pMutex);
+#else
+	pthread_mutex_unlock((pthread_mutex_t*)pMutex);
+#endif
+}
+
+Cond* Cond_Create(void) {
+#if defined(_WIN32)
+	CONDITION_VARIABLE* pCond = malloc(sizeof(*pCond));
+	if (pCond == NULL) {
+		return NULL;
+	}
+	InitializeConditionVariable(pCond);
+	return (Cond*)pCond;
+#else
+	pthread_cond_t* pCond = malloc(sizeof(*pCond));
+	if (pCond == NULL) {
+		return NULL;
+	}
+	//Timed waits are measured on the same clock as Clock_Now, so changes to the system time don't affect them.
+	pthread_condattr_t attr;
+	if (pthread_condattr_init(&attr) != 0) {
+		free(pCond);
+		return NULL;
+	}
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	const int result = pthread_cond_init(pCond, &attr);
+	pthread_condattr_destroy(&attr);
+	if (result != 0) {
+		free(pCond);
+		return NULL;
+	}
+	return (Cond*)pCond;
+#endif
+}
+
+void Cond_Destroy(Cond* pCond) {
+#if !defined(_WIN32)
+	pthread_cond_destroy((pthread_cond_t*)pCond);
+#endif
+	free(pCond);
+}
+
+void Cond_Wait(Cond* pCond, Mutex* pMutex) {
+#if defined(_WIN32)
+	SleepConditionVariableCS((CONDITION_VARIABLE*)pCond, (CRITICAL_SECTION*)pMutex, INFINITE);
+#else
+	pthread_cond_wait((pthread_cond_t*)pCond, (pthread_mutex_t*)pMutex);
+#endif
+}
+
+bool Cond_Wait_Timeout(Cond* pCond, Mutex* pMutex, unsigned __int32 timeout) {
+#if defined(_WIN32)
+	return SleepConditionVariableCS((CONDITION_VARIABLE*)pCond, (CRITICAL_SECTION*)pMutex, timeout) != 0;
+#else
+	if (timeout == INFINITE) {
+		return pthread_cond_wait((pthread_cond_t*)pCond, (pthread_mutex_t*)pMutex) == 0;
+	}
+
+	struct timespec deadline;
+	clock_gettime(CLOCK_MONOTONIC, &deadline);
+	deadline.tv_sec += timeout / 1000;
+	deadline.tv_nsec += (long)(timeout % 1000) * 1000000;
+	if (deadline.tv_nsec >= 1000000000) {
+		deadline.tv_sec++;
+		deadline.tv_nsec -= 1000000000;
+	}
+	return pthread_cond_timedwait((pthread_cond_t*)pCond, (pthread_mutex_t*)pMutex, &deadline) == 0;
+#endif
+}
+
+void Cond_Wake_All(Cond* pCond) {
+#if defined(_WIN32)
+	WakeAllConditionVariable((CONDITION_VARIABLE*)pCond);
+#else
+	pthread_cond_broadcast((pthread_cond_t*)pCond);
+#endif
+}
+
+#if defined(_WIN32)
+static unsigned __stdcall run_thread(void* thread_ptr) {
+	Thread* pThread = thread_ptr;
+	pThread->function(pThread->arg);
+	return 0;
+}
+#else
+static void* run_thread(void* thread_ptr) {
+	Thread* pThread = thread_ptr;
+	pThread->function(pThread->arg);
+	return NULL;
+}
+#endif
+
+Thread* Thread_Start(void (*function)(void* arg), void* arg) {
+	Thread* pThread = malloc(sizeof(*pThread));
+	if (pThread == NULL) {
+		return NULL;
+	}
+	pThread->function = function;
+	pThread->arg = arg;
+
+#if defined(_WIN32)
+	//_beginthreadex rather than _beginthread so the handle stays valid until it's joined.
+	pThread->handle = (HANDLE)_beginthreadex(NULL, 0, run_thread, pThread, 0, NULL);
+	if (pThread->handle == NULL) {
+		free(pThread);
+		return NULL;
+	}
+#else
+	if (pthread_create(&pThread->thread, NULL, run_thread, pThread) != 0) {
+		free(pThread);
+		return NULL;
+	}
+#endif
+
+	return pThread;
+}
+
+void Thread_Join(Thread* pThread) {
+#if defined(_WIN32)
+	WaitForSingleObject(pThread->handle, INFINITE);
+	CloseHandle(pThread->handle);
+#else
+	pthread_join(pThread->thread, NULL);
+#endif
+	free(pThread);
+}
+
+bool Thread_Is_Current(const Thread* pThread) {
+#if defined(_WIN32)
+	return GetThreadId(pThread->handle) == GetCurrentThreadId();
+#else
+	return pthread_equal(pThread->thread, pthread_self()) != 0;
+#endif
+}
+
+clock_t Clock_Now(void) {
+#if defined(_WIN32)
+	//The MSVC runtime's clock already counts elapsed time.
+	return clock();
+#else
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (clock_t)now.tv_sec * CLOCKS_PER_SEC + (clock_t)(now.tv_nsec / (1000000000 / CLOCKS_PER_SEC));
+#endif
+}
+
+unsigned __int64 Clock_Now_Ns(void) {
+#if defined(_WIN32)
+	LARGE_INTEGER counter;
+	LARGE_INTEGER frequency;
+	QueryPerformanceCounter(&counter);
+	QueryPerformanceFrequency(&frequency);
+	//Split so the multiplication can't overflow however long the system has been up.
+	const unsigned __int64 seconds = (unsigned __int64)(counter.QuadPart / frequency.QuadPart);
+	const unsigned __int64 remainder = (unsigned __int64)(counter.QuadPart % frequency.QuadPart);
+	return seconds * 1000000000 + remainder * 1000000000 / (unsigned __int64)frequency.QuadPart;
+#else
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (unsigned __int64)now.tv_sec * 1000000000 + (unsigned __int64)now.tv_nsec;
+#endif
+}
+
+Poller* Poller_Create(void) {
+	Poller* pPoller = malloc(sizeof(*pPoller));
+	if (pPoller == NULL) {
+		return NULL;
+	}
+	pPoller->count = 0;
+	pPoller->ready_count = 0;
+	pPoller->ready_next = 0;
+
+#if defined(_WIN32)
+	pPoller->hStopEvent = CreateEventW(NULL, true, false, NULL);
+	pPoller->hWakeEvent = CreateEventW(NULL, false, true, NULL);
+	if (pPoller->hStopEvent == NULL || pPoller->hWakeEvent == NULL) {
+		if (pPoller->hStopEvent != NULL) {
+			CloseHandle(pPoller->hStopEvent);
+		}
+		if (pPoller->hWakeEvent != NULL) {
+			CloseHandle(pPoller->hWakeEvent);
+		}
+		free(pPoller);
+		return NULL;
+	}
+
+	//Timed waits are only as precise as the system timer, which otherwise ticks every 15.6 ms.
+	timeBeginPeriod(1);
+#else
+	pPoller->stopped = false;
+	pPoller->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+	//Starts at 1 so the first wait returns straight away.
+	pPoller->wake_fd = eventfd(1, EFD_NONBLOCK | EFD_CLOEXEC);
+
+	//The poller itself stands for the eventfd, since sockets are identified by the pointer they were added with.
+	struct epoll_event event = {
+		.events = EPOLLIN | EPOLLET,
+		.data.ptr = pPoller,
+	};
+	if (pPoller->epoll_fd == -1 || pPoller->wake_fd == -1 ||
+		epoll_ctl(pPoller->epoll_fd, EPOLL_CTL_ADD, pPoller->wake_fd, &event) == -1) {
+		if (pPoller->epoll_fd != -1) {
+			close(pPoller->epoll_fd);
+		}
+		if (pPoller->wake_fd != -1) {
+			close(pPoller->wake_fd);
+		}
+		free(pPoller);
+		return NULL;
+	}
+#endif
+
+	return pPoller;
+}
+
+void Poller_Destroy(Poller* pPoller) {
+#if defined(_WIN32)
+	for (unsigned int x = 0; x < pPoller->count; x++) {
+		WSACloseEvent(pPoller->entries[x].hEvent);
+	}
+	CloseHandle(pPoller->hStopEvent);
+	CloseHandle(pPoller->hWakeEvent);
+	timeEndPeriod(1);
+#else
+	close(pPoller->epoll_fd);
+	close(pPoller->wake_fd);
+#endif
+	free(pPoller);
+}
+
+int Poller_Watch(Poller* pPoller, SOCKET socket, int events) {
+	//The old sockets may already be closed, in which case they're no longer being watched anyway.
+	while (pPoller->count > 0) {
+		Poller_Remove(pPoller, pPoller->entries[pPoller->count - 1].socket);
+	}
+
+	return Poller_Add(pPoller, socket, events, NULL);
+}
+
+int Poller_Add(Poller* pPoller, SOCKET socket, int events, void* pUser) {
+	if (pPoller->count >= POLLER_MAX_SOCKETS) {
+		return SOCKET_ERROR;
+	}
+	Poller_Entry* pEntry = &pPoller->entries[pPoller->count];
+
+#if defined(_WIN32)
+	pEntry->hEvent = WSACreateEvent();
+	if (pEntry->hEvent == WSA_INVALID_EVENT) {
+		return SOCKET_ERROR;
+	}
+
+	//FD_WRITE is only signalled once the socket has room again after a send would have blocked. A connection being made
+	//signals FD_WRITE once it's made and only FD_CONNECT if it fails.
+	const long network_events = events == POLLER_ACCEPT ? FD_ACCEPT : FD_READ | FD_WRITE | FD_CLOSE | FD_CONNECT;
+	if (WSAEventSelect(socket, pEntry->hEvent, network_events) == SOCKET_ERROR) {
+		WSACloseEvent(pEntry->hEvent);
+		return SOCKET_ERROR;
+	}
+#else
+	//EPOLLOUT is only reported again once the socket has room after a send would have blocked.
+	struct epoll_event event = {
+		.events = EPOLLET | (events == POLLER_ACCEPT ? EPOLLIN : EPOLLIN | EPOLLOUT | EPOLLRDHUP),
+		.data.ptr = pUser,
+	};
+	if (epoll_ctl(pPoller->epoll_fd, EPOLL_CTL_ADD, socket, &event) == -1) {
+		return SOCKET_ERROR;
+	}
+#endif
+
+	pEntry->socket = socket;
+	pEntry->pUser = pUser;
+	pPoller->count++;
+	return NO_ERROR;
+}
+
+void Poller_Remove(Poller* pPoller, SOCKET socket) {
+	for (unsigned int x = 0; x < pPoller->count; x++) {
+		Poller_Entry* pEntry = &pPoller->entries[x];
+		if (pEntry->socket != socket) {
+			continue;
+		}
+
+#if defined(_WIN32)
+		WSAEventSelect(socket, NULL, 0);
+		WSACloseEvent(pEntry->hEvent);
+#else
+		epoll_ctl(pPoller->epoll_fd, EPOLL_CTL_DEL, socket, NULL);
+#endif
+
+		//Activity found on the socket that hasn't been taken yet is no longer reported.
+		for (unsigned int y = pPoller->ready_next; y < pPoller->ready_count; y++) {
+			if (pPoller->ready[y] == pEntry->pUser) {
+				pPoller->ready[y] = pPoller->ready[--pPoller->ready_count];
+				break;
+			}
+		}
+
+		*pEntry = pPoller->entries[--pPoller->count];
+		return;
+	}
+}
+
+void Poller_Wake(Poller* pPoller) {
+#if defined(_WIN32)
+	SetEvent(pPoller->hWakeEvent);
+#else
+	const uint64_t one = 1;
+	//Only fails if the counter is about to overflow, in which case a wake-up is already pending.
+	(void)!write(pPoller->wake_fd, &one, sizeof(one));
+#endif
+}
+
+void Poller_Stop(Poller* pPoller) {
+#if defined(_WIN32)
+	SetEvent(pPoller->hStopEvent);
+#else
+	__atomic_store_n(&pPoller->stopped, true, __ATOMIC_RELEASE);
+	Poller_Wake(pPoller);
+#endif
+}
+
+bool Poller_Wait(Poller* pPoller, unsigned __int32 timeout) {
+	pPoller->ready_count = 0;
+	pPoller->ready_next = 0;
+
+#if defined(_WIN32)
+	HANDLE handles[2 + POLLER_MAX_SOCKETS] = { pPoller->hStopEvent, pPoller->hWakeEvent };
+	for (unsigned int x = 0; x < pPoller->count; x++) {
+		handles[2 + x] = pPoller->entries[x].hEvent;
+	}
+
+	DWORD waitResult = WaitForMultipleObjects(2 + pPoller->count, handles, false, timeout);
+	if (waitResult == WAIT_OBJECT_0) {
+		return false;
+	}
+
+	//Only the first event set is reported, so every socket from there on is checked. Checking also resets its event.
+	//Each pass reads until the socket would block, so nothing that set it is missed.
+	if (waitResult >= WAIT_OBJECT_0 + 2 && waitResult < WAIT_OBJECT_0 + 2 + pPoller->count) {
+		for (unsigned int x = waitResult - WAIT_OBJECT_0 - 2; x < pPoller->count; x++) {
+			WSANETWORKEVENTS events;
+			if (WSAEnumNetworkEvents(pPoller->entries[x].socket, pPoller->entries[x].hEvent, &events) == 0 && events.lNetworkEvents != 0) {
+				pPoller->ready[pPoller->ready_count++] = pPoller->entries[x].pUser;
+			}
+		}
+	}
+
+	return true;
+#else
+	if (__atomic_load_n(&pPoller->stopped, __ATOMIC_ACQUIRE)) {
+		return false;
+	}
+
+	const int timeout_ms = timeout == INFINITE ? -1 : timeout > INT_MAX ? INT_MAX : (int)timeout;
+
+	//Edge-triggered, so each event is reported once and there's no level to reset on the socket.
+	struct epoll_event events[POLLER_MAX_SOCKETS + 1];
+	const int count = epoll_wait(pPoller->epoll_fd, events, sizeof(events) / sizeof(events[0]), timeout_ms);
+	for (int x = 0; x < count; x++) {
+		if (events[x].data.ptr == pPoller) {
+			uint64_t value;
+			(void)!read(pPoller->wake_fd, &value, sizeof(value));
+		}
+		else {
+			pPoller->ready[pPoller->ready_count++] = events[x].data.ptr;
+		}
+	}
+
+	return !__atomic_load_n(&pPoller->stopped, __ATOMIC_ACQUIRE);
+#endif
+}
+
+bool Poller_Next(Poller* pPoller, void** ppUser) {
+	if (pPoller->ready_next >= pPoller->ready_count) {
+		return false;
+	}
+
+	*ppUser = pPoller->ready[pPoller->ready_next++];
+	return true;
+}
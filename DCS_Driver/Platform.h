@@ -0,0 +1,297 @@
+#pragma once
+#include <stdbool.h>
+#include <time.h>
+
+//Everything that differs between the Windows and Linux builds.
+//Windows uses WinSock, Win32 threads, critical sections and WSAEventSelect. Linux uses BSD sockets, pthreads and
+//edge-triggered epoll with an eventfd for wake-ups. The rest of the code only uses what's declared here.
+
+#if defined(_WIN32)
+#include <crtdbg.h>
+#include <WinSock2.h>
+#include <ws2tcpip.h>
+#else
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <netdb.h>
+
+//MSVC keywords. Libraries are built with -fvisibility=hidden so, as with a DLL, only what's marked
+//dllexport can be seen from outside and the library's own calls can't be bound to a program's functions.
+#define __int8 char
+#define __int16 short
+#define __int32 int
+#define __int64 long long
+#define __declspec(attribute) __declspec_##attribute
+#define __declspec_dllexport __attribute__((visibility("default")))
+#define __declspec_dllimport
+
+//The debug heap only exists in the MSVC runtime.
+#define _CrtSetDbgFlag(flags) ((void)0)
+#define _CRTDBG_ALLOC_MEM_DF 0
+#define _CRTDBG_LEAK_CHECK_DF 0
+
+//BSD sockets under their WinSock names. There's nothing to start up or clean up.
+typedef int SOCKET;
+typedef int WSADATA;
+#define INVALID_SOCKET (-1)
+#define SOCKET_ERROR (-1)
+#define NO_ERROR 0
+#define WSAEWOULDBLOCK EWOULDBLOCK
+#define WSAStartup(version, pData) ((void)(pData), 0)
+#define WSACleanup() ((void)0)
+#define WSAGetLastError() errno
+#define WSASetLastError(error) ((void)(errno = (error)))
+#define closesocket close
+
+//The CRT's bounds-checked string and random number functions.
+#define _TRUNCATE ((size_t)-1)
+#define _snprintf_s(buffer, size, count, ...) snprintf(buffer, size, __VA_ARGS__)
+
+static inline int strcat_s(char* dest, size_t size, const char* src) {
+	const size_t length = strnlen(dest, size);
+	if (length == size) {
+		return EINVAL;
+	}
+	snprintf(&dest[length], size - length, "%s", src);
+	return 0;
+}
+
+//Fills [*pValue] from the kernel's random number generator. Returns 0 on success.
+int rand_s(unsigned int* pValue);
+
+#define ZeroMemory(pDest, size) memset(pDest, 0, size)
+
+//Timeout that never expires.
+#define INFINITE 0xFFFFFFFF
+
+//Suspends the calling thread for [milliseconds], or for good if it's INFINITE.
+static inline void Sleep(unsigned __int32 milliseconds) {
+	if (milliseconds == INFINITE) {
+		for (;;) {
+			pause();
+		}
+	}
+
+	struct timespec remaining = {
+		.tv_sec = milliseconds / 1000,
+		.tv_nsec = (long)(milliseconds % 1000) * 1000000,
+	};
+	//Carry on sleeping after being interrupted by a signal.
+	while (nanosleep(&remaining, &remaining) != 0 && errno == EINTR);
+}
+#endif
+
+//Sockets//
+
+//Buffer given to Socket_Send.
+#if defined(_WIN32)
+typedef WSABUF Send_Buffer;
+#else
+typedef struct iovec Send_Buffer;
+#endif
+
+//Points [pBuffer] at [size] bytes from [pData].
+static inline void Send_Buffer_Set(Send_Buffer* pBuffer, const void* pData, unsigned __int32 size) {
+#if defined(_WIN32)
+	pBuffer->buf = (char*)pData;
+	pBuffer->len = size;
+#else
+	pBuffer->iov_base = (void*)pData;
+	pBuffer->iov_len = size;
+#endif
+}
+
+//Writes [count] buffers to [socket] in one call. Returns the number of bytes written, or SOCKET_ERROR
+//with the reason in WSAGetLastError. A closed connection is reported as an error rather than a signal.
+int Socket_Send(SOCKET socket, Send_Buffer* pBuffers, unsigned __int32 count);
+
+//Reads up to [size] bytes from [socket] into [pBuffer] like recv, and sets [*pTimestamp] to the Clock_Now_Ns time the last
+//of them was received. That's the time the kernel received them if Socket_Enable_Timestamps succeeded, or the time
+//the call returned otherwise. Returns the number of bytes read, 0 if the connection was closed, or SOCKET_ERROR with
+//the reason in WSAGetLastError.
+int Socket_Recv(SOCKET socket, char* pBuffer, int size, unsigned __int64* pTimestamp);
+
+//Has the kernel timestamp the data [socket] receives for Socket_Recv. Returns NO_ERROR if it will, which is only on Linux.
+int Socket_Enable_Timestamps(SOCKET socket);
+
+//Makes calls on [socket] return WSAEWOULDBLOCK rather than wait. Returns NO_ERROR on success.
+int Socket_Set_Nonblocking(SOCKET socket);
+
+//Starts connecting [socket], which must be non-blocking, to [pAddress]. Returns NO_ERROR if the connection was made or is
+//being made, in which case a poller watching the socket reports it once it's finished, or SOCKET_ERROR with the reason
+//in WSAGetLastError.
+int Socket_Connect(SOCKET socket, const struct sockaddr* pAddress, int length);
+
+//Returns NO_ERROR once a connection started by Socket_Connect has been made, WSAEWOULDBLOCK while it's still being made,
+//or the reason it failed.
+int Socket_Connect_Result(SOCKET socket);
+
+//Threads//
+
+typedef struct Mutex Mutex;
+
+//Creates an unlocked mutex. Returns NULL on failure.
+Mutex* Mutex_Create(void);
+//Frees a mutex that isn't locked.
+void Mutex_Destroy(Mutex* pMutex);
+void Mutex_Lock(Mutex* pMutex);
+void Mutex_Unlock(Mutex* pMutex);
+
+typedef struct Thread Thread;
+
+//Runs [function] with [arg] on a new thread. Returns NULL on failure.
+Thread* Thread_Start(void (*function)(void* arg), void* arg);
+//Waits for the thread to return and frees it.
+void Thread_Join(Thread* pThread);
+//Whether the calling thread is [pThread].
+bool Thread_Is_Current(const Thread* pThread);
+
+typedef struct Cond Cond;
+
+//Creates a condition variable. Returns NULL on failure.
+Cond* Cond_Create(void);
+//Frees a condition variable no thread is waiting on.
+void Cond_Destroy(Cond* pCond);
+//Unlocks [pMutex], waits for the condition variable to be woken and locks [pMutex] again.
+//Can also return without being woken, so the caller must check what it's waiting for again.
+void Cond_Wait(Cond* pCond, Mutex* pMutex);
+//Same as Cond_Wait, but gives up after [timeout] milliseconds. A [timeout] of INFINITE never expires.
+//Returns false if it gave up, so the caller can stop waiting once its own deadline has passed.
+bool Cond_Wait_Timeout(Cond* pCond, Mutex* pMutex, unsigned __int32 timeout);
+//Wakes every thread waiting on the condition variable.
+void Cond_Wake_All(Cond* pCond);
+
+//Adds one to [*pValue] as a single atomic operation and returns the result.
+static inline unsigned __int32 Atomic_Increment(volatile unsigned __int32* pValue) {
+#if defined(_WIN32)
+	return (unsigned __int32)InterlockedIncrement((volatile LONG*)pValue);
+#else
+	return __atomic_add_fetch(pValue, 1, __ATOMIC_SEQ_CST);
+#endif
+}
+
+//Subtracts one from [*pValue] as a single atomic operation and returns the result.
+static inline unsigned __int32 Atomic_Decrement(volatile unsigned __int32* pValue) {
+#if defined(_WIN32)
+	return (unsigned __int32)InterlockedDecrement((volatile LONG*)pValue);
+#else
+	return __atomic_sub_fetch(pValue, 1, __ATOMIC_SEQ_CST);
+#endif
+}
+
+//Reads [*pValue] so that later reads and writes can't be moved before it.
+static inline unsigned __int32 Atomic_Load_Acquire(const volatile unsigned __int32* pValue) {
+#if defined(_WIN32)
+	return (unsigned __int32)ReadAcquire((const volatile LONG*)pValue);
+#else
+	return __atomic_load_n(pValue, __ATOMIC_ACQUIRE);
+#endif
+}
+
+//Writes [value] to [*pValue] so that earlier reads and writes can't be moved after it.
+static inline void Atomic_Store_Release(volatile unsigned __int32* pValue, unsigned __int32 value) {
+#if defined(_WIN32)
+	WriteRelease((volatile LONG*)pValue, (LONG)value);
+#else
+	__atomic_store_n(pValue, value, __ATOMIC_RELEASE);
+#endif
+}
+
+//Sets [*pValue] to [value] as a single atomic operation and returns what it was before.
+static inline unsigned __int32 Atomic_Exchange(volatile unsigned __int32* pValue, unsigned __int32 value) {
+#if defined(_WIN32)
+	return (unsigned __int32)InterlockedExchange((volatile LONG*)pValue, (LONG)value);
+#else
+	return __atomic_exchange_n(pValue, value, __ATOMIC_SEQ_CST);
+#endif
+}
+
+//Sets [*pValue] to [desired] if it's still [expected], as a single atomic operation. Returns whether it was set.
+static inline bool Atomic_Compare_Exchange(volatile unsigned __int32* pValue, unsigned __int32 expected, unsigned __int32 desired) {
+#if defined(_WIN32)
+	return (unsigned __int32)InterlockedCompareExchange((volatile LONG*)pValue, (LONG)desired, (LONG)expected) == expected;
+#else
+	return __atomic_compare_exchange_n(pValue, &expected, desired, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+#endif
+}
+
+//Reads the pointer at [ppValue] so that later reads and writes can't be moved before it.
+static inline void* Atomic_Load_Pointer_Acquire(void* const volatile* ppValue) {
+#if defined(_WIN32)
+	return ReadPointerAcquire(ppValue);
+#else
+	return __atomic_load_n(ppValue, __ATOMIC_ACQUIRE);
+#endif
+}
+
+//Sets the pointer at [ppValue] to [pValue] as a single atomic operation and returns what it was before.
+static inline void* Atomic_Exchange_Pointer(void* volatile* ppValue, void* pValue) {
+#if defined(_WIN32)
+	return InterlockedExchangePointer(ppValue, pValue);
+#else
+	return __atomic_exchange_n(ppValue, pValue, __ATOMIC_SEQ_CST);
+#endif
+}
+
+//Time//
+
+//Current time in CLOCKS_PER_SEC units. Counts elapsed time rather than CPU time and never goes backwards.
+clock_t Clock_Now(void);
+//Current time in nanoseconds from an arbitrary starting point. Counts elapsed time and never goes backwards like
+//Clock_Now, but with the resolution deadlines of a few milliseconds need.
+unsigned __int64 Clock_Now_Ns(void);
+//Nanoseconds in a second and a millisecond of Clock_Now_Ns.
+#define CLOCK_NS_PER_SEC ((unsigned __int64)1000000000)
+#define CLOCK_NS_PER_MS ((unsigned __int64)1000000)
+
+//Poller//
+
+//Blocks a thread until one of the sockets it watches has something to do, another thread wakes it or it's told to stop.
+typedef struct Poller Poller;
+
+//Socket events a poller can watch for.
+#define POLLER_ACCEPT 0 //A connection can be accepted
+#define POLLER_READ_WRITE 1 //The socket can be read, has room to write again, was closed or finished connecting
+
+//Most sockets one poller can watch. WaitForMultipleObjects takes 64 handles, two of which are the stop and wake events.
+#define POLLER_MAX_SOCKETS 62
+
+//Creates a poller that isn't watching a socket yet. It starts woken so the first wait returns straight away.
+//Returns NULL on failure.
+Poller* Poller_Create(void);
+//Frees the poller. The sockets it was watching should already be closed.
+void Poller_Destroy(Poller* pPoller);
+
+//Watches [socket] for [events] instead of whichever sockets were watched before.
+//Events are edge-triggered: each wait only reports new activity, so the socket must be read until it would block.
+//Returns NO_ERROR on success.
+int Poller_Watch(Poller* pPoller, SOCKET socket, int events);
+
+//Watches [socket] for [events] as well as the sockets already watched. Poller_Next hands back [pUser] when it has activity.
+//Events are edge-triggered as with Poller_Watch. Returns NO_ERROR on success, or SOCKET_ERROR if it can't be watched
+//or POLLER_MAX_SOCKETS sockets already are.
+int Poller_Add(Poller* pPoller, SOCKET socket, int events, void* pUser);
+
+//Stops watching [socket]. Must be called before the socket is closed, since its number can be reused straight away.
+void Poller_Remove(Poller* pPoller, SOCKET socket);
+
+//Makes the current or next Poller_Wait return. Safe to call from any thread.
+void Poller_Wake(Poller* pPoller);
+
+//Makes the current and every later Poller_Wait return false. Safe to call from any thread.
+void Poller_Stop(Poller* pPoller);
+
+//Blocks until a watched socket has an event, the poller is woken or [timeout] milliseconds pass.
+//A [timeout] of INFINITE never expires. Returns false if Poller_Stop was called.
+bool Poller_Wait(Poller* pPoller, unsigned __int32 timeout);
+
+//Takes the next socket the last Poller_Wait found activity on and sets [*ppUser] to the pointer it was added with.
+//Returns false once every one has been taken. A socket with activity is reported by a later wait if not by this one.
+bool Poller_Next(Poller* pPoller, void** ppUser);
@@ -0,0 +1,71 @@
+#define _CRTDBG_MAP_ALLOC
+#include <stdlib.h>
+#include "Platform.h"
+
+#include "Queue.h"
+
+void Queue_Init(Queue* pQueue, Queue_Cell* pCells, unsigned __int32 capacity) {
+	pQueue->pCells = pCells;
+	pQueue->mask = capacity - 1;
+	for (unsigned __int32 x = 0; x < capacity; x++) {
+		pCells[x].sequence = x;
+		pCells[x].pItem = NULL;
+	}
+	pQueue->push_pos = 0;
+	pQueue->pop_pos = 0;
+}
+
+bool Queue_Push(Queue* pQueue, void* pItem) {
+	unsigned __int32 pos = Atomic_Load_Acquire(&pQueue->push_pos);
+	for (;;) {
+		Queue_Cell* pCell = &pQueue->pCells[pos & pQueue->mask];
+		const unsigned __int32 sequence = Atomic_Load_Acquire(&pCell->sequence);
+		const __int32 diff = (__int32)(sequence - pos);
+
+		if (diff == 0) {
+			//The cell is empty. Claim the position, unless another pusher got there first.
+			if (Atomic_Compare_Exchange(&pQueue->push_pos, pos, pos + 1)) {
+				pCell->pItem = pItem;
+				Atomic_Store_Release(&pCell->sequence, pos + 1);
+				return true;
+			}
+			pos = Atomic_Load_Acquire(&pQueue->push_pos);
+		}
+		else if (diff < 0) {
+			//The item pushed a lap ago hasn't been popped yet.
+			return false;
+		}
+		else {
+			//Another pusher has already taken this position.
+			pos = Atomic_Load_Acquire(&pQueue->push_pos);
+		}
+	}
+}
+
+void* Queue_Pop(Queue* pQueue) {
+	unsigned __int32 pos = Atomic_Load_Acquire(&pQueue->pop_pos);
+	for (;;) {
+		Queue_Cell* pCell = &pQueue->pCells[pos & pQueue->mask];
+		const unsigned __int32 sequence = Atomic_Load_Acquire(&pCell->sequence);
+		const __int32 diff = (__int32)(sequence - (pos + 1));
+
+		if (diff == 0) {
+			//The cell is full. Claim the position, unless another popper got there first.
+			if (Atomic_Compare_Exchange(&pQueue->pop_pos, pos, pos + 1)) {
+				void* pItem = pCell->pItem;
+				//Mark the cell empty for the push a lap from now.
+				Atomic_Store_Release(&pCell->sequence, pos + pQueue->mask + 1);
+				return pItem;
+			}
+			pos = Atomic_Load_Acquire(&pQueue->pop_pos);
+		}
+		else if (diff < 0) {
+			//Nothing has been pushed at this position yet.
+			return NULL;
+		}
+		else {
+			//Another popper has already taken this position.
+			pos = Atomic_Load_Acquire(&pQueue->pop_pos);
+		}
+	}
+}
@@ -0,0 +1,35 @@
+#pragma once
+#include <stdbool.h>
+#include "Platform.h"
+
+//Bounded lock-free queue of pointers. Any number of threads can push and pop at once without taking a lock,
+//so a full or empty queue is reported straight away rather than waited on.
+//Each cell carries a sequence number saying whose turn it is: a pusher claims a position by advancing
+//[push_pos] and fills the cell once its sequence shows it has been emptied, and a popper does the reverse.
+
+//Bytes the positions are spread over so pushers and poppers don't invalidate each other's cache lines.
+#define QUEUE_CACHE_LINE 64
+
+typedef struct {
+	volatile unsigned __int32 sequence; //Position the cell can next be pushed or popped at
+	void* pItem; //Item stored in the cell
+} Queue_Cell;
+
+typedef struct {
+	Queue_Cell* pCells; //Capacity cells, supplied by the owner
+	unsigned __int32 mask; //Capacity - 1
+	char pad1[QUEUE_CACHE_LINE];
+	volatile unsigned __int32 push_pos; //Position of the next push
+	char pad2[QUEUE_CACHE_LINE];
+	volatile unsigned __int32 pop_pos; //Position of the next pop
+	char pad3[QUEUE_CACHE_LINE];
+} Queue;
+
+//Sets up an empty queue using [pCells], which holds [capacity] cells. [capacity] must be a power of 2.
+void Queue_Init(Queue* pQueue, Queue_Cell* pCells, unsigned __int32 capacity);
+
+//Adds [pItem] to the back of the queue. Returns false if the queue is full.
+bool Queue_Push(Queue* pQueue, void* pItem);
+
+//Removes the item at the front of the queue. Returns NULL if the queue is empty.
+void* Queue_Pop(Queue* pQueue);
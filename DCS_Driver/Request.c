@@ -0,0 +1,503 @@
+#define _CRTDBG_MAP_ALLOC
+#include <stdlib.h>
+#include "Platform.h"
+#include <string.h>
+
+#include "Device.h"
+#include "Request.h"
+
+//Returns true if the DCS answers [command_code] with a reply of the same data ID after acknowledging it.
+static bool command_has_reply(Data_ID command_code);
+//Takes the request off its device's list if it's still there. Returns false if it was already taken, meaning
+//something else resolved it. Must be called with the device's hRequestMutex held.
+static bool unlist_Request(DCS_Device* pDevice, DCS_Request* pRequest);
+//Sets the status and response of a request that was just unlisted, wakes the threads waiting for it, calls its
+//callback and drops the list's reference to it. [pReply] is copied if it's given and [status] is NO_DCS_ERROR.
+static void resolve_Request(DCS_Request* pRequest, int status, Data_ID data_id, const DCS_Response* pReply);
+//Copies the data of [pReply] for a reply of [data_id] into the request's response, including what it points to.
+static int copy_Reply(DCS_Request* pRequest, Data_ID data_id, const DCS_Response* pReply);
+//Frees the request once its last reference is gone.
+static void free_Request(DCS_Request* pRequest);
+
+int DCS_Request_Wait(DCS_Request_Handle hRequest, unsigned __int32 timeout_ms, DCS_Response* pResponse) {
+	if (hRequest == NULL) {
+		return FRAME_INVALID_DATA;
+	}
+
+	const unsigned __int64 start = Clock_Now_Ns();
+
+	Mutex_Lock(hRequest->pMutex);
+	//The request resolves by its own deadline at the latest, as long as its device is open, so waiting forever is safe.
+	while (hRequest->response.status == REQUEST_PENDING && timeout_ms != 0) {
+		unsigned __int32 remaining = INFINITE;
+		if (timeout_ms != INFINITE) {
+			const unsigned __int64 waited = (Clock_Now_Ns() - start) / CLOCK_NS_PER_MS;
+			if (waited >= timeout_ms) {
+				break;
+			}
+			remaining = timeout_ms - (unsigned __int32)waited;
+		}
+		Cond_Wait_Timeout(hRequest->pCond, hRequest->pMutex, remaining);
+	}
+
+	const int status = hRequest->response.status;
+	if (pResponse != NULL) {
+		*pResponse = hRequest->response;
+	}
+	Mutex_Unlock(hRequest->pMutex);
+
+	return status;
+}
+
+int DCS_Request_Poll(DCS_Request_Handle hRequest, DCS_Response* pResponse) {
+	return DCS_Request_Wait(hRequest, 0, pResponse);
+}
+
+int DCS_Request_Free(DCS_Request_Handle hRequest) {
+	if (hRequest == NULL) {
+		return FRAME_INVALID_DATA;
+	}
+
+	Request_Release(hRequest);
+	return NO_DCS_ERROR;
+}
+
+int Request_Open(DCS_Device* pDevice) {
+	pDevice->hRequestMutex = Mutex_Create();
+	if (pDevice->hRequestMutex == NULL) {
+		return THREAD_START_ERROR;
+	}
+
+	pDevice->pRequests = NULL;
+	pDevice->requests_listed = 0;
+	memset(pDevice->reply_records, 0, sizeof(pDevice->reply_records));
+	pDevice->replies_expected = 0;
+	pDevice->requests_open = true;
+
+	return NO_DCS_ERROR;
+}
+
+void Request_Close(DCS_Device* pDevice) {
+	if (pDevice->hRequestMutex == NULL) {
+		return;
+	}
+
+	//Anything still tracked has already been failed, so all that's left is dropping the references.
+	Request_Fail_All(pDevice, NETWORK_NOT_READY);
+
+	Mutex_Destroy(pDevice->hRequestMutex);
+	pDevice->hRequestMutex = NULL;
+}
+
+int Request_Create(DCS_Device* pDevice, DCS_Request_Options options, DCS_Request** ppRequest) {
+	*ppRequest = NULL;
+	if (pDevice == NULL || pDevice->hRequestMutex == NULL) {
+		return NETWORK_NOT_READY;
+	}
+
+	DCS_Request* pRequest = calloc(1, sizeof(*pRequest));
+	if (pRequest == NULL) {
+		return MEMORY_ALLOCATION_ERROR;
+	}
+
+	pRequest->pMutex = Mutex_Create();
+	pRequest->pCond = Cond_Create();
+	if (pRequest->pMutex == NULL || pRequest->pCond == NULL) {
+		free_Request(pRequest);
+		return MEMORY_ALLOCATION_ERROR;
+	}
+
+	//One reference for the application and one for the device's list. The transmission takes its own.
+	pRequest->refs = 2;
+	pRequest->response.status = REQUEST_PENDING;
+	pRequest->callback = options.callback;
+	pRequest->pContext = options.pContext;
+
+	const unsigned __int32 timeout = options.timeout_ms != 0 ? options.timeout_ms : DCS_DEFAULT_REQUEST_TIMEOUT_MS;
+	pRequest->deadline = Clock_Now_Ns() + timeout * CLOCK_NS_PER_MS;
+
+	Mutex_Lock(pDevice->hRequestMutex);
+	if (!pDevice->requests_open) {
+		Mutex_Unlock(pDevice->hRequestMutex);
+		free_Request(pRequest);
+		return NETWORK_NOT_READY;
+	}
+	pRequest->listed = true;
+	pRequest->pNextItem = pDevice->pRequests;
+	pDevice->pRequests = pRequest;
+	Atomic_Increment(&pDevice->requests_listed);
+	Mutex_Unlock(pDevice->hRequestMutex);
+
+	*ppRequest = pRequest;
+	return NO_DCS_ERROR;
+}
+
+int Request_Submit(DCS_Device* pDevice, DCS_Request* pRequest, int send_result, DCS_Request_Handle* pHandle) {
+	if (send_result != NO_DCS_ERROR) {
+		//The transmission, if one was made, already dropped its reference when it was released.
+		Mutex_Lock(pDevice->hRequestMutex);
+		const bool listed = unlist_Request(pDevice, pRequest);
+		Mutex_Unlock(pDevice->hRequestMutex);
+
+		if (listed) {
+			Request_Release(pRequest);
+		}
+		Request_Release(pRequest);
+
+		if (pHandle != NULL) {
+			*pHandle = NULL;
+		}
+		return send_result;
+	}
+
+	if (pHandle != NULL) {
+		*pHandle = pRequest;
+	}
+	else {
+		Request_Release(pRequest);
+	}
+	return NO_DCS_ERROR;
+}
+
+void Request_Retain(DCS_Request* pRequest) {
+	if (pRequest == NULL) {
+		return;
+	}
+
+	Mutex_Lock(pRequest->pMutex);
+	pRequest->refs++;
+	Mutex_Unlock(pRequest->pMutex);
+}
+
+void Request_Release(DCS_Request* pRequest) {
+	if (pRequest == NULL) {
+		return;
+	}
+
+	Mutex_Lock(pRequest->pMutex);
+	const bool last = --pRequest->refs == 0;
+	Mutex_Unlock(pRequest->pMutex);
+
+	if (last) {
+		free_Request(pRequest);
+	}
+}
+
+void Request_Acknowledged(DCS_Device* pDevice, DCS_Request* pRequest, Data_ID command_code, Sequence_ID sequence) {
+	if (!command_has_reply(command_code)) {
+		if (pRequest != NULL) {
+			Mutex_Lock(pDevice->hRequestMutex);
+			const bool listed = unlist_Request(pDevice, pRequest);
+			Mutex_Unlock(pDevice->hRequestMutex);
+
+			if (listed) {
+				resolve_Request(pRequest, NO_DCS_ERROR, command_code, NULL);
+			}
+			Request_Release(pRequest);
+		}
+		return;
+	}
+
+	const unsigned __int64 currTime = Clock_Now_Ns();
+	Reply_Record* pRecord = NULL;
+	DCS_Request* pDropped = NULL;
+
+	Mutex_Lock(pDevice->hRequestMutex);
+	//Take a record that's free or was given up on, or the oldest one if they're all in use since its reply is the most likely to have been lost.
+	for (unsigned int x = 0; x < DCS_MAX_COMMAND_WINDOW; x++) {
+		Reply_Record* pCandidate = &pDevice->reply_records[x];
+		if (!pCandidate->pending || currTime >= pCandidate->deadline) {
+			pRecord = pCandidate;
+			break;
+		}
+		if (pRecord == NULL || pCandidate->order < pRecord->order) {
+			pRecord = pCandidate;
+		}
+	}
+	if (pRecord->pending) {
+		pDropped = pRecord->pRequest;
+	}
+
+	pRecord->pending = true;
+	pRecord->data_id = command_code;
+	pRecord->sequence = sequence;
+	pRecord->order = pDevice->replies_expected++;
+	pRecord->deadline = currTime + COMMAND_RESPONSE_TIMEOUT * CLOCK_NS_PER_SEC;
+	pRecord->pRequest = pRequest;
+	Mutex_Unlock(pDevice->hRequestMutex);
+
+	//A request whose record was taken still times out on its own deadline.
+	Request_Release(pDropped);
+}
+
+void Request_Reply(DCS_Device* pDevice, Data_ID data_id, Sequence_ID sequence, const DCS_Response* pReply) {
+	if (pDevice->hRequestMutex == NULL) {
+		return;
+	}
+
+	const unsigned __int64 currTime = Clock_Now_Ns();
+	DCS_Request* pRequest = NULL;
+	bool listed = false;
+
+	Mutex_Lock(pDevice->hRequestMutex);
+	Reply_Record* pMatch = NULL;
+	for (unsigned int x = 0; x < DCS_MAX_COMMAND_WINDOW; x++) {
+		Reply_Record* pRecord = &pDevice->reply_records[x];
+		if (!pRecord->pending || pRecord->data_id != data_id || currTime >= pRecord->deadline) {
+			continue;
+		}
+
+		//A sequenced reply names its command. Otherwise the oldest command of its type is the one answered.
+		if (sequence != 0) {
+			if (pRecord->sequence == sequence) {
+				pMatch = pRecord;
+				break;
+			}
+		}
+		else if (pMatch == NULL || pRecord->order < pMatch->order) {
+			pMatch = pRecord;
+		}
+	}
+
+	//Replies that don't match a record, like one that arrived after it was given up on, are only passed to the callbacks.
+	if (pMatch != NULL) {
+		pMatch->pending = false;
+		pRequest = pMatch->pRequest;
+		pMatch->pRequest = NULL;
+		if (pRequest != NULL) {
+			listed = unlist_Request(pDevice, pRequest);
+		}
+	}
+	Mutex_Unlock(pDevice->hRequestMutex);
+
+	if (listed) {
+		resolve_Request(pRequest, NO_DCS_ERROR, data_id, pReply);
+	}
+	Request_Release(pRequest);
+}
+
+void Request_Expire(DCS_Device* pDevice) {
+	//The requests may all have resolved since the timer was armed.
+	if (Atomic_Load_Acquire(&pDevice->requests_listed) == 0) {
+		return;
+	}
+
+	const unsigned __int64 currTime = Clock_Now_Ns();
+	DCS_Request* pExpired = NULL;
+
+	Mutex_Lock(pDevice->hRequestMutex);
+	DCS_Request** ppRequest = &pDevice->pRequests;
+	while (*ppRequest != NULL) {
+		DCS_Request* pRequest = *ppRequest;
+		if (currTime < pRequest->deadline) {
+			ppRequest = &pRequest->pNextItem;
+			continue;
+		}
+
+		*ppRequest = pRequest->pNextItem;
+		pRequest->listed = false;
+		Atomic_Store_Release(&pDevice->requests_listed, pDevice->requests_listed - 1);
+
+		pRequest->pNextItem = pExpired;
+		pExpired = pRequest;
+	}
+	Mutex_Unlock(pDevice->hRequestMutex);
+
+	//Callbacks are called without the lock, since they can make more requests.
+	while (pExpired != NULL) {
+		DCS_Request* pRequest = pExpired;
+		pExpired = pRequest->pNextItem;
+		resolve_Request(pRequest, REQUEST_TIMED_OUT, 0, NULL);
+	}
+}
+
+void Request_Next_Deadline(DCS_Device* pDevice, unsigned __int64* pNext) {
+	if (Atomic_Load_Acquire(&pDevice->requests_listed) == 0) {
+		return;
+	}
+
+	Mutex_Lock(pDevice->hRequestMutex);
+	for (DCS_Request* pRequest = pDevice->pRequests; pRequest != NULL; pRequest = pRequest->pNextItem) {
+		if (pRequest->deadline < *pNext) {
+			*pNext = pRequest->deadline;
+		}
+	}
+	Mutex_Unlock(pDevice->hRequestMutex);
+}
+
+unsigned int Request_Take_Replies(DCS_Device* pDevice, Reply_Record* pLost) {
+	const unsigned __int64 currTime = Clock_Now_Ns();
+	DCS_Request* pDropped[DCS_MAX_COMMAND_WINDOW];
+	unsigned int dropped = 0;
+	unsigned int lost = 0;
+
+	Mutex_Lock(pDevice->hRequestMutex);
+	for (unsigned int x = 0; x < DCS_MAX_COMMAND_WINDOW; x++) {
+		Reply_Record* pRecord = &pDevice->reply_records[x];
+		if (!pRecord->pending) {
+			continue;
+		}
+
+		//A reply already given up on isn't asked for again, and its request times out on its own deadline.
+		if (currTime >= pRecord->deadline) {
+			if (pRecord->pRequest != NULL) {
+				pDropped[dropped++] = pRecord->pRequest;
+			}
+		}
+		else {
+			//Kept in the order the replies were expected in.
+			unsigned int index = lost++;
+			while (index > 0 && pLost[index - 1].order > pRecord->order) {
+				pLost[index] = pLost[index - 1];
+				index--;
+			}
+			pLost[index] = *pRecord;
+		}
+
+		pRecord->pending = false;
+		pRecord->pRequest = NULL;
+	}
+	Mutex_Unlock(pDevice->hRequestMutex);
+
+	for (unsigned int x = 0; x < dropped; x++) {
+		Request_Release(pDropped[x]);
+	}
+
+	return lost;
+}
+
+void Request_Fail_All(DCS_Device* pDevice, int status) {
+	if (pDevice->hRequestMutex == NULL) {
+		return;
+	}
+
+	DCS_Request* pFailed = NULL;
+	DCS_Request* pForgotten[DCS_MAX_COMMAND_WINDOW];
+	unsigned int forgotten = 0;
+
+	Mutex_Lock(pDevice->hRequestMutex);
+	pDevice->requests_open = false;
+
+	pFailed = pDevice->pRequests;
+	pDevice->pRequests = NULL;
+	Atomic_Store_Release(&pDevice->requests_listed, 0);
+	for (DCS_Request* pRequest = pFailed; pRequest != NULL; pRequest = pRequest->pNextItem) {
+		pRequest->listed = false;
+	}
+
+	for (unsigned int x = 0; x < DCS_MAX_COMMAND_WINDOW; x++) {
+		Reply_Record* pRecord = &pDevice->reply_records[x];
+		if (pRecord->pending && pRecord->pRequest != NULL) {
+			pForgotten[forgotten++] = pRecord->pRequest;
+		}
+		pRecord->pending = false;
+		pRecord->pRequest = NULL;
+	}
+	Mutex_Unlock(pDevice->hRequestMutex);
+
+	while (pFailed != NULL) {
+		DCS_Request* pRequest = pFailed;
+		pFailed = pRequest->pNextItem;
+		resolve_Request(pRequest, status, 0, NULL);
+	}
+
+	for (unsigned int x = 0; x < forgotten; x++) {
+		Request_Release(pForgotten[x]);
+	}
+}
+
+static bool command_has_reply(Data_ID command_code) {
+	switch (command_code) {
+		case GET_DCS_STATUS:
+		case GET_CORRELATOR_SETTING:
+		case GET_ANALYZER_SETTING:
+		case GET_SIMULATED_DATA:
+		case GET_ANALYZER_PREFIT_PARAM:
+			return true;
+
+		default:
+			return false;
+	}
+}
+
+static bool unlist_Request(DCS_Device* pDevice, DCS_Request* pRequest) {
+	if (!pRequest->listed) {
+		return false;
+	}
+
+	DCS_Request** ppRequest = &pDevice->pRequests;
+	while (*ppRequest != pRequest) {
+		ppRequest = &(*ppRequest)->pNextItem;
+	}
+	*ppRequest = pRequest->pNextItem;
+	pRequest->pNextItem = NULL;
+	pRequest->listed = false;
+	Atomic_Store_Release(&pDevice->requests_listed, pDevice->requests_listed - 1);
+
+	return true;
+}
+
+static void resolve_Request(DCS_Request* pRequest, int status, Data_ID data_id, const DCS_Response* pReply) {
+	pRequest->pNextItem = NULL;
+
+	Mutex_Lock(pRequest->pMutex);
+	if (status == NO_DCS_ERROR && pReply != NULL) {
+		status = copy_Reply(pRequest, data_id, pReply);
+	}
+	pRequest->response.status = status;
+	Cond_Wake_All(pRequest->pCond);
+	Mutex_Unlock(pRequest->pMutex);
+
+	//Only this thread resolved the request, and nothing changes its response from here on, so it's read without the lock.
+	if (pRequest->callback != NULL) {
+		pRequest->callback(pRequest->pContext, pRequest, &pRequest->response);
+	}
+
+	Request_Release(pRequest);
+}
+
+static int copy_Reply(DCS_Request* pRequest, Data_ID data_id, const DCS_Response* pReply) {
+	DCS_Response* pResponse = &pRequest->response;
+	pResponse->data = pReply->data;
+
+	//The arrays in a reply only live for the duration of its callbacks.
+	const void* pSource = NULL;
+	size_t size = 0;
+	if (data_id == GET_ANALYZER_SETTING && pReply->data.analyzer_setting.Cha_Num > 0) {
+		pSource = pReply->data.analyzer_setting.pAnalyzer_Setting;
+		size = sizeof(*pReply->data.analyzer_setting.pAnalyzer_Setting) * pReply->data.analyzer_setting.Cha_Num;
+	}
+	else if (data_id == GET_SIMULATED_DATA && pReply->data.simulated_correlation.Data_Num > 0) {
+		pSource = pReply->data.simulated_correlation.pCorrBuf;
+		size = sizeof(*pReply->data.simulated_correlation.pCorrBuf) * pReply->data.simulated_correlation.Data_Num;
+	}
+	if (pSource == NULL) {
+		return NO_DCS_ERROR;
+	}
+
+	pRequest->pReplyData = malloc(size);
+	if (pRequest->pReplyData == NULL) {
+		memset(&pResponse->data, 0, sizeof(pResponse->data));
+		return MEMORY_ALLOCATION_ERROR;
+	}
+	memcpy(pRequest->pReplyData, pSource, size);
+
+	if (data_id == GET_ANALYZER_SETTING) {
+		pResponse->data.analyzer_setting.pAnalyzer_Setting = pRequest->pReplyData;
+	}
+	else {
+		pResponse->data.simulated_correlation.pCorrBuf = pRequest->pReplyData;
+	}
+	return NO_DCS_ERROR;
+}
+
+static void free_Request(DCS_Request* pRequest) {
+	free(pRequest->pReplyData);
+	if (pRequest->pMutex != NULL) {
+		Mutex_Destroy(pRequest->pMutex);
+	}
+	if (pRequest->pCond != NULL) {
+		Cond_Destroy(pRequest->pCond);
+	}
+	free(pRequest);
+}
@@ -0,0 +1,84 @@
+#pragma once
+#include <stdbool.h>
+#include "Platform.h"
+#include "Internal.h"
+#include "DCS_Driver.h"
+
+//Requests track commands sent with the DCS_*_Async functions until the DCS answers them. A Set command resolves
+//when it's acknowledged. A Get command resolves when its reply arrives. On a sequenced connection the DCS echoes
+//the command's sequence ID in its reply, which is matched to the command by it. Unsequenced replies are matched
+//by the order the device's Get commands of the same type were acknowledged in, since the DCS answers them in turn.
+//Every Get command is counted, so ones sent without a request don't take the replies of the ones with a request.
+//
+//A request is referenced by the application until DCS_Request_Free, by its device's list of unresolved requests,
+//and by whichever of its transmission, command record or reply record is carrying its command.
+
+struct DCS_Request {
+	Mutex* pMutex; //Guards refs and response
+	Cond* pCond; //Woken when the request resolves
+	unsigned int refs; //References held, the request is freed when the last is dropped
+	DCS_Response response; //status is REQUEST_PENDING until the request resolves
+	void* pReplyData; //Copy of the array the response points to, if it has one
+	unsigned __int64 deadline; //Clock_Now_Ns time the request times out at if it hasn't resolved
+	DCS_Request_CB_Def callback; //Called once the request resolves, can be NULL
+	void* pContext; //Passed to callback
+	bool listed; //Whether the request is in its device's list. Guarded by the device's hRequestMutex.
+	struct DCS_Request* pNextItem; //Next request in its device's list
+};
+
+//Get command acknowledged by the DCS whose reply hasn't arrived yet.
+typedef struct {
+	bool pending; //Whether the record is in use
+	Data_ID data_id; //Data ID of the reply, the same as the command's
+	Sequence_ID sequence; //Sequence ID of the command, which its reply echoes. 0 if the command was sent without one.
+	unsigned __int64 order; //Get commands acknowledged by the device before this one, so replies are matched in turn
+	unsigned __int64 deadline; //Clock_Now_Ns time the reply is given up at, so a lost reply doesn't shift the ones after it
+	DCS_Request* pRequest; //Request resolved by the reply, NULL if the command was sent without one
+} Reply_Record;
+
+//Sets up the device's request tracking and starts taking requests. Called when the device is opened.
+//Returns a standard DCS status code.
+int Request_Open(DCS_Device* pDevice);
+
+//Frees what Request_Open set up. Called once nothing can use the device's requests any more.
+void Request_Close(DCS_Device* pDevice);
+
+//Creates a request for a command about to be sent to [pDevice] and adds it to the device's list. Returns NETWORK_NOT_READY
+//if the device isn't open or its connection has been lost.
+int Request_Create(DCS_Device* pDevice, DCS_Request_Options options, DCS_Request** ppRequest);
+
+//Finishes sending a request made with Request_Create. [send_result] is what sending its command returned. On success
+//*pHandle is set to the request, or the application's reference is dropped if pHandle is NULL. Otherwise the request is
+//discarded without its callback being called and *pHandle is set to NULL. Returns [send_result].
+int Request_Submit(DCS_Device* pDevice, DCS_Request* pRequest, int send_result, DCS_Request_Handle* pHandle);
+
+//Adds a reference to the request. Does nothing if it's NULL.
+void Request_Retain(DCS_Request* pRequest);
+
+//Drops a reference to the request, freeing it if that was the last. Does nothing if it's NULL.
+void Request_Release(DCS_Request* pRequest);
+
+//Handles the acknowledgement of a command sent with the sequence ID [sequence], taking over the command record's reference
+//to [pRequest]. A Set command's request is resolved, and a reply record is kept for a Get command whether or not it has a
+//request. Called by the event loop.
+void Request_Acknowledged(DCS_Device* pDevice, DCS_Request* pRequest, Data_ID command_code, Sequence_ID sequence);
+
+//Resolves the request waiting for a reply of [data_id] with [pReply], which is copied: the one whose command had the
+//sequence ID [sequence], or the oldest if the reply has none. Called as each reply is decoded.
+void Request_Reply(DCS_Device* pDevice, Data_ID data_id, Sequence_ID sequence, const DCS_Response* pReply);
+
+//Resolves every request whose deadline has passed with REQUEST_TIMED_OUT. Called by the event loop when the device's
+//request deadline timer fires.
+void Request_Expire(DCS_Device* pDevice);
+
+//Lowers [*pNext] to the earliest deadline of the device's unresolved requests, if one is earlier.
+void Request_Next_Deadline(DCS_Device* pDevice, unsigned __int64* pNext);
+
+//Forgets the replies still expected on a connection that was lost, so their Get commands can be sent again. Copies the
+//records that haven't been given up on to [pLost], oldest first, passing on their references to their requests.
+//[pLost] has room for DCS_MAX_COMMAND_WINDOW records. Returns the number copied. Called by the event loop.
+unsigned int Request_Take_Replies(DCS_Device* pDevice, Reply_Record* pLost);
+
+//Stops taking requests for the device and resolves every unresolved one with [status]. The replies still expected are
+//forgotten, since they'll never arrive. Called when the device is closed or its connection is lost.
+void Request_Fail_All(DCS_Device* pDevice, int status);
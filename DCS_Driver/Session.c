@@ -0,0 +1,124 @@
+#define _CRT_RAND_S
+#define _CRTDBG_MAP_ALLOC
+#include <stdlib.h>
+#include "Platform.h"
+#include <limits.h>
+#include <string.h>
+
+#include "Device.h"
+#include "Session.h"
+
+//Data ID of the command that sets each setting.
+static const Data_ID session_commands[Session_Setting_Count] = {
+	[SESSION_CORRELATOR] = SET_CORRELATOR_SETTING,
+	[SESSION_ANALYZER] = SET_ANALYZER_SETTING,
+	[SESSION_PREFIT] = SET_ANALYZER_PREFIT_PARAM,
+	[SESSION_OPTICAL] = SET_OPTICAL_PARAM,
+	[SESSION_ENABLE] = ENABLE_CORR_ANALYZER,
+	[SESSION_MEASUREMENT] = START_MEASUREMENT,
+};
+
+//Frees the data kept for a setting.
+static void forget_Setting(Session_Frame* pSetting);
+
+void Session_Open(DCS_Device* pDevice, const DCS_Address* pAddress, const struct sockaddr* pConnected, int length) {
+	Session* pSession = &pDevice->session;
+
+	pSession->reconnect = pAddress->reconnect;
+	const unsigned __int32 min_ms = pAddress->reconnect_min_ms != 0 ? pAddress->reconnect_min_ms : DCS_DEFAULT_RECONNECT_MIN_MS;
+	const unsigned __int32 max_ms = pAddress->reconnect_max_ms != 0 ? pAddress->reconnect_max_ms : DCS_DEFAULT_RECONNECT_MAX_MS;
+	pSession->min_delay = min_ms * CLOCK_NS_PER_MS;
+	pSession->max_delay = max_ms > min_ms ? max_ms * CLOCK_NS_PER_MS : pSession->min_delay;
+
+	memcpy(&pSession->address, pConnected, length);
+	pSession->address_length = length;
+	pSession->state = LINK_CONNECTED;
+	pSession->attempts = 0;
+}
+
+void Session_Close(DCS_Device* pDevice) {
+	for (unsigned int x = 0; x < Session_Setting_Count; x++) {
+		forget_Setting(&pDevice->session.settings[x]);
+	}
+	pDevice->session.state = LINK_CONNECTED;
+}
+
+void Session_Acknowledged(DCS_Device* pDevice, const Transmission_Data_Type* pTransmission) {
+	Session* pSession = &pDevice->session;
+
+	if (pTransmission->command_code == STOP_MEASUREMENT) {
+		forget_Setting(&pSession->settings[SESSION_MEASUREMENT]);
+		return;
+	}
+
+	for (unsigned int x = 0; x < Session_Setting_Count; x++) {
+		if (session_commands[x] != pTransmission->command_code) {
+			continue;
+		}
+
+		//The data sits between the header and the trailer, after the prepended frame size.
+		Frame_Version version;
+		memcpy(&version, &pTransmission->pFrame[sizeof(pTransmission->size)], sizeof(version));
+		version = itohs(version);
+		const unsigned __int32 start = sizeof(pTransmission->size) + Frame_Header_Size(version);
+		const unsigned __int32 size = pTransmission->size - Frame_Header_Size(version) - Frame_Trailer_Size(version);
+
+		//Settings are rarely changed, so the data is copied each time rather than kept in a buffer of its own.
+		char* pData = malloc(size > 0 ? size : 1);
+		if (pData == NULL) {
+			return;
+		}
+		memcpy(pData, &pTransmission->pFrame[start], size);
+
+		forget_Setting(&pSession->settings[x]);
+		pSession->settings[x].pData = pData;
+		pSession->settings[x].size = size;
+		return;
+	}
+}
+
+Transmission_Data_Type* Session_Replay(DCS_Device* pDevice) {
+	Transmission_Data_Type* pHead = NULL;
+	Transmission_Data_Type** ppTail = &pHead;
+
+	//Frames are built again rather than copied, so each gets a new sequence ID.
+	for (unsigned int x = 0; x < Session_Setting_Count; x++) {
+		const Session_Frame* pSetting = &pDevice->session.settings[x];
+		if (pSetting->pData == NULL) {
+			continue;
+		}
+
+		Frame_Builder builder;
+		if (Frame_Begin(&builder, pDevice, session_commands[x], pSetting->size, NULL) != NO_DCS_ERROR) {
+			continue;
+		}
+		Frame_Put(&builder, pSetting->pData, pSetting->size);
+
+		Transmission_Data_Type* pTransmission = Frame_Finish(&builder);
+		if (pTransmission != NULL) {
+			*ppTail = pTransmission;
+			ppTail = &pTransmission->pNextItem;
+		}
+	}
+
+	return pHead;
+}
+
+unsigned __int64 Session_Backoff(DCS_Device* pDevice) {
+	Session* pSession = &pDevice->session;
+	const unsigned __int64 delay = pSession->delay;
+	pSession->delay = delay < pSession->max_delay / 2 ? delay * 2 : pSession->max_delay;
+
+	//Without jitter, devices that lost the same DCS would keep trying at the same moments.
+	unsigned int random = 0;
+	if (rand_s(&random) != 0) {
+		random = 0;
+	}
+	return delay - (unsigned __int64)((delay / 2) * ((double)random / UINT_MAX));
+}
+
+static void forget_Setting(Session_Frame* pSetting) {
+	free(pSetting->pData);
+	pSetting->pData = NULL;
+	pSetting->size = 0;
+}
@@ -0,0 +1,70 @@
+#pragma once
+#include <stdbool.h>
+#include "Platform.h"
+#include "Internal.h"
+#include "DCS_Driver.h"
+#include "Timer_Wheel.h"
+
+//What a device opened with DCS_Address.reconnect keeps to carry on after its connection is lost. The event loop keeps
+//serving the device and connects again to the address it first connected to, waiting longer after each failed attempt,
+//while the application carries on queuing commands. Once the connection is back, the settings the DCS last acknowledged
+//are sent again, followed by the commands the lost connection left unanswered and then the queued ones. Everything here
+//is only used by the loop thread.
+
+//Settings sent again after reconnecting, in the order they're sent.
+typedef enum {
+	SESSION_CORRELATOR,
+	SESSION_ANALYZER,
+	SESSION_PREFIT,
+	SESSION_OPTICAL,
+	SESSION_ENABLE,
+	SESSION_MEASUREMENT, //Start_Measurement, forgotten once Stop_Measurement is acknowledged
+	Session_Setting_Count
+} Session_Setting;
+
+//Where the device's connection is.
+typedef enum {
+	LINK_CONNECTED, //Connected, or not being served by an event loop
+	LINK_WAITING, //Lost, waiting for the next attempt to connect
+	LINK_CONNECTING, //Lost, with an attempt to connect being made
+} Link_State;
+
+//Seconds an attempt to connect again can take before it's given up.
+#define SESSION_CONNECT_TIMEOUT 5
+
+//Data of the last acknowledged frame of one setting.
+typedef struct {
+	char* pData; //NULL if the setting hasn't been acknowledged
+	unsigned __int32 size; //Bytes at pData
+} Session_Frame;
+
+typedef struct {
+	bool reconnect; //Whether a lost connection is made again
+	unsigned __int64 min_delay; //Nanoseconds before the second attempt to connect
+	unsigned __int64 max_delay; //Most nanoseconds between attempts
+	struct sockaddr_storage address; //Address the device connected to when it was opened
+	int address_length; //Bytes of [address] in use
+	Link_State state;
+	unsigned __int64 delay; //Nanoseconds before the next attempt if the one being made fails, before jitter
+	unsigned __int32 attempts; //Attempts made since the connection was lost
+	unsigned __int64 lost_time; //Clock_Now_Ns time the connection was found lost
+	unsigned __int64 last_data; //Clock_Now_Ns time data was last received on the lost connection
+	Timer retry; //Fires when the next attempt is due, or when the one being made has taken too long
+	Session_Frame settings[Session_Setting_Count]; //Last acknowledged frame of each setting
+} Session;
+
+//Sets up the device's session for a connection made to [pAddress], with the reconnect settings of [address].
+void Session_Open(DCS_Device* pDevice, const DCS_Address* pAddress, const struct sockaddr* pConnected, int length);
+
+//Forgets the settings the device's session holds. Called when the device leaves its event loop.
+void Session_Close(DCS_Device* pDevice);
+
+//Keeps the data of an acknowledged command frame if it's one of the settings sent again after reconnecting.
+void Session_Acknowledged(DCS_Device* pDevice, const Transmission_Data_Type* pTransmission);
+
+//Builds a frame for each setting the device's session holds and returns them, linked in the order they're sent.
+Transmission_Data_Type* Session_Replay(DCS_Device* pDevice);
+
+//Returns the time to wait before the next attempt to connect, cut by a random amount of up to half, and doubles
+//the wait for the one after it.
+unsigned __int64 Session_Backoff(DCS_Device* pDevice);
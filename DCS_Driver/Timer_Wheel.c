@@ -0,0 +1,205 @@
+#define _CRTDBG_MAP_ALLOC
+#include <stdlib.h>
+#include "Platform.h"
+#include <string.h>
+
+#include "Timer_Wheel.h"
+
+//Mask of a slot index within a level.
+#define TIMER_SLOT_MASK (TIMER_SLOTS - 1)
+//Ticks spanned by the whole wheel.
+#define TIMER_WHEEL_SPAN ((unsigned __int64)1 << (TIMER_SLOT_BITS * TIMER_LEVELS))
+
+//Adds an unarmed timer to the slot for its tick, or to pDue if the wheel has already passed it.
+static void place_Timer(Timer_Wheel* pWheel, Timer* pTimer);
+//Links [pTimer] in at the front of the list at [ppList].
+static void link_Timer(Timer** ppList, Timer* pTimer);
+//Removes the first timer of the list at [ppList] and disarms it.
+static Timer* pop_Timer(Timer_Wheel* pWheel, Timer** ppList);
+//Spreads the coarser slots the wheel has just reached over the levels below. Called when the tick is at the start of a
+//level 0 lap, and carries on up for every level that's also at the start of a lap.
+static void cascade(Timer_Wheel* pWheel);
+//Fires every timer in the list at [ppList], which has already been taken out of the wheel.
+static void fire_Timers(Timer_Wheel* pWheel, Timer** ppList);
+
+void Timer_Wheel_Init(Timer_Wheel* pWheel, unsigned __int64 now) {
+	memset(pWheel, 0, sizeof(*pWheel));
+	pWheel->tick = now / TIMER_TICK_NS;
+}
+
+void Timer_Wheel_Advance(Timer_Wheel* pWheel, unsigned __int64 now) {
+	const unsigned __int64 target = now / TIMER_TICK_NS;
+
+	//Timers scheduled into the past are taken first. Any scheduled into the past again wait for the next advance.
+	Timer* pDue = pWheel->pDue;
+	pWheel->pDue = NULL;
+	if (pDue != NULL) {
+		pDue->ppPrev = &pDue;
+		fire_Timers(pWheel, &pDue);
+	}
+
+	while (pWheel->tick <= target) {
+		//Nothing to cascade or fire, so the ticks in between don't need visiting.
+		if (pWheel->armed == 0) {
+			pWheel->tick = target + 1;
+			break;
+		}
+
+		const unsigned int index = (unsigned int)(pWheel->tick & TIMER_SLOT_MASK);
+		if (index == 0) {
+			cascade(pWheel);
+		}
+		else if (pWheel->slots[0][index] == NULL) {
+			//Skip to the next slot in use or the end of the lap, so a long wait costs a step per lap rather than per tick.
+			unsigned int used = index + 1;
+			while (used < TIMER_SLOTS && pWheel->slots[0][used] == NULL) {
+				used++;
+			}
+			pWheel->tick += used - index;
+			if (pWheel->tick > target + 1) {
+				pWheel->tick = target + 1;
+			}
+			continue;
+		}
+
+		//The slot is taken as a whole, and the tick moved on first, so timers scheduled again by their callbacks
+		//go to a later slot or pDue rather than back into this list.
+		Timer* pList = pWheel->slots[0][index];
+		pWheel->slots[0][index] = NULL;
+		pWheel->tick++;
+		if (pList != NULL) {
+			pList->ppPrev = &pList;
+			fire_Timers(pWheel, &pList);
+		}
+	}
+}
+
+unsigned __int32 Timer_Wheel_Timeout(const Timer_Wheel* pWheel, unsigned __int64 now) {
+	if (pWheel->pDue != NULL) {
+		return 0;
+	}
+	if (pWheel->armed == 0) {
+		return INFINITE;
+	}
+
+	//The first slot in use at each level, going round from the wheel's tick, holds that level's earliest timer.
+	//A coarser level's timers can still be due before a finer level's, so every level is checked.
+	unsigned __int64 next = ~(unsigned __int64)0;
+	for (unsigned int level = 0; level < TIMER_LEVELS; level++) {
+		//A coarser level's current slot is cascaded when the wheel reaches the start of it. Until then it holds the level's
+		//earliest timers, and after that only ones a whole lap away.
+		const unsigned __int64 lap_mask = ((unsigned __int64)1 << (TIMER_SLOT_BITS * level)) - 1;
+		const unsigned int start = (unsigned int)((pWheel->tick >> (TIMER_SLOT_BITS * level)) & TIMER_SLOT_MASK)
+			+ ((pWheel->tick & lap_mask) != 0 ? 1 : 0);
+		for (unsigned int x = 0; x < TIMER_SLOTS; x++) {
+			const unsigned int index = (start + x) & TIMER_SLOT_MASK;
+			const Timer* pTimer = pWheel->slots[level][index];
+			if (pTimer == NULL) {
+				continue;
+			}
+			for (; pTimer != NULL; pTimer = pTimer->pNext) {
+				if (pTimer->tick < next) {
+					next = pTimer->tick;
+				}
+			}
+			break;
+		}
+	}
+
+	const unsigned __int64 due = next * TIMER_TICK_NS;
+	if (due <= now) {
+		return 0;
+	}
+	//Round up so the wait doesn't end just before the tick.
+	const unsigned __int64 timeout = (due - now + 999999) / 1000000;
+	return timeout < INFINITE ? (unsigned __int32)timeout : INFINITE - 1;
+}
+
+void Timer_Init(Timer* pTimer, Timer_CB_Def callback, void* pContext) {
+	memset(pTimer, 0, sizeof(*pTimer));
+	pTimer->callback = callback;
+	pTimer->pContext = pContext;
+}
+
+void Timer_Schedule(Timer_Wheel* pWheel, Timer* pTimer, unsigned __int64 expires) {
+	Timer_Cancel(pWheel, pTimer);
+
+	pTimer->expires = expires;
+	//Rounded up so the timer never fires before it's due.
+	pTimer->tick = (expires + TIMER_TICK_NS - 1) / TIMER_TICK_NS;
+	place_Timer(pWheel, pTimer);
+	pWheel->armed++;
+}
+
+void Timer_Cancel(Timer_Wheel* pWheel, Timer* pTimer) {
+	if (pTimer->ppPrev == NULL) {
+		return;
+	}
+
+	*pTimer->ppPrev = pTimer->pNext;
+	if (pTimer->pNext != NULL) {
+		pTimer->pNext->ppPrev = pTimer->ppPrev;
+	}
+	pTimer->pNext = NULL;
+	pTimer->ppPrev = NULL;
+	pWheel->armed--;
+}
+
+static void place_Timer(Timer_Wheel* pWheel, Timer* pTimer) {
+	if (pTimer->tick < pWheel->tick) {
+		link_Timer(&pWheel->pDue, pTimer);
+		return;
+	}
+
+	//Timers beyond the wheel's span wait in the furthest slot and are placed again once it's reached.
+	const unsigned __int64 delta = pTimer->tick - pWheel->tick;
+	const unsigned __int64 tick = delta < TIMER_WHEEL_SPAN ? pTimer->tick : pWheel->tick + TIMER_WHEEL_SPAN - 1;
+
+	unsigned int level = 0;
+	while (level < TIMER_LEVELS - 1 && delta >> (TIMER_SLOT_BITS * (level + 1)) != 0) {
+		level++;
+	}
+	link_Timer(&pWheel->slots[level][(tick >> (TIMER_SLOT_BITS * level)) & TIMER_SLOT_MASK], pTimer);
+}
+
+static void link_Timer(Timer** ppList, Timer* pTimer) {
+	pTimer->pNext = *ppList;
+	if (pTimer->pNext != NULL) {
+		pTimer->pNext->ppPrev = &pTimer->pNext;
+	}
+	pTimer->ppPrev = ppList;
+	*ppList = pTimer;
+}
+
+static Timer* pop_Timer(Timer_Wheel* pWheel, Timer** ppList) {
+	Timer* pTimer = *ppList;
+	Timer_Cancel(pWheel, pTimer);
+	return pTimer;
+}
+
+static void cascade(Timer_Wheel* pWheel) {
+	for (unsigned int level = 1; level < TIMER_LEVELS; level++) {
+		const unsigned int index = (unsigned int)((pWheel->tick >> (TIMER_SLOT_BITS * level)) & TIMER_SLOT_MASK);
+
+		Timer* pList = pWheel->slots[level][index];
+		pWheel->slots[level][index] = NULL;
+		while (pList != NULL) {
+			Timer* pTimer = pList;
+			pList = pTimer->pNext;
+			place_Timer(pWheel, pTimer);
+		}
+
+		//The next level only reaches a new slot when this one starts a new lap.
+		if (index != 0) {
+			break;
+		}
+	}
+}
+
+static void fire_Timers(Timer_Wheel* pWheel, Timer** ppList) {
+	//Timers are popped one at a time, so a callback can cancel or schedule any timer, including ones still in the list.
+	while (*ppList != NULL) {
+		Timer* pTimer = pop_Timer(pWheel, ppList);
+		pTimer->callback(pTimer, pTimer->pContext);
+	}
+}
@@ -0,0 +1,64 @@
+#pragma once
+#include <stdbool.h>
+#include "Platform.h"
+
+//Hierarchical timer wheel on the Clock_Now_Ns clock with a resolution of one tick. Timers due within TIMER_SLOTS
+//ticks sit in the slot of the tick they're due on, and later ones in coarser levels, each TIMER_SLOTS times the span
+//of the one below. A coarser slot is spread over the level below as the wheel reaches it, so scheduling, cancelling
+//and firing a timer take constant time however many are armed. Timers are embedded in their owner's struct, and
+//a wheel is only used by the thread that owns it.
+
+//Nanoseconds in one tick of the wheel. Timers never fire early and fire at most one tick late.
+#define TIMER_TICK_NS 1000000
+//Slots in each level of the wheel. Must be a power of 2.
+#define TIMER_SLOTS 64
+//Bits of a tick each level's slot index is taken from.
+#define TIMER_SLOT_BITS 6
+//Levels in the wheel. Together they span TIMER_SLOTS^TIMER_LEVELS ticks, about 4.6 hours, and timers due
+//later than that are parked in the last slot of the top level until they're within reach.
+#define TIMER_LEVELS 4
+
+struct Timer;
+
+//Called on the wheel's thread once a timer is due. The timer can be scheduled again from the callback.
+typedef void(*Timer_CB_Def)(struct Timer* pTimer, void* pContext);
+
+typedef struct Timer {
+	unsigned __int64 expires; //Clock_Now_Ns time the timer is due at
+	unsigned __int64 tick; //Tick the timer fires on, the first one at or after [expires]
+	Timer_CB_Def callback; //Called when the timer fires
+	void* pContext; //Passed to callback
+	struct Timer* pNext; //Next timer in the same slot
+	struct Timer** ppPrev; //Link pointing at this timer, NULL if it isn't armed
+} Timer;
+
+typedef struct {
+	Timer* slots[TIMER_LEVELS][TIMER_SLOTS]; //Armed timers by level and slot
+	Timer* pDue; //Timers scheduled for a tick the wheel had already passed, fired on the next advance
+	unsigned __int64 tick; //Next tick to be processed
+	unsigned int armed; //Number of timers in the wheel
+} Timer_Wheel;
+
+//Sets up an empty wheel whose first tick is [now].
+void Timer_Wheel_Init(Timer_Wheel* pWheel, unsigned __int64 now);
+
+//Fires every timer due by [now], in the order of the ticks they're due on.
+void Timer_Wheel_Advance(Timer_Wheel* pWheel, unsigned __int64 now);
+
+//Milliseconds from [now] until the earliest armed timer fires, rounded up, 0 if one is already due
+//and INFINITE if none is armed.
+unsigned __int32 Timer_Wheel_Timeout(const Timer_Wheel* pWheel, unsigned __int64 now);
+
+//Sets up an unarmed timer.
+void Timer_Init(Timer* pTimer, Timer_CB_Def callback, void* pContext);
+
+//Arms the timer to fire at [expires], moving it if it's already armed.
+void Timer_Schedule(Timer_Wheel* pWheel, Timer* pTimer, unsigned __int64 expires);
+
+//Disarms the timer. Does nothing if it isn't armed.
+void Timer_Cancel(Timer_Wheel* pWheel, Timer* pTimer);
+
+//Whether the timer is waiting to fire.
+static inline bool Timer_Armed(const Timer* pTimer) {
+	return pTimer->ppPrev != NULL;
+}
@@ -0,0 +1,433 @@
+#define _CRTDBG_MAP_ALLOC
+#include <stdlib.h>
+#include "Platform.h"
+
+#include "Uring.h"
+
+#if defined(__linux__)
+#include <stdint.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+//Submission queue size. Holds a full chain of sends plus the receive and a cancel.
+#define URING_ENTRIES 128
+
+//user_data of the requests that aren't sends. Sends carry their caller's pointer, which is never either of these.
+#define RECV_TAG 0
+#define CANCEL_TAG 1
+
+//Buffer group the receive buffers are registered under.
+#define RECV_BUFFER_GROUP 0
+
+struct Uring {
+	int fd; //Ring file descriptor
+	SOCKET socket; //Socket being read and written
+
+	void* pRings; //Submission and completion rings, mapped together
+	size_t rings_size;
+	struct io_uring_sqe* pSqes; //Submission queue entries
+	size_t sqes_size;
+
+	unsigned* pSq_Head; //Submission entries the kernel has consumed
+	unsigned* pSq_Tail; //Submission entries made visible to the kernel
+	unsigned* pSq_Array;
+	unsigned sq_mask;
+	unsigned sq_entries;
+	unsigned sq_local_tail; //Submission entries written, including ones not made visible yet
+
+	unsigned* pCq_Head; //Completions taken
+	unsigned* pCq_Tail; //Completions posted by the kernel
+	struct io_uring_cqe* pCqes;
+	unsigned cq_mask;
+
+	struct io_uring_buf_ring* pBuf_Ring; //Receive buffers the kernel can pick from
+	size_t buf_ring_size;
+	char* pRecv_Buffers; //URING_RECV_BUFFERS buffers of URING_RECV_BUFFER_SIZE bytes
+	unsigned short buf_tail; //Buffers given to the kernel so far, wrapping
+	int held_buffer; //Buffer handed out by the last URING_RECEIVED, -1 if none
+
+	bool recv_armed; //Whether the multishot receive is queued or running
+	unsigned sends; //Sends queued or running
+	struct io_uring_sqe* pLast_Send; //Last send queued since the last submit, linked to the next one queued
+};
+
+static int sys_io_uring_setup(unsigned entries, struct io_uring_params* pParams) {
+	return (int)syscall(__NR_io_uring_setup, entries, pParams);
+}
+
+static int sys_io_uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags) {
+	return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, NULL, 0);
+}
+
+static int sys_io_uring_register(int fd, unsigned opcode, void* arg, unsigned nr_args) {
+	return (int)syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+//Hands receive buffer [bid] back to the kernel.
+static void give_buffer(Uring* pUring, unsigned short bid) {
+	//Only the fields of the entry are written. The ring's tail shares the first entry's reserved field.
+	struct io_uring_buf* pBuf = &pUring->pBuf_Ring->bufs[pUring->buf_tail & (URING_RECV_BUFFERS - 1)];
+	pBuf->addr = (uintptr_t)&pUring->pRecv_Buffers[(size_t)bid * URING_RECV_BUFFER_SIZE];
+	pBuf->len = URING_RECV_BUFFER_SIZE;
+	pBuf->bid = bid;
+
+	pUring->buf_tail++;
+	__atomic_store_n(&pUring->pBuf_Ring->tail, pUring->buf_tail, __ATOMIC_RELEASE);
+}
+
+//Returns a cleared submission entry, or NULL if the submission queue is full.
+static struct io_uring_sqe* next_sqe(Uring* pUring) {
+	const unsigned head = __atomic_load_n(pUring->pSq_Head, __ATOMIC_ACQUIRE);
+	if (pUring->sq_local_tail - head >= pUring->sq_entries) {
+		return NULL;
+	}
+
+	const unsigned index = pUring->sq_local_tail & pUring->sq_mask;
+	struct io_uring_sqe* pSqe = &pUring->pSqes[index];
+	memset(pSqe, 0, sizeof(*pSqe));
+	pUring->pSq_Array[index] = index;
+	pUring->sq_local_tail++;
+
+	return pSqe;
+}
+
+//Queues the multishot receive. It keeps completing into the registered buffers until it runs out of them or fails.
+static bool queue_recv(Uring* pUring) {
+	struct io_uring_sqe* pSqe = next_sqe(pUring);
+	if (pSqe == NULL) {
+		return false;
+	}
+
+	pSqe->opcode = IORING_OP_RECV;
+	pSqe->fd = pUring->socket;
+	pSqe->ioprio = IORING_RECV_MULTISHOT;
+	pSqe->flags = IOSQE_BUFFER_SELECT;
+	pSqe->buf_group = RECV_BUFFER_GROUP;
+	pSqe->user_data = RECV_TAG;
+
+	pUring->recv_armed = true;
+	return true;
+}
+
+//Makes every written submission entry visible and hands them to the kernel, waiting for [min_complete] completions.
+static int enter(Uring* pUring, unsigned min_complete) {
+	__atomic_store_n(pUring->pSq_Tail, pUring->sq_local_tail, __ATOMIC_RELEASE);
+	const unsigned to_submit = pUring->sq_local_tail - __atomic_load_n(pUring->pSq_Head, __ATOMIC_ACQUIRE);
+
+	int result;
+	do {
+		result = sys_io_uring_enter(pUring->fd, to_submit, min_complete, min_complete > 0 ? IORING_ENTER_GETEVENTS : 0);
+	} while (result < 0 && errno == EINTR);
+
+	return result;
+}
+
+//Takes the next completion off the completion ring. Returns false if none is waiting.
+static bool take_cqe(Uring* pUring, struct io_uring_cqe* pCqe) {
+	const unsigned head = *pUring->pCq_Head;
+	if (head == __atomic_load_n(pUring->pCq_Tail, __ATOMIC_ACQUIRE)) {
+		return false;
+	}
+
+	*pCqe = pUring->pCqes[head & pUring->cq_mask];
+	__atomic_store_n(pUring->pCq_Head, head + 1, __ATOMIC_RELEASE);
+	return true;
+}
+
+//Frees everything Uring_Create set up. Nothing can be in flight.
+static void free_uring(Uring* pUring) {
+	if (pUring->pRecv_Buffers != NULL) {
+		free(pUring->pRecv_Buffers);
+	}
+	if (pUring->pBuf_Ring != NULL && pUring->pBuf_Ring != MAP_FAILED) {
+		munmap(pUring->pBuf_Ring, pUring->buf_ring_size);
+	}
+	if (pUring->pSqes != NULL && pUring->pSqes != MAP_FAILED) {
+		munmap(pUring->pSqes, pUring->sqes_size);
+	}
+	if (pUring->pRings != NULL && pUring->pRings != MAP_FAILED) {
+		munmap(pUring->pRings, pUring->rings_size);
+	}
+	if (pUring->fd >= 0) {
+		close(pUring->fd);
+	}
+	free(pUring);
+}
+
+Uring* Uring_Create(SOCKET socket) {
+	Uring* pUring = calloc(1, sizeof(*pUring));
+	if (pUring == NULL) {
+		return NULL;
+	}
+	pUring->socket = socket;
+	pUring->held_buffer = -1;
+
+	//Failed submissions still complete, so one bad send doesn't stop the rest of the batch.
+	struct io_uring_params params;
+	memset(&params, 0, sizeof(params));
+	params.flags = IORING_SETUP_SUBMIT_ALL;
+
+	pUring->fd = sys_io_uring_setup(URING_ENTRIES, &params);
+	if (pUring->fd < 0 || !(params.features & IORING_FEAT_SINGLE_MMAP)) {
+		free_uring(pUring);
+		return NULL;
+	}
+
+	//Both rings share one mapping on every kernel with provided buffer rings.
+	const size_t sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+	const size_t cq_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+	pUring->rings_size = sq_size > cq_size ? sq_size : cq_size;
+	pUring->pRings = mmap(NULL, pUring->rings_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, pUring->fd, IORING_OFF_SQ_RING);
+
+	pUring->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+	pUring->pSqes = mmap(NULL, pUring->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, pUring->fd, IORING_OFF_SQES);
+	if (pUring->pRings == MAP_FAILED || pUring->pSqes == MAP_FAILED) {
+		free_uring(pUring);
+		return NULL;
+	}
+
+	char* pRings = pUring->pRings;
+	pUring->pSq_Head = (unsigned*)&pRings[params.sq_off.head];
+	pUring->pSq_Tail = (unsigned*)&pRings[params.sq_off.tail];
+	pUring->pSq_Array = (unsigned*)&pRings[params.sq_off.array];
+	pUring->sq_mask = *(unsigned*)&pRings[params.sq_off.ring_mask];
+	pUring->sq_entries = params.sq_entries;
+	pUring->sq_local_tail = *pUring->pSq_Tail;
+
+	pUring->pCq_Head = (unsigned*)&pRings[params.cq_off.head];
+	pUring->pCq_Tail = (unsigned*)&pRings[params.cq_off.tail];
+	pUring->pCqes = (struct io_uring_cqe*)&pRings[params.cq_off.cqes];
+	pUring->cq_mask = *(unsigned*)&pRings[params.cq_off.ring_mask];
+
+	//The buffer ring must be page aligned, so it gets its own mapping.
+	pUring->buf_ring_size = URING_RECV_BUFFERS * sizeof(struct io_uring_buf);
+	pUring->pBuf_Ring = mmap(NULL, pUring->buf_ring_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	pUring->pRecv_Buffers = malloc((size_t)URING_RECV_BUFFERS * URING_RECV_BUFFER_SIZE);
+	if (pUring->pBuf_Ring == MAP_FAILED || pUring->pRecv_Buffers == NULL) {
+		free_uring(pUring);
+		return NULL;
+	}
+
+	struct io_uring_buf_reg reg;
+	memset(&reg, 0, sizeof(reg));
+	reg.ring_addr = (uintptr_t)pUring->pBuf_Ring;
+	reg.ring_entries = URING_RECV_BUFFERS;
+	reg.bgid = RECV_BUFFER_GROUP;
+	if (sys_io_uring_register(pUring->fd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0) {
+		free_uring(pUring);
+		return NULL;
+	}
+
+	for (unsigned short bid = 0; bid < URING_RECV_BUFFERS; bid++) {
+		give_buffer(pUring, bid);
+	}
+
+	if (!queue_recv(pUring) || enter(pUring, 0) < 0) {
+		free_uring(pUring);
+		return NULL;
+	}
+
+	//Kernels without multishot receive reject it straight away. Anything else is left for Uring_Next.
+	const unsigned head = *pUring->pCq_Head;
+	if (head != __atomic_load_n(pUring->pCq_Tail, __ATOMIC_ACQUIRE)) {
+		const struct io_uring_cqe* pCqe = &pUring->pCqes[head & pUring->cq_mask];
+		if (pCqe->user_data == RECV_TAG && pCqe->res == -EINVAL) {
+			free_uring(pUring);
+			return NULL;
+		}
+	}
+
+	return pUring;
+}
+
+void Uring_Destroy(Uring* pUring) {
+	if (pUring == NULL) {
+		return;
+	}
+
+	//The receive and sends would carry on after the socket is closed, since they hold their own reference to it,
+	//and keep using the buffers. Cancel them and wait for each to report that it's finished.
+	if (pUring->recv_armed || pUring->sends > 0) {
+		struct io_uring_sqe* pSqe = next_sqe(pUring);
+		if (pSqe != NULL) {
+			pSqe->opcode = IORING_OP_ASYNC_CANCEL;
+			pSqe->cancel_flags = IORING_ASYNC_CANCEL_ANY;
+			pSqe->user_data = CANCEL_TAG;
+		}
+
+		unsigned min_complete = 0;
+		while (enter(pUring, min_complete) >= 0) {
+			struct io_uring_cqe cqe;
+			while (take_cqe(pUring, &cqe)) {
+				if (cqe.user_data == RECV_TAG) {
+					if (!(cqe.flags & IORING_CQE_F_MORE)) {
+						pUring->recv_armed = false;
+					}
+				}
+				else if (cqe.user_data != CANCEL_TAG) {
+					pUring->sends--;
+				}
+			}
+
+			if (!pUring->recv_armed && pUring->sends == 0) {
+				break;
+			}
+			min_complete = 1;
+		}
+	}
+
+	free_uring(pUring);
+}
+
+int Uring_Fd(const Uring* pUring) {
+	return pUring->fd;
+}
+
+bool Uring_Can_Send(const Uring* pUring) {
+	return pUring->sends == 0;
+}
+
+bool Uring_Queue_Send(Uring* pUring, const void* pData, unsigned __int32 size, void* pUser) {
+	if (pUring->sends >= URING_MAX_SENDS) {
+		return false;
+	}
+
+	struct io_uring_sqe* pSqe = next_sqe(pUring);
+	if (pSqe == NULL) {
+		return false;
+	}
+
+	//MSG_WAITALL has the kernel finish a partial write itself, so each send either writes everything or fails.
+	pSqe->opcode = IORING_OP_SEND;
+	pSqe->fd = pUring->socket;
+	pSqe->addr = (uintptr_t)pData;
+	pSqe->len = size;
+	pSqe->msg_flags = MSG_WAITALL | MSG_NOSIGNAL;
+	pSqe->user_data = (uintptr_t)pUser;
+
+	//Each send only starts once the one before it has finished, so frames go out in order.
+	if (pUring->pLast_Send != NULL) {
+		pUring->pLast_Send->flags |= IOSQE_IO_LINK;
+	}
+	pUring->pLast_Send = pSqe;
+	pUring->sends++;
+
+	return true;
+}
+
+int Uring_Submit(Uring* pUring) {
+	//The receive stops when it runs out of buffers or fails, and picks up where it left off once restarted.
+	if (!pUring->recv_armed) {
+		queue_recv(pUring);
+	}
+	pUring->pLast_Send = NULL;
+
+	if (pUring->sq_local_tail == __atomic_load_n(pUring->pSq_Head, __ATOMIC_ACQUIRE)) {
+		return 0;
+	}
+	if (enter(pUring, 0) < 0) {
+		return SOCKET_ERROR;
+	}
+	return 1;
+}
+
+bool Uring_Next(Uring* pUring, Uring_Completion* pCompletion) {
+	//The buffer handed out last time has been used by now.
+	if (pUring->held_buffer >= 0) {
+		give_buffer(pUring, (unsigned short)pUring->held_buffer);
+		pUring->held_buffer = -1;
+	}
+
+	struct io_uring_cqe cqe;
+	while (take_cqe(pUring, &cqe)) {
+		memset(pCompletion, 0, sizeof(*pCompletion));
+
+		if (cqe.user_data == CANCEL_TAG) {
+			continue;
+		}
+
+		if (cqe.user_data != RECV_TAG) {
+			pUring->sends--;
+			pCompletion->pUser = (void*)(uintptr_t)cqe.user_data;
+			if (cqe.res < 0) {
+				pCompletion->type = URING_FAILED;
+				pCompletion->error = -cqe.res;
+			}
+			else {
+				pCompletion->type = URING_SENT;
+				pCompletion->size = (unsigned __int32)cqe.res;
+			}
+			return true;
+		}
+
+		if (!(cqe.flags & IORING_CQE_F_MORE)) {
+			pUring->recv_armed = false;
+		}
+
+		if (cqe.res > 0) {
+			const unsigned short bid = (unsigned short)(cqe.flags >> IORING_CQE_BUFFER_SHIFT);
+			pUring->held_buffer = bid;
+
+			pCompletion->type = URING_RECEIVED;
+			pCompletion->pData = &pUring->pRecv_Buffers[(size_t)bid * URING_RECV_BUFFER_SIZE];
+			pCompletion->size = (unsigned __int32)cqe.res;
+			return true;
+		}
+		if (cqe.res == 0) {
+			pCompletion->type = URING_CLOSED;
+			return true;
+		}
+		//Out of buffers. They're handed back as completions are taken, and the receive restarts on the next submit.
+		if (cqe.res == -ENOBUFS) {
+			continue;
+		}
+
+		pCompletion->type = URING_FAILED;
+		pCompletion->error = -cqe.res;
+		return true;
+	}
+
+	return false;
+}
+#else
+//Only Linux has io_uring. The COM task falls back to the socket everywhere else.
+
+Uring* Uring_Create(SOCKET socket) {
+	(void)socket;
+	return NULL;
+}
+
+void Uring_Destroy(Uring* pUring) {
+	(void)pUring;
+}
+
+int Uring_Fd(const Uring* pUring) {
+	(void)pUring;
+	return -1;
+}
+
+bool Uring_Can_Send(const Uring* pUring) {
+	(void)pUring;
+	return false;
+}
+
+bool Uring_Queue_Send(Uring* pUring, const void* pData, unsigned __int32 size, void* pUser) {
+	(void)pUring;
+	(void)pData;
+	(void)size;
+	(void)pUser;
+	return false;
+}
+
+int Uring_Submit(Uring* pUring) {
+	(void)pUring;
+	return SOCKET_ERROR;
+}
+
+bool Uring_Next(Uring* pUring, Uring_Completion* pCompletion) {
+	(void)pUring;
+	(void)pCompletion;
+	return false;
+}
+#endif
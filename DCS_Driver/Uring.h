@@ -0,0 +1,59 @@
+#pragma once
+#include <stdbool.h>
+#include "Platform.h"
+
+//Linux io_uring transport for the COM task. A single multishot receive fills a ring of buffers registered
+//with the kernel, and the frames queued in a pass are written by one chain of linked sends, so a busy
+//connection costs one system call per pass rather than one per read or write.
+//Only built on Linux. Elsewhere, or on kernels without multishot receive (before 6.0), Uring_Create returns
+//NULL and the COM task uses the socket directly.
+
+//Number of receive buffers registered with the kernel. Must be a power of 2.
+#define URING_RECV_BUFFERS 64
+//Size of each receive buffer.
+#define URING_RECV_BUFFER_SIZE 16384
+//Most sends linked into one chain.
+#define URING_MAX_SENDS 64
+
+//Kinds of completion handed out by Uring_Next.
+#define URING_RECEIVED 1 //[pData] holds [size] received bytes, valid until the next call to Uring_Next
+#define URING_SENT 2 //The send queued with [pUser] was completely written
+#define URING_CLOSED 3 //The peer closed the connection
+#define URING_FAILED 4 //A receive or send failed with the errno value [error]
+
+typedef struct {
+	int type; //One of the URING_ kinds above
+	const char* pData; //Received bytes for URING_RECEIVED
+	unsigned __int32 size; //Number of bytes received or sent
+	void* pUser; //Value given to Uring_Queue_Send for URING_SENT
+	int error; //errno value for URING_FAILED
+} Uring_Completion;
+
+typedef struct Uring Uring;
+
+//Sets up a ring for [socket] and starts receiving into the registered buffers.
+//Returns NULL if io_uring or one of the features it needs isn't available.
+Uring* Uring_Create(SOCKET socket);
+
+//Cancels every receive and send still in flight, waits for them to finish and frees the ring.
+//Must be called before the socket is closed, since requests in flight keep it open.
+void Uring_Destroy(Uring* pUring);
+
+//File descriptor that becomes readable when completions are waiting. Watched in place of the socket.
+int Uring_Fd(const Uring* pUring);
+
+//Whether a new chain of sends can be queued. A chain is only started once the previous one has
+//completed, so frames can't be reordered on the stream.
+bool Uring_Can_Send(const Uring* pUring);
+
+//Queues a send of [size] bytes from [pData], linked to the sends queued before it since the last submit.
+//[pData] must stay valid until the send's completion is handed out with [pUser], which can't be NULL.
+//Returns false if too many sends are already queued.
+bool Uring_Queue_Send(Uring* pUring, const void* pData, unsigned __int32 size, void* pUser);
+
+//Submits the queued sends, and the receive if it has to be restarted, in one system call.
+//Returns the number of system calls made, or SOCKET_ERROR with the reason in errno.
+int Uring_Submit(Uring* pUring);
+
+//Takes the next completion. Returns false if none is waiting.
+bool Uring_Next(Uring* pUring, Uring_Completion* pCompletion);
@@ -0,0 +1,197 @@
+#define _CRTDBG_MAP_ALLOC
+#include <stdlib.h>
+#include "Platform.h"
+
+#include "Device.h"
+#include "Event_Loop.h"
+#include "User_Timer.h"
+
+//Called by the wheel when a timer comes due. Calls the application's callback unless the timer was cancelled,
+//then schedules the next call or drops the device's reference.
+static void fire_User_Timer(Timer* pTimer, void* pContext);
+//Takes the timer off the device's list of armed timers.
+static void unlist_User_Timer(DCS_Device* pDevice, DCS_Timer* pUserTimer);
+//Drops a reference to the timer, freeing it if that was the last.
+static void release_User_Timer(DCS_Timer* pUserTimer);
+
+int DCS_Schedule_Timer(DCS_Handle hDevice, unsigned __int32 delay_ms, unsigned __int32 period_ms, DCS_Timer_CB_Def callback, void* pContext, DCS_Timer_Handle* pTimer) {
+	if (pTimer != NULL) {
+		*pTimer = NULL;
+	}
+	if (hDevice == NULL || callback == NULL) {
+		return FRAME_INVALID_DATA;
+	}
+	if (hDevice->hTimerMutex == NULL) {
+		return NETWORK_NOT_READY;
+	}
+
+	DCS_Timer* pUserTimer = calloc(1, sizeof(*pUserTimer));
+	if (pUserTimer == NULL) {
+		return MEMORY_ALLOCATION_ERROR;
+	}
+
+	//The application only holds a reference if it took the handle.
+	pUserTimer->refs = pTimer != NULL ? 2 : 1;
+	pUserTimer->callback = callback;
+	pUserTimer->pContext = pContext;
+	pUserTimer->first = Clock_Now_Ns() + delay_ms * CLOCK_NS_PER_MS;
+	pUserTimer->period = period_ms * CLOCK_NS_PER_MS;
+	pUserTimer->pDevice = hDevice;
+
+	Mutex_Lock(hDevice->hTimerMutex);
+	if (!hDevice->timers_open) {
+		Mutex_Unlock(hDevice->hTimerMutex);
+		free(pUserTimer);
+		return NETWORK_NOT_READY;
+	}
+	pUserTimer->pNextItem = hDevice->pNewTimers;
+	hDevice->pNewTimers = pUserTimer;
+	Atomic_Store_Release(&hDevice->new_timers, 1);
+	Mutex_Unlock(hDevice->hTimerMutex);
+
+	if (pTimer != NULL) {
+		*pTimer = pUserTimer;
+	}
+
+	//The event loop arms the timer on its next pass, which doesn't happen by itself while the connection is quiet.
+	Event_Loop_Wake(hDevice);
+
+	return NO_DCS_ERROR;
+}
+
+int DCS_Cancel_Timer(DCS_Timer_Handle hTimer) {
+	if (hTimer == NULL) {
+		return FRAME_INVALID_DATA;
+	}
+
+	Atomic_Store_Release(&hTimer->cancelled, 1);
+	release_User_Timer(hTimer);
+	return NO_DCS_ERROR;
+}
+
+int User_Timer_Open(DCS_Device* pDevice) {
+	pDevice->hTimerMutex = Mutex_Create();
+	if (pDevice->hTimerMutex == NULL) {
+		return THREAD_START_ERROR;
+	}
+
+	pDevice->pNewTimers = NULL;
+	pDevice->new_timers = 0;
+	pDevice->pTimers = NULL;
+	pDevice->timers_open = true;
+
+	return NO_DCS_ERROR;
+}
+
+void User_Timer_Close(DCS_Device* pDevice) {
+	if (pDevice->hTimerMutex == NULL) {
+		return;
+	}
+
+	//A device that never joined its event loop can still have new timers waiting.
+	DCS_Timer* pNew = pDevice->pNewTimers;
+	pDevice->pNewTimers = NULL;
+	while (pNew != NULL) {
+		DCS_Timer* pUserTimer = pNew;
+		pNew = pUserTimer->pNextItem;
+		release_User_Timer(pUserTimer);
+	}
+
+	Mutex_Destroy(pDevice->hTimerMutex);
+	pDevice->hTimerMutex = NULL;
+}
+
+void User_Timer_Take(DCS_Device* pDevice) {
+	//Most passes have no new timers, so they don't take the lock.
+	if (Atomic_Load_Acquire(&pDevice->new_timers) == 0) {
+		return;
+	}
+
+	Mutex_Lock(pDevice->hTimerMutex);
+	DCS_Timer* pNew = pDevice->pNewTimers;
+	pDevice->pNewTimers = NULL;
+	Atomic_Store_Release(&pDevice->new_timers, 0);
+	Mutex_Unlock(pDevice->hTimerMutex);
+
+	while (pNew != NULL) {
+		DCS_Timer* pUserTimer = pNew;
+		pNew = pUserTimer->pNextItem;
+
+		if (Atomic_Load_Acquire(&pUserTimer->cancelled) != 0) {
+			release_User_Timer(pUserTimer);
+			continue;
+		}
+
+		Timer_Init(&pUserTimer->timer, fire_User_Timer, pUserTimer);
+		Timer_Schedule(pDevice->pWheel, &pUserTimer->timer, pUserTimer->first);
+		pUserTimer->pNextItem = pDevice->pTimers;
+		pDevice->pTimers = pUserTimer;
+	}
+}
+
+void User_Timer_Stop(DCS_Device* pDevice) {
+	if (pDevice->hTimerMutex == NULL) {
+		return;
+	}
+
+	Mutex_Lock(pDevice->hTimerMutex);
+	pDevice->timers_open = false;
+	DCS_Timer* pNew = pDevice->pNewTimers;
+	pDevice->pNewTimers = NULL;
+	Atomic_Store_Release(&pDevice->new_timers, 0);
+	Mutex_Unlock(pDevice->hTimerMutex);
+
+	while (pNew != NULL) {
+		DCS_Timer* pUserTimer = pNew;
+		pNew = pUserTimer->pNextItem;
+		release_User_Timer(pUserTimer);
+	}
+
+	while (pDevice->pTimers != NULL) {
+		DCS_Timer* pUserTimer = pDevice->pTimers;
+		pDevice->pTimers = pUserTimer->pNextItem;
+		Timer_Cancel(pDevice->pWheel, &pUserTimer->timer);
+		release_User_Timer(pUserTimer);
+	}
+}
+
+static void fire_User_Timer(Timer* pTimer, void* pContext) {
+	DCS_Timer* pUserTimer = pContext;
+	DCS_Device* pDevice = pUserTimer->pDevice;
+
+	if (Atomic_Load_Acquire(&pUserTimer->cancelled) == 0) {
+		pUserTimer->callback(pUserTimer->pContext, pUserTimer);
+	}
+
+	//The callback can cancel the timer, so it's checked again. Calls missed while the loop was held up are skipped
+	//rather than made all at once, keeping the calls on the timer's original schedule.
+	if (pUserTimer->period != 0 && Atomic_Load_Acquire(&pUserTimer->cancelled) == 0) {
+		const unsigned __int64 now = Clock_Now_Ns();
+		unsigned __int64 next = pTimer->expires + pUserTimer->period;
+		if (next <= now) {
+			next += ((now - next) / pUserTimer->period + 1) * pUserTimer->period;
+		}
+		Timer_Schedule(pDevice->pWheel, pTimer, next);
+		return;
+	}
+
+	unlist_User_Timer(pDevice, pUserTimer);
+	release_User_Timer(pUserTimer);
+}
+
+static void unlist_User_Timer(DCS_Device* pDevice, DCS_Timer* pUserTimer) {
+	DCS_Timer** ppUserTimer = &pDevice->pTimers;
+	while (*ppUserTimer != NULL) {
+		if (*ppUserTimer == pUserTimer) {
+			*ppUserTimer = pUserTimer->pNextItem;
+			return;
+		}
+		ppUserTimer = &(*ppUserTimer)->pNextItem;
+	}
+}
+
+static void release_User_Timer(DCS_Timer* pUserTimer) {
+	if (Atomic_Decrement(&pUserTimer->refs) == 0) {
+		free(pUserTimer);
+	}
+}
@@ -0,0 +1,39 @@
+#pragma once
+#include <stdbool.h>
+#include "Platform.h"
+#include "Internal.h"
+#include "DCS_Driver.h"
+#include "Timer_Wheel.h"
+
+//Timers the application schedules with DCS_Schedule_Timer. Any thread can schedule one, so new timers are handed to
+//the device's event loop through a list guarded by the device's hTimerMutex, and the loop arms them in its wheel on
+//its next pass. A timer is referenced by the application until DCS_Cancel_Timer and by the device until it has fired
+//for the last time. Cancelling only marks the timer, since its device may be gone by then, and the event loop drops it
+//when it next comes due.
+
+typedef struct DCS_Timer DCS_Timer;
+
+struct DCS_Timer {
+	Timer timer; //Entry in the event loop's wheel. Only used by the loop thread.
+	DCS_Timer_CB_Def callback; //Called each time the timer fires
+	void* pContext; //Passed to callback
+	unsigned __int64 first; //Clock_Now_Ns time of the first call
+	unsigned __int64 period; //Nanoseconds between calls, 0 if the timer only fires once
+	volatile unsigned __int32 refs; //References held, the timer is freed when the last is dropped
+	volatile unsigned __int32 cancelled; //Set by DCS_Cancel_Timer
+	DCS_Device* pDevice; //Device whose event loop fires the timer
+	struct DCS_Timer* pNextItem; //Next timer in the device's list of new or armed timers
+};
+
+//Sets up the device's timer list and starts taking timers. Called when the device is opened.
+//Returns a standard DCS status code.
+int User_Timer_Open(DCS_Device* pDevice);
+
+//Frees what User_Timer_Open set up. Called once the device's event loop has stopped serving it.
+void User_Timer_Close(DCS_Device* pDevice);
+
+//Arms the timers scheduled since the last pass in the device's wheel. Called by the event loop on every pass.
+void User_Timer_Take(DCS_Device* pDevice);
+
+//Stops taking timers for the device and drops every one it holds. Called by the event loop when the device leaves it.
+void User_Timer_Stop(DCS_Device* pDevice);
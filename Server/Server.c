@@ -1,6 +1,6 @@
 #define _CRTDBG_MAP_ALLOC
 #include <stdlib.h>
-#include <crtdbg.h>
+#include "Platform.h"
 #include <stdio.h>
 
 #include "Server_Lib.h"
@@ -8,11 +8,12 @@
 
 #define DEFAULT_PORT "50000"
 
-int main(void) {
+//Serves one client at a time on the port given as the first argument, or DEFAULT_PORT.
+int main(int argc, char* argv[]) {
 	//Needed to detect and output memory leaks in debug mode.
 	_CrtSetDbgFlag(_CRTDBG_ALLOC_MEM_DF | _CRTDBG_LEAK_CHECK_DF);
 
-	int result = Start_Server(DEFAULT_PORT);
+	int result = Start_Server(argc > 1 ? argv[1] : DEFAULT_PORT);
 	if (result != NO_DCS_ERROR) {
 		return result;
 	}
@@ -0,0 +1,335 @@
+#include <string.h>
+
+#include "Checksum.h"
+#include "Endianess.h"
+
+//Pick the widest XOR the compiler is allowed to emit.
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define CHECKSUM_USE_AVX2
+#define CHECKSUM_USE_SSE2
+#elif defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || defined(__SSE2__)
+#include <emmintrin.h>
+#define CHECKSUM_USE_SSE2
+#elif defined(_M_ARM64) || defined(__ARM_NEON)
+#include <arm_neon.h>
+#define CHECKSUM_USE_NEON
+#endif
+
+//Folds a 64 bit XOR accumulator down to a single byte.
+static inline Checksum fold_64(unsigned __int64 value) {
+	value ^= value >> 32;
+	value ^= value >> 16;
+	value ^= value >> 8;
+	return (Checksum)value;
+}
+
+#if defined(CHECKSUM_USE_SSE2)
+static inline Checksum fold_128(__m128i value) {
+	unsigned __int64 words[2];
+	_mm_storeu_si128((__m128i*)words, value);
+	return fold_64(words[0] ^ words[1]);
+}
+#elif defined(CHECKSUM_USE_NEON)
+static inline Checksum fold_128(uint8x16_t value) {
+	uint64x2_t words = vreinterpretq_u64_u8(value);
+	return fold_64(vgetq_lane_u64(words, 0) ^ vgetq_lane_u64(words, 1));
+}
+#endif
+
+#if defined(CHECKSUM_USE_AVX2)
+static inline Checksum fold_256(__m256i value) {
+	return fold_128(_mm_xor_si128(_mm256_castsi256_si128(value), _mm256_extracti128_si256(value, 1)));
+}
+#endif
+
+Checksum checksum_update(Checksum checksum, const void* pData, size_t size) {
+	const unsigned char* pIn = pData;
+	size_t x = 0;
+
+#if defined(CHECKSUM_USE_AVX2)
+	if (size >= 32) {
+		__m256i acc = _mm256_setzero_si256();
+		for (; x + 32 <= size; x += 32) {
+			acc = _mm256_xor_si256(acc, _mm256_loadu_si256((const __m256i*)&pIn[x]));
+		}
+		checksum ^= fold_256(acc);
+	}
+#endif
+
+#if defined(CHECKSUM_USE_SSE2)
+	if (size - x >= 16) {
+		__m128i acc = _mm_setzero_si128();
+		for (; x + 16 <= size; x += 16) {
+			acc = _mm_xor_si128(acc, _mm_loadu_si128((const __m128i*)&pIn[x]));
+		}
+		checksum ^= fold_128(acc);
+	}
+#elif defined(CHECKSUM_USE_NEON)
+	if (size - x >= 16) {
+		uint8x16_t acc = vdupq_n_u8(0);
+		for (; x + 16 <= size; x += 16) {
+			acc = veorq_u8(acc, vld1q_u8(&pIn[x]));
+		}
+		checksum ^= fold_128(acc);
+	}
+#endif
+
+	//Word-wide tail, or the whole buffer if no vector instructions are available.
+	unsigned __int64 word_acc = 0;
+	for (; x + sizeof(word_acc) <= size; x += sizeof(word_acc)) {
+		unsigned __int64 word;
+		memcpy(&word, &pIn[x], sizeof(word));
+		word_acc ^= word;
+	}
+	checksum ^= fold_64(word_acc);
+
+	for (; x < size; x++) {
+		checksum ^= pIn[x];
+	}
+
+	return checksum;
+}
+
+Checksum copy_checksum(void* pDest, const void* pSrc, size_t size, Checksum checksum) {
+	unsigned char* pOut = pDest;
+	const unsigned char* pIn = pSrc;
+	size_t x = 0;
+
+#if defined(CHECKSUM_USE_AVX2)
+	if (size >= 32) {
+		__m256i acc = _mm256_setzero_si256();
+		for (; x + 32 <= size; x += 32) {
+			__m256i v = _mm256_loadu_si256((const __m256i*)&pIn[x]);
+			_mm256_storeu_si256((__m256i*)&pOut[x], v);
+			acc = _mm256_xor_si256(acc, v);
+		}
+		checksum ^= fold_256(acc);
+	}
+#endif
+
+#if defined(CHECKSUM_USE_SSE2)
+	if (size - x >= 16) {
+		__m128i acc = _mm_setzero_si128();
+		for (; x + 16 <= size; x += 16) {
+			__m128i v = _mm_loadu_si128((const __m128i*)&pIn[x]);
+			_mm_storeu_si128((__m128i*)&pOut[x], v);
+			acc = _mm_xor_si128(acc, v);
+		}
+		checksum ^= fold_128(acc);
+	}
+#elif defined(CHECKSUM_USE_NEON)
+	if (size - x >= 16) {
+		uint8x16_t acc = vdupq_n_u8(0);
+		for (; x + 16 <= size; x += 16) {
+			uint8x16_t v = vld1q_u8(&pIn[x]);
+			vst1q_u8(&pOut[x], v);
+			acc = veorq_u8(acc, v);
+		}
+		checksum ^= fold_128(acc);
+	}
+#endif
+
+	unsigned __int64 word_acc = 0;
+	for (; x + sizeof(word_acc) <= size; x += sizeof(word_acc)) {
+		unsigned __int64 word;
+		memcpy(&word, &pIn[x], sizeof(word));
+		memcpy(&pOut[x], &word, sizeof(word));
+		word_acc ^= word;
+	}
+	checksum ^= fold_64(word_acc);
+
+	for (; x < size; x++) {
+		pOut[x] = pIn[x];
+		checksum ^= pIn[x];
+	}
+
+	return checksum;
+}
+
+Checksum compute_checksum(const char* pDataBuf, unsigned __int32 size) {
+	return checksum_update(0, pDataBuf, size);
+}
+
+bool check_checksum(const char* pDataBuf, unsigned __int32 size) {
+	//The checksum byte cancels out the rest of a valid frame.
+	return checksum_update(0, pDataBuf, size) == 0x00;
+}
+
+////////////////////
+//CRC32C (Castagnoli)
+////////////////////
+
+//Reflected CRC32C polynomial.
+#define CRC32C_POLY 0x82F63B78
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define CRC32C_USE_SSE42
+#include <nmmintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define CRC32C_TARGET
+#else
+#include <cpuid.h>
+#define CRC32C_TARGET __attribute__((target("sse4.2")))
+#endif
+#elif defined(__ARM_FEATURE_CRC32)
+#define CRC32C_USE_ARM
+#include <arm_acle.h>
+#elif defined(_M_ARM64)
+#define CRC32C_USE_ARM
+#include <intrin.h>
+#endif
+
+//Slicing-by-8 table for CPUs without CRC instructions.
+static unsigned __int32 crc32c_table[8][256];
+//Whether crc32c_init has run.
+static bool crc32c_ready = false;
+//Whether the CPU has CRC32C instructions.
+static bool crc32c_hw = false;
+
+void crc32c_init(void) {
+	if (crc32c_ready) {
+		return;
+	}
+
+	for (unsigned __int32 n = 0; n < 256; n++) {
+		unsigned __int32 crc = n;
+		for (int k = 0; k < 8; k++) {
+			crc = (crc & 1) ? (crc >> 1) ^ CRC32C_POLY : crc >> 1;
+		}
+		crc32c_table[0][n] = crc;
+	}
+	for (unsigned __int32 n = 0; n < 256; n++) {
+		unsigned __int32 crc = crc32c_table[0][n];
+		for (int k = 1; k < 8; k++) {
+			crc = crc32c_table[0][crc & 0xFF] ^ (crc >> 8);
+			crc32c_table[k][n] = crc;
+		}
+	}
+
+#if defined(CRC32C_USE_SSE42)
+	//SSE4.2 is reported in bit 20 of ECX for CPUID leaf 1.
+#if defined(_MSC_VER)
+	int info[4];
+	__cpuid(info, 1);
+	crc32c_hw = (info[2] & (1 << 20)) != 0;
+#else
+	unsigned int eax, ebx, ecx, edx;
+	crc32c_hw = __get_cpuid(1, &eax, &ebx, &ecx, &edx) && (ecx & (1 << 20)) != 0;
+#endif
+#elif defined(CRC32C_USE_ARM)
+	crc32c_hw = true;
+#endif
+
+	crc32c_ready = true;
+}
+
+//Slicing-by-8 CRC32C over the already inverted [crc], copying to [pOut] if it isn't NULL.
+static unsigned __int32 crc32c_sw(unsigned __int32 crc, unsigned char* pOut, const unsigned char* pIn, size_t size) {
+	size_t x = 0;
+	for (; x + 8 <= size; x += 8) {
+		unsigned __int32 lo;
+		unsigned __int32 hi;
+		memcpy(&lo, &pIn[x], sizeof(lo));
+		memcpy(&hi, &pIn[x + 4], sizeof(hi));
+		if (pOut != NULL) {
+			memcpy(&pOut[x], &pIn[x], 8);
+		}
+
+		//The table works on little endian words.
+#if ENDIANESS_HOST == DCS_BIG_ENDIAN
+		lo = Swap32(lo);
+		hi = Swap32(hi);
+#endif
+		lo ^= crc;
+		crc = crc32c_table[7][lo & 0xFF] ^ crc32c_table[6][(lo >> 8) & 0xFF] ^
+			crc32c_table[5][(lo >> 16) & 0xFF] ^ crc32c_table[4][lo >> 24] ^
+			crc32c_table[3][hi & 0xFF] ^ crc32c_table[2][(hi >> 8) & 0xFF] ^
+			crc32c_table[1][(hi >> 16) & 0xFF] ^ crc32c_table[0][hi >> 24];
+	}
+	for (; x < size; x++) {
+		if (pOut != NULL) {
+			pOut[x] = pIn[x];
+		}
+		crc = crc32c_table[0][(crc ^ pIn[x]) & 0xFF] ^ (crc >> 8);
+	}
+	return crc;
+}
+
+#if defined(CRC32C_USE_SSE42)
+//CRC32C using the SSE4.2 crc32 instruction over the already inverted [crc], copying to [pOut] if it isn't NULL.
+static CRC32C_TARGET unsigned __int32 crc32c_hw_update(unsigned __int32 crc, unsigned char* pOut, const unsigned char* pIn, size_t size) {
+	size_t x = 0;
+#if defined(_M_X64) || defined(__x86_64__)
+	unsigned __int64 crc64 = crc;
+	for (; x + 8 <= size; x += 8) {
+		unsigned __int64 word;
+		memcpy(&word, &pIn[x], sizeof(word));
+		if (pOut != NULL) {
+			memcpy(&pOut[x], &word, sizeof(word));
+		}
+		crc64 = _mm_crc32_u64(crc64, word);
+	}
+	crc = (unsigned __int32)crc64;
+#endif
+	for (; x + 4 <= size; x += 4) {
+		unsigned __int32 word;
+		memcpy(&word, &pIn[x], sizeof(word));
+		if (pOut != NULL) {
+			memcpy(&pOut[x], &word, sizeof(word));
+		}
+		crc = _mm_crc32_u32(crc, word);
+	}
+	for (; x < size; x++) {
+		if (pOut != NULL) {
+			pOut[x] = pIn[x];
+		}
+		crc = _mm_crc32_u8(crc, pIn[x]);
+	}
+	return crc;
+}
+#elif defined(CRC32C_USE_ARM)
+//CRC32C using the ARMv8 crc32c instructions over the already inverted [crc], copying to [pOut] if it isn't NULL.
+static unsigned __int32 crc32c_hw_update(unsigned __int32 crc, unsigned char* pOut, const unsigned char* pIn, size_t size) {
+	size_t x = 0;
+	for (; x + 8 <= size; x += 8) {
+		unsigned __int64 word;
+		memcpy(&word, &pIn[x], sizeof(word));
+		if (pOut != NULL) {
+			memcpy(&pOut[x], &word, sizeof(word));
+		}
+		crc = __crc32cd(crc, word);
+	}
+	for (; x < size; x++) {
+		if (pOut != NULL) {
+			pOut[x] = pIn[x];
+		}
+		crc = __crc32cb(crc, pIn[x]);
+	}
+	return crc;
+}
+#endif
+
+//Runs the CRC32C implementation picked by crc32c_init.
+static unsigned __int32 crc32c_run(unsigned __int32 crc, unsigned char* pOut, const unsigned char* pIn, size_t size) {
+	if (!crc32c_ready) {
+		crc32c_init();
+	}
+
+	crc = ~crc;
+#if defined(CRC32C_USE_SSE42) || defined(CRC32C_USE_ARM)
+	if (crc32c_hw) {
+		return ~crc32c_hw_update(crc, pOut, pIn, size);
+	}
+#endif
+	return ~crc32c_sw(crc, pOut, pIn, size);
+}
+
+unsigned __int32 crc32c_update(unsigned __int32 crc, const void* pData, size_t size) {
+	return crc32c_run(crc, NULL, pData, size);
+}
+
+unsigned __int32 copy_crc32c(void* pDest, const void* pSrc, size_t size, unsigned __int32 crc) {
+	return crc32c_run(crc, pDest, pSrc, size);
+}
@@ -0,0 +1,39 @@
+#pragma once
+#include <stddef.h>
+#include <stdbool.h>
+#include "Platform.h"
+
+//Checksum of DCS frame is an 8 bit integer.
+typedef unsigned __int8 Checksum;
+
+//The DCS checksum is the XOR of every byte in the frame, so it can be computed on wide words
+//and folded down to a byte at the end. All functions give the same result as a byte-wise XOR.
+
+//XORs [size] bytes from [pData] into [checksum] and returns the result.
+Checksum checksum_update(Checksum checksum, const void* pData, size_t size);
+
+//Copies [size] bytes from [pSrc] to [pDest] while XORing them into [checksum] so the data is only read once.
+//Returns the updated checksum. The buffers must not overlap.
+Checksum copy_checksum(void* pDest, const void* pSrc, size_t size, Checksum checksum);
+
+//Computes a checksum from a given DCS frame.
+Checksum compute_checksum(const char* pDataBuf, unsigned __int32 size);
+
+//Checks given checksum from a full DCS frame.
+//Returns true if checksum is valid. False otherwise.
+bool check_checksum(const char* pDataBuf, unsigned __int32 size);
+
+//Size of the CRC32C trailer on FRAME_VERSION_CRC32C frames.
+#define CRC32C_SIZE 4
+
+//Picks the CRC32C implementation for this CPU and builds the fallback table.
+//Called before the COM thread starts so the CRC32C functions are safe to use from any thread afterwards.
+void crc32c_init(void);
+
+//Continues the CRC32C [crc] of earlier data over [size] bytes from [pData]. Start with a crc of 0.
+//Uses the SSE4.2 or ARMv8 CRC instructions when available and slicing-by-8 otherwise.
+unsigned __int32 crc32c_update(unsigned __int32 crc, const void* pData, size_t size);
+
+//Copies [size] bytes from [pSrc] to [pDest] while continuing the CRC32C [crc] over them.
+//Returns the updated CRC32C. The buffers must not overlap.
+unsigned __int32 copy_crc32c(void* pDest, const void* pSrc, size_t size, unsigned __int32 crc);
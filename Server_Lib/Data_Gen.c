@@ -1,7 +1,8 @@
 #define _CRT_RAND_S
 #define _CRTDBG_MAP_ALLOC
 #include <stdlib.h>
-#include <crtdbg.h>
+#include "Platform.h"
+#include <limits.h>
 
 #include "Server_Lib.h"
 #include "Data_Gen.h"
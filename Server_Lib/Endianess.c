@@ -0,0 +1,241 @@
+#include <string.h>
+
+#include "Endianess.h"
+
+//Pick the widest byte shuffle the compiler is allowed to emit. SWAP_ALL_PATHS keeps the narrower x86 one as well,
+//so the paths can be compared against each other.
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define SWAP_USE_AVX2
+#define SWAP_USE_SSSE3
+#elif defined(__SSSE3__) || defined(__AVX__)
+#include <tmmintrin.h>
+#define SWAP_USE_SSSE3
+#endif
+#if (defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || defined(__SSE2__)) && \
+	(!defined(SWAP_USE_SSSE3) || defined(SWAP_ALL_PATHS))
+#include <emmintrin.h>
+#define SWAP_USE_SSE2
+#endif
+#if defined(_M_ARM64) || defined(__ARM_NEON)
+#include <arm_neon.h>
+#define SWAP_USE_NEON
+#endif
+
+/*6 endianess management functions are defined with 5 character function names.
+The first 4 characters describe which direction the conversion is doing.
+"htoo" refers to "host to output" & "itoh" refers to "input to host".
+The last character refers to the data type. "l" is long, "s" is short,
+"f" is float.*/
+
+//Swaps the byte order of a float.
+static inline float swap_float(const float inFloat) {
+	float retVal = 0.0f;
+	char* floatToConvert = (char*)&inFloat;
+	char* returnFloat = (char*)&retVal;
+
+	//Swap the bytes into a temporary buffer
+	returnFloat[0] = floatToConvert[3];
+	returnFloat[1] = floatToConvert[2];
+	returnFloat[2] = floatToConvert[1];
+	returnFloat[3] = floatToConvert[0];
+
+	return retVal;
+}
+
+//Converts long from host to output byte order.
+u_long htool(u_long hostlong) {
+#if SWAP_OUTPUT
+	return Swap32(hostlong);
+#else
+	return hostlong;
+#endif
+}
+
+//Converts short from host to output byte order.
+u_short htoos(u_short hostshort) {
+#if SWAP_OUTPUT
+	return Swap16(hostshort);
+#else
+	return hostshort;
+#endif
+}
+
+//Converts float from host to output byte order.
+float htoof(float value) {
+#if SWAP_OUTPUT
+	return swap_float(value);
+#else
+	return value;
+#endif
+}
+
+//Converts long from input to host byte order.
+u_long itohl(u_long ilong) {
+#if SWAP_INPUT
+	return Swap32(ilong);
+#else
+	return ilong;
+#endif
+}
+
+//Converts short from input to host byte order.
+u_short itohs(u_short ishort) {
+#if SWAP_INPUT
+	return Swap16(ishort);
+#else
+	return ishort;
+#endif
+}
+
+//Converts float from input to host byte order.
+float itohf(float value) {
+#if SWAP_INPUT
+	return swap_float(value);
+#else
+	return value;
+#endif
+}
+
+//The array swaps are only built where the host's byte order differs from the input or output one, or where
+//SWAP_ALL_PATHS asks for them to be compared.
+#if SWAP_INPUT || SWAP_OUTPUT || defined(SWAP_ALL_PATHS)
+//Each path reverses the bytes of [count] 32 bit values from [pSrc] into [pDest], leaving the values that don't fill
+//a vector to the narrower paths.
+
+//Swaps one value at a time. Used for the tails of the vector paths, or the whole array if there are none.
+static void swap32_scalar(void* pDest, const void* pSrc, size_t count) {
+	unsigned char* pOut = pDest;
+	const unsigned char* pIn = pSrc;
+
+	for (size_t x = 0; x < count; x++) {
+		unsigned __int32 value;
+		memcpy(&value, &pIn[x * 4], sizeof(value));
+		value = Swap32(value);
+		memcpy(&pOut[x * 4], &value, sizeof(value));
+	}
+}
+
+#if defined(SWAP_USE_SSE2)
+//Without pshufb, swaps the 16 bit halves of each value and then the bytes of each half.
+static void swap32_sse2(void* pDest, const void* pSrc, size_t count) {
+	unsigned char* pOut = pDest;
+	const unsigned char* pIn = pSrc;
+	size_t x = 0;
+
+	for (; x + 4 <= count; x += 4) {
+		__m128i v = _mm_loadu_si128((const __m128i*)&pIn[x * 4]);
+		v = _mm_shufflelo_epi16(v, _MM_SHUFFLE(2, 3, 0, 1));
+		v = _mm_shufflehi_epi16(v, _MM_SHUFFLE(2, 3, 0, 1));
+		v = _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+		_mm_storeu_si128((__m128i*)&pOut[x * 4], v);
+	}
+
+	swap32_scalar(&pOut[x * 4], &pIn[x * 4], count - x);
+}
+#endif
+
+#if defined(SWAP_USE_SSSE3)
+static void swap32_ssse3(void* pDest, const void* pSrc, size_t count) {
+	unsigned char* pOut = pDest;
+	const unsigned char* pIn = pSrc;
+	size_t x = 0;
+
+	const __m128i mask128 = _mm_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+	for (; x + 4 <= count; x += 4) {
+		__m128i v = _mm_loadu_si128((const __m128i*)&pIn[x * 4]);
+		_mm_storeu_si128((__m128i*)&pOut[x * 4], _mm_shuffle_epi8(v, mask128));
+	}
+
+	swap32_scalar(&pOut[x * 4], &pIn[x * 4], count - x);
+}
+#endif
+
+#if defined(SWAP_USE_AVX2)
+static void swap32_avx2(void* pDest, const void* pSrc, size_t count) {
+	unsigned char* pOut = pDest;
+	const unsigned char* pIn = pSrc;
+	size_t x = 0;
+
+	const __m256i mask256 = _mm256_setr_epi8(
+		3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12,
+		3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+	for (; x + 8 <= count; x += 8) {
+		__m256i v = _mm256_loadu_si256((const __m256i*)&pIn[x * 4]);
+		_mm256_storeu_si256((__m256i*)&pOut[x * 4], _mm256_shuffle_epi8(v, mask256));
+	}
+
+	swap32_ssse3(&pOut[x * 4], &pIn[x * 4], count - x);
+}
+#endif
+
+#if defined(SWAP_USE_NEON)
+static void swap32_neon(void* pDest, const void* pSrc, size_t count) {
+	unsigned char* pOut = pDest;
+	const unsigned char* pIn = pSrc;
+	size_t x = 0;
+
+	for (; x + 4 <= count; x += 4) {
+		vst1q_u8(&pOut[x * 4], vrev32q_u8(vld1q_u8(&pIn[x * 4])));
+	}
+
+	swap32_scalar(&pOut[x * 4], &pIn[x * 4], count - x);
+}
+#endif
+#endif
+
+#if SWAP_INPUT || SWAP_OUTPUT
+//Reverses the bytes of [count] 32 bit values from [pSrc] into [pDest] with the widest path available.
+static void swap32_array(void* pDest, const void* pSrc, size_t count) {
+#if defined(SWAP_USE_AVX2)
+	swap32_avx2(pDest, pSrc, count);
+#elif defined(SWAP_USE_SSSE3)
+	swap32_ssse3(pDest, pSrc, count);
+#elif defined(SWAP_USE_SSE2)
+	swap32_sse2(pDest, pSrc, count);
+#elif defined(SWAP_USE_NEON)
+	swap32_neon(pDest, pSrc, count);
+#else
+	swap32_scalar(pDest, pSrc, count);
+#endif
+}
+#endif
+
+//Copies [count] 32 bit values when no swap is needed.
+static inline void copy32_array(void* pDest, const void* pSrc, size_t count) {
+	if (pDest != pSrc) {
+		memcpy(pDest, pSrc, count * sizeof(unsigned __int32));
+	}
+}
+
+void htoo32_array(void* pDest, const void* pSrc, size_t count) {
+#if SWAP_OUTPUT
+	swap32_array(pDest, pSrc, count);
+#else
+	copy32_array(pDest, pSrc, count);
+#endif
+}
+
+void itoh32_array(void* pDest, const void* pSrc, size_t count) {
+#if SWAP_INPUT
+	swap32_array(pDest, pSrc, count);
+#else
+	copy32_array(pDest, pSrc, count);
+#endif
+}
+
+void htoof_array(void* pDest, const float* pSrc, size_t count) {
+	htoo32_array(pDest, pSrc, count);
+}
+
+void htool_array(void* pDest, const unsigned __int32* pSrc, size_t count) {
+	htoo32_array(pDest, pSrc, count);
+}
+
+void itohf_array(float* pDest, const void* pSrc, size_t count) {
+	itoh32_array(pDest, pSrc, count);
+}
+
+void itohl_array(unsigned __int32* pDest, const void* pSrc, size_t count) {
+	itoh32_array(pDest, pSrc, count);
+}
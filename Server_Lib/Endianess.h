@@ -0,0 +1,83 @@
+#pragma once
+#include <stddef.h>
+#include "Platform.h"
+
+//Byte orders
+#define DCS_BIG_ENDIAN 0 //network byte order
+#define DCS_LITTLE_ENDIAN 1
+
+//Sets endianess of packaged/received data
+#define ENDIANESS_OUTPUT DCS_LITTLE_ENDIAN
+#define ENDIANESS_INPUT DCS_LITTLE_ENDIAN
+
+//Byte order of the host, resolved at compile time so conversions that aren't needed compile away.
+#if defined(_M_IX86) || defined(_M_X64) || defined(_M_ARM) || defined(_M_ARM64) || \
+	(defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)
+#define ENDIANESS_HOST DCS_LITTLE_ENDIAN
+#elif defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+#define ENDIANESS_HOST DCS_BIG_ENDIAN
+#else
+#error "Unable to determine the host byte order."
+#endif
+
+//True if the current system is big endian
+#define IS_BIG_ENDIAN (ENDIANESS_HOST == DCS_BIG_ENDIAN)
+
+//True if data has to be swapped going from host to output or from input to host.
+#define SWAP_OUTPUT (ENDIANESS_HOST != ENDIANESS_OUTPUT)
+#define SWAP_INPUT (ENDIANESS_HOST != ENDIANESS_INPUT)
+
+//Swaps endianess of 16 bit field
+#define Swap16(data) \
+( (((data) >> 8) & 0x00FF) | (((data) << 8) & 0xFF00) )
+
+//Swaps endianess of 32 bit field
+#define Swap32(data)   \
+( (((data) >> 24) & 0x000000FF) | (((data) >>  8) & 0x0000FF00) | \
+  (((data) <<  8) & 0x00FF0000) | (((data) << 24) & 0xFF000000) )
+
+//Host to output functions//
+
+//Converts host long to ENDIANESS_OUTPUT endianess.
+u_long htool(u_long hlong);
+
+//Converts host short to ENDIANESS_OUTPUT endianess.
+u_short htoos(u_short hshort);
+
+//Converts host float to ENDIANESS_OUTPUT endianess.
+float htoof(float value);
+
+//Input to host functions//
+
+//Converts ENDIANESS_INPUT endianess long to host endianess.
+u_long itohl(u_long ilong);
+
+//Converts ENDIANESS_INPUT endianess short to host endianess.
+u_short itohs(u_short ishort);
+
+//Converts ENDIANESS_INPUT endianess float to host endianess.
+float itohf(float value);
+
+//Array functions//
+//Convert [count] 32 bit values at a time. The source and destination don't need to be aligned
+//and may be the same buffer, but they must not otherwise overlap.
+
+//Converts an array of host floats to ENDIANESS_OUTPUT endianess.
+void htoof_array(void* pDest, const float* pSrc, size_t count);
+
+//Converts an array of host longs to ENDIANESS_OUTPUT endianess.
+void htool_array(void* pDest, const unsigned __int32* pSrc, size_t count);
+
+//Converts an array of ENDIANESS_INPUT endianess floats to host endianess.
+void itohf_array(float* pDest, const void* pSrc, size_t count);
+
+//Converts an array of ENDIANESS_INPUT endianess longs to host endianess.
+void itohl_array(unsigned __int32* pDest, const void* pSrc, size_t count);
+
+//Converts records made up only of 32 bit fields (e.g. BFI_Data) to ENDIANESS_OUTPUT endianess.
+//[count] is the number of 32 bit fields, not records.
+void htoo32_array(void* pDest, const void* pSrc, size_t count);
+
+//Converts records made up only of 32 bit fields (e.g. BFI_Data) from ENDIANESS_INPUT endianess.
+//[count] is the number of 32 bit fields, not records.
+void itoh32_array(void* pDest, const void* pSrc, size_t count);
@@ -0,0 +1,45 @@
+#pragma once
+#include <stdbool.h>
+#include "Platform.h"
+
+//Splits the received byte stream into DCS frames. Data is received straight into the framer's buffer
+//and complete frames are handed out where they are, so nothing is copied after recv. Partial frames are
+//kept between reads, and the buffer only grows as far as the largest frame (plus one read) requires.
+
+//Smallest amount of free space offered to recv. Also the initial size of the buffer.
+#define FRAMER_MIN_READ 4096
+
+//Largest frame accepted, excluding the prepended frame size. A bigger prepended frame size means the
+//stream is corrupt or out of sync, and since frames can't be found again the connection can't continue.
+#define FRAMER_MAX_FRAME_SIZE (64 * 1024 * 1024)
+
+//Results of Framer_Next.
+#define FRAMER_NEED_MORE 0 //No complete frame is buffered
+#define FRAMER_FRAME 1 //A complete frame was handed out
+#define FRAMER_BAD_SIZE 2 //The prepended frame size is larger than FRAMER_MAX_FRAME_SIZE
+
+typedef struct {
+	char* pBuffer; //Received bytes, starting with the first frame not yet handed out
+	unsigned __int32 capacity; //Number of bytes pBuffer can hold
+	unsigned __int32 start; //Offset of the first byte not yet handed out
+	unsigned __int32 end; //Offset one past the last received byte
+} Framer;
+
+//Initializes an empty framer. No memory is allocated until the first Framer_Reserve.
+void Framer_Init(Framer* pFramer);
+
+//Frees the framer's buffer and leaves it empty, ready to be used again.
+void Framer_Free(Framer* pFramer);
+
+//Returns where the next [*pAvailable] received bytes should be written, making room for at least
+//FRAMER_MIN_READ bytes or the rest of the frame being received, whichever is larger.
+//Frames handed out by Framer_Next are invalidated. Returns NULL if memory couldn't be allocated.
+char* Framer_Reserve(Framer* pFramer, unsigned __int32* pAvailable);
+
+//Adds [count] bytes written to the space given by Framer_Reserve to the buffered data.
+void Framer_Commit(Framer* pFramer, unsigned __int32 count);
+
+//Hands out the next complete frame *excluding* the prepended frame size. [*ppFrame] points into the
+//framer's buffer and stays valid until the next call to Framer_Reserve or Framer_Free.
+//Returns FRAMER_FRAME, FRAMER_NEED_MORE or FRAMER_BAD_SIZE.
+int Framer_Next(Framer* pFramer, char** ppFrame, unsigned __int32* pSize);
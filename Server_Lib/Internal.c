@@ -1,6 +1,6 @@
 #define _CRTDBG_MAP_ALLOC
 #include <stdlib.h>
-#include <crtdbg.h>
+#include "Platform.h"
 #include <stdio.h>
 #include <math.h>
 #include <time.h>
@@ -13,6 +13,9 @@
 static int Send_DCS_Data(Data_ID data_ID, char* pDataBuf, const unsigned __int32 BufferSize);
 static int Send_Command_Ack(Data_ID id);
 
+//Sequence ID of the command being processed, echoed in every frame sent while it's processed.
+static Sequence_ID reply_sequence = 0;
+
 static int Send_Intensity_Data(Intensity_Data* dataArray, unsigned __int32 arrLength);
 static int Send_BFI_Data(BFI_Data* dataArray, unsigned __int32 arrLength);
 static int Send_Corr_Intensity_Data(Corr_Intensity_Data* dataArray, unsigned __int32 arrLength, float* delays, unsigned __int32 delay_Num);
@@ -33,10 +36,12 @@ static int Process_Get_Analyzer_Prefit();
 int process_recv(char* buff, unsigned __int32 buffLen) {
 	hexDump("process_recv", buff, buffLen);
 
-	//Verify checksum.
-	if (!check_checksum(buff, buffLen)) {
-		printf("Checksum error\n");
-		return FRAME_CHECKSUM_ERROR;
+	//The checksum was verified by recv_data as the frame was received.
+
+	//Frame must at least hold the header, type id, data id and checksum.
+	if (buffLen < sizeof(Frame_Version) + sizeof(Type_ID) + sizeof(Data_ID) + sizeof(Checksum)) {
+		printf("Frame too short\n");
+		return FRAME_INVALID_DATA;
 	}
 
 	unsigned __int32 index = 0; //Index to track position in buff.
@@ -47,11 +52,22 @@ int process_recv(char* buff, unsigned __int32 buffLen) {
 	index += sizeof(header);
 
 	header = itohs(header);
-	if (header != FRAME_VERSION) {
+	if (!Frame_Version_Valid(header)) {
 		printf("Invalid header\n");
 		return FRAME_VERSION_ERROR;
 	}
 
+	//Sequenced frames have a sequence ID after the data ID, and CRC32C frames end in a 4 byte trailer instead of the 1 byte checksum.
+	const unsigned __int32 headerSize = Frame_Header_Size(header);
+	const unsigned __int32 trailerSize = Frame_Trailer_Size(header);
+	if (buffLen < headerSize + trailerSize) {
+		printf("Frame too short\n");
+		return FRAME_INVALID_DATA;
+	}
+
+	//Reply with the same integrity check and sequencing the client used.
+	Set_Frame_Format(trailerSize == CRC32C_SIZE ? FRAME_CHECK_CRC32C : FRAME_CHECK_XOR, headerSize > sizeof(Frame_Version) + sizeof(Type_ID) + sizeof(Data_ID));
+
 	//Ensure type id is correct.
 	Type_ID type_id;
 	memcpy(&type_id, &buff[index], sizeof(type_id));
@@ -70,8 +86,17 @@ int process_recv(char* buff, unsigned __int32 buffLen) {
 
 	data_id = itohl(data_id);
 
+	//Replies to this command carry its sequence ID so the client can match them to it.
+	Sequence_ID sequence = 0;
+	if (index < headerSize) {
+		memcpy(&sequence, &buff[index], sizeof(sequence));
+		index += sizeof(sequence);
+
+		sequence = itohl(sequence);
+	}
+
 	//Obtain just the data portion of the frame and place in pDataBuff.
-	unsigned int pDataBuffLen = buffLen - sizeof(data_id) - sizeof(type_id) - sizeof(header) - sizeof(Checksum);
+	unsigned int pDataBuffLen = buffLen - headerSize - trailerSize;
 	char* pDataBuff = malloc(pDataBuffLen);
 	if (pDataBuff == NULL) {
 		return MEMORY_ALLOCATION_ERROR;
@@ -80,6 +105,7 @@ int process_recv(char* buff, unsigned __int32 buffLen) {
 	memcpy(pDataBuff, &buff[index], pDataBuffLen);
 	index += pDataBuffLen;
 
+	reply_sequence = sequence;
 	Send_Command_Ack(data_id);
 
 	//Call the correct callbacks based on data id with pDataBuff.
@@ -139,38 +165,22 @@ int process_recv(char* buff, unsigned __int32 buffLen) {
 
 		default:
 			printf("ERROR: Invalid Command Received");
+			reply_sequence = 0;
 			return FRAME_INVALID_DATA;
 	}
 
+	//Anything sent after this, like measurement data, isn't a reply to this command.
+	reply_sequence = 0;
+
 	free(pDataBuff);
 
 	return NO_DCS_ERROR;
 }
 
-//Computes checksum from given buffer of given size
-Checksum compute_checksum(char* pDataBuf, unsigned int size) {
-	Checksum xor_sum = 0;
-	for (size_t index = 0; index < size; index++) {
-		xor_sum ^= pDataBuf[index];
-	}
-
-	return xor_sum;
-}
-
-//Checks given checksum from a full DCS frame
-//Returns true if checksum is valid
-bool check_checksum(char* pDataBuf, size_t size) {
-	Checksum xor_sum = 0;
-	for (size_t index = 0; index < size; index++) {
-		xor_sum ^= pDataBuf[index];
-	}
-
-	return xor_sum == 0x00;
-}
+//Time of the last generated measurement in seconds.
+static double last_Measurement_Time = 0.0;
 
 int Handle_Measurement() {
-	static double last_Measurement_Time = 0.0;
-
 	Measurement_Status status;
 	bool bCorrOut;
 	bool bAnalyzerOut;
@@ -186,7 +196,7 @@ int Handle_Measurement() {
 	}
 
 	if (status.measurement_going) {
-		const clock_t currTime = clock();
+		const clock_t currTime = Clock_Now();
 		const double currTimeSec = currTime / CLOCKS_PER_SEC;
 
 		if ((currTimeSec - last_Measurement_Time) >= status.interval * 10 / 1000) {
@@ -272,6 +282,21 @@ int Handle_Measurement() {
 	return NO_DCS_ERROR;
 }
 
+unsigned __int32 Next_Measurement_Timeout(void) {
+	Measurement_Status status;
+	if (Get_Measurement_Status(&status) != NO_DCS_ERROR || !status.measurement_going) {
+		return INFINITE;
+	}
+
+	//Same due time that Handle_Measurement checks for.
+	const clock_t currTime = Clock_Now();
+	const clock_t due = (clock_t)((last_Measurement_Time + status.interval * 10 / 1000) * CLOCKS_PER_SEC);
+	if (due <= currTime) {
+		return 0;
+	}
+	return (unsigned __int32)(((due - currTime) * 1000 + CLOCKS_PER_SEC - 1) / CLOCKS_PER_SEC);
+}
+
 static int Send_Intensity_Data(Intensity_Data* dataArray, unsigned __int32 arrLength) {
 	const unsigned int to_send_data_size = sizeof(arrLength) + arrLength * sizeof(*dataArray);
 	char* to_send_data = malloc(to_send_data_size);
@@ -280,18 +305,12 @@ static int Send_Intensity_Data(Intensity_Data* dataArray, unsigned __int32 arrLe
 	}
 
 	size_t index = 0;
-	memcpy(&to_send_data[index], &arrLength, sizeof(arrLength));
-	index += sizeof(arrLength);
-
-	for (unsigned int x = 0; x < arrLength; x++) {
-		int netCha_Id = htool(dataArray[x].Cha_ID);
-		memcpy(&to_send_data[index], &netCha_Id, sizeof(netCha_Id));
-		index += sizeof(netCha_Id);
+	unsigned __int32 netArrLength = htool(arrLength);
+	memcpy(&to_send_data[index], &netArrLength, sizeof(netArrLength));
+	index += sizeof(netArrLength);
 
-		float netIntensity = htoof(dataArray[x].intensity);
-		memcpy(&to_send_data[index], &netIntensity, sizeof(netIntensity));
-		index += sizeof(netIntensity);
-	}
+	//Intensity_Data is a Cha_ID and an intensity, both 32 bits, so it is converted as one array.
+	htoo32_array(&to_send_data[index], dataArray, arrLength * (sizeof(*dataArray) / sizeof(__int32)));
 
 	int result = Send_DCS_Data(GET_INTENSITY, to_send_data, to_send_data_size);
 	free(to_send_data);
@@ -307,26 +326,12 @@ static int Send_BFI_Data(BFI_Data* dataArray, unsigned __int32 arrLength) {
 	}
 
 	size_t index = 0;
-	memcpy(&to_send_data[index], &arrLength, sizeof(arrLength));
-	index += sizeof(arrLength);
+	unsigned __int32 netArrLength = htool(arrLength);
+	memcpy(&to_send_data[index], &netArrLength, sizeof(netArrLength));
+	index += sizeof(netArrLength);
 
-	for (unsigned int x = 0; x < arrLength; x++) {
-		int netCha_Id = htool(dataArray[x].Cha_ID);
-		memcpy(&to_send_data[index], &netCha_Id, sizeof(netCha_Id));
-		index += sizeof(netCha_Id);
-
-		float netBFI = htoof(dataArray[x].BFI);
-		memcpy(&to_send_data[index], &netBFI, sizeof(netBFI));
-		index += sizeof(netBFI);
-
-		float netBeta = htoof(dataArray[x].Beta);
-		memcpy(&to_send_data[index], &netBeta, sizeof(netBeta));
-		index += sizeof(netBeta);
-
-		float netrMSE = htoof(dataArray[x].rMSE);
-		memcpy(&to_send_data[index], &netrMSE, sizeof(netrMSE));
-		index += sizeof(netrMSE);
-	}
+	//BFI_Data is four 32 bit fields, so every record is converted as one array.
+	htoo32_array(&to_send_data[index], dataArray, arrLength * (sizeof(*dataArray) / sizeof(__int32)));
 
 	int result = Send_DCS_Data(GET_BFI_DATA, to_send_data, to_send_data_size);
 	free(to_send_data);
@@ -349,8 +354,9 @@ static int Send_Corr_Intensity_Data(Corr_Intensity_Data* dataArray, unsigned __i
 	}
 
 	size_t index = 0;
-	memcpy(&to_send_data[index], &arrLength, sizeof(arrLength));
-	index += sizeof(arrLength);
+	unsigned __int32 netArrLength = htool(arrLength);
+	memcpy(&to_send_data[index], &netArrLength, sizeof(netArrLength));
+	index += sizeof(netArrLength);
 
 	for (unsigned int x = 0; x < arrLength; x++) {
 		int netCha_Id = htool(dataArray[x].Cha_ID);
@@ -365,11 +371,8 @@ static int Send_Corr_Intensity_Data(Corr_Intensity_Data* dataArray, unsigned __i
 		memcpy(&to_send_data[index], &netDataN, sizeof(netDataN));
 		index += sizeof(netDataN);
 
-		for (int y = 0; y < dataArray[x].Data_Num; y++) {
-			float netCorr = htoof(dataArray[x].pCorrBuf[y]);
-			memcpy(&to_send_data[index], &netCorr, sizeof(netCorr));
-			index += sizeof(netCorr);
-		}
+		htoof_array(&to_send_data[index], dataArray[x].pCorrBuf, dataArray[x].Data_Num);
+		index += dataArray[x].Data_Num * sizeof(*dataArray[x].pCorrBuf);
 	}
 
 	//Add delays
@@ -377,11 +380,8 @@ static int Send_Corr_Intensity_Data(Corr_Intensity_Data* dataArray, unsigned __i
 	memcpy(&to_send_data[index], &netDelayNum, sizeof(netDelayNum));
 	index += sizeof(netDelayNum);
 
-	for (unsigned int x = 0; x < delay_Num; x++) {
-		float netDelay = htoof(delays[x]);
-		memcpy(&to_send_data[index], &netDelay, sizeof(netDelay));
-		index += sizeof(netDelay);
-	}
+	htoof_array(&to_send_data[index], delays, delay_Num);
+	index += delay_Num * sizeof(*delays);
 
 	int result = Send_DCS_Data(GET_CORR_INTENSITY, to_send_data, to_send_data_size);
 	free(to_send_data);
@@ -494,7 +494,7 @@ static int Process_Analyzer_Set(char* buff) {
 
 	settings = malloc(sizeof(*settings) * Cha_Num);
 	if (settings == NULL) {
-		return MEMORY_ALLOCATION_ALIGNMENT;
+		return MEMORY_ALLOCATION_ERROR;
 	}
 
 #pragma warning (disable: 6386 6385)
@@ -655,11 +655,7 @@ static int Process_Simulated_Correlation() {
 	memcpy(&to_send_data[index], &net_Data_Num, sizeof(net_Data_Num));
 	index += sizeof(net_Data_Num);
 
-	for (int x = 0; x < Data_Num; x++) {
-		pCorrBuf[x] = htoof(pCorrBuf[x]);
-	}
-
-	memcpy(&to_send_data[index], pCorrBuf, sizeof(*pCorrBuf) * Data_Num);
+	htoof_array(&to_send_data[index], pCorrBuf, Data_Num);
 	free(pCorrBuf);
 
 	int result = Send_DCS_Data(GET_SIMULATED_DATA, to_send_data, to_send_data_size);
@@ -678,7 +674,7 @@ static int Process_Optical_Set(char* buff) {
 
 	param = malloc(sizeof(*param) * Cha_Num);
 	if (param == NULL) {
-		return MEMORY_ALLOCATION_ALIGNMENT;
+		return MEMORY_ALLOCATION_ERROR;
 	}
 
 #pragma warning (disable: 6386 6385)
@@ -750,7 +746,7 @@ static int Process_Get_Analyzer_Prefit() {
 
 static int Send_Command_Ack(Data_ID id) {
 	Data_ID networkID = htool(id);
-	return Send_DCS_Data(COMMAND_ACK, (char*) &id, sizeof(id));
+	return Send_DCS_Data(COMMAND_ACK, (char*) &networkID, sizeof(networkID));
 }
 
 int Send_DCS_Message(const char* message) {
@@ -799,15 +795,77 @@ int Send_DCS_Error(const char* message, unsigned __int32 code) {
 	return Send_DCS_Message(error);
 }
 
+//Integrity check used by outgoing frames. Follows the client's frames.
+static Frame_Check_Type frame_check = FRAME_CHECK_XOR;
+
+//Whether outgoing frames carry a sequence ID.
+static bool frame_sequenced = false;
+
+void Set_Frame_Format(Frame_Check_Type check, bool sequenced) {
+	frame_check = check;
+	frame_sequenced = sequenced;
+}
+
+//Frame version of frames with the given integrity check and sequencing.
+static Frame_Version frame_version_for(Frame_Check_Type check, bool sequenced) {
+	if (sequenced) {
+		return check == FRAME_CHECK_CRC32C ? FRAME_VERSION_SEQUENCED_CRC32C : FRAME_VERSION_SEQUENCED;
+	}
+	return check == FRAME_CHECK_CRC32C ? FRAME_VERSION_CRC32C : FRAME_VERSION;
+}
+
+//Returns true if frames with the given version carry a sequence ID.
+static inline bool frame_version_sequenced(Frame_Version version) {
+	return version == FRAME_VERSION_SEQUENCED || version == FRAME_VERSION_SEQUENCED_CRC32C;
+}
+
+bool Frame_Version_Valid(Frame_Version version) {
+	return version == FRAME_VERSION || version == FRAME_VERSION_CRC32C || frame_version_sequenced(version);
+}
+
+unsigned __int32 Frame_Header_Size(Frame_Version version) {
+	const unsigned __int32 size = sizeof(Frame_Version) + sizeof(Type_ID) + sizeof(Data_ID);
+	return frame_version_sequenced(version) ? size + sizeof(Sequence_ID) : size;
+}
+
+unsigned __int32 Frame_Trailer_Size(Frame_Version version) {
+	return version == FRAME_VERSION_CRC32C || version == FRAME_VERSION_SEQUENCED_CRC32C ? CRC32C_SIZE : sizeof(Checksum);
+}
+
+bool check_frame(const char* pFrame, unsigned __int32 size) {
+	Frame_Version version;
+	if (size < sizeof(version)) {
+		return false;
+	}
+	memcpy(&version, pFrame, sizeof(version));
+	version = itohs(version);
+
+	if (Frame_Trailer_Size(version) != CRC32C_SIZE) {
+		return check_checksum(pFrame, size);
+	}
+
+	//CRC32C covers everything before the trailer.
+	if (size < sizeof(version) + CRC32C_SIZE) {
+		return false;
+	}
+	unsigned __int32 crc;
+	memcpy(&crc, &pFrame[size - CRC32C_SIZE], sizeof(crc));
+	return crc32c_update(0, pFrame, size - CRC32C_SIZE) == itohl(crc);
+}
+
 static int Send_DCS_Data(Data_ID data_ID, char* pDataBuf, const unsigned __int32 BufferSize) {
+	const Frame_Version version = frame_version_for(frame_check, frame_sequenced);
+	const unsigned __int32 headerSize = Frame_Header_Size(version);
+	const unsigned __int32 trailerSize = Frame_Trailer_Size(version);
+
 	//Allocate memory for [pTransmission].
 	Transmission_Data_Type* pTransmission = malloc(sizeof(*pTransmission));
 	if (pTransmission == NULL) {
 		return MEMORY_ALLOCATION_ERROR;
 	}
 
-	//Transmission size = 2(Header) + 4(Type ID) + 4(Data ID) + BufferSize + 1 (Checksum)
-	pTransmission->size = sizeof(Frame_Version) + sizeof(Type_ID) + sizeof(Data_ID) + BufferSize + 1;
+	//Transmission size = 2(Header) + 4(Type ID) + 4(Data ID) + 4(Sequence ID, if sequenced) + BufferSize + 1 (Checksum) or 4 (CRC32C)
+	pTransmission->size = headerSize + BufferSize + trailerSize;
 
 	unsigned __int32 index = 0; //Index to track position in pFrame.
 	pTransmission->pFrame = malloc(pTransmission->size);
@@ -817,7 +875,7 @@ static int Send_DCS_Data(Data_ID data_ID, char* pDataBuf, const unsigned __int32
 	}
 
 	//Change frame version to output byte order and copy to output buffer.
-	const Frame_Version frame_version = htoos(FRAME_VERSION);
+	const Frame_Version frame_version = htoos(version);
 #pragma warning (disable: 6386)
 	memcpy(&pTransmission->pFrame[index], &frame_version, sizeof(frame_version));
 	index += sizeof(frame_version);
@@ -830,8 +888,15 @@ static int Send_DCS_Data(Data_ID data_ID, char* pDataBuf, const unsigned __int32
 
 	//Change data ID to output byte order and copy to output buffer.
 	const Data_ID data_ID_out = htool(data_ID);
-	memcpy(&pTransmission->pFrame[index], &data_ID, sizeof(data_ID));
-	index += sizeof(data_ID);
+	memcpy(&pTransmission->pFrame[index], &data_ID_out, sizeof(data_ID_out));
+	index += sizeof(data_ID_out);
+
+	//Echo the sequence ID of the command being replied to.
+	if (frame_version_sequenced(version)) {
+		const Sequence_ID sequence_out = htool(reply_sequence);
+		memcpy(&pTransmission->pFrame[index], &sequence_out, sizeof(sequence_out));
+		index += sizeof(sequence_out);
+	}
 
 	//Copy main data to output buffer.
 	if (pDataBuf != NULL) {
@@ -839,8 +904,14 @@ static int Send_DCS_Data(Data_ID data_ID, char* pDataBuf, const unsigned __int32
 		index += BufferSize;
 	}
 
-	//Add checksum calculated from 2(Header) + 4(Type ID) + 4(Data ID) + BufferSize
-	pTransmission->pFrame[pTransmission->size - 1] = compute_checksum(pTransmission->pFrame, pTransmission->size - 1);
+	//Add checksum or CRC32C calculated from 2(Header) + 4(Type ID) + 4(Data ID) + BufferSize
+	if (version == FRAME_VERSION_CRC32C) {
+		const unsigned __int32 crc = htool(crc32c_update(0, pTransmission->pFrame, index));
+		memcpy(&pTransmission->pFrame[index], &crc, sizeof(crc));
+	}
+	else {
+		pTransmission->pFrame[pTransmission->size - 1] = compute_checksum(pTransmission->pFrame, pTransmission->size - 1);
+	}
 
 	pTransmission->command_code = data_ID;
 
@@ -848,86 +919,6 @@ static int Send_DCS_Data(Data_ID data_ID, char* pDataBuf, const unsigned __int32
 	return result;
 }
 
-////////////////////////////////
-//Endianess management functions
-////////////////////////////////
-static inline bool should_swap_htoo() {
-	if (!IS_BIG_ENDIAN && ENDIANESS_OUTPUT == BIG_ENDIAN) {
-		return true;
-	}
-	if (IS_BIG_ENDIAN && ENDIANESS_OUTPUT == LITTLE_ENDIAN) {
-		return true;
-	}
-	return false;
-}
-
-static inline bool should_swap_itoh() {
-	if (!IS_BIG_ENDIAN && ENDIANESS_INPUT == BIG_ENDIAN) {
-		return true;
-	}
-	if (IS_BIG_ENDIAN && ENDIANESS_INPUT == LITTLE_ENDIAN) {
-		return true;
-	}
-	return false;
-}
-
-
-static inline float swap_float(const float inFloat) {
-	float retVal = 0.0f;
-	char* floatToConvert = (char*)&inFloat;
-	char* returnFloat = (char*)&retVal;
-
-	//Swap the bytes into a temporary buffer
-	returnFloat[0] = floatToConvert[3];
-	returnFloat[1] = floatToConvert[2];
-	returnFloat[2] = floatToConvert[1];
-	returnFloat[3] = floatToConvert[0];
-
-	return retVal;
-}
-
-u_long htool(u_long hostlong) {
-	if (should_swap_htoo()) {
-		return Swap32(hostlong);
-	}
-	return hostlong;
-}
-
-u_short htoos(u_short hostshort) {
-	if (should_swap_htoo()) {
-		return Swap16(hostshort);
-	}
-	return hostshort;
-}
-
-float htoof(float value) {
-	if (should_swap_htoo()) {
-		return swap_float(value);
-	}
-	return value;
-}
-
-u_long itohl(u_long ilong) {
-	if (should_swap_itoh()) {
-		return Swap32(ilong);
-	}
-	return ilong;
-}
-
-u_short itohs(u_short ishort) {
-	if (should_swap_itoh()) {
-		return Swap16(ishort);
-	}
-	return ishort;
-}
-
-float itohf(float value) {
-	if (should_swap_itoh()) {
-		return swap_float(value);
-	}
-	return value;
-}
-
 //Convenience function for dumping data to stdout in debug builds, but nothing in release.
 void hexDump(const char* desc, const void* addr, const unsigned __int32 len) {
 #if defined(_DEBUG)
@@ -1,47 +1,9 @@
 ﻿#pragma once
 
 #include <stdbool.h>
-#include <WinSock2.h>
-
-enum Endianess
-{
-	LITTLE_ENDIAN = 1,
-	BIG_ENDIAN = 0,
-};
-
-//Sets endianess of packaged/received data
-//0 is network byte order(big endian)
-//1 is little endian
-#define ENDIANESS_OUTPUT LITTLE_ENDIAN
-#define ENDIANESS_INPUT LITTLE_ENDIAN
-
-//True if the current system is big endian
-#define IS_BIG_ENDIAN (!*(unsigned char *)&(unsigned __int16){1})
-
-#define Swap16(data) \
-( (((data) >> 8) & 0x00FF) | (((data) << 8) & 0xFF00) ) 
-
-#define Swap32(data)   \
-( (((data) >> 24) & 0x000000FF) | (((data) >>  8) & 0x0000FF00) | \
-  (((data) <<  8) & 0x00FF0000) | (((data) << 24) & 0xFF000000) ) 
-
-//Converts host long to ENDIANESS_OUTPUT endianess.
-u_long htool(u_long hlong);
-
-//Converts host short to ENDIANESS_OUTPUT endianess.
-u_short htoos(u_short hshort);
-
-//Converts host float to ENDIANESS_OUTPUT endianess.
-float htoof(float value);
-
-//Converts ENDIANESS_INPUT endianess long to host endianess.
-u_long itohl(u_long ilong);
-
-//Converts ENDIANESS_INPUT endianess short to host endianess.
-u_short itohs(u_short ishort);
-
-//Converts ENDIANESS_INPUT endianess float to host endianess.
-float itohf(float value);
+#include "Platform.h"
+#include "Endianess.h"
+#include "Checksum.h"
 
 //Data IDs
 /*The following are data IDs used in the communication between the
@@ -73,6 +35,12 @@ host and the remote DCS. GET IDs are for the data from the DCS*/
 #define DATA_ID 0x00000001
 
 #define FRAME_VERSION 0xFF01
+//Same frame as FRAME_VERSION but with a CRC32C trailer in place of the 1 byte checksum.
+#define FRAME_VERSION_CRC32C 0xFF02
+//Sequenced frames carry a Sequence_ID after the data ID so several commands can be in flight
+//and each response matched to its command. Otherwise the same as the two versions above.
+#define FRAME_VERSION_SEQUENCED 0xFF11
+#define FRAME_VERSION_SEQUENCED_CRC32C 0xFF12
 
 #define HEADER_SIZE 2
 #define TYPE_ID_SIZE 4
@@ -156,13 +124,35 @@ typedef unsigned __int32 Type_ID;
 //Data id of DCS frame is a 32 bit integer.
 typedef unsigned __int32 Data_ID;
 
-//Checksum of DCS frame is an 8 bit integer.
-typedef unsigned __int8 Checksum;
+//Sequence id of a sequenced DCS frame is a 32 bit integer. 0 means the frame isn't tied to a command.
+typedef unsigned __int32 Sequence_ID;
+
+//Integrity check carried by a frame.
+typedef enum {
+	FRAME_CHECK_XOR, //1 byte XOR checksum
+	FRAME_CHECK_CRC32C, //4 byte CRC32C
+} Frame_Check_Type;
+
+//Sets the integrity check used by frames sent from now on and whether they carry sequence IDs.
+//process_recv switches it to whatever the client used so replies match the client.
+void Set_Frame_Format(Frame_Check_Type check, bool sequenced);
+
+//Returns true if [version] (host order) is a known frame version.
+bool Frame_Version_Valid(Frame_Version version);
 
+//Size of the frame version, type id, data id and, for sequenced frames, sequence id that start a frame.
+unsigned __int32 Frame_Header_Size(Frame_Version version);
+
+//Size of the integrity check at the end of a frame with the given (host order) frame version.
+unsigned __int32 Frame_Trailer_Size(Frame_Version version);
+
+//Verifies the checksum or CRC32C of a full DCS frame based on its frame version.
+//Returns true if the frame is intact. False otherwise.
+bool check_frame(const char* pFrame, unsigned __int32 size);
+
+//Processes a DCS frame *excluding* the prepended frame size whose checksum has already been verified.
 int process_recv(char* buff, unsigned __int32 buffLen);
 
-unsigned __int8 compute_checksum(char* pDataBuf, unsigned int size);
-bool check_checksum(char* pDataBuf, size_t size);
 
 void hexDump(const char* desc, const void* addr, const unsigned __int32 len);
 
@@ -178,4 +168,7 @@ int Enqueue_Trans_FIFO(Transmission_Data_Type* pTransmission);
 int Send_DCS_Message(const char* message);
 int Send_DCS_Error(const char* message, unsigned int code);
 
-int Handle_Measurement(void);
\ No newline at end of file
+int Handle_Measurement(void);
+
+//Milliseconds until Handle_Measurement has data to send, or INFINITE if no measurement is going.
+unsigned __int32 Next_Measurement_Timeout(void);
\ No newline at end of file
@@ -0,0 +1,338 @@
+#define _CRTDBG_MAP_ALLOC
+#include <stdlib.h>
+#include <limits.h>
+
+#include "Platform.h"
+
+#if defined(_WIN32)
+#include <process.h>
+
+#pragma comment (lib, "Ws2_32.lib")
+#else
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/random.h>
+#endif
+
+struct Thread {
+#if defined(_WIN32)
+	HANDLE handle;
+#else
+	pthread_t thread;
+#endif
+	void (*function)(void* arg); //Function run by the thread
+	void* arg; //Argument given to [function]
+};
+
+struct Poller {
+#if defined(_WIN32)
+	HANDLE hStopEvent; //Manual-reset event set once the poller is stopped
+	WSAEVENT hSocketEvent; //Event Winsock signals when the watched socket has activity
+	HANDLE hWakeEvent; //Auto-reset event set by Poller_Wake
+#else
+	int epoll_fd; //Epoll instance watching the socket and [wake_fd]
+	int wake_fd; //Eventfd written by Poller_Wake and Poller_Stop
+	volatile bool stopped; //Set once the poller is stopped
+#endif
+	SOCKET socket; //Socket being watched, INVALID_SOCKET if none
+};
+
+#if !defined(_WIN32)
+int rand_s(unsigned int* pValue) {
+	if (getrandom(pValue, sizeof(*pValue), 0) != sizeof(*pValue)) {
+		return errno;
+	}
+	return 0;
+}
+#endif
+
+int Socket_Send(SOCKET socket, Send_Buffer* pBuffers, unsigned __int32 count) {
+#if defined(_WIN32)
+	DWORD bytes_sent = 0;
+	if (WSASend(socket, pBuffers, count, &bytes_sent, 0, NULL, NULL) == SOCKET_ERROR) {
+		return SOCKET_ERROR;
+	}
+	return (int)bytes_sent;
+#else
+	struct msghdr message = {
+		.msg_iov = pBuffers,
+		.msg_iovlen = count,
+	};
+	//Without MSG_NOSIGNAL, writing to a connection the peer closed would end the process with SIGPIPE.
+	return (int)sendmsg(socket, &message, MSG_NOSIGNAL);
+#endif
+}
+
+int Socket_Set_Nonblocking(SOCKET socket) {
+#if defined(_WIN32)
+	u_long iMode = 1;
+	return ioctlsocket(socket, FIONBIO, &iMode);
+#else
+	const int flags = fcntl(socket, F_GETFL, 0);
+	if (flags == -1 || fcntl(socket, F_SETFL, flags | O_NONBLOCK) == -1) {
+		return SOCKET_ERROR;
+	}
+	return NO_ERROR;
+#endif
+}
+
+Mutex* Mutex_Create(void) {
+#if defined(_WIN32)
+	//A critical section only enters the kernel when another thread holds it, unlike a mutex object.
+	CRITICAL_SECTION* pSection = malloc(sizeof(*pSection));
+	if (pSection == NULL) {
+		return NULL;
+	}
+	InitializeCriticalSection(pSection);
+	return (Mutex*)pSection;
+#else
+	pthread_mutex_t* pMutex = malloc(sizeof(*pMutex));
+	if (pMutex == NULL) {
+		return NULL;
+	}
+	if (pthread_mutex_init(pMutex, NULL) != 0) {
+		free(pMutex);
+		return NULL;
+	}
+	return (Mutex*)pMutex;
+#endif
+}
+
+void Mutex_Destroy(Mutex* pMutex) {
+#if defined(_WIN32)
+	DeleteCriticalSection((CRITICAL_SECTION*)pMutex);
+#else
+	pthread_mutex_destroy((pthread_mutex_t*)pMutex);
+#endif
+	free(pMutex);
+}
+
+void Mutex_Lock(Mutex* pMutex) {
+#if defined(_WIN32)
+	EnterCriticalSection((CRITICAL_SECTION*)pMutex);
+#else
+	pthread_mutex_lock((pthread_mutex_t*)pMutex);
+#endif
+}
+
+void Mutex_Unlock(Mutex* pMutex) {
+#if defined(_WIN32)
+	LeaveCriticalSection((CRITICAL_SECTION*)pMutex);
+#else
+	pthread_mutex_unlock((pthread_mutex_t*)pMutex);
+#endif
+}
+
+#if defined(_WIN32)
+static unsigned __stdcall run_thread(void* thread_ptr) {
+	Thread* pThread = thread_ptr;
+	pThread->function(pThread->arg);
+	return 0;
+}
+#else
+static void* run_thread(void* thread_ptr) {
+	Thread* pThread = thread_ptr;
+	pThread->function(pThread->arg);
+	return NULL;
+}
+#endif
+
+Thread* Thread_Start(void (*function)(void* arg), void* arg) {
+	Thread* pThread = malloc(sizeof(*pThread));
+	if (pThread == NULL) {
+		return NULL;
+	}
+	pThread->function = function;
+	pThread->arg = arg;
+
+#if defined(_WIN32)
+	//_beginthreadex rather than _beginthread so the handle stays valid until it's joined.
+	pThread->handle = (HANDLE)_beginthreadex(NULL, 0, run_thread, pThread, 0, NULL);
+	if (pThread->handle == NULL) {
+		free(pThread);
+		return NULL;
+	}
+#else
+	if (pthread_create(&pThread->thread, NULL, run_thread, pThread) != 0) {
+		free(pThread);
+		return NULL;
+	}
+#endif
+
+	return pThread;
+}
+
+void Thread_Join(Thread* pThread) {
+#if defined(_WIN32)
+	WaitForSingleObject(pThread->handle, INFINITE);
+	CloseHandle(pThread->handle);
+#else
+	pthread_join(pThread->thread, NULL);
+#endif
+	free(pThread);
+}
+
+clock_t Clock_Now(void) {
+#if defined(_WIN32)
+	//The MSVC runtime's clock already counts elapsed time.
+	return clock();
+#else
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (clock_t)now.tv_sec * CLOCKS_PER_SEC + (clock_t)(now.tv_nsec / (1000000000 / CLOCKS_PER_SEC));
+#endif
+}
+
+Poller* Poller_Create(void) {
+	Poller* pPoller = malloc(sizeof(*pPoller));
+	if (pPoller == NULL) {
+		return NULL;
+	}
+	pPoller->socket = INVALID_SOCKET;
+
+#if defined(_WIN32)
+	pPoller->hStopEvent = CreateEventW(NULL, true, false, NULL);
+	pPoller->hSocketEvent = WSACreateEvent();
+	pPoller->hWakeEvent = CreateEventW(NULL, false, true, NULL);
+	if (pPoller->hStopEvent == NULL || pPoller->hSocketEvent == WSA_INVALID_EVENT || pPoller->hWakeEvent == NULL) {
+		if (pPoller->hStopEvent != NULL) {
+			CloseHandle(pPoller->hStopEvent);
+		}
+		if (pPoller->hSocketEvent != WSA_INVALID_EVENT) {
+			WSACloseEvent(pPoller->hSocketEvent);
+		}
+		if (pPoller->hWakeEvent != NULL) {
+			CloseHandle(pPoller->hWakeEvent);
+		}
+		free(pPoller);
+		return NULL;
+	}
+#else
+	pPoller->stopped = false;
+	pPoller->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+	//Starts at 1 so the first wait returns straight away.
+	pPoller->wake_fd = eventfd(1, EFD_NONBLOCK | EFD_CLOEXEC);
+
+	struct epoll_event event = {
+		.events = EPOLLIN | EPOLLET,
+		.data.fd = pPoller->wake_fd,
+	};
+	if (pPoller->epoll_fd == -1 || pPoller->wake_fd == -1 ||
+		epoll_ctl(pPoller->epoll_fd, EPOLL_CTL_ADD, pPoller->wake_fd, &event) == -1) {
+		if (pPoller->epoll_fd != -1) {
+			close(pPoller->epoll_fd);
+		}
+		if (pPoller->wake_fd != -1) {
+			close(pPoller->wake_fd);
+		}
+		free(pPoller);
+		return NULL;
+	}
+#endif
+
+	return pPoller;
+}
+
+void Poller_Destroy(Poller* pPoller) {
+#if defined(_WIN32)
+	CloseHandle(pPoller->hStopEvent);
+	WSACloseEvent(pPoller->hSocketEvent);
+	CloseHandle(pPoller->hWakeEvent);
+#else
+	close(pPoller->epoll_fd);
+	close(pPoller->wake_fd);
+#endif
+	free(pPoller);
+}
+
+int Poller_Watch(Poller* pPoller, SOCKET socket, int events) {
+	//The old socket may already be closed, in which case it's no longer being watched anyway.
+#if defined(_WIN32)
+	if (pPoller->socket != INVALID_SOCKET) {
+		WSAEventSelect(pPoller->socket, NULL, 0);
+	}
+	pPoller->socket = INVALID_SOCKET;
+
+	//FD_WRITE is only signalled once the socket has room again after a send would have blocked.
+	const long network_events = events == POLLER_ACCEPT ? FD_ACCEPT : FD_READ | FD_WRITE | FD_CLOSE;
+	if (WSAEventSelect(socket, pPoller->hSocketEvent, network_events) == SOCKET_ERROR) {
+		return SOCKET_ERROR;
+	}
+#else
+	if (pPoller->socket != INVALID_SOCKET) {
+		epoll_ctl(pPoller->epoll_fd, EPOLL_CTL_DEL, pPoller->socket, NULL);
+	}
+	pPoller->socket = INVALID_SOCKET;
+
+	//EPOLLOUT is only reported again once the socket has room after a send would have blocked.
+	struct epoll_event event = {
+		.events = EPOLLET | (events == POLLER_ACCEPT ? EPOLLIN : EPOLLIN | EPOLLOUT | EPOLLRDHUP),
+		.data.fd = socket,
+	};
+	if (epoll_ctl(pPoller->epoll_fd, EPOLL_CTL_ADD, socket, &event) == -1) {
+		return SOCKET_ERROR;
+	}
+#endif
+
+	pPoller->socket = socket;
+	return NO_ERROR;
+}
+
+void Poller_Wake(Poller* pPoller) {
+#if defined(_WIN32)
+	SetEvent(pPoller->hWakeEvent);
+#else
+	const uint64_t one = 1;
+	//Only fails if the counter is about to overflow, in which case a wake-up is already pending.
+	(void)!write(pPoller->wake_fd, &one, sizeof(one));
+#endif
+}
+
+void Poller_Stop(Poller* pPoller) {
+#if defined(_WIN32)
+	SetEvent(pPoller->hStopEvent);
+#else
+	__atomic_store_n(&pPoller->stopped, true, __ATOMIC_RELEASE);
+	Poller_Wake(pPoller);
+#endif
+}
+
+bool Poller_Wait(Poller* pPoller, unsigned __int32 timeout) {
+#if defined(_WIN32)
+	HANDLE handles[] = { pPoller->hStopEvent, pPoller->hSocketEvent, pPoller->hWakeEvent };
+
+	DWORD waitResult = WaitForMultipleObjects(sizeof(handles) / sizeof(handles[0]), handles, false, timeout);
+	if (waitResult == WAIT_OBJECT_0) {
+		return false;
+	}
+
+	//Reset the socket event. Each pass reads until the socket would block, so nothing that set it is missed.
+	if (waitResult == WAIT_OBJECT_0 + 1 && pPoller->socket != INVALID_SOCKET) {
+		WSANETWORKEVENTS events;
+		WSAEnumNetworkEvents(pPoller->socket, pPoller->hSocketEvent, &events);
+	}
+
+	return true;
+#else
+	if (__atomic_load_n(&pPoller->stopped, __ATOMIC_ACQUIRE)) {
+		return false;
+	}
+
+	const int timeout_ms = timeout == INFINITE ? -1 : timeout > INT_MAX ? INT_MAX : (int)timeout;
+
+	//Edge-triggered, so each event is reported once and there's no level to reset on the socket.
+	struct epoll_event events[2];
+	const int count = epoll_wait(pPoller->epoll_fd, events, sizeof(events) / sizeof(events[0]), timeout_ms);
+	for (int x = 0; x < count; x++) {
+		if (events[x].data.fd == pPoller->wake_fd) {
+			uint64_t value;
+			(void)!read(pPoller->wake_fd, &value, sizeof(value));
+		}
+	}
+
+	return !__atomic_load_n(&pPoller->stopped, __ATOMIC_ACQUIRE);
+#endif
+}
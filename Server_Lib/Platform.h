@@ -0,0 +1,177 @@
+#pragma once
+#include <stdbool.h>
+#include <time.h>
+
+//Everything that differs between the Windows and Linux builds.
+//Windows uses WinSock, Win32 threads, critical sections and WSAEventSelect. Linux uses BSD sockets, pthreads and
+//edge-triggered epoll with an eventfd for wake-ups. The rest of the code only uses what's declared here.
+
+#if defined(_WIN32)
+#include <crtdbg.h>
+#include <WinSock2.h>
+#include <ws2tcpip.h>
+#else
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <netdb.h>
+
+//MSVC keywords. Libraries are built with -fvisibility=hidden so, as with a DLL, only what's marked
+//dllexport can be seen from outside and the library's own calls can't be bound to a program's functions.
+#define __int8 char
+#define __int16 short
+#define __int32 int
+#define __int64 long long
+#define __declspec(attribute) __declspec_##attribute
+#define __declspec_dllexport __attribute__((visibility("default")))
+#define __declspec_dllimport
+
+//The debug heap only exists in the MSVC runtime.
+#define _CrtSetDbgFlag(flags) ((void)0)
+#define _CRTDBG_ALLOC_MEM_DF 0
+#define _CRTDBG_LEAK_CHECK_DF 0
+
+//BSD sockets under their WinSock names. There's nothing to start up or clean up.
+typedef int SOCKET;
+typedef int WSADATA;
+#define INVALID_SOCKET (-1)
+#define SOCKET_ERROR (-1)
+#define NO_ERROR 0
+#define WSAEWOULDBLOCK EWOULDBLOCK
+#define WSAStartup(version, pData) ((void)(pData), 0)
+#define WSACleanup() ((void)0)
+#define WSAGetLastError() errno
+#define closesocket close
+
+//The CRT's bounds-checked string and random number functions.
+#define _TRUNCATE ((size_t)-1)
+#define _snprintf_s(buffer, size, count, ...) snprintf(buffer, size, __VA_ARGS__)
+
+static inline int strcat_s(char* dest, size_t size, const char* src) {
+	const size_t length = strnlen(dest, size);
+	if (length == size) {
+		return EINVAL;
+	}
+	snprintf(&dest[length], size - length, "%s", src);
+	return 0;
+}
+
+//Fills [*pValue] from the kernel's random number generator. Returns 0 on success.
+int rand_s(unsigned int* pValue);
+
+#define ZeroMemory(pDest, size) memset(pDest, 0, size)
+
+//Timeout that never expires.
+#define INFINITE 0xFFFFFFFF
+
+//Suspends the calling thread for [milliseconds], or for good if it's INFINITE.
+static inline void Sleep(unsigned __int32 milliseconds) {
+	if (milliseconds == INFINITE) {
+		for (;;) {
+			pause();
+		}
+	}
+
+	struct timespec remaining = {
+		.tv_sec = milliseconds / 1000,
+		.tv_nsec = (long)(milliseconds % 1000) * 1000000,
+	};
+	//Carry on sleeping after being interrupted by a signal.
+	while (nanosleep(&remaining, &remaining) != 0 && errno == EINTR);
+}
+#endif
+
+//Sockets//
+
+//Buffer given to Socket_Send.
+#if defined(_WIN32)
+typedef WSABUF Send_Buffer;
+#else
+typedef struct iovec Send_Buffer;
+#endif
+
+//Points [pBuffer] at [size] bytes from [pData].
+static inline void Send_Buffer_Set(Send_Buffer* pBuffer, const void* pData, unsigned __int32 size) {
+#if defined(_WIN32)
+	pBuffer->buf = (char*)pData;
+	pBuffer->len = size;
+#else
+	pBuffer->iov_base = (void*)pData;
+	pBuffer->iov_len = size;
+#endif
+}
+
+//Writes [count] buffers to [socket] in one call. Returns the number of bytes written, or SOCKET_ERROR
+//with the reason in WSAGetLastError. A closed connection is reported as an error rather than a signal.
+int Socket_Send(SOCKET socket, Send_Buffer* pBuffers, unsigned __int32 count);
+
+//Makes calls on [socket] return WSAEWOULDBLOCK rather than wait. Returns NO_ERROR on success.
+int Socket_Set_Nonblocking(SOCKET socket);
+
+//Threads//
+
+typedef struct Mutex Mutex;
+
+//Creates an unlocked mutex. Returns NULL on failure.
+Mutex* Mutex_Create(void);
+//Frees a mutex that isn't locked.
+void Mutex_Destroy(Mutex* pMutex);
+void Mutex_Lock(Mutex* pMutex);
+void Mutex_Unlock(Mutex* pMutex);
+
+typedef struct Thread Thread;
+
+//Runs [function] with [arg] on a new thread. Returns NULL on failure.
+Thread* Thread_Start(void (*function)(void* arg), void* arg);
+//Waits for the thread to return and frees it.
+void Thread_Join(Thread* pThread);
+
+//Adds one to [*pValue] as a single atomic operation and returns the result.
+static inline unsigned __int32 Atomic_Increment(volatile unsigned __int32* pValue) {
+#if defined(_WIN32)
+	return (unsigned __int32)InterlockedIncrement((volatile LONG*)pValue);
+#else
+	return __atomic_add_fetch(pValue, 1, __ATOMIC_SEQ_CST);
+#endif
+}
+
+//Time//
+
+//Current time in CLOCKS_PER_SEC units. Counts elapsed time rather than CPU time and never goes backwards.
+clock_t Clock_Now(void);
+
+//Poller//
+
+//Blocks a thread until the socket it watches has something to do, another thread wakes it or it's told to stop.
+typedef struct Poller Poller;
+
+//Socket events a poller can watch for.
+#define POLLER_ACCEPT 0 //A connection can be accepted
+#define POLLER_READ_WRITE 1 //The socket can be read, has room to write again or was closed
+
+//Creates a poller that isn't watching a socket yet. It starts woken so the first wait returns straight away.
+//Returns NULL on failure.
+Poller* Poller_Create(void);
+//Frees the poller. The socket it was watching should already be closed.
+void Poller_Destroy(Poller* pPoller);
+
+//Watches [socket] for [events] instead of whichever socket was watched before.
+//Events are edge-triggered: each wait only reports new activity, so the socket must be read until it would block.
+//Returns NO_ERROR on success.
+int Poller_Watch(Poller* pPoller, SOCKET socket, int events);
+
+//Makes the current or next Poller_Wait return. Safe to call from any thread.
+void Poller_Wake(Poller* pPoller);
+
+//Makes the current and every later Poller_Wait return false. Safe to call from any thread.
+void Poller_Stop(Poller* pPoller);
+
+//Blocks until the watched socket has an event, the poller is woken or [timeout] milliseconds pass.
+//A [timeout] of INFINITE never expires. Returns false if Poller_Stop was called.
+bool Poller_Wait(Poller* pPoller, unsigned __int32 timeout);
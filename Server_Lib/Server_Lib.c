@@ -1,26 +1,20 @@
 #define _CRTDBG_MAP_ALLOC
 #include <stdlib.h>
-#include <crtdbg.h>
+#include "Platform.h"
 #include <stdio.h>
 #include <stdbool.h>
-#include <winsock2.h>
-#include <ws2tcpip.h>
-#include <process.h>
 
 #include "Server_Lib.h"
 #include "Internal.h"
+#include "Framer.h"
 #include "Store.h"
 
-#pragma comment (lib, "Ws2_32.lib")
-
-static HANDLE threadHandle;
-static HANDLE hRunMutex;
+static Thread* threadHandle;
+//Watches the listening socket, then the client socket while one is connected. Stopping it ends the server thread.
+static Poller* pPoller;
 
 static void Listen_And_Handle(void* socket_ptr);
 
-static int make_socket_nonblocking(SOCKET socket);
-
-static Transmission_Data_Type* Dequeue_Trans_FIFO(void);
 
 // Pointer to the transmission FIFO head
 static Transmission_Data_Type* pTrans_FIFO_Head = NULL;
@@ -29,14 +23,42 @@ static Transmission_Data_Type* pTrans_FIFO_Tail = NULL;
 
 static void clear_Trans_FIFO(void);
 
-//Sends data passed to function and releases it when finished. Returns <0 on error.
-static int send_data(SOCKET ConnectSocket, Transmission_Data_Type* data_to_send);
+//Most buffers given to a single Socket_Send call. Each frame takes up to two, its size and the frame itself.
+#define SEND_BATCH_MAX 64
+
+//Frames taken off the transmission FIFO that haven't been completely written to the socket yet.
+typedef struct {
+	Transmission_Data_Type* pHead; //Oldest frame, partly written if [sent] isn't 0
+	Transmission_Data_Type* pTail; //Newest frame
+	unsigned __int32 sent; //Bytes of pHead, including its prepended size, already written
+} Output_Cursor;
+
+//Counters for the frames written to one client.
+typedef struct {
+	unsigned __int64 frames_sent; //Frames completely written to the socket
+	unsigned __int64 send_calls; //Scatter-gather writes made
+	unsigned __int64 frames_coalesced; //Frames written in the same call as at least one other frame
+	unsigned __int64 partial_writes; //Writes the socket only took part of
+} Send_Stats;
+
+//Moves every frame in the transmission FIFO to the end of [pCursor].
+static void take_Trans_FIFO(Output_Cursor* pCursor);
+//Releases every frame in [pCursor] without sending it.
+static void clear_output(Output_Cursor* pCursor);
+
+//Writes as much of the frames in [pCursor] as the socket will take in one scatter-gather call and
+//releases the frames that were completely written. Returns <0 on error.
+static int send_data(SOCKET ConnectSocket, Output_Cursor* pCursor, Send_Stats* pStats);
 
 //Receives data from socket. Returns >0 on fatal error, <0 on non-fatal error.
-static int recv_data(SOCKET ConnectSocket);
+static int recv_data(SOCKET ConnectSocket, Framer* pFramer);
+
+//Verifies and processes every complete frame buffered in [pFramer], recording the last frame error in [*pFrameResult].
+//Returns false if the stream can't be split into frames any more.
+static bool process_frames(Framer* pFramer, int* pFrameResult);
 
 int Start_Server(const char* port) {
-	if (threadHandle != NULL || hRunMutex != NULL) {
+	if (threadHandle != NULL || pPoller != NULL) {
 		return THREAD_ALREADY_EXISTS;
 	}
 
@@ -56,6 +78,9 @@ int Start_Server(const char* port) {
 		return NETWORK_INIT_ERROR;
 	}
 
+	//Pick the CRC32C implementation before any frames are handled.
+	crc32c_init();
+
 	ZeroMemory(&hints, sizeof(hints));
 	hints.ai_family = AF_INET;
 	hints.ai_socktype = SOCK_STREAM;
@@ -99,9 +124,9 @@ int Start_Server(const char* port) {
 		return NETWORK_INIT_ERROR;
 	}
 
-	//Initialize a set mutex for stopping the thread later.
-	hRunMutex = CreateMutexW(NULL, true, NULL);
-	if (hRunMutex == NULL) {
+	//Create the poller that stops the thread later.
+	pPoller = Poller_Create();
+	if (pPoller == NULL) {
 		closesocket(ListenSocket);
 		WSACleanup();
 		return THREAD_START_ERROR;
@@ -111,8 +136,8 @@ int Start_Server(const char* port) {
 	if (iResult != NO_DCS_ERROR) {
 		closesocket(ListenSocket);
 		WSACleanup();
-		CloseHandle(hRunMutex);
-		hRunMutex = NULL;
+		Poller_Destroy(pPoller);
+		pPoller = NULL;
 		return THREAD_START_ERROR;
 	}
 
@@ -121,22 +146,21 @@ int Start_Server(const char* port) {
 	if (heapSock == NULL) {
 		closesocket(ListenSocket);
 		WSACleanup();
-		CloseHandle(hRunMutex);
-		hRunMutex = NULL;
+		Poller_Destroy(pPoller);
+		pPoller = NULL;
 		close_Store();
 		return MEMORY_ALLOCATION_ERROR;
 	}
 	*heapSock = ListenSocket;
 
-	threadHandle = (HANDLE)_beginthread(Listen_And_Handle, 0, (void*)heapSock);
-	if (threadHandle == NULL || PtrToLong(threadHandle) == -1L) {
-		threadHandle = NULL;
-
+	threadHandle = Thread_Start(Listen_And_Handle, (void*)heapSock);
+	if (threadHandle == NULL) {
+		free(heapSock);
 		closesocket(ListenSocket);
 		WSACleanup();
 
-		CloseHandle(hRunMutex);
-		hRunMutex = NULL;
+		Poller_Destroy(pPoller);
+		pPoller = NULL;
 		return THREAD_START_ERROR;
 	}
 
@@ -148,16 +172,16 @@ int Stop_Server(void) {
 	Cleanup_Logs();
 
 	//If the COM task isn't already stopped, free all the task's resources.
-	if (hRunMutex != NULL) {
-		//Release the run mutex to stop the thread.
-		ReleaseMutex(hRunMutex);
+	if (threadHandle != NULL) {
+		//Stop the poller to stop the thread.
+		Poller_Stop(pPoller);
 
 		//Wait for thread to close.
-		WaitForSingleObject(threadHandle, INFINITE);
+		Thread_Join(threadHandle);
+		threadHandle = NULL;
 
-		WaitForSingleObject(hRunMutex, INFINITE);
-		CloseHandle(hRunMutex);
-		hRunMutex = NULL;
+		Poller_Destroy(pPoller);
+		pPoller = NULL;
 	}
 
 	return NO_DCS_ERROR;
@@ -170,18 +194,27 @@ static void Listen_And_Handle(void* socket_ptr) {
 	int iResult = 0;
 
 	//Make socket non-blocking
-	iResult = make_socket_nonblocking(ListenSocket);
+	iResult = Socket_Set_Nonblocking(ListenSocket);
 	if (iResult != NO_ERROR) {
-		printf("ioctlsocket failed with error: %ld\n", iResult);
+		printf("Making the socket non-blocking failed with error: %d\n", WSAGetLastError());
 		closesocket(ListenSocket);
 		WSACleanup();
 		return;
 	}
 
-	while (WaitForSingleObject(hRunMutex, 50) == WAIT_TIMEOUT) {
+	//Wakes the thread when a client can be accepted.
+	iResult = Poller_Watch(pPoller, ListenSocket, POLLER_ACCEPT);
+	if (iResult != NO_ERROR) {
+		printf("Watching the socket failed with error: %d\n", WSAGetLastError());
+		closesocket(ListenSocket);
+		WSACleanup();
+		return;
+	}
+
+	while (Poller_Wait(pPoller, INFINITE)) {
 		SOCKET ClientSocket = INVALID_SOCKET;
 		struct sockaddr addr;
-		int addr_len = sizeof(addr);
+		socklen_t addr_len = sizeof(addr);
 
 		// Accept a client socket
 		ClientSocket = accept(ListenSocket, &addr, &addr_len);
@@ -206,115 +239,197 @@ static void Listen_And_Handle(void* socket_ptr) {
 		_snprintf_s(connectionMessage, sizeof(connectionMessage), _TRUNCATE, "Connected to %s:%u", ipStr, port);
 		Add_Log(connectionMessage);
 
-		iResult = make_socket_nonblocking(ClientSocket);
+		//Replies use plain unsequenced frames until the new client sends something else.
+		Set_Frame_Format(FRAME_CHECK_XOR, false);
+
+		iResult = Socket_Set_Nonblocking(ClientSocket);
+		if (iResult != NO_ERROR) {
+			printf("Making the socket non-blocking failed with error: %d\n", WSAGetLastError());
+			closesocket(ClientSocket);
+			continue;
+		}
+
+		//Only the client is watched while it's connected. Another client isn't accepted until it disconnects.
+		iResult = Poller_Watch(pPoller, ClientSocket, POLLER_READ_WRITE);
 		if (iResult != NO_ERROR) {
-			printf("ioctlsocket failed with error: %ld\n", iResult);
+			printf("Watching the socket failed with error: %d\n", WSAGetLastError());
 			closesocket(ClientSocket);
+			Poller_Watch(pPoller, ListenSocket, POLLER_ACCEPT);
 			continue;
 		}
 
+		//Received data that hasn't been handed out as frames yet, kept for the whole connection.
+		Framer framer;
+		Framer_Init(&framer);
+		//Frames waiting to be written to the client.
+		Output_Cursor output = { 0 };
+		Send_Stats stats = { 0 };
+
+		//Each pass runs when the client sends something, the socket has room again or the next measurement is due.
+		//Frames are only queued on this thread during a pass, so they're all sent before waiting again, unless the socket is full.
 		bool recv_failed = false;
-		while (WaitForSingleObject(hRunMutex, 50) == WAIT_TIMEOUT) {
+		while (Poller_Wait(pPoller, Next_Measurement_Timeout())) {
+			//Commands are handled first so their replies go out in this pass.
+			iResult = recv_data(ClientSocket, &framer);
+			if (iResult > 0) {
+				recv_failed = true;
+				break;
+			}
+
 			Handle_Measurement();
 
-			Transmission_Data_Type* data_to_send = Dequeue_Trans_FIFO();
-			if (data_to_send != NULL) {
-				iResult = send_data(ClientSocket, data_to_send);
-				if (iResult < 0) {
-					recv_failed = true;
+			//Everything queued since the last pass goes out together. A write takes at most SEND_BATCH_MAX / 2 frames, so
+			//writes go on until none are left or the socket is full, since the socket is only reported writable again once
+			//it has been full.
+			take_Trans_FIFO(&output);
+			iResult = 0;
+			while (output.pHead != NULL) {
+				iResult = send_data(ClientSocket, &output, &stats);
+				if (iResult <= 0) {
 					break;
 				}
 			}
-
-			iResult = recv_data(ClientSocket);
-			if (iResult > 0) {
+			if (iResult < 0) {
 				recv_failed = true;
 				break;
 			}
 		}
+		Framer_Free(&framer);
+		clear_output(&output);
+
+		char statsMessage[100];
+		_snprintf_s(statsMessage, sizeof(statsMessage), _TRUNCATE, "Sent %llu frames in %llu writes (%llu coalesced, %llu partial)",
+			stats.frames_sent, stats.send_calls, stats.frames_coalesced, stats.partial_writes);
+		Add_Log(statsMessage);
 
 		//If recv didn't fail, the thread should be ended.
 		if (!recv_failed) {
+			closesocket(ClientSocket);
 			break;
 		}
 		Add_Log("Disconnected");
+
+		//Go back to waiting for the next client.
+		iResult = Poller_Watch(pPoller, ListenSocket, POLLER_ACCEPT);
+		if (iResult != NO_ERROR) {
+			printf("Watching the socket failed with error: %d\n", WSAGetLastError());
+			break;
+		}
 	}
 
 	//Cleanup
 	closesocket(ListenSocket);
 	WSACleanup();
-
-	ReleaseMutex(hRunMutex);
-	_endthread();
 }
 
-static int send_data(SOCKET ConnectSocket, Transmission_Data_Type* data_to_send) {
-	//Allocate more memory in preparation for prepending frame size (excluding itself) to the frame.
-	char* tmp = realloc(data_to_send->pFrame, data_to_send->size + sizeof(data_to_send->size));
-	if (tmp == NULL) {
-		free(data_to_send->pFrame);
-		free(data_to_send);
-		return MEMORY_ALLOCATION_ERROR;
-	}
-
-	data_to_send->pFrame = tmp;
-
-	//Shift pFrame sizeof(data_to_send->size) bytes to give space for the prepended frame size.
-	memmove(&data_to_send->pFrame[sizeof(data_to_send->size)], data_to_send->pFrame, data_to_send->size);
+static int send_data(SOCKET ConnectSocket, Output_Cursor* pCursor, Send_Stats* pStats) {
+	Send_Buffer buffers[SEND_BATCH_MAX];
+	unsigned __int32 buffer_count = 0;
+	unsigned __int32 offset = pCursor->sent;
+	unsigned __int32 total_size = 0;
+	unsigned __int32 frame_count = 0;
+
+	//Each frame is sent as its prepended size followed by the frame, so neither has to be copied.
+	//The first frame starts wherever a previous call stopped writing it.
+	for (Transmission_Data_Type* item = pCursor->pHead; item != NULL && buffer_count + 2 <= SEND_BATCH_MAX; item = item->pNextItem) {
+		if (offset < sizeof(item->size)) {
+			Send_Buffer_Set(&buffers[buffer_count], (char*)&item->size + offset, sizeof(item->size) - offset);
+			total_size += sizeof(item->size) - offset;
+			buffer_count++;
+			offset = sizeof(item->size);
+		}
 
-#pragma warning (disable: 6386)
-	//Write prepended data_to_send->size on the packet.
-	memcpy(data_to_send->pFrame, &data_to_send->size, sizeof(data_to_send->size));
-#pragma warning (default: 6386)
+		Send_Buffer_Set(&buffers[buffer_count], &item->pFrame[offset - sizeof(item->size)], item->size + sizeof(item->size) - offset);
+		total_size += item->size + sizeof(item->size) - offset;
+		buffer_count++;
+		frame_count++;
+		offset = 0;
 
-	hexDump("Data packet", data_to_send->pFrame, data_to_send->size + sizeof(data_to_send->size));
+		hexDump("Data packet", item->pFrame, item->size);
+	}
+	if (buffer_count == 0) {
+		return 0;
+	}
 
-	//Send the data over the socket. data_to_send->size was not modified when prepending the frame size so it is added here.
-	int iResult = send(ConnectSocket, data_to_send->pFrame, data_to_send->size + sizeof(data_to_send->size), 0);
+	int iResult = Socket_Send(ConnectSocket, buffers, buffer_count);
 	if (iResult == SOCKET_ERROR) {
+		//The socket buffer being full isn't an error. What's left is written on a later pass.
+		if (WSAGetLastError() == WSAEWOULDBLOCK) {
+			return 0;
+		}
+
 		//printf("send failed with error: %d\n", WSAGetLastError());
 		closesocket(ConnectSocket);
+		return iResult;
 	}
-	free(data_to_send->pFrame);
-	free(data_to_send);
 
-	//printf("Bytes Sent: %d\n", iResult);
+	//Release the frames that were completely written and keep the position in a partly written one.
+	const unsigned __int32 bytes_sent = (unsigned __int32)iResult;
+	unsigned __int32 frames_sent = 0;
+	unsigned __int32 remaining = bytes_sent;
+	while (pCursor->pHead != NULL) {
+		Transmission_Data_Type* item = pCursor->pHead;
+		const unsigned __int32 unsent = item->size + sizeof(item->size) - pCursor->sent;
+		if (remaining < unsent) {
+			pCursor->sent += remaining;
+			break;
+		}
 
-	return iResult;
+		remaining -= unsent;
+		pCursor->sent = 0;
+		pCursor->pHead = item->pNextItem;
+		free(item->pFrame);
+		free(item);
+		frames_sent++;
+	}
+	if (pCursor->pHead == NULL) {
+		pCursor->pTail = NULL;
+	}
+
+	pStats->send_calls++;
+	pStats->frames_sent += frames_sent;
+	if (frame_count > 1) {
+		pStats->frames_coalesced += frames_sent;
+	}
+	if (bytes_sent < total_size) {
+		pStats->partial_writes++;
+	}
+
+	//printf("Bytes Sent: %d\n", bytes_sent);
+
+	return (int)bytes_sent;
 }
 
-static int recv_data(SOCKET ConnectSocket) {
+static int recv_data(SOCKET ConnectSocket, Framer* pFramer) {
 	int iResult = 0;
-	char socket_buffer[1024];
-	char* frame_data = NULL;
-	unsigned int frame_data_size = 0;
+	int frameResult = NO_DCS_ERROR;
 
 	//Receives data waiting in buffer. Continues if no data available as socket is non-blocking.
 	do {
-		iResult = recv(ConnectSocket, socket_buffer, sizeof(socket_buffer), 0);
-		if (iResult > 0) {
-			//Data is available. Write it to the frame_data buffer.
-			frame_data_size += iResult;
+		//Data is received straight into the framer after any partial frame left from the last read.
+		unsigned __int32 available;
+		char* pRecv = Framer_Reserve(pFramer, &available);
+		if (pRecv == NULL) {
+			closesocket(ConnectSocket);
+			return 1;
+		}
 
-			char* tmp = realloc(frame_data, frame_data_size);
-			if (tmp == NULL) {
-				free(frame_data);
+		iResult = recv(ConnectSocket, pRecv, (int)available, 0);
+		if (iResult > 0) {
+			hexDump("recv", pRecv, iResult);
+			Framer_Commit(pFramer, iResult);
 
+			//Data is available. Verify and process each frame that's now complete.
+			if (!process_frames(pFramer, &frameResult)) {
 				closesocket(ConnectSocket);
 				return 1;
 			}
-
-			frame_data = tmp;
-
-			memcpy(&frame_data[frame_data_size - iResult], socket_buffer, iResult);
 		}
 		else if (iResult == 0) {
 			//Should never occur due to non-blocking socket.
 
 			//printf("Connection closed\n");
 			closesocket(ConnectSocket);
-
-			free(frame_data);
 			return 1;
 		}
 		else if (iResult < 0) {
@@ -327,36 +442,35 @@ static int recv_data(SOCKET ConnectSocket) {
 			else {
 				//printf("recv failed with error: %d\n", err);
 				closesocket(ConnectSocket);
-
-				free(frame_data);
 				return 1;
 			}
 		}
 	} while (iResult > 0);
 
-	if (frame_data_size > 0) {
-		hexDump("recv", frame_data, frame_data_size);
+	if (frameResult != NO_DCS_ERROR) {
+		return frameResult;
 	}
+	return iResult;
+}
 
-	//Loop over each frame that's available as multiple may have been received at once.
-	for (unsigned __int32 totLen = 0; totLen < frame_data_size;) {
-		//Strip off 32 bit integer size from beginning of frame to make well-defined DCS frame `buff`
-		unsigned __int32 frameLen;
-		memcpy(&frameLen, &frame_data[totLen], sizeof(frameLen));
-
-		//Find pointer of received data and process it in process_recv.
-		char* buff = &frame_data[sizeof(frameLen) + totLen];
-		int tmpiResult = process_recv(buff, frameLen);
-		if (tmpiResult != NO_DCS_ERROR) {
-			iResult = tmpiResult;
-		}
+static bool process_frames(Framer* pFramer, int* pFrameResult) {
+	char* pFrame;
+	unsigned __int32 frame_size;
+	int status;
 
-		totLen += sizeof(frameLen) + frameLen;
-		//printf("%d", iResult);
+	//Frames are verified and processed where they were received.
+	while ((status = Framer_Next(pFramer, &pFrame, &frame_size)) == FRAMER_FRAME) {
+		int tmpResult = FRAME_CHECKSUM_ERROR;
+		if (check_frame(pFrame, frame_size)) {
+			tmpResult = process_recv(pFrame, frame_size);
+		}
+		if (tmpResult != NO_DCS_ERROR) {
+			*pFrameResult = tmpResult;
+		}
 	}
-	free(frame_data);
 
-	return iResult;
+	//A frame size that can't be valid means the frame boundaries are lost.
+	return status != FRAMER_BAD_SIZE;
 }
 
 int Enqueue_Trans_FIFO(Transmission_Data_Type* pTransmission) {
@@ -376,20 +490,37 @@ int Enqueue_Trans_FIFO(Transmission_Data_Type* pTransmission) {
 	return NO_DCS_ERROR;
 }
 
-static Transmission_Data_Type* Dequeue_Trans_FIFO() {
-	Transmission_Data_Type* pTransmission = pTrans_FIFO_Head;
-
-	//If the original FIFO head isn't null, shift the queue.
-	if (pTransmission != NULL) {
-		pTrans_FIFO_Head = pTrans_FIFO_Head->pNextItem;
+static void take_Trans_FIFO(Output_Cursor* pCursor) {
+	if (pTrans_FIFO_Head == NULL) {
+		return;
 	}
 
-	//If the new FIFO head is null, the queue is empty.
-	if (pTrans_FIFO_Head == NULL) {
-		pTrans_FIFO_Tail = NULL;
+	//The whole FIFO is moved at once. It keeps its order behind any frames still being written.
+	if (pCursor->pHead == NULL) {
+		pCursor->pHead = pTrans_FIFO_Head;
+		pCursor->sent = 0;
+	}
+	else {
+		pCursor->pTail->pNextItem = pTrans_FIFO_Head;
 	}
+	pCursor->pTail = pTrans_FIFO_Tail;
+
+	pTrans_FIFO_Head = NULL;
+	pTrans_FIFO_Tail = NULL;
+}
 
-	return pTransmission;
+static void clear_output(Output_Cursor* pCursor) {
+	Transmission_Data_Type* item = pCursor->pHead;
+	while (item != NULL) {
+		Transmission_Data_Type* tmp_item = item;
+		item = item->pNextItem;
+
+		free(tmp_item->pFrame);
+		free(tmp_item);
+	}
+	pCursor->pHead = NULL;
+	pCursor->pTail = NULL;
+	pCursor->sent = 0;
 }
 
 
@@ -405,8 +536,3 @@ static void clear_Trans_FIFO(void) {
 	pTrans_FIFO_Head = NULL;
 	pTrans_FIFO_Tail = NULL;
 }
-
-static int make_socket_nonblocking(SOCKET socket) {
-	u_long iMode = 1;
-	return ioctlsocket(socket, FIONBIO, &iMode);
-}
\ No newline at end of file
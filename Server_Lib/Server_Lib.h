@@ -1,3 +1,5 @@
+#include "Platform.h"
+
 #ifdef SERVER_LIB_EXPORTS
 #define SERVER_LIB_API __declspec(dllexport)
 #else
@@ -1,6 +1,6 @@
 #define _CRTDBG_MAP_ALLOC
 #include <stdlib.h>
-#include <crtdbg.h>
+#include "Platform.h"
 #include <stdio.h>
 
 #include "Store.h"
@@ -9,7 +9,7 @@
 
 #define NUM_CHANNELS 6
 
-static HANDLE hStoreMutex;
+static Mutex* hStoreMutex;
 static inline void set_Store_mutex(void);
 static inline void release_Store_mutex(void);
 
@@ -465,7 +465,7 @@ int init_Store() {
 		return THREAD_ALREADY_EXISTS;
 	}
 
-	hStoreMutex = CreateMutexW(NULL, false, NULL);
+	hStoreMutex = Mutex_Create();
 	if (hStoreMutex == NULL) {
 		return THREAD_START_ERROR;
 	}
@@ -477,11 +477,11 @@ int close_Store() {
 		return NO_DCS_ERROR;
 	}
 
-	int result = CloseHandle(hStoreMutex);
+	Mutex_Destroy(hStoreMutex);
 
 	hStoreMutex = NULL;
 
-	return result;
+	return NO_DCS_ERROR;
 }
 
 static inline void set_Store_mutex() {
@@ -489,7 +489,7 @@ static inline void set_Store_mutex() {
 		return;
 	}
 
-	WaitForSingleObject(hStoreMutex, INFINITE);
+	Mutex_Lock(hStoreMutex);
 }
 
 static inline void release_Store_mutex() {
@@ -497,5 +497,5 @@ static inline void release_Store_mutex() {
 		return;
 	}
 
-	ReleaseMutex(hStoreMutex);
+	Mutex_Unlock(hStoreMutex);
 }
\ No newline at end of file